@@ -0,0 +1,62 @@
+package org.github.cyterdan.chat_over_kafka
+
+import android.os.Build
+import android.util.Log
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import org.github.cyterdan.chat_over_kafka.audio.AudioService
+import org.junit.Assert.assertTrue
+import org.junit.Test
+import org.junit.runner.RunWith
+import java.io.File
+
+/**
+ * Seal and open cost of 160-byte audio frames under both frame ciphers, measured natively
+ * on the device's own OpenSSL paths (AES and PMULL on ARMv8, AES-NI and CLMUL on x86).
+ * Results are logged under "FrameCipherBenchmark" with the ABI and the CPU's AES feature.
+ */
+@RunWith(AndroidJUnit4::class)
+class FrameCipherBenchmark {
+
+    // "aes" among the CPU features: ARMv8 Cryptography Extensions, or AES-NI on x86
+    private fun hasAesInstructions(): Boolean =
+        File("/proc/cpuinfo").readLines()
+            .filter { it.startsWith("Features") || it.startsWith("flags") }
+            .any { line -> line.substringAfter(':').split(' ').contains("aes") }
+
+    // Best of ROUNDS, so a descheduled round does not count
+    private fun measure(cipher: Int): LongArray {
+        RdKafka.benchmarkFrameCipher(cipher, FRAME_BYTES, WARM_UP_FRAMES)
+        return (1..ROUNDS).map { RdKafka.benchmarkFrameCipher(cipher, FRAME_BYTES, FRAMES) }
+            .reduce { best, round -> longArrayOf(minOf(best[0], round[0]), minOf(best[1], round[1])) }
+    }
+
+    @Test
+    fun bothCiphersSealAndOpenFramesFarWithinAFrameTime() {
+        val frameNs = AudioService.FRAME_DURATION_MS * 1_000_000
+        val results = mapOf(
+            "AES-128-GCM" to measure(RdKafka.FRAME_CIPHER_AES_128_GCM),
+            "ChaCha20-Poly1305" to measure(RdKafka.FRAME_CIPHER_CHACHA20_POLY1305)
+        )
+
+        Log.i(
+            "FrameCipherBenchmark",
+            "${Build.SUPPORTED_ABIS.first()}, AES instructions: ${hasAesInstructions()}; " +
+                results.entries.joinToString("; ") { (name, ns) ->
+                    "$name seal ${ns[0]} ns, open ${ns[1]} ns per $FRAME_BYTES B frame " +
+                        "(${"%.0f".format(FRAME_BYTES * 1000.0 / ns[0])} MB/s sealed)"
+                }
+        )
+        results.forEach { (name, ns) ->
+            // A speaker seals one frame and every listener opens it per frame time
+            assertTrue("$name seal ${ns[0]} ns", ns[0] * 1000 < frameNs)
+            assertTrue("$name open ${ns[1]} ns", ns[1] * 1000 < frameNs)
+        }
+    }
+
+    private companion object {
+        const val FRAME_BYTES = 160
+        const val WARM_UP_FRAMES = 1_000
+        const val FRAMES = 20_000
+        const val ROUNDS = 5
+    }
+}
@@ -0,0 +1,61 @@
+package org.github.cyterdan.chat_over_kafka
+
+import android.os.Debug
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Test
+import org.junit.runner.RunWith
+
+/**
+ * The recycling consume path must not allocate per record once its holders are warm:
+ * lease, fill in place (as the native poll does), copy out, recycle.
+ */
+@RunWith(AndroidJUnit4::class)
+class MessageHolderPoolAllocationTest {
+
+    private val key = "alice/1700000000000".toByteArray()
+    private val frame = ByteArray(160) { it.toByte() }
+    private val scratch = ByteArray(frame.size)
+
+    private fun consumeOne(pool: MessageHolderPool) {
+        val holder = pool.lease()
+        holder.key.clear()
+        holder.key.put(key)
+        holder.keyLength = key.size
+        holder.value.clear()
+        holder.value.put(frame)
+        holder.valueLength = frame.size
+        if (holder.keyMatches(key)) holder.copyValueInto(scratch)
+        pool.recycle(holder)
+    }
+
+    @Suppress("DEPRECATION")
+    @Test
+    fun steadyStateConsumeDoesNotAllocate() {
+        val pool = MessageHolderPool(maxPooled = 8)
+        repeat(100) { consumeOne(pool) }
+
+        Debug.resetThreadAllocCount()
+        Debug.startAllocCounting()
+        repeat(RECORDS) { consumeOne(pool) }
+        Debug.stopAllocCounting()
+        val allocations = Debug.getThreadAllocCount()
+
+        assertEquals(frame[frame.size - 1], scratch[scratch.size - 1])
+        // A long live session is ~17 records a second; allow a handful of stray objects in total
+        assertTrue("$allocations objects allocated for $RECORDS records", allocations < 16)
+    }
+
+    @Test
+    fun holdersAreReused() {
+        val pool = MessageHolderPool(maxPooled = 8)
+        val first = pool.lease()
+        pool.recycle(first)
+        assertTrue(first === pool.lease())
+    }
+
+    private companion object {
+        const val RECORDS = 10_000
+    }
+}
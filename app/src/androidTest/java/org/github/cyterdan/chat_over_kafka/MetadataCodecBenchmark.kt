@@ -0,0 +1,104 @@
+package org.github.cyterdan.chat_over_kafka
+
+import android.util.Log
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertTrue
+import org.junit.Test
+import org.junit.runner.RunWith
+import kotlin.random.Random
+
+/**
+ * Metadata topic bytes and timeline parse time of the binary codec against the JSON it
+ * replaced, on a synthetic channel history. Results are logged under "MetadataCodecBenchmark".
+ */
+@RunWith(AndroidJUnit4::class)
+class MetadataCodecBenchmark {
+
+    private fun syntheticHistory(records: Int): List<AudioMetadata> {
+        val random = Random(42)
+        val users = List(40) { "user-${it.toString().padStart(3, '0')}" }
+        var offset = 0L
+        var timestamp = 1_730_000_000_000L
+        return List(records) {
+            val frames = random.nextLong(15, 500)
+            val reactions = Reactions.EMOJIS.associateWith { users.shuffled(random).take(random.nextInt(0, 12)) }
+                .filterValues { it.isNotEmpty() }
+            val frameIndex = LongArray(((frames * 60 / 1000) * 2).toInt()) { i ->
+                if (i % 2 == 0) offset + i * 8 else (i / 2) * 1000L
+            }
+            val author = users[random.nextInt(users.size)]
+            AudioMetadata(
+                userId = author,
+                channelId = 1,
+                startOffset = offset,
+                endOffset = offset + frames - 1,
+                timestamp = timestamp,
+                messageCount = frames,
+                reactions = reactions,
+                frameIndex = frameIndex,
+                frameKey = "$author/$timestamp",
+                firstFrameTime = timestamp - frames * 60,
+                lastFrameTime = timestamp,
+                audioPartition = random.nextInt(3)
+            ).also {
+                offset += frames + random.nextLong(0, 50)
+                timestamp += random.nextLong(10_000, 600_000)
+            }
+        }
+    }
+
+    private inline fun timeNs(rounds: Int, block: () -> Unit): Long {
+        block()  // warm up
+        val start = System.nanoTime()
+        repeat(rounds) { block() }
+        return (System.nanoTime() - start) / rounds
+    }
+
+    @Test
+    fun binaryIsSmallerAndFasterToParseThanJson() {
+        val history = syntheticHistory(RECORDS)
+        val json = history.map { it.toJson().toByteArray() }
+        val binary = history.map { it.toBytes() }
+
+        // Both formats decode to the same records; the binary one lists reactors in dictionary order
+        fun normalized(m: AudioMetadata) = m.copy(reactions = m.reactions.mapValues { it.value.sorted() })
+        history.indices.forEach { i ->
+            assertEquals(normalized(history[i]), normalized(AudioMetadata.fromBytes(binary[i])))
+            assertEquals(history[i], AudioMetadata.fromBytes(json[i]))
+        }
+
+        val jsonBytes = json.sumOf { it.size.toLong() }
+        val binaryBytes = binary.sumOf { it.size.toLong() }
+        // User ids and frame keys are stored verbatim in both formats (a record's reactors once
+        // in binary), so they are a floor no per-record encoding gets below
+        val verbatimBytes = history.sumOf { m ->
+            (m.reactions.values.flatten() + m.userId).distinct().sumOf { it.toByteArray().size } +
+                m.frameKey.toByteArray().size
+        }.toLong()
+        val jsonNs = timeNs(ROUNDS) { json.forEach { AudioMetadata.fromBytes(it) } }
+        val binaryNs = timeNs(ROUNDS) { binary.forEach { AudioMetadata.fromBytes(it) } }
+
+        Log.i(
+            "MetadataCodecBenchmark",
+            "$RECORDS records: JSON $jsonBytes B, ${jsonNs / 1000} us; " +
+                "binary $binaryBytes B ($verbatimBytes B of ids and keys), ${binaryNs / 1000} us " +
+                "(${"%.1f".format(jsonBytes.toDouble() / binaryBytes)}x smaller, " +
+                "${"%.1f".format((jsonBytes - verbatimBytes).toDouble() / (binaryBytes - verbatimBytes))}x " +
+                "without ids and keys, ${"%.1f".format(jsonNs.toDouble() / binaryNs)}x faster)"
+        )
+        // Not an order of magnitude overall: on this reaction-heavy history the ids and keys are
+        // more than half of the binary bytes, and the decoder has to make the same strings
+        assertTrue("binary $binaryBytes B vs JSON $jsonBytes B", binaryBytes * 2 < jsonBytes)
+        assertTrue(
+            "binary $binaryBytes B vs JSON $jsonBytes B beyond $verbatimBytes B of ids and keys",
+            (binaryBytes - verbatimBytes) * 4 < jsonBytes - verbatimBytes
+        )
+        assertTrue("binary $binaryNs ns vs JSON $jsonNs ns", binaryNs * 2 < jsonNs)
+    }
+
+    private companion object {
+        const val RECORDS = 2_000
+        const val ROUNDS = 5
+    }
+}
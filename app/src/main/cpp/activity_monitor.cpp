@@ -0,0 +1,261 @@
+#include "activity_monitor.h"
+
+#include <android/log.h>
+#include <algorithm>
+#include <chrono>
+#include <set>
+
+#include "metadata_cache.h"
+
+static const char* const LOG_TAG = "ActivityMonitor";
+
+// Upper bound for one round trip; a slower round is skipped, not waited for.
+static const int kRoundTimeoutMs = 5000;
+
+// The result queue is polled in slices this long so stop() never waits on the network.
+static const int kPollSliceMs = 100;
+
+namespace {
+
+int64_t wallClockMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+ActivityMonitor& ActivityMonitor::instance() {
+    static ActivityMonitor monitor;
+    return monitor;
+}
+
+ActivityMonitor::~ActivityMonitor() {
+    stop();
+}
+
+void ActivityMonitor::start(rd_kafka_t* rk, std::vector<Channel> channels, int intervalMs) {
+    stop();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = false;
+    m_rk = rk;
+    m_activity.assign(channels.size(), ChannelActivity());
+    m_channels = std::move(channels);
+    m_audioPartitions.clear();
+    m_watermarks.clear();
+    m_thread = std::thread(&ActivityMonitor::loop, this, rk, std::max(intervalMs, 500));
+}
+
+void ActivityMonitor::stop() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        thread = std::move(m_thread);
+    }
+    m_cv.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rk = nullptr;
+    m_channels.clear();
+    m_activity.clear();
+}
+
+void ActivityMonitor::stopFor(rd_kafka_t* rk) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_rk != rk) return;
+    }
+    stop();
+}
+
+std::vector<ChannelActivity> ActivityMonitor::snapshot() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_activity;
+}
+
+void ActivityMonitor::loop(rd_kafka_t* rk, int intervalMs) {
+    bool partitionsKnown = false;
+    auto previousRound = std::chrono::steady_clock::time_point();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        lock.unlock();
+        if (!partitionsKnown) {
+            partitionsKnown = refreshPartitions(rk, std::min(intervalMs, kRoundTimeoutMs));
+        }
+        const auto roundStart = std::chrono::steady_clock::now();
+        bool complete = false;
+        const bool received = poll(rk, std::min(intervalMs, kRoundTimeoutMs), complete);
+        // A partition that did not answer may have moved or been added; look again next round
+        partitionsKnown = partitionsKnown && complete;
+        lock.lock();
+
+        if (!received) {
+            // Nothing is known about this round: report silence and start the deltas over
+            for (ChannelActivity& activity : m_activity) {
+                activity.talking = false;
+                activity.audioPerMinute = 0;
+                activity.metadataPerMinute = 0;
+            }
+            previousRound = std::chrono::steady_clock::time_point();
+        } else {
+            if (previousRound != std::chrono::steady_clock::time_point()) {
+                publish(std::chrono::duration_cast<std::chrono::milliseconds>(roundStart - previousRound).count());
+            }
+            previousRound = roundStart;
+        }
+
+        m_cv.wait_until(lock, roundStart + std::chrono::milliseconds(intervalMs), [this] { return m_stopping; });
+    }
+}
+
+bool ActivityMonitor::refreshPartitions(rd_kafka_t* rk, int timeoutMs) {
+    std::set<std::string> topics;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Channel& channel : m_channels) {
+            topics.insert(channel.audioTopic);
+        }
+    }
+
+    std::map<std::string, int32_t> counts;
+    bool complete = true;
+    for (const std::string& topic : topics) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) return false;
+        }
+        rd_kafka_topic_t* rkt = rd_kafka_topic_new(rk, topic.c_str(), nullptr);
+        if (!rkt) {
+            complete = false;
+            continue;
+        }
+        const struct rd_kafka_metadata* metadata = nullptr;
+        rd_kafka_resp_err_t err = rd_kafka_metadata(rk, 0, rkt, &metadata, timeoutMs);
+        if (err == RD_KAFKA_RESP_ERR_NO_ERROR && metadata->topic_cnt == 1 && !metadata->topics[0].err) {
+            MetadataCache::instance().recordMetadata(metadata);
+            counts[topic] = metadata->topics[0].partition_cnt;
+        } else {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Partitions of %s unknown: %s", topic.c_str(),
+                                rd_kafka_err2str(err ? err : metadata->topics[0].err));
+            complete = false;
+        }
+        if (metadata) rd_kafka_metadata_destroy(metadata);
+        rd_kafka_topic_destroy(rkt);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& entry : counts) {
+        m_audioPartitions[entry.first] = entry.second;
+    }
+    return complete;
+}
+
+bool ActivityMonitor::poll(rd_kafka_t* rk, int timeoutMs, bool& complete) {
+    rd_kafka_topic_partition_list_t* partitions = rd_kafka_topic_partition_list_new(16);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::set<PartitionKey> wanted;
+        for (const Channel& channel : m_channels) {
+            auto count = m_audioPartitions.find(channel.audioTopic);
+            for (int32_t p = 0; count != m_audioPartitions.end() && p < count->second; p++) {
+                wanted.emplace(channel.audioTopic, p);
+            }
+            wanted.emplace(channel.metadataTopic, channel.metadataPartition);
+        }
+        for (const PartitionKey& key : wanted) {
+            rd_kafka_topic_partition_list_add(partitions, key.first.c_str(), key.second)->offset =
+                    RD_KAFKA_OFFSET_SPEC_LATEST;
+        }
+    }
+
+    char errstr[256];
+    rd_kafka_AdminOptions_t* options = rd_kafka_AdminOptions_new(rk, RD_KAFKA_ADMIN_OP_LISTOFFSETS);
+    rd_kafka_AdminOptions_set_request_timeout(options, timeoutMs, errstr, sizeof(errstr));
+    // A queue per round, so the late answer of a round that timed out is never read as the next one
+    rd_kafka_queue_t* queue = rd_kafka_queue_new(rk);
+    // One request per partition leader for all channels
+    rd_kafka_ListOffsets(rk, partitions, options, queue);
+    rd_kafka_AdminOptions_destroy(options);
+    const int requested = partitions->cnt;
+    rd_kafka_topic_partition_list_destroy(partitions);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    rd_kafka_event_t* event = nullptr;
+    while (!event) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) break;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "ListOffsets timed out");
+            break;
+        }
+        event = rd_kafka_queue_poll(queue, kPollSliceMs);
+    }
+
+    rd_kafka_queue_destroy(queue);
+    if (!event) return false;
+
+    bool received = false;
+    const rd_kafka_ListOffsets_result_t* result = rd_kafka_event_ListOffsets_result(event);
+    if (rd_kafka_event_error(event) || !result) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "ListOffsets failed: %s", rd_kafka_event_error_string(event));
+    } else {
+        size_t count = 0;
+        const rd_kafka_ListOffsetsResultInfo_t** infos = rd_kafka_ListOffsets_result_infos(result, &count);
+        int answered = 0;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_watermarks) {
+            entry.second.delta = 0;
+        }
+        for (size_t i = 0; i < count; i++) {
+            const rd_kafka_topic_partition_t* tp = rd_kafka_ListOffsetsResultInfo_topic_partition(infos[i]);
+            Watermark& watermark = m_watermarks[{tp->topic, tp->partition}];
+            if (tp->err || tp->offset < 0) {
+                // No delta across the gap: it would be counted against a single round
+                watermark = Watermark();
+                continue;
+            }
+            // A watermark that went back means the topic was recreated
+            watermark.delta = watermark.high >= 0 && tp->offset >= watermark.high ? tp->offset - watermark.high : 0;
+            watermark.high = tp->offset;
+            answered++;
+        }
+        complete = answered == requested;
+        received = true;
+    }
+    rd_kafka_event_destroy(event);
+    return received;
+}
+
+void ActivityMonitor::publish(int64_t elapsedMs) {
+    if (elapsedMs <= 0) return;
+    auto deltaOf = [this](const std::string& topic, int32_t partition) {
+        auto it = m_watermarks.find({topic, partition});
+        return it == m_watermarks.end() ? int64_t(0) : it->second.delta;
+    };
+
+    const int64_t now = wallClockMs();
+    for (size_t i = 0; i < m_channels.size(); i++) {
+        const Channel& channel = m_channels[i];
+        int64_t audio = 0;
+        auto count = m_audioPartitions.find(channel.audioTopic);
+        for (int32_t p = 0; count != m_audioPartitions.end() && p < count->second; p++) {
+            audio += deltaOf(channel.audioTopic, p);
+        }
+        const int64_t metadata = deltaOf(channel.metadataTopic, channel.metadataPartition);
+
+        ChannelActivity& activity = m_activity[i];
+        activity.talking = audio > 0;
+        activity.audioPerMinute = audio * 60000 / elapsedMs;
+        activity.metadataPerMinute = metadata * 60000 / elapsedMs;
+        if (activity.talking) {
+            activity.lastTalkMs = now;
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef CHAT_OVER_KAFKA_ACTIVITY_MONITOR_H
+#define CHAT_OVER_KAFKA_ACTIVITY_MONITOR_H
+
+#include <rdkafka.h>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * What one channel looks like from its watermarks.
+ */
+struct ChannelActivity {
+    bool talking = false;           // audio frames were appended during the last round
+    int64_t audioPerMinute = 0;     // audio frames appended, over the last round
+    int64_t metadataPerMinute = 0;  // metadata records (recordings, reactions) appended
+    int64_t lastTalkMs = -1;        // wall clock of the last round that saw frames, -1 if never
+};
+
+/**
+ * Watches every channel for activity without consuming it.
+ *
+ * A background thread asks for the log end offset of every audio partition
+ * and the metadata partition of each channel with one ListOffsets admin
+ * request per round. librdkafka splits it into a single request per
+ * partition leader on the connections the handle already has. The deltas
+ * between rounds give message rates and a "someone is talking" flag. A
+ * round costs a few dozen bytes per partition, so watching ten channels
+ * every few seconds stays at a few hundred bytes per second. No fetch
+ * session is opened and no payload bytes are read.
+ *
+ * Audio partition counts come from a metadata request for each audio topic
+ * when monitoring starts, and again when a partition stops answering.
+ *
+ * The monitor borrows the handle it is started with: stop it, or stop it
+ * for that handle, before the handle is destroyed.
+ */
+class ActivityMonitor {
+public:
+    struct Channel {
+        std::string audioTopic;
+        std::string metadataTopic;
+        int32_t metadataPartition = 0;
+    };
+
+    static ActivityMonitor& instance();
+    ~ActivityMonitor();
+
+    /** Starts (or restarts) watching `channels` through `rk`, one round every `intervalMs`. */
+    void start(rd_kafka_t* rk, std::vector<Channel> channels, int intervalMs);
+
+    /** Stops watching. Safe to call when not running. */
+    void stop();
+
+    /** Stops watching if the monitor borrows `rk`. */
+    void stopFor(rd_kafka_t* rk);
+
+    /** Latest activity of each channel, in the order passed to start(). Empty when not running. */
+    std::vector<ChannelActivity> snapshot();
+
+private:
+    using PartitionKey = std::pair<std::string, int32_t>;
+
+    struct Watermark {
+        int64_t high = -1;
+        int64_t delta = 0;  // appended since the previous round
+    };
+
+    ActivityMonitor() = default;
+
+    void loop(rd_kafka_t* rk, int intervalMs);
+    bool refreshPartitions(rd_kafka_t* rk, int timeoutMs);
+    // Runs one ListOffsets round; false if no result arrived. `complete` is set if every partition answered.
+    bool poll(rd_kafka_t* rk, int timeoutMs, bool& complete);
+    void publish(int64_t elapsedMs);
+
+    std::mutex m_mutex;  // guards everything below but the thread
+    std::condition_variable m_cv;
+    bool m_stopping = false;
+    rd_kafka_t* m_rk = nullptr;
+    std::vector<Channel> m_channels;
+    std::map<std::string, int32_t> m_audioPartitions;  // audio topic -> partition count
+    std::map<PartitionKey, Watermark> m_watermarks;
+    std::vector<ChannelActivity> m_activity;
+    std::thread m_thread;
+};
+
+#endif //CHAT_OVER_KAFKA_ACTIVITY_MONITOR_H
@@ -0,0 +1,429 @@
+#include "client_pool.h"
+
+#include <android/log.h>
+#include <algorithm>
+#include <unistd.h>
+
+#include "connection_tracker.h"
+#include "frame_pipeline.h"
+#include "memory_budget.h"
+#include "metadata_cache.h"
+#include "nativelib.h"
+#include "playout_merger.h"
+#include "reactor.h"
+#include "reaper.h"
+#include "speaker_partitioner.h"
+#include "tls_context.h"
+
+static const char* const LOG_TAG = "ClientPool";
+
+// Idle handles beyond this count are closed right away instead of waiting
+// for the grace period.
+static const size_t kMaxIdleClients = 4;
+
+// How long an idle handle gets to leave its group or deliver what it holds.
+static const int kCloseDeadlineMs = 3000;
+
+// A live frame that is not acknowledged within this is dropped: by then the
+// listeners have played past it.
+static const char* const kRealtimeDeadlineMs = "1500";
+static const char* const kRealtimeRequestTimeoutMs = "1000";
+
+// Ordered frames get longer: acks=all waits for the in-sync replicas.
+static const char* const kOrderedDeadlineMs = "3000";
+
+std::string ClientSpec::key() const {
+    return brokers + '\n' + caCertPath + '\n' + clientCertPath + '\n' + clientKeyPath + '\n' +
+           std::to_string(static_cast<int>(role)) + '\n' + profile;
+}
+
+QosClass ClientPool::qosOf(const ClientSpec& spec) {
+    if (spec.role != ClientRole::Producer) return QosClass::Durable;
+    if (spec.profile == "realtime") return QosClass::Realtime;
+    if (spec.profile == "ordered") return QosClass::Ordered;
+    return QosClass::Durable;
+}
+
+static const char* profileOf(QosClass qos) {
+    switch (qos) {
+        case QosClass::Realtime: return "realtime";
+        case QosClass::Ordered: return "ordered";
+        default: return "durable";
+    }
+}
+
+bool ClientPool::applyQos(rd_kafka_conf_t* conf, QosClass qos, char* errstr, size_t errstr_size) {
+    auto set = [&](const char* name, const char* value) {
+        return rd_kafka_conf_set(conf, name, value, errstr, errstr_size) == RD_KAFKA_CONF_OK;
+    };
+    if (qos == QosClass::Realtime) {
+        // Retries stop at the delivery deadline, so a lost ack costs one frame, not a stall
+        return set("acks", "1") &&
+               set("linger.ms", "0") &&
+               set("message.timeout.ms", kRealtimeDeadlineMs) &&
+               set("request.timeout.ms", kRealtimeRequestTimeoutMs) &&
+               set("retry.backoff.ms", "50") &&
+               FramePipeline::apply(conf, errstr, errstr_size);
+    }
+    if (qos == QosClass::Ordered) {
+        // The broker rejects a batch whose sequence does not follow the last
+        // one it appended, so five batches can be in flight per connection
+        // and a retried one still lands in its place, exactly once.
+        return set("enable.idempotence", "true") &&
+               set("acks", "all") &&
+               set("max.in.flight.requests.per.connection", "5") &&
+               set("linger.ms", "5") &&
+               set("message.timeout.ms", kOrderedDeadlineMs) &&
+               set("retry.backoff.ms", "50") &&
+               FramePipeline::apply(conf, errstr, errstr_size);
+    }
+    return set("enable.idempotence", "true") &&
+           set("acks", "all");
+}
+
+ClientPool& ClientPool::instance() {
+    static ClientPool pool;
+    return pool;
+}
+
+ClientPool::~ClientPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_janitor.joinable()) {
+        m_janitor.join();
+    }
+}
+
+rd_kafka_t* ClientPool::create(const ClientSpec& spec, const std::string& groupId, std::string& error) {
+    std::shared_ptr<TlsContext> tls = TlsContext::acquire(
+            spec.caCertPath.c_str(), spec.clientCertPath.c_str(), spec.clientKeyPath.c_str(), error);
+    if (!tls) {
+        return nullptr;
+    }
+
+    char errstr[512];
+    auto conf_deleter = [](rd_kafka_conf_t *c) { rd_kafka_conf_destroy(c); };
+    std::unique_ptr<rd_kafka_conf_t, decltype(conf_deleter)> conf_ptr(rd_kafka_conf_new(), conf_deleter);
+
+    auto set = [&](const char* name, const char* value) {
+        return rd_kafka_conf_set(conf_ptr.get(), name, value, errstr, sizeof(errstr)) == RD_KAFKA_CONF_OK;
+    };
+
+    const std::string bootstrap = MetadataCache::instance().bootstrapFor(spec.brokers);
+    bool ok = set("bootstrap.servers", bootstrap.c_str()) &&
+              tls->apply(conf_ptr.get(), errstr, sizeof(errstr)) &&
+              ConnectionTracker::instance().apply(conf_ptr.get(), errstr, sizeof(errstr)) &&
+              MemoryBudget::instance().apply(conf_ptr.get(), spec.role, errstr, sizeof(errstr));
+
+    if (ok && spec.role == ClientRole::Consumer) {
+        // Pooled consumers outlive a single caller, so never store offsets
+        // under their group: every lease starts from the profile's reset
+        // strategy exactly like a brand-new group would.
+        ok = set("group.id", groupId.c_str()) &&
+             set("enable.auto.commit", "false") &&
+             set("auto.offset.reset", spec.profile.empty() ? "latest" : spec.profile.c_str());
+    } else if (ok) {
+        ok = applyQos(conf_ptr.get(), qosOf(spec), errstr, sizeof(errstr)) &&
+             SpeakerPartitioner::instance().apply(conf_ptr.get(), errstr, sizeof(errstr));
+        rd_kafka_conf_set_dr_msg_cb(conf_ptr.get(), delivery_report_cb);
+    }
+
+    if (!ok) {
+        error = errstr;
+        return nullptr;
+    }
+
+    rd_kafka_conf_set_log_cb(conf_ptr.get(), kafka_log_callback);
+
+    rd_kafka_type_t type = spec.role == ClientRole::Consumer ? RD_KAFKA_CONSUMER : RD_KAFKA_PRODUCER;
+    rd_kafka_t* rk = rd_kafka_new(type, conf_ptr.get(), errstr, sizeof(errstr));
+    if (!rk) {
+        error = errstr;
+        return nullptr;
+    }
+    conf_ptr.release();
+    if (!MemoryBudget::instance().track(rk, spec.role, error)) {
+        rd_kafka_destroy(rk);
+        return nullptr;
+    }
+    Reactor::instance().attach(rk);
+    return rk;
+}
+
+void ClientPool::close(const Entry& entry) {
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Closing idle %s %s",
+                        entry.spec.role == ClientRole::Consumer ? "consumer" : "producer", rd_kafka_name(entry.rk));
+    // Never block the janitor (or evictIdle's caller) on an unreachable broker.
+    Reaper::instance().submit(entry.rk, kCloseDeadlineMs);
+}
+
+rd_kafka_t* ClientPool::acquire(const ClientSpec& spec, std::string& error) {
+    const std::string key = spec.key();
+    std::string groupId;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_entries) {
+            if (entry->key != key) continue;
+            // Producers are shared; consumers only when nobody holds them.
+            if (spec.role == ClientRole::Producer || entry->refs == 0) {
+                entry->refs++;
+                return entry->rk;
+            }
+        }
+        if (spec.role == ClientRole::Consumer) {
+            groupId = "chok-" + std::to_string(getpid()) + "-" + std::to_string(++m_consumerSerial);
+        }
+    }
+
+    makeRoom(spec.role);
+    // Create outside the lock: rd_kafka_new spawns threads and may take a while.
+    rd_kafka_t* rk = create(spec, groupId, error);
+    if (!rk) {
+        return nullptr;
+    }
+
+    rd_kafka_t* shared = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Another caller may have created the same producer meanwhile; keep theirs
+        if (spec.role == ClientRole::Producer) {
+            for (auto& entry : m_entries) {
+                if (entry->key == key) {
+                    entry->refs++;
+                    shared = entry->rk;
+                    break;
+                }
+            }
+        }
+        if (!shared) {
+            m_entries.push_back(std::unique_ptr<Entry>(new Entry{key, spec, rk, 1, {}, {}}));
+            __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Created %s %s (%zu pooled handles)",
+                                spec.role == ClientRole::Consumer ? "consumer" : "producer",
+                                rd_kafka_name(rk), m_entries.size());
+        }
+    }
+    if (shared) {
+        // Never used, so there is nothing to deliver
+        Reaper::instance().submit(rk, kCloseDeadlineMs);
+        return shared;
+    }
+    ensureJanitor();
+    return rk;
+}
+
+void ClientPool::release(rd_kafka_t* rk) {
+    ClientRole role;
+    std::map<QosClass, rd_kafka_t*> siblings;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                               [rk](const std::unique_ptr<Entry>& e) { return e->rk == rk; });
+        if (it == m_entries.end() || (*it)->refs == 0) {
+            return;
+        }
+        role = (*it)->spec.role;
+        if (role == ClientRole::Producer && --(*it)->refs == 0) {
+            (*it)->idleSince = std::chrono::steady_clock::now();
+            std::swap(siblings, (*it)->siblings);
+        }
+    }
+    for (const auto& sibling : siblings) {
+        // Idles together with its producer and expires after the same grace
+        release(sibling.second);
+    }
+
+    if (role == ClientRole::Consumer) {
+        // Drop the caller's subscription/assignment before anyone else can
+        // lease this consumer.
+        rd_kafka_unsubscribe(rk);
+        rd_kafka_assign(rk, nullptr);
+        PlayoutMerger::instance().detach(rk);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_entries) {
+            if (entry->rk == rk && entry->refs > 0) {
+                entry->refs = 0;
+                entry->idleSince = std::chrono::steady_clock::now();
+            }
+        }
+    }
+    m_cv.notify_all();
+}
+
+bool ClientPool::retain(rd_kafka_t* rk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                           [rk](const std::unique_ptr<Entry>& e) { return e->rk == rk; });
+    if (it == m_entries.end() || (*it)->spec.role != ClientRole::Producer || (*it)->refs == 0) {
+        return false;
+    }
+    (*it)->refs++;
+    return true;
+}
+
+rd_kafka_t* ClientPool::forQos(rd_kafka_t* rk, QosClass qos, std::string& error) {
+    ClientSpec spec;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                               [rk](const std::unique_ptr<Entry>& e) { return e->rk == rk; });
+        if (it == m_entries.end() || (*it)->spec.role != ClientRole::Producer || qosOf((*it)->spec) == qos) {
+            return rk;
+        }
+        auto sibling = (*it)->siblings.find(qos);
+        if (sibling != (*it)->siblings.end()) {
+            return sibling->second;
+        }
+        spec = (*it)->spec;
+    }
+
+    spec.profile = profileOf(qos);
+    rd_kafka_t* sibling = acquire(spec, error);
+    if (!sibling) {
+        return nullptr;
+    }
+
+    rd_kafka_t* extra = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                               [rk](const std::unique_ptr<Entry>& e) { return e->rk == rk; });
+        if (it == m_entries.end() || (*it)->refs == 0) {
+            // Released meanwhile
+            extra = sibling;
+            sibling = rk;
+        } else {
+            // Another caller may have got there first
+            auto inserted = (*it)->siblings.emplace(qos, sibling);
+            if (!inserted.second) {
+                extra = sibling;
+                sibling = inserted.first->second;
+            }
+        }
+    }
+    if (extra) {
+        release(extra);
+    }
+    return sibling;
+}
+
+std::vector<rd_kafka_t*> ClientPool::family(rd_kafka_t* rk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<rd_kafka_t*> handles{rk};
+    for (const auto& entry : m_entries) {
+        if (entry->rk != rk) continue;
+        for (const auto& sibling : entry->siblings) {
+            handles.push_back(sibling.second);
+        }
+    }
+    return handles;
+}
+
+void ClientPool::setIdleGraceMs(int graceMs) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idleGrace = std::chrono::milliseconds(std::max(graceMs, 0));
+    }
+    m_cv.notify_all();
+}
+
+void ClientPool::evictIdle() {
+    std::vector<std::unique_ptr<Entry>> idle;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            if ((*it)->refs == 0) {
+                idle.push_back(std::move(*it));
+                it = m_entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const auto& entry : idle) {
+        close(*entry);
+    }
+}
+
+void ClientPool::makeRoom(ClientRole role) {
+    while (!MemoryBudget::instance().hasRoom(role)) {
+        std::unique_ptr<Entry> oldest;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto victim = m_entries.end();
+            for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+                if ((*it)->refs == 0 && (*it)->spec.role == role &&
+                    (victim == m_entries.end() || (*it)->idleSince < (*victim)->idleSince)) {
+                    victim = it;
+                }
+            }
+            if (victim == m_entries.end()) return;  // every slot is in use; create() refuses
+            oldest = std::move(*victim);
+            m_entries.erase(victim);
+        }
+        close(*oldest);
+    }
+}
+
+size_t ClientPool::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+size_t ClientPool::size(ClientRole role) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<size_t>(std::count_if(m_entries.begin(), m_entries.end(),
+                                             [role](const std::unique_ptr<Entry>& e) { return e->spec.role == role; }));
+}
+
+void ClientPool::ensureJanitor() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_janitor.joinable()) {
+        m_janitor = std::thread(&ClientPool::janitorLoop, this);
+    }
+}
+
+void ClientPool::janitorLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping) {
+        const auto now = std::chrono::steady_clock::now();
+        auto nextWake = now + std::chrono::seconds(60);
+        std::vector<std::unique_ptr<Entry>> expired;
+
+        // Oldest idle handles first so the cap evicts the least recently used.
+        std::vector<Entry*> idle;
+        for (auto& entry : m_entries) {
+            if (entry->refs == 0) idle.push_back(entry.get());
+        }
+        std::sort(idle.begin(), idle.end(),
+                  [](const Entry* a, const Entry* b) { return a->idleSince < b->idleSince; });
+
+        for (size_t i = 0; i < idle.size(); i++) {
+            Entry* entry = idle[i];
+            const auto deadline = entry->idleSince + m_idleGrace;
+            if (deadline <= now || idle.size() - i > kMaxIdleClients) {
+                auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                                       [entry](const std::unique_ptr<Entry>& e) { return e.get() == entry; });
+                expired.push_back(std::move(*it));
+                m_entries.erase(it);
+            } else {
+                nextWake = std::min(nextWake, deadline);
+            }
+        }
+
+        if (!expired.empty()) {
+            lock.unlock();
+            for (const auto& entry : expired) {
+                close(*entry);
+            }
+            lock.lock();
+            continue;
+        }
+
+        m_cv.wait_until(lock, nextWake);
+    }
+}
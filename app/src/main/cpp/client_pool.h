@@ -0,0 +1,146 @@
+#ifndef CHAT_OVER_KAFKA_CLIENT_POOL_H
+#define CHAT_OVER_KAFKA_CLIENT_POOL_H
+
+#include <rdkafka.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class ClientRole : int {
+    Producer = 0,
+    Consumer = 1,
+};
+
+/**
+ * Delivery guarantees of a producer handle.
+ *
+ * Durable handles are for metadata, reactions and rollups: idempotent,
+ * acks=all and retried until delivered. Live audio has two: Ordered handles
+ * are idempotent with up to five requests in flight per broker, so frames
+ * are pipelined yet a retry can neither reorder nor duplicate them, and
+ * dropped after a short delivery deadline. Realtime handles trade that for
+ * ack latency: acks=1, no linger and a shorter deadline, after which a frame
+ * is dropped instead of retried, so a retry may land it out of order.
+ *
+ * Recordings use Ordered unless they ask for Realtime (RecordingSpec):
+ * acks=all adds the in-sync replicas' round trip to each frame's ack, which
+ * pipelining keeps off the send path, and gap-free sessions are usually
+ * worth more to listeners than the ack.
+ */
+enum class QosClass : int {
+    Realtime = 0,
+    Durable = 1,
+    Ordered = 2,
+};
+
+/**
+ * Everything that identifies an interchangeable client handle.
+ *
+ * `profile` selects role-specific tuning: for consumers it is the
+ * auto.offset.reset strategy ("latest" / "earliest"), for producers the
+ * QoS class ("realtime" / "ordered" / "durable"; anything else is
+ * durable).
+ */
+struct ClientSpec {
+    std::string brokers;
+    std::string caCertPath;
+    std::string clientCertPath;
+    std::string clientKeyPath;
+    ClientRole role = ClientRole::Producer;
+    std::string profile;
+
+    std::string key() const;
+};
+
+/**
+ * Process-wide pool of librdkafka handles shared by every activity.
+ *
+ * Producers are shared: every acquire() with the same spec returns the same
+ * handle and bumps its reference count. Consumers carry per-caller
+ * subscription state, so each acquire() leases a handle exclusively; a
+ * released consumer is unsubscribed and parked for reuse by the next caller
+ * with the same spec. Handles nobody holds are closed by a janitor thread
+ * once they have been idle for the grace period, or right away when a new
+ * handle needs their slot of the memory budget.
+ */
+class ClientPool {
+public:
+    static ClientPool& instance();
+
+    /** Returns a handle for `spec`, or nullptr with `error` filled in. */
+    rd_kafka_t* acquire(const ClientSpec& spec, std::string& error);
+
+    /** Drops one reference to a handle obtained from acquire(). Unknown handles are ignored. */
+    void release(rd_kafka_t* rk);
+
+    /**
+     * Adds a reference to a pooled producer somebody holds, for work that may
+     * outlive the holder's own reference. False for any other handle.
+     */
+    bool retain(rd_kafka_t* rk);
+
+    /**
+     * Returns the producer of class `qos` that goes with the pooled producer
+     * `rk`: `rk` itself if it is of that class, otherwise a producer with the
+     * same credentials and brokers, created on first use and held for as long
+     * as `rk` is (a sibling). Handles the pool does not know are returned as
+     * they are. Returns nullptr with `error` filled in if the producer cannot
+     * be created.
+     */
+    rd_kafka_t* forQos(rd_kafka_t* rk, QosClass qos, std::string& error);
+
+    /** `rk` and the siblings held for it. */
+    std::vector<rd_kafka_t*> family(rd_kafka_t* rk);
+
+    /** Sets the producer properties of `qos` on `conf`. */
+    static bool applyQos(rd_kafka_conf_t* conf, QosClass qos, char* errstr, size_t errstr_size);
+
+    static QosClass qosOf(const ClientSpec& spec);
+
+    void setIdleGraceMs(int graceMs);
+
+    /** Closes every handle nobody holds right now, e.g. after the memory budget changed. */
+    void evictIdle();
+
+    /** Number of live handles (in use or idle). */
+    size_t size();
+
+    /** Number of live handles of `role`. */
+    size_t size(ClientRole role);
+
+    ~ClientPool();
+
+private:
+    struct Entry {
+        std::string key;
+        ClientSpec spec;
+        rd_kafka_t* rk;
+        int refs;
+        std::chrono::steady_clock::time_point idleSince;
+        std::map<QosClass, rd_kafka_t*> siblings;  // producers of the other classes, one reference each while refs > 0
+    };
+
+    ClientPool() = default;
+
+    static rd_kafka_t* create(const ClientSpec& spec, const std::string& groupId, std::string& error);
+    static void close(const Entry& entry);
+    /** Closes idle handles of `role`, oldest first, until the memory budget has a slot for one more. */
+    void makeRoom(ClientRole role);
+    void ensureJanitor();
+    void janitorLoop();
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::unique_ptr<Entry>> m_entries;
+    std::thread m_janitor;
+    bool m_stopping = false;
+    std::chrono::milliseconds m_idleGrace{30000};
+    uint64_t m_consumerSerial = 0;
+};
+
+#endif //CHAT_OVER_KAFKA_CLIENT_POOL_H
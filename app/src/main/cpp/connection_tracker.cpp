@@ -0,0 +1,69 @@
+#include "connection_tracker.h"
+
+#include <android/log.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+static const char* const LOG_TAG = "ConnectionTracker";
+
+ConnectionTracker& ConnectionTracker::instance() {
+    static ConnectionTracker tracker;
+    return tracker;
+}
+
+bool ConnectionTracker::apply(rd_kafka_conf_t* conf, char* errstr, size_t errstr_size) {
+    const std::pair<const char*, const char*> settings[] = {
+            // Reconnect right away after a reset instead of backing off for
+            // up to 10 s like a server client would.
+            {"reconnect.backoff.ms", "50"},
+            {"reconnect.backoff.max.ms", "1000"},
+            // Give up on a connect to an unreachable address quickly.
+            {"socket.connection.setup.timeout.ms", "10000"},
+            // Close idle connections before carrier NATs silently drop them.
+            {"connections.max.idle.ms", "240000"},
+    };
+
+    for (const auto& setting : settings) {
+        if (rd_kafka_conf_set(conf, setting.first, setting.second, errstr, errstr_size) != RD_KAFKA_CONF_OK) {
+            return false;
+        }
+    }
+
+    rd_kafka_conf_set_socket_cb(conf, openSocket);
+    rd_kafka_conf_set_closesocket_cb(conf, closeSocket);
+    return true;
+}
+
+int ConnectionTracker::openSocket(int domain, int type, int protocol, void* /* opaque */) {
+    int fd = socket(domain, type | SOCK_CLOEXEC, protocol);
+    if (fd == -1) {
+        return -1;  // librdkafka reports errno
+    }
+    ConnectionTracker& tracker = instance();
+    std::lock_guard<std::mutex> lock(tracker.m_mutex);
+    tracker.m_sockets.insert(fd);
+    return fd;
+}
+
+int ConnectionTracker::closeSocket(int sockfd, void* /* opaque */) {
+    ConnectionTracker& tracker = instance();
+    std::lock_guard<std::mutex> lock(tracker.m_mutex);
+    tracker.m_sockets.erase(sockfd);
+    return close(sockfd);
+}
+
+int ConnectionTracker::onNetworkChanged() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int reset = 0;
+    for (int fd : m_sockets) {
+        // shutdown() rather than close(): the owning broker thread still
+        // holds the fd and closes it through closeSocket when it notices.
+        if (shutdown(fd, SHUT_RDWR) == 0) {
+            reset++;
+        }
+    }
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Network changed: reset %d of %zu broker sockets",
+                        reset, m_sockets.size());
+    return reset;
+}
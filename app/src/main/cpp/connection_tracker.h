@@ -0,0 +1,38 @@
+#ifndef CHAT_OVER_KAFKA_CONNECTION_TRACKER_H
+#define CHAT_OVER_KAFKA_CONNECTION_TRACKER_H
+
+#include <rdkafka.h>
+#include <mutex>
+#include <set>
+
+/**
+ * Tracks every broker socket so a network handoff can be handled in place.
+ *
+ * When Android switches the default network (Wi-Fi to LTE and back), sockets
+ * bound to the old interface are dead but librdkafka only notices after a
+ * request or keepalive times out. Instead of recreating client handles,
+ * onNetworkChanged() shuts the tracked sockets down: every broker thread
+ * sees the failure at once and reconnects through its normal (shortened)
+ * backoff, keeping its queues, assignments and in-flight messages.
+ */
+class ConnectionTracker {
+public:
+    static ConnectionTracker& instance();
+
+    /** Installs the socket callbacks and reconnect settings on `conf`. */
+    bool apply(rd_kafka_conf_t* conf, char* errstr, size_t errstr_size);
+
+    /** Shuts down all tracked sockets. Returns how many were reset. */
+    int onNetworkChanged();
+
+private:
+    ConnectionTracker() = default;
+
+    static int openSocket(int domain, int type, int protocol, void* opaque);
+    static int closeSocket(int sockfd, void* opaque);
+
+    std::mutex m_mutex;  // also held across close() so a reused fd is never shut down
+    std::set<int> m_sockets;
+};
+
+#endif //CHAT_OVER_KAFKA_CONNECTION_TRACKER_H
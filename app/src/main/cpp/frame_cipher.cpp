@@ -0,0 +1,191 @@
+#include "frame_cipher.h"
+
+#include <android/log.h>
+#include <openssl/rand.h>
+#include <cstring>
+
+#include "native_log.h"
+
+static const char* const LOG_TAG = "FrameCipher";
+
+static const int kNonceBytes = 12;
+
+namespace {
+
+const char kHexDigits[] = "0123456789abcdef";
+
+int hexValue(uint8_t c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Reads the nonce prefix from the "/<24 hex digits>" that ends a session key.
+bool noncePrefix(const uint8_t* recordKey, size_t recordKeyLen, uint8_t* prefix) {
+    const size_t hexLen = 2 * kNonceBytes;
+    if (recordKeyLen < hexLen + 1 || recordKey[recordKeyLen - hexLen - 1] != '/') return false;
+    const uint8_t* hex = recordKey + recordKeyLen - hexLen;
+    for (int i = 0; i < kNonceBytes; i++) {
+        const int high = hexValue(hex[2 * i]);
+        const int low = hexValue(hex[2 * i + 1]);
+        if (high < 0 || low < 0) return false;
+        prefix[i] = static_cast<uint8_t>(high << 4 | low);
+    }
+    return true;
+}
+
+// The session's nonce prefix with `sequence` XORed into its last four bytes.
+bool makeNonce(const uint8_t* recordKey, size_t recordKeyLen, uint32_t sequence, uint8_t* nonce) {
+    if (!noncePrefix(recordKey, recordKeyLen, nonce)) return false;
+    for (int i = 0; i < 4; i++) {
+        nonce[8 + i] ^= static_cast<uint8_t>(sequence >> (24 - 8 * i));
+    }
+    return true;
+}
+
+// Reads the sequence varint; returns its length, or 0 if it is malformed.
+size_t readSequence(const uint8_t* frame, size_t len, uint32_t& sequence) {
+    sequence = 0;
+    for (size_t i = 0; i < len && i < 5; i++) {
+        sequence |= static_cast<uint32_t>(frame[i] & 0x7F) << (7 * i);
+        if (!(frame[i] & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+FrameKey::FrameKey(FrameAlgorithm algorithm, const uint8_t* key, size_t keyLen, std::string& error) {
+    m_cipher = algorithm == FrameAlgorithm::ChaCha20Poly1305 ? EVP_chacha20_poly1305() : EVP_aes_128_gcm();
+    if (keyLen != static_cast<size_t>(EVP_CIPHER_key_length(m_cipher))) {
+        error = "Frame key must be " + std::to_string(EVP_CIPHER_key_length(m_cipher)) + " bytes";
+        return;
+    }
+
+    // Expand the key once per direction; frames only set a new nonce.
+    m_seal = EVP_CIPHER_CTX_new();
+    m_open = EVP_CIPHER_CTX_new();
+    if (!m_seal || !m_open ||
+        EVP_EncryptInit_ex(m_seal, m_cipher, nullptr, key, nullptr) != 1 ||
+        EVP_DecryptInit_ex(m_open, m_cipher, nullptr, key, nullptr) != 1) {
+        error = "Failed to initialise the frame cipher";
+        EVP_CIPHER_CTX_free(m_seal);
+        EVP_CIPHER_CTX_free(m_open);
+        m_seal = m_open = nullptr;
+    }
+}
+
+FrameKey::~FrameKey() {
+    EVP_CIPHER_CTX_free(m_seal);
+    EVP_CIPHER_CTX_free(m_open);
+}
+
+bool FrameKey::sessionKey(const std::string& speaker, int64_t startedAtMs, std::string& key) {
+    uint8_t prefix[kNonceBytes];
+    if (RAND_bytes(prefix, sizeof(prefix)) != 1) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "No random nonce prefix for a session of %s",
+                            speaker.c_str());
+        return false;
+    }
+    key = speaker + "/" + std::to_string(startedAtMs) + "/";
+    for (uint8_t byte : prefix) {
+        key += kHexDigits[byte >> 4];
+        key += kHexDigits[byte & 0x0F];
+    }
+    return true;
+}
+
+size_t FrameKey::prefixBytes(uint32_t sequence) {
+    size_t bytes = 1;
+    while (sequence >= 0x80) {
+        sequence >>= 7;
+        bytes++;
+    }
+    return bytes;
+}
+
+size_t FrameKey::seal(const uint8_t* recordKey, size_t recordKeyLen, uint32_t sequence,
+                      uint8_t* frame, size_t plainLen) {
+    const size_t prefix = prefixBytes(sequence);
+    uint32_t rest = sequence;
+    for (size_t i = 0; i < prefix; i++) {
+        frame[i] = static_cast<uint8_t>((rest & 0x7F) | (i + 1 < prefix ? 0x80 : 0));
+        rest >>= 7;
+    }
+
+    uint8_t nonce[kNonceBytes];
+    if (!makeNonce(recordKey, recordKeyLen, sequence, nonce)) {
+        NativeLog::instance().print(ANDROID_LOG_ERROR, LOG_TAG, "Frame %u has no session nonce", sequence);
+        return 0;
+    }
+
+    uint8_t* body = frame + prefix;
+    int outLen = 0;
+    int finalLen = 0;
+    std::lock_guard<std::mutex> lock(m_sealMutex);
+    if (EVP_EncryptInit_ex(m_seal, nullptr, nullptr, nullptr, nonce) != 1 ||
+        (recordKeyLen > 0 &&
+         EVP_EncryptUpdate(m_seal, nullptr, &outLen, recordKey, static_cast<int>(recordKeyLen)) != 1) ||
+        EVP_EncryptUpdate(m_seal, body, &outLen, body, static_cast<int>(plainLen)) != 1 ||
+        EVP_EncryptFinal_ex(m_seal, body + outLen, &finalLen) != 1 ||
+        EVP_CIPHER_CTX_ctrl(m_seal, EVP_CTRL_AEAD_GET_TAG, kTagBytes, body + plainLen) != 1) {
+        NativeLog::instance().print(ANDROID_LOG_ERROR, LOG_TAG, "Sealing frame %u failed", sequence);
+        return 0;
+    }
+    return prefix + plainLen + kTagBytes;
+}
+
+long FrameKey::openedSize(const uint8_t* frame, size_t len) {
+    uint32_t sequence;
+    const size_t prefix = readSequence(frame, len, sequence);
+    if (prefix == 0 || len < prefix + kTagBytes) return -1;
+    return static_cast<long>(len - prefix - kTagBytes);
+}
+
+bool FrameKey::open(const uint8_t* recordKey, size_t recordKeyLen, const uint8_t* frame, size_t len,
+                    uint8_t* out) {
+    uint32_t sequence;
+    const size_t prefix = readSequence(frame, len, sequence);
+    if (prefix == 0 || len < prefix + kTagBytes) return false;
+    const size_t cipherLen = len - prefix - kTagBytes;
+
+    uint8_t nonce[kNonceBytes];
+    if (!makeNonce(recordKey, recordKeyLen, sequence, nonce)) return false;
+
+    // The tag is copied because the control call takes a mutable pointer
+    uint8_t tag[kTagBytes];
+    memcpy(tag, frame + prefix + cipherLen, kTagBytes);
+
+    int outLen = 0;
+    int finalLen = 0;
+    std::lock_guard<std::mutex> lock(m_openMutex);
+    return EVP_DecryptInit_ex(m_open, nullptr, nullptr, nullptr, nonce) == 1 &&
+           (recordKeyLen == 0 ||
+            EVP_DecryptUpdate(m_open, nullptr, &outLen, recordKey, static_cast<int>(recordKeyLen)) == 1) &&
+           EVP_DecryptUpdate(m_open, out, &outLen, frame + prefix, static_cast<int>(cipherLen)) == 1 &&
+           EVP_CIPHER_CTX_ctrl(m_open, EVP_CTRL_AEAD_SET_TAG, kTagBytes, tag) == 1 &&
+           EVP_DecryptFinal_ex(m_open, out + outLen, &finalLen) == 1;
+}
+
+FrameCipher& FrameCipher::instance() {
+    static FrameCipher cipher;
+    return cipher;
+}
+
+bool FrameCipher::setKey(const std::string& topic, FrameAlgorithm algorithm, const uint8_t* key, size_t keyLen,
+                         std::string& error) {
+    auto frameKey = std::make_shared<FrameKey>(algorithm, key, keyLen, error);
+    if (!frameKey->valid()) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_keys[topic] = std::move(frameKey);
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Frames of %s are sealed", topic.c_str());
+    return true;
+}
+
+std::shared_ptr<FrameKey> FrameCipher::keyFor(const char* topic) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_keys.empty() || !topic) return nullptr;
+    auto it = m_keys.find(topic);
+    return it == m_keys.end() ? nullptr : it->second;
+}
@@ -0,0 +1,108 @@
+#ifndef CHAT_OVER_KAFKA_FRAME_CIPHER_H
+#define CHAT_OVER_KAFKA_FRAME_CIPHER_H
+
+#include <openssl/evp.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+enum class FrameAlgorithm : int {
+    Aes128Gcm = 0,         // AES instructions on ARMv8 and x86
+    ChaCha20Poly1305 = 1,  // for channels read mostly by devices without them
+};
+
+/**
+ * One channel's end-to-end key for audio frames.
+ *
+ * A sealed frame is laid out as
+ *
+ *   varint sequence | ciphertext | 16-byte tag
+ *
+ * Every session draws a random 96-bit nonce prefix and carries it in its
+ * record key, "<speaker>/<session start>/<24 hex digits>" (see
+ * sessionKey()). A frame's 12-byte nonce is that prefix with the big-endian
+ * sequence XORed into its last four bytes, so two sessions sharing the
+ * channel key reuse a nonce only if their random prefixes collide. The nonce
+ * is never sent: the receiver rebuilds it from the key and the sequence
+ * prefix (one or two bytes for any recording shorter than 16 minutes). The
+ * record key is also the associated data, so a frame cannot be replayed into
+ * another session. A record key without the random part has no nonce, so
+ * its frames neither seal nor open.
+ *
+ * The key schedule is expanded once per direction. Each frame only resets
+ * the nonce of the reused EVP_CIPHER_CTX, so OpenSSL's hardware AES and
+ * PMULL/CLMUL paths run without any per-frame allocation.
+ */
+class FrameKey {
+public:
+    static const size_t kTagBytes = 16;
+
+    FrameKey(FrameAlgorithm algorithm, const uint8_t* key, size_t keyLen, std::string& error);
+    ~FrameKey();
+
+    FrameKey(const FrameKey&) = delete;
+    FrameKey& operator=(const FrameKey&) = delete;
+
+    bool valid() const { return m_seal && m_open; }
+
+    /**
+     * Sets `key` to the record key of a new session of `speaker` started at
+     * `startedAtMs`, with a fresh random nonce prefix. False if no random
+     * bytes could be drawn; the session must not start.
+     */
+    static bool sessionKey(const std::string& speaker, int64_t startedAtMs, std::string& key);
+
+    /** Bytes in front of the plaintext of frame `sequence` (its varint). */
+    static size_t prefixBytes(uint32_t sequence);
+
+    /**
+     * Seals the frame in place. `frame` holds prefixBytes(sequence) bytes of
+     * room, then `plainLen` plaintext bytes, then kTagBytes of room. Returns the
+     * sealed size, or 0 on failure.
+     */
+    size_t seal(const uint8_t* recordKey, size_t recordKeyLen, uint32_t sequence,
+                uint8_t* frame, size_t plainLen);
+
+    /** Plaintext size of a sealed frame of `len` bytes, or -1 if it cannot be one. */
+    static long openedSize(const uint8_t* frame, size_t len);
+
+    /**
+     * Opens a sealed frame into `out` (openedSize() bytes). Returns false if
+     * the frame is malformed or fails authentication.
+     */
+    bool open(const uint8_t* recordKey, size_t recordKeyLen, const uint8_t* frame, size_t len, uint8_t* out);
+
+private:
+    const EVP_CIPHER* m_cipher;
+    std::mutex m_sealMutex;
+    EVP_CIPHER_CTX* m_seal = nullptr;
+    std::mutex m_openMutex;
+    EVP_CIPHER_CTX* m_open = nullptr;
+};
+
+/**
+ * Frame keys by audio topic. Topics without a key carry plaintext frames.
+ */
+class FrameCipher {
+public:
+    static FrameCipher& instance();
+
+    /** Seals and opens the frames of `topic` with `key` from now on. */
+    bool setKey(const std::string& topic, FrameAlgorithm algorithm, const uint8_t* key, size_t keyLen,
+                std::string& error);
+
+    /** The key of `topic`, or nullptr if its frames are plaintext. */
+    std::shared_ptr<FrameKey> keyFor(const char* topic);
+
+private:
+    FrameCipher() = default;
+
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<FrameKey>, std::less<>> m_keys;  // finds by const char* without a copy
+};
+
+#endif //CHAT_OVER_KAFKA_FRAME_CIPHER_H
@@ -0,0 +1,155 @@
+#include "frame_pipeline.h"
+
+#include "memory_budget.h"
+#include "native_log.h"
+
+static const char* const LOG_TAG = "FramePipeline";
+
+// How often an ordered producer reports its retries.
+static const char* const kStatsIntervalMs = "5000";
+
+/**
+ * The opaque of one enqueued frame. It keeps its session and sink alive, so
+ * a report that arrives after endSession() still reaches them.
+ */
+class FramePipeline::Pending final : public DeliveryListener {
+public:
+    Pending(std::shared_ptr<Session> session, std::shared_ptr<FrameSink> sink, uint32_t sequence, size_t bytes)
+            : m_session(std::move(session)), m_sink(std::move(sink)), m_sequence(sequence), m_bytes(bytes) {}
+
+    void onDelivery(const rd_kafka_message_t* msg) override {
+        if (FramePipeline::instance().onDelivery(*m_session, m_sequence, msg) && m_sink) {
+            FrameReport report;
+            report.sequence = m_sequence;
+            report.partition = msg->partition;
+            report.offset = msg->offset;
+            report.timestamp = rd_kafka_message_timestamp(msg, nullptr);
+            m_sink->onFrame(m_sequence, m_bytes, msg->err, report);
+        }
+        delete this;
+    }
+
+private:
+    std::shared_ptr<Session> m_session;
+    std::shared_ptr<FrameSink> m_sink;
+    uint32_t m_sequence;
+    size_t m_bytes;
+};
+
+FramePipeline& FramePipeline::instance() {
+    static FramePipeline pipeline;
+    return pipeline;
+}
+
+bool FramePipeline::apply(rd_kafka_conf_t* conf, char* errstr, size_t errstr_size) {
+    if (rd_kafka_conf_set(conf, "statistics.interval.ms", kStatsIntervalMs, errstr, errstr_size) != RD_KAFKA_CONF_OK) {
+        return false;
+    }
+    // Replaces the memory budget's callback, which statsCallback forwards to
+    rd_kafka_conf_set_stats_cb(conf, statsCallback);
+    return true;
+}
+
+rd_kafka_resp_err_t FramePipeline::enqueue(rd_kafka_t* rk, const char* topic, const uint8_t* key, size_t keyLen,
+                                           const uint8_t* frame, size_t frameLen, uint32_t sequence,
+                                           std::shared_ptr<FrameSink> sink) {
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const std::string sessionKey(reinterpret_cast<const char*>(key), keyLen);
+        std::shared_ptr<Session>& entry = m_sessions[sessionKey];
+        if (!entry) entry = std::make_shared<Session>();
+        session = entry;
+    }
+
+    auto* pending = new Pending(std::move(session), std::move(sink), sequence, frameLen);
+    // Never blocks: a full queue fails the frame rather than the capture thread
+    rd_kafka_resp_err_t err = rd_kafka_producev(
+            rk,
+            RD_KAFKA_V_TOPIC(topic),
+            RD_KAFKA_V_KEY(key, keyLen),
+            RD_KAFKA_V_VALUE(const_cast<uint8_t*>(frame), frameLen),
+            RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+            RD_KAFKA_V_OPAQUE(static_cast<DeliveryListener*>(pending)),
+            RD_KAFKA_V_END
+    );
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        delete pending;
+        m_stats.failed++;
+    } else {
+        m_stats.enqueued++;
+    }
+    return err;
+}
+
+bool FramePipeline::onDelivery(Session& session, uint32_t sequence, const rd_kafka_message_t* msg) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (msg->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        m_stats.failed++;
+        NativeLog::instance().print(ANDROID_LOG_WARN, LOG_TAG, "Frame %u not delivered: %s", sequence,
+                                    rd_kafka_err2str(msg->err));
+        return true;
+    }
+    m_stats.delivered++;
+
+    if (sequence < session.delivered.size() && session.delivered[sequence]) {
+        m_stats.duplicates++;
+        NativeLog::instance().print(ANDROID_LOG_WARN, LOG_TAG, "Frame %u delivered again at offset %lld", sequence,
+                                    static_cast<long long>(msg->offset));
+        return false;
+    }
+    if (sequence >= session.delivered.size()) {
+        session.delivered.resize(sequence + 1);
+    }
+    session.delivered[sequence] = true;
+
+    // Offsets must follow sequences. A session is pinned to one partition; a
+    // move (its partition was deleted) restarts the comparison.
+    if (session.started && session.partition == msg->partition &&
+        (msg->offset > session.lastOffset) != (sequence > session.lastSequence)) {
+        m_stats.reordered++;
+        NativeLog::instance().print(ANDROID_LOG_WARN, LOG_TAG,
+                                    "Frame %u at offset %lld is out of order with frame %u at %lld", sequence, static_cast<long long>(msg->offset), session.lastSequence,
+                                    static_cast<long long>(session.lastOffset));
+    }
+    session.started = true;
+    session.partition = msg->partition;
+    session.lastSequence = sequence;
+    session.lastOffset = msg->offset;
+    return true;
+}
+
+void FramePipeline::endSession(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sessions.erase(key);
+}
+
+FrameDeliveryStats FramePipeline::stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void FramePipeline::forget(rd_kafka_t* rk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_handleRetries.erase(rk);
+}
+
+int FramePipeline::statsCallback(rd_kafka_t* rk, char* json, size_t json_len, void* /* opaque */) {
+    MemoryBudget::instance().onStats(rk, json, json_len);
+    instance().onStats(rk, json, json_len);
+    return 0;  // librdkafka frees the JSON
+}
+
+void FramePipeline::onStats(rd_kafka_t* rk, const char* json, size_t json_len) {
+    // Per-broker totals since the handle was created
+    const int64_t retries = MemoryBudget::sumStats(json, json_len, {"brokers", "*", "txretries"});
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int64_t& seen = m_handleRetries[rk];
+    if (retries > seen) {
+        m_stats.retries += retries - seen;
+    }
+    seen = retries;
+}
@@ -0,0 +1,122 @@
+#ifndef CHAT_OVER_KAFKA_FRAME_PIPELINE_H
+#define CHAT_OVER_KAFKA_FRAME_PIPELINE_H
+
+#include <rdkafka.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Receives the delivery report of a message produced with it as opaque.
+ * The producers' delivery callback hands every report to its listener.
+ */
+class DeliveryListener {
+public:
+    virtual void onDelivery(const rd_kafka_message_t* msg) = 0;
+
+protected:
+    ~DeliveryListener() = default;
+};
+
+/** Where one frame landed. */
+struct FrameReport {
+    uint32_t sequence = 0;
+    int32_t partition = -1;
+    int64_t offset = -1;
+    int64_t timestamp = -1;  // broker LogAppendTime on audio topics, -1 if unknown
+};
+
+/**
+ * Receives the fate of the frames enqueued with it: each frame is reported
+ * exactly once, delivered or not. A duplicate delivery is never passed on.
+ */
+class FrameSink {
+public:
+    /** Frame `sequence` of `bytes` landed at `report`, or was dropped with `err`. */
+    virtual void onFrame(uint32_t sequence, size_t bytes, rd_kafka_resp_err_t err, const FrameReport& report) = 0;
+
+protected:
+    ~FrameSink() = default;
+};
+
+/** Delivery counters of every frame enqueued since the process started. */
+struct FrameDeliveryStats {
+    int64_t enqueued = 0;
+    int64_t delivered = 0;
+    int64_t failed = 0;      // not delivered within the deadline, or rejected
+    int64_t retries = 0;     // produce requests the ordered producers sent again
+    int64_t duplicates = 0;  // a sequence of a session delivered twice
+    int64_t reordered = 0;   // a frame that landed below an earlier frame of its session
+};
+
+/**
+ * Pipelined audio frames.
+ *
+ * enqueue() hands a frame to the producer and returns without waiting for
+ * it, so a recording has as many produce requests in flight as its producer
+ * allows. On an ordered producer (see QosClass::Ordered) the frames of a
+ * session are appended in the order they were enqueued even when a request
+ * is retried, and exactly once.
+ *
+ * Each frame's fate goes to the sink it was enqueued with (a recording,
+ * see RecordingSession). Every delivery is also checked against the
+ * previous one of its session (the record key): a sequence that comes back twice counts as a
+ * duplicate, a frame whose offset and sequence disagree on which of the two
+ * came first as a reorder. Both stay at 0 on an ordered producer; they are
+ * counted so that stays visible in the field, and because a realtime
+ * producer makes no such promise. Retries come from the frame producers'
+ * statistics.
+ */
+class FramePipeline {
+public:
+    static FramePipeline& instance();
+
+    /** Installs the statistics the retry counter is read from on a frame producer's `conf`. */
+    static bool apply(rd_kafka_conf_t* conf, char* errstr, size_t errstr_size);
+
+    /**
+     * Produces `frame` (copied) as frame `sequence` of the session keyed
+     * `key`, without waiting. Unless this fails, `sink` hears of the frame
+     * once it is delivered or dropped.
+     */
+    rd_kafka_resp_err_t enqueue(rd_kafka_t* rk, const char* topic, const uint8_t* key, size_t keyLen,
+                                const uint8_t* frame, size_t frameLen, uint32_t sequence,
+                                std::shared_ptr<FrameSink> sink);
+
+    /** Forgets the order of the session keyed `key`. Later deliveries are still counted. */
+    void endSession(const std::string& key);
+
+    FrameDeliveryStats stats();
+
+    /** Stops reading the statistics of a handle that is about to be destroyed. */
+    void forget(rd_kafka_t* rk);
+
+private:
+    struct Session {
+        std::vector<bool> delivered;  // by sequence
+        bool started = false;
+        int32_t partition = -1;
+        uint32_t lastSequence = 0;  // of the previous report
+        int64_t lastOffset = -1;
+    };
+
+    class Pending;
+
+    FramePipeline() = default;
+
+    static int statsCallback(rd_kafka_t* rk, char* json, size_t json_len, void* opaque);
+    void onStats(rd_kafka_t* rk, const char* json, size_t json_len);
+    // False if the delivery is a duplicate
+    bool onDelivery(Session& session, uint32_t sequence, const rd_kafka_message_t* msg);
+
+    std::mutex m_mutex;  // guards everything below, including the sessions' contents
+    std::map<std::string, std::shared_ptr<Session>, std::less<>> m_sessions;
+    std::map<rd_kafka_t*, int64_t> m_handleRetries;  // last txretries seen per handle
+    FrameDeliveryStats m_stats;
+};
+
+#endif //CHAT_OVER_KAFKA_FRAME_PIPELINE_H
@@ -0,0 +1,229 @@
+#include "memory_budget.h"
+
+#include <android/log.h>
+#include <algorithm>
+#include <cJSON.h>
+#include <cstring>
+#include <string>
+
+static const char* const LOG_TAG = "MemoryBudget";
+
+// How the budget is split, in percent.
+static const int kProducerSharePct = 20;
+static const int kConsumerSharePct = 55;
+static const int kCacheSharePct = 25;
+
+// How many handles of each role the shares are divided between: a producer
+// per QoS class for one set of credentials plus an unpooled one, and the
+// live, backlog, metadata and range-read consumers of two screens.
+static const int kProducerSlots = 4;
+static const int kConsumerSlots = 6;
+
+// Typical Opus frame record, used to turn byte limits into message counts.
+static const int kTypicalMessageBytes = 256;
+
+// librdkafka's own default, which fetch.max.bytes may not go below.
+static const int kMaxMessageBytes = 1000000;
+
+static int64_t sumAt(const cJSON* node, const char* const* step, const char* const* end) {
+    if (!node) return 0;
+    if (step == end) {
+        return cJSON_IsNumber(node) ? static_cast<int64_t>(node->valuedouble) : 0;
+    }
+    if (strcmp(*step, "*") != 0) {
+        return sumAt(cJSON_GetObjectItemCaseSensitive(node, *step), step + 1, end);
+    }
+    int64_t total = 0;
+    const cJSON* child;
+    cJSON_ArrayForEach(child, node) {
+        total += sumAt(child, step + 1, end);
+    }
+    return total;
+}
+
+int64_t MemoryBudget::sumStats(const char* json, size_t len, std::initializer_list<const char*> path) {
+    cJSON* root = cJSON_ParseWithLength(json, len);
+    if (!root) return 0;
+    const int64_t total = sumAt(root, path.begin(), path.end());
+    cJSON_Delete(root);
+    return total;
+}
+
+MemoryBudget& MemoryBudget::instance() {
+    static MemoryBudget budget;
+    return budget;
+}
+
+void MemoryBudget::setBudget(int64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budgetBytes = std::max<int64_t>(bytes, 0);
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Memory budget set to %lld bytes",
+                        static_cast<long long>(m_budgetBytes));
+}
+
+int64_t MemoryBudget::budget() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budgetBytes;
+}
+
+int MemoryBudget::slots(ClientRole role) {
+    return role == ClientRole::Producer ? kProducerSlots : kConsumerSlots;
+}
+
+MemoryLimits MemoryBudget::limits() {
+    const int64_t budgetBytes = budget();
+    MemoryLimits limits;
+    if (budgetBytes <= 0) {
+        return limits;
+    }
+
+    // Fixed slots, so a handle's limits do not depend on how many others exist;
+    // the floors are librdkafka's minimums, not a share of their own
+    const int64_t perProducer = budgetBytes * kProducerSharePct / 100 / kProducerSlots;
+    const int64_t perConsumer = budgetBytes * kConsumerSharePct / 100 / kConsumerSlots;
+
+    limits.producerQueueKbytes = static_cast<int>(std::max<int64_t>(perProducer / 1024, 1));
+    limits.producerQueueMessages = static_cast<int>(
+            std::max<int64_t>(perProducer / kTypicalMessageBytes, 1));
+
+    // Half of a consumer's share is the prefetch queue, the other half bounds
+    // a single in-flight fetch response.
+    limits.consumerQueueKbytes = static_cast<int>(std::max<int64_t>(perConsumer / 2 / 1024, 1));
+    limits.consumerQueueMessages = static_cast<int>(
+            std::min<int64_t>(std::max<int64_t>(perConsumer / 2 / kTypicalMessageBytes, 1), 100000));
+    limits.fetchMaxBytes = static_cast<int>(
+            std::min<int64_t>(std::max<int64_t>(perConsumer / 2, 1000), 50 * 1024 * 1024));
+    limits.partitionFetchBytes = std::min(limits.fetchMaxBytes, 1024 * 1024);
+
+    limits.cacheBytes = budgetBytes * kCacheSharePct / 100;
+    return limits;
+}
+
+bool MemoryBudget::apply(rd_kafka_conf_t* conf, ClientRole role, char* errstr, size_t errstr_size) {
+    const MemoryLimits limits = this->limits();
+    if (limits.producerQueueKbytes == 0) {
+        return true;
+    }
+
+    auto set = [&](const char* name, int64_t value) {
+        return rd_kafka_conf_set(conf, name, std::to_string(value).c_str(), errstr, errstr_size) == RD_KAFKA_CONF_OK;
+    };
+
+    bool ok;
+    if (role == ClientRole::Producer) {
+        ok = set("queue.buffering.max.kbytes", limits.producerQueueKbytes) &&
+             set("queue.buffering.max.messages", limits.producerQueueMessages);
+    } else {
+        ok = set("queued.max.messages.kbytes", limits.consumerQueueKbytes) &&
+             set("queued.min.messages", limits.consumerQueueMessages) &&
+             set("fetch.max.bytes", limits.fetchMaxBytes) &&
+             set("max.partition.fetch.bytes", limits.partitionFetchBytes) &&
+             // fetch.max.bytes may not be below it
+             set("message.max.bytes", std::min(limits.fetchMaxBytes, kMaxMessageBytes)) &&
+             // Must exceed fetch.max.bytes by at least the protocol overhead.
+             set("receive.message.max.bytes", std::max(limits.fetchMaxBytes + 512, 1000));
+    }
+
+    // Usage is sampled from the statistics the handle emits.
+    ok = ok && set("statistics.interval.ms", 5000);
+    if (ok) {
+        rd_kafka_conf_set_stats_cb(conf, statsCallback);
+    }
+    return ok;
+}
+
+int MemoryBudget::statsCallback(rd_kafka_t* rk, char* json, size_t json_len, void* /* opaque */) {
+    instance().onStats(rk, json, json_len);
+    return 0;  // librdkafka frees the JSON
+}
+
+void MemoryBudget::onStats(rd_kafka_t* rk, const char* json, size_t json_len) {
+    const bool producer = rd_kafka_type(rk) == RD_KAFKA_PRODUCER;
+    const int64_t bytes = producer
+            // Top-level total of messages waiting in the producer queues.
+            ? sumStats(json, json_len, {"msg_size"})
+            // Per-partition prefetch queues.
+            : sumStats(json, json_len, {"topics", "*", "partitions", "*", "fetchq_size"});
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_handles.find(rk);
+    if (it == m_handles.end()) return;  // closing, or created before the budget was set
+    (producer ? it->second.producerBytes : it->second.consumerBytes) = bytes;
+    checkLocked();
+}
+
+size_t MemoryBudget::countLocked(ClientRole role) const {
+    return static_cast<size_t>(std::count_if(m_handles.begin(), m_handles.end(),
+                                             [role](const std::pair<rd_kafka_t* const, HandleUsage>& e) {
+                                                 return e.second.role == role;
+                                             }));
+}
+
+bool MemoryBudget::hasRoom(ClientRole role) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budgetBytes <= 0 || countLocked(role) < static_cast<size_t>(slots(role));
+}
+
+bool MemoryBudget::track(rd_kafka_t* rk, ClientRole role, std::string& error) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_budgetBytes > 0 && countLocked(role) >= static_cast<size_t>(slots(role))) {
+        error = std::string("The memory budget has room for ") + std::to_string(slots(role)) +
+                (role == ClientRole::Producer ? " producers" : " consumers") + ", all in use";
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "%s", error.c_str());
+        return false;
+    }
+    m_handles[rk].role = role;
+    return true;
+}
+
+void MemoryBudget::forget(rd_kafka_t* rk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_handles.erase(rk);
+}
+
+void MemoryBudget::reportCacheUsage(int64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cacheBytes = std::max<int64_t>(bytes, 0);
+    checkLocked();
+}
+
+void MemoryBudget::checkLocked() {
+    if (m_budgetBytes <= 0) return;
+    int64_t producerBytes = 0;
+    int64_t consumerBytes = 0;
+    for (const auto& entry : m_handles) {
+        producerBytes += entry.second.producerBytes;
+        consumerBytes += entry.second.consumerBytes;
+    }
+    const bool over = producerBytes > m_budgetBytes * kProducerSharePct / 100 ||
+                      consumerBytes > m_budgetBytes * kConsumerSharePct / 100 ||
+                      m_cacheBytes > m_budgetBytes * kCacheSharePct / 100;
+    if (over) {
+        m_breaches++;
+        if (!m_overShare) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG,
+                                "Over budget: producers %lld, consumers %lld, cache %lld of %lld bytes",
+                                static_cast<long long>(producerBytes), static_cast<long long>(consumerBytes),
+                                static_cast<long long>(m_cacheBytes), static_cast<long long>(m_budgetBytes));
+        }
+    }
+    m_overShare = over;
+}
+
+MemoryUsage MemoryBudget::usage() {
+    MemoryUsage usage;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    usage.budgetBytes = m_budgetBytes;
+    usage.cacheBytes = m_cacheBytes;
+    usage.handles = static_cast<int64_t>(m_handles.size());
+    for (const auto& entry : m_handles) {
+        usage.producerQueuedBytes += entry.second.producerBytes;
+        usage.consumerQueuedBytes += entry.second.consumerBytes;
+    }
+    if (m_budgetBytes > 0) {
+        const int64_t total = usage.producerQueuedBytes + usage.consumerQueuedBytes + usage.cacheBytes;
+        usage.overBudgetBytes = std::max<int64_t>(total - m_budgetBytes, 0);
+    }
+    usage.breaches = m_breaches;
+    return usage;
+}
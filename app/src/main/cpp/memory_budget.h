@@ -0,0 +1,113 @@
+#ifndef CHAT_OVER_KAFKA_MEMORY_BUDGET_H
+#define CHAT_OVER_KAFKA_MEMORY_BUDGET_H
+
+#include <rdkafka.h>
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "client_pool.h"
+
+/**
+ * Per-handle limits derived from the process memory budget.
+ */
+struct MemoryLimits {
+    int producerQueueKbytes = 0;     // queue.buffering.max.kbytes
+    int producerQueueMessages = 0;   // queue.buffering.max.messages
+    int consumerQueueKbytes = 0;     // queued.max.messages.kbytes
+    int consumerQueueMessages = 0;   // queued.min.messages
+    int fetchMaxBytes = 0;           // fetch.max.bytes
+    int partitionFetchBytes = 0;     // max.partition.fetch.bytes
+    int64_t cacheBytes = 0;          // app-side jitter/decode cache
+};
+
+/**
+ * Measured usage, in bytes.
+ */
+struct MemoryUsage {
+    int64_t budgetBytes = 0;
+    int64_t producerQueuedBytes = 0;
+    int64_t consumerQueuedBytes = 0;
+    int64_t cacheBytes = 0;
+    int64_t handles = 0;
+    int64_t overBudgetBytes = 0;     // by how much the sampled total exceeds the budget, else 0
+    int64_t breaches = 0;            // samples in which a share exceeded its part of the budget
+};
+
+/**
+ * One byte budget that bounds every native queue.
+ *
+ * librdkafka's defaults are sized for servers (a single consumer may prefetch
+ * up to ~64 MB). The budget is split between producer queues, consumer
+ * prefetch and the app's audio caches, and each share into a fixed number of
+ * slots per role. Every handle is sized for one slot when it is created and
+ * holds it until it is handed to the reaper; a handle that finds every slot
+ * of its role taken is refused (the client pool first closes idle handles to
+ * make room). The sum of the limits therefore never exceeds the budget.
+ * Usage is sampled from librdkafka's statistics callback.
+ *
+ * A budget of 0 (the default) leaves librdkafka's own defaults untouched and
+ * admits any number of handles.
+ */
+class MemoryBudget {
+public:
+    static MemoryBudget& instance();
+
+    void setBudget(int64_t bytes);
+    int64_t budget();
+    MemoryLimits limits();
+
+    /** Applies the per-slot limits of `role` to `conf`. */
+    bool apply(rd_kafka_conf_t* conf, ClientRole role, char* errstr, size_t errstr_size);
+
+    /** Handles of `role` the budget has room for. */
+    static int slots(ClientRole role);
+
+    /** Whether a handle of `role` created now would get a slot. */
+    bool hasRoom(ClientRole role);
+
+    /**
+     * Gives the new handle `rk` a slot of `role`. False, with `error` filled
+     * in, if every slot is taken; the caller then destroys `rk`.
+     */
+    bool track(rd_kafka_t* rk, ClientRole role, std::string& error);
+
+    /** Frees the slot of a handle that is about to be destroyed. */
+    void forget(rd_kafka_t* rk);
+
+    void reportCacheUsage(int64_t bytes);
+    MemoryUsage usage();
+
+    /** Samples usage from a statistics JSON, for handles whose statistics callback is another one. */
+    void onStats(rd_kafka_t* rk, const char* json, size_t json_len);
+
+    /**
+     * Sum of the numbers at `path` in a statistics JSON. A "*" step stands for
+     * every member of an object, e.g. {"topics", "*", "partitions", "*", "fetchq_size"}.
+     */
+    static int64_t sumStats(const char* json, size_t len, std::initializer_list<const char*> path);
+
+private:
+    struct HandleUsage {
+        ClientRole role = ClientRole::Producer;
+        int64_t producerBytes = 0;
+        int64_t consumerBytes = 0;
+    };
+
+    MemoryBudget() = default;
+
+    static int statsCallback(rd_kafka_t* rk, char* json, size_t json_len, void* opaque);
+    size_t countLocked(ClientRole role) const;
+    void checkLocked();
+
+    std::mutex m_mutex;
+    int64_t m_budgetBytes = 0;
+    int64_t m_cacheBytes = 0;
+    int64_t m_breaches = 0;
+    bool m_overShare = false;  // the last sample exceeded a share, so the next breach is not logged again
+    std::map<rd_kafka_t*, HandleUsage> m_handles;
+};
+
+#endif //CHAT_OVER_KAFKA_MEMORY_BUDGET_H
@@ -0,0 +1,155 @@
+#include "metadata_cache.h"
+
+#include <android/log.h>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+static const char* const LOG_TAG = "MetadataCache";
+static const char* const kHeader = "chok-metadata-cache 1";
+
+MetadataCache& MetadataCache::instance() {
+    static MetadataCache cache;
+    return cache;
+}
+
+void MetadataCache::setPath(const std::string& path, const std::string& brokers) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_path == path && m_cluster == brokers) return;
+    m_path = path;
+    m_cluster = brokers;
+    m_brokers.clear();
+    m_topics.clear();
+    loadLocked();
+}
+
+void MetadataCache::loadLocked() {
+    std::ifstream in(m_path);
+    if (!in) return;
+
+    std::string line;
+    if (!std::getline(in, line) || line != kHeader) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Ignoring cache with unknown format: %s", m_path.c_str());
+        return;
+    }
+    if (!std::getline(in, line) || line != "cluster " + m_cluster) {
+        __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Cache belongs to another cluster, ignoring it");
+        return;
+    }
+
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind;
+        fields >> kind;
+        if (kind == "broker") {
+            int32_t id;
+            std::string address;
+            if (fields >> id >> address) m_brokers[id] = address;
+        } else if (kind == "partition") {
+            std::string topic;
+            int32_t id;
+            Partition p;
+            if (fields >> topic >> id >> p.leader >> p.low >> p.high) m_topics[topic][id] = p;
+        }
+    }
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Loaded %zu brokers, %zu topics",
+                        m_brokers.size(), m_topics.size());
+}
+
+std::string MetadataCache::bootstrapFor(const std::string& brokers) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_brokers.empty() || brokers != m_cluster) return brokers;
+
+    std::vector<std::string> ordered;
+    std::set<std::string> seen;
+    auto add = [&](const std::string& address) {
+        if (!address.empty() && seen.insert(address).second) ordered.push_back(address);
+    };
+
+    std::istringstream configured(brokers);
+    std::string address;
+    while (std::getline(configured, address, ',')) add(address);
+    for (const auto& broker : m_brokers) add(broker.second);
+
+    std::string result;
+    for (const auto& a : ordered) {
+        if (!result.empty()) result += ',';
+        result += a;
+    }
+    return result;
+}
+
+void MetadataCache::recordMetadata(const struct rd_kafka_metadata* metadata) {
+    if (!metadata) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (int i = 0; i < metadata->broker_cnt; i++) {
+        const rd_kafka_metadata_broker& b = metadata->brokers[i];
+        std::string address = std::string(b.host) + ":" + std::to_string(b.port);
+        if (m_brokers[b.id] != address) {
+            m_brokers[b.id] = address;
+            m_dirty = true;
+        }
+    }
+
+    for (int t = 0; t < metadata->topic_cnt; t++) {
+        const rd_kafka_metadata_topic& mt = metadata->topics[t];
+        if (mt.err != RD_KAFKA_RESP_ERR_NO_ERROR) continue;
+        auto& partitions = m_topics[mt.topic];
+        for (int p = 0; p < mt.partition_cnt; p++) {
+            Partition& cached = partitions[mt.partitions[p].id];
+            if (cached.leader != mt.partitions[p].leader) {
+                cached.leader = mt.partitions[p].leader;
+                m_dirty = true;
+            }
+        }
+    }
+}
+
+void MetadataCache::recordWatermarks(const char* topic, int32_t partition, int64_t low, int64_t high) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Partition& cached = m_topics[topic][partition];
+    if (cached.low != low || cached.high != high) {
+        cached.low = low;
+        cached.high = high;
+        m_dirty = true;
+    }
+}
+
+void MetadataCache::save() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_dirty && !m_path.empty()) saveLocked();
+}
+
+void MetadataCache::saveLocked() {
+    const std::string tmpPath = m_path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        if (!out) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Cannot write %s", tmpPath.c_str());
+            return;
+        }
+        out << kHeader << '\n';
+        out << "cluster " << m_cluster << '\n';
+        for (const auto& broker : m_brokers) {
+            out << "broker " << broker.first << ' ' << broker.second << '\n';
+        }
+        for (const auto& topic : m_topics) {
+            for (const auto& p : topic.second) {
+                out << "partition " << topic.first << ' ' << p.first << ' ' << p.second.leader << ' '
+                    << p.second.low << ' ' << p.second.high << '\n';
+            }
+        }
+        if (!out.flush()) {
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), m_path.c_str()) == 0) {
+        m_dirty = false;
+    } else {
+        std::remove(tmpPath.c_str());
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef CHAT_OVER_KAFKA_METADATA_CACHE_H
+#define CHAT_OVER_KAFKA_METADATA_CACHE_H
+
+#include <rdkafka.h>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * Broker metadata persisted to app storage for fast cold starts.
+ *
+ * Remembers broker addresses, partition leaders and the last known
+ * watermarks of the channel topics. New clients get the remembered brokers
+ * as extra bootstrap candidates, so a cold start still connects when the
+ * configured address is unreachable. librdkafka picks bootstrap brokers in
+ * no particular order, so the list's order means nothing. Entries are
+ * refreshed from the metadata and watermark queries clients already make
+ * (see warmUp) and written back with a temp-file + rename so a crash never
+ * leaves a torn file.
+ */
+class MetadataCache {
+public:
+    struct Partition {
+        int32_t leader = -1;
+        int64_t low = -1;
+        int64_t high = -1;
+    };
+
+    static MetadataCache& instance();
+
+    /**
+     * Sets the backing file and loads it if present. Cached entries that
+     * were recorded for a different bootstrap list are discarded.
+     */
+    void setPath(const std::string& path, const std::string& brokers);
+
+    /**
+     * Returns `brokers` extended with the remembered broker addresses.
+     * Returns `brokers` unchanged while nothing is cached for that cluster.
+     */
+    std::string bootstrapFor(const std::string& brokers);
+
+    /** Records brokers and partition leaders from a metadata response. */
+    void recordMetadata(const struct rd_kafka_metadata* metadata);
+
+    void recordWatermarks(const char* topic, int32_t partition, int64_t low, int64_t high);
+
+    /** Writes the cache to disk if it changed since the last save. */
+    void save();
+
+private:
+    MetadataCache() = default;
+
+    void loadLocked();
+    void saveLocked();
+
+    std::mutex m_mutex;
+    std::string m_path;
+    std::string m_cluster;  // bootstrap list the entries belong to
+    bool m_dirty = false;
+    std::map<int32_t, std::string> m_brokers;  // id -> host:port
+    std::map<std::string, std::map<int32_t, Partition>> m_topics;
+};
+
+#endif //CHAT_OVER_KAFKA_METADATA_CACHE_H
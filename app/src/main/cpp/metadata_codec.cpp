@@ -0,0 +1,358 @@
+#include "metadata_codec.h"
+
+#include <algorithm>
+#include <map>
+
+// Timestamps are stored relative to this instant so current ones fit in
+// fewer varint bytes.
+static const int64_t kEpochBaseMs = 1704067200000LL;  // 2024-01-01T00:00:00Z
+static const int64_t kEpochBaseHour = kEpochBaseMs / 3600000;
+
+// Must match Reactions.EMOJIS on the Kotlin side; new emojis are appended.
+static const char* const kEmojiTable[] = {
+        "\xF0\x9F\x91\x8D",          // 👍
+        "\xE2\x9D\xA4\xEF\xB8\x8F",  // ❤️
+        "\xF0\x9F\x94\xA5",          // 🔥
+};
+static const uint64_t kEmojiCount = sizeof(kEmojiTable) / sizeof(kEmojiTable[0]);
+static const uint64_t kLiteralEmoji = 127;
+
+// Optional field tags.
+static const uint64_t kTagFrameIndex = 1;
+static const uint64_t kTagFrameKey = 2;
+static const uint64_t kTagFrameTimes = 3;
+static const uint64_t kTagAudioPartition = 4;
+
+namespace {
+
+void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void putZigzag(std::vector<uint8_t>& out, int64_t value) {
+    putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void putString(std::vector<uint8_t>& out, const std::string& s) {
+    putVarint(out, s.size());
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t len) : m_p(data), m_end(data + len) {}
+
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (m_p == m_end) return false;
+            uint8_t b = *m_p++;
+            value |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool zigzag(int64_t& value) {
+        uint64_t raw;
+        if (!varint(raw)) return false;
+        value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+        return true;
+    }
+
+    bool string(std::string& s) {
+        uint64_t len;
+        if (!varint(len) || len > remaining()) return false;
+        s.assign(reinterpret_cast<const char*>(m_p), len);
+        m_p += len;
+        return true;
+    }
+
+    bool bytes(const uint8_t*& p, size_t len) {
+        if (len > remaining()) return false;
+        p = m_p;
+        m_p += len;
+        return true;
+    }
+
+    bool byte(uint8_t& b) {
+        if (m_p == m_end) return false;
+        b = *m_p++;
+        return true;
+    }
+
+    size_t remaining() const { return static_cast<size_t>(m_end - m_p); }
+
+private:
+    const uint8_t* m_p;
+    const uint8_t* m_end;
+};
+
+// Emoji code: index into kEmojiTable, or kLiteralEmoji and the string.
+void putEmoji(std::vector<uint8_t>& out, const std::string& emoji) {
+    const char* const* known = std::find_if(kEmojiTable, kEmojiTable + kEmojiCount,
+                                            [&](const char* e) { return emoji == e; });
+    if (known != kEmojiTable + kEmojiCount) {
+        putVarint(out, static_cast<uint64_t>(known - kEmojiTable));
+    } else {
+        putVarint(out, kLiteralEmoji);
+        putString(out, emoji);
+    }
+}
+
+bool readEmoji(Reader& in, std::string& emoji) {
+    uint64_t code;
+    if (!in.varint(code)) return false;
+    if (code < kEmojiCount) {
+        emoji = kEmojiTable[code];
+        return true;
+    }
+    return code == kLiteralEmoji && in.string(emoji);
+}
+
+} // namespace
+
+void MetadataCodec::encode(const MetadataRecord& record, std::vector<uint8_t>& out) {
+    out.clear();
+    out.push_back(kMagic);
+    out.push_back(kVersion);
+    putVarint(out, static_cast<uint32_t>(record.channelId));
+    putZigzag(out, record.startOffset);
+    putVarint(out, static_cast<uint64_t>(std::max<int64_t>(record.endOffset - record.startOffset, 0)));
+    putZigzag(out, record.timestamp - kEpochBaseMs);
+    putVarint(out, static_cast<uint64_t>(std::max<int64_t>(record.messageCount, 0)));
+
+    // User dictionary: author first, then reactors as they appear.
+    std::vector<const std::string*> users{&record.userId};
+    std::map<std::string, size_t> index{{record.userId, 0}};
+    for (const auto& reaction : record.reactions) {
+        for (const auto& user : reaction.second) {
+            if (index.emplace(user, users.size()).second) users.push_back(&user);
+        }
+    }
+    putVarint(out, users.size());
+    for (const std::string* user : users) putString(out, *user);
+
+    const size_t bitsetBytes = (users.size() + 7) / 8;
+    putVarint(out, record.reactions.size());
+    for (const auto& reaction : record.reactions) {
+        putEmoji(out, reaction.first);
+        const size_t at = out.size();
+        out.resize(at + bitsetBytes, 0);
+        for (const auto& user : reaction.second) {
+            const size_t i = index[user];
+            out[at + i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+        }
+    }
+
+    if (!record.frameIndex.empty()) {
+        std::vector<uint8_t> field;
+        putVarint(field, record.frameIndex.size());
+        int64_t prevOffset = record.startOffset;
+        int64_t prevMs = 0;
+        for (const auto& point : record.frameIndex) {
+            putZigzag(field, point.first - prevOffset);
+            putVarint(field, static_cast<uint64_t>(std::max<int64_t>(point.second - prevMs, 0)));
+            prevOffset = point.first;
+            prevMs = std::max(point.second, prevMs);
+        }
+        putVarint(out, kTagFrameIndex);
+        putVarint(out, field.size());
+        out.insert(out.end(), field.begin(), field.end());
+    }
+
+    if (!record.frameKey.empty()) {
+        putVarint(out, kTagFrameKey);
+        putString(out, record.frameKey);
+    }
+
+    if (record.firstFrameTime > 0 && record.lastFrameTime >= record.firstFrameTime) {
+        std::vector<uint8_t> field;
+        putZigzag(field, record.firstFrameTime - kEpochBaseMs);
+        putVarint(field, static_cast<uint64_t>(record.lastFrameTime - record.firstFrameTime));
+        putVarint(out, kTagFrameTimes);
+        putVarint(out, field.size());
+        out.insert(out.end(), field.begin(), field.end());
+    }
+
+    if (record.audioPartition > 0) {
+        std::vector<uint8_t> field;
+        putVarint(field, static_cast<uint64_t>(record.audioPartition));
+        putVarint(out, kTagAudioPartition);
+        putVarint(out, field.size());
+        out.insert(out.end(), field.begin(), field.end());
+    }
+}
+
+bool MetadataCodec::decode(const uint8_t* data, size_t len, MetadataRecord& out) {
+    Reader in(data, len);
+    uint8_t magic, version;
+    if (!in.byte(magic) || magic != kMagic || !in.byte(version) || version < 1 || version > kVersion) {
+        return false;
+    }
+
+    uint64_t channelId, span, messageCount, userCount, reactionCount;
+    int64_t tsDelta;
+    if (!in.varint(channelId) || !in.zigzag(out.startOffset) || !in.varint(span) ||
+        !in.zigzag(tsDelta) || !in.varint(messageCount) || !in.varint(userCount) ||
+        userCount == 0 || userCount > in.remaining()) {
+        return false;
+    }
+    out.channelId = static_cast<int32_t>(channelId);
+    out.endOffset = out.startOffset + static_cast<int64_t>(span);
+    out.timestamp = tsDelta + kEpochBaseMs;
+    out.messageCount = static_cast<int64_t>(messageCount);
+
+    std::vector<std::string> users(userCount);
+    for (auto& user : users) {
+        if (!in.string(user)) return false;
+    }
+    out.userId = users[0];
+
+    const size_t bitsetBytes = (users.size() + 7) / 8;
+    if (!in.varint(reactionCount) || reactionCount > in.remaining()) return false;
+    out.reactions.clear();
+    out.reactions.reserve(reactionCount);
+    for (uint64_t r = 0; r < reactionCount; r++) {
+        std::string emoji;
+        if (!readEmoji(in, emoji)) return false;
+
+        const uint8_t* bits;
+        if (!in.bytes(bits, bitsetBytes)) return false;
+        std::vector<std::string> reactors;
+        for (size_t i = 0; i < users.size(); i++) {
+            if (bits[i / 8] & (1u << (i % 8))) reactors.push_back(users[i]);
+        }
+        out.reactions.emplace_back(std::move(emoji), std::move(reactors));
+    }
+
+    out.frameIndex.clear();
+    out.frameKey.clear();
+    out.firstFrameTime = 0;
+    out.lastFrameTime = 0;
+    out.audioPartition = 0;
+    while (in.remaining() > 0) {
+        uint64_t tag, fieldLen;
+        const uint8_t* payload;
+        if (!in.varint(tag) || !in.varint(fieldLen) || fieldLen > in.remaining() ||
+            !in.bytes(payload, static_cast<size_t>(fieldLen))) {
+            return false;
+        }
+        if (tag == kTagFrameIndex && !decodeFrameIndex(payload, static_cast<size_t>(fieldLen), out)) {
+            return false;
+        }
+        if (tag == kTagFrameKey) {
+            out.frameKey.assign(reinterpret_cast<const char*>(payload), static_cast<size_t>(fieldLen));
+        }
+        if (tag == kTagFrameTimes) {
+            Reader field(payload, static_cast<size_t>(fieldLen));
+            int64_t first;
+            uint64_t span;
+            if (!field.zigzag(first) || !field.varint(span)) return false;
+            out.firstFrameTime = first + kEpochBaseMs;
+            out.lastFrameTime = out.firstFrameTime + static_cast<int64_t>(span);
+        }
+        if (tag == kTagAudioPartition) {
+            Reader field(payload, static_cast<size_t>(fieldLen));
+            uint64_t partition;
+            if (!field.varint(partition)) return false;
+            out.audioPartition = static_cast<int32_t>(partition);
+        }
+        // Unknown tags come from newer writers and are skipped.
+    }
+    return true;
+}
+
+bool MetadataCodec::decodeFrameIndex(const uint8_t* data, size_t len, MetadataRecord& out) {
+    Reader in(data, len);
+    uint64_t count;
+    if (!in.varint(count) || count > len) return false;
+    out.frameIndex.reserve(count);
+    int64_t offset = out.startOffset;
+    int64_t mediaMs = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        int64_t offsetDelta;
+        uint64_t msDelta;
+        if (!in.zigzag(offsetDelta) || !in.varint(msDelta)) return false;
+        offset += offsetDelta;
+        mediaMs += static_cast<int64_t>(msDelta);
+        out.frameIndex.emplace_back(offset, mediaMs);
+    }
+    return true;
+}
+
+std::pair<int64_t, int64_t> MetadataCodec::seek(const std::vector<std::pair<int64_t, int64_t>>& frameIndex,
+                                                int64_t startOffset, int64_t mediaTimeMs) {
+    auto after = std::upper_bound(frameIndex.begin(), frameIndex.end(), mediaTimeMs,
+                                  [](int64_t ms, const std::pair<int64_t, int64_t>& point) {
+                                      return ms < point.second;
+                                  });
+    if (after == frameIndex.begin()) {
+        return {startOffset, 0};
+    }
+    return *(after - 1);
+}
+
+bool MetadataCodec::isBinary(const uint8_t* data, size_t len) {
+    return len >= 2 && data[0] == kMagic;
+}
+
+void MetadataCodec::encodeDelta(const ReactionDelta& delta, std::vector<uint8_t>& out) {
+    out.clear();
+    out.push_back(kDeltaMagic);
+    out.push_back(kVersion);
+    putVarint(out, static_cast<uint32_t>(delta.channelId));
+    putZigzag(out, delta.startOffset);
+    putEmoji(out, delta.emoji);
+    putString(out, delta.userId);
+    out.push_back(delta.added ? 1 : 0);
+    putZigzag(out, delta.timestamp - kEpochBaseMs);
+}
+
+bool MetadataCodec::decodeDelta(const uint8_t* data, size_t len, ReactionDelta& out) {
+    Reader in(data, len);
+    uint8_t magic, version, added;
+    uint64_t channelId;
+    int64_t tsDelta;
+    if (!in.byte(magic) || magic != kDeltaMagic || !in.byte(version) || version < 1 || version > kVersion ||
+        !in.varint(channelId) || !in.zigzag(out.startOffset) || !readEmoji(in, out.emoji) ||
+        !in.string(out.userId) || !in.byte(added) || !in.zigzag(tsDelta)) {
+        return false;
+    }
+    out.channelId = static_cast<int32_t>(channelId);
+    out.added = added != 0;
+    out.timestamp = tsDelta + kEpochBaseMs;
+    // Bytes after the timestamp come from newer writers and are ignored.
+    return true;
+}
+
+void MetadataCodec::encodeRollup(const RollupRecord& rollup, std::vector<uint8_t>& out) {
+    out.clear();
+    out.push_back(kRollupMagic);
+    out.push_back(kVersion);
+    putVarint(out, static_cast<uint32_t>(rollup.channelId));
+    putVarint(out, static_cast<uint64_t>(std::max<int64_t>(rollup.hour - kEpochBaseHour, 0)));
+    putString(out, rollup.userId);
+    putVarint(out, static_cast<uint64_t>(std::max<int64_t>(rollup.recordings, 0)));
+    putVarint(out, static_cast<uint64_t>(std::max<int64_t>(rollup.durationMs, 0)));
+}
+
+bool MetadataCodec::decodeRollup(const uint8_t* data, size_t len, RollupRecord& out) {
+    Reader in(data, len);
+    uint8_t magic, version;
+    uint64_t channelId, hour, recordings, durationMs;
+    if (!in.byte(magic) || magic != kRollupMagic || !in.byte(version) || version < 1 || version > kVersion ||
+        !in.varint(channelId) || !in.varint(hour) || !in.string(out.userId) ||
+        !in.varint(recordings) || !in.varint(durationMs)) {
+        return false;
+    }
+    out.channelId = static_cast<int32_t>(channelId);
+    out.hour = static_cast<int64_t>(hour) + kEpochBaseHour;
+    out.recordings = static_cast<int64_t>(recordings);
+    out.durationMs = static_cast<int64_t>(durationMs);
+    return true;
+}
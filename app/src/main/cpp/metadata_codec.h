@@ -0,0 +1,146 @@
+#ifndef CHAT_OVER_KAFKA_METADATA_CODEC_H
+#define CHAT_OVER_KAFKA_METADATA_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * One recording's metadata record, mirroring the Kotlin AudioMetadata.
+ */
+struct MetadataRecord {
+    std::string userId;
+    int32_t channelId = 0;
+    int64_t startOffset = 0;
+    int64_t endOffset = 0;
+    int64_t timestamp = 0;
+    int64_t messageCount = 0;
+    // emoji -> ids of the users who reacted with it
+    std::vector<std::pair<std::string, std::vector<std::string>>> reactions;
+    // Sparse (offset, media time in ms) points, ascending by media time
+    std::vector<std::pair<int64_t, int64_t>> frameIndex;
+    // Key of the recording's audio records; empty for records written
+    // before frames were keyed per session
+    std::string frameKey;
+    // Broker timestamps of the first and last audio frame; 0 when unknown
+    int64_t firstFrameTime = 0;
+    int64_t lastFrameTime = 0;
+    // Partition of the audio topic holding the frames
+    int32_t audioPartition = 0;
+};
+
+/**
+ * One user adding or removing one reaction on one recording. Deltas for the
+ * same (recording, emoji, user) resolve last-writer-wins by timestamp.
+ */
+struct ReactionDelta {
+    int32_t channelId = 0;
+    int64_t startOffset = 0;  // identifies the recording (AudioMetadata.recordingId)
+    std::string emoji;
+    std::string userId;
+    bool added = true;
+    int64_t timestamp = 0;
+};
+
+/**
+ * One speaker's activity on a channel during one clock hour. Counts only
+ * grow, so of two records for the same bucket the larger one is newer.
+ */
+struct RollupRecord {
+    int32_t channelId = 0;
+    int64_t hour = 0;  // hours since the Unix epoch
+    std::string userId;
+    int64_t recordings = 0;
+    int64_t durationMs = 0;
+};
+
+/**
+ * Compact binary encoding of metadata records, reaction deltas and hourly
+ * rollups.
+ *
+ * Layout (version 1):
+ *
+ *   magic 0xC7, version
+ *   varint channelId
+ *   zigzag startOffset, varint (endOffset - startOffset)
+ *   zigzag (timestamp - 2024-01-01T00:00Z in ms), varint messageCount
+ *   varint userCount, then each user id as varint length + UTF-8;
+ *     user 0 is the author, the rest are reactors in first-seen order
+ *   varint reactionCount, then per reaction:
+ *     varint emoji code (index into the shared emoji table, or
+ *     kLiteralEmoji followed by a length-prefixed string) and a bitset of
+ *     ceil(userCount / 8) bytes selecting the reacting users
+ *   optional fields until the end: varint tag, varint length, payload
+ *     (decoders skip tags they do not know)
+ *
+ * Optional fields:
+ *
+ *   1 frame index: varint count, then per point zigzag offset delta and
+ *     varint media-time delta, both relative to the previous point (the
+ *     first offset relative to startOffset)
+ *   2 frame key: the raw key bytes of the recording's audio records
+ *   3 frame times: zigzag (firstFrameTime - 2024-01-01T00:00Z in ms),
+ *     varint (lastFrameTime - firstFrameTime)
+ *   4 audio partition: varint; absent for partition 0
+ *
+ * Reaction deltas (version 1):
+ *
+ *   magic 0xC8, version
+ *   varint channelId, zigzag startOffset
+ *   emoji code as above, user id as varint length + UTF-8
+ *   byte 1 = added / 0 = removed
+ *   zigzag (timestamp - 2024-01-01T00:00Z in ms)
+ *
+ * Hourly rollups (version 1):
+ *
+ *   magic 0xC9, version
+ *   varint channelId, varint (hour - 2024-01-01T00:00Z in hours)
+ *   user id as varint length + UTF-8
+ *   varint recordings, varint durationMs
+ *
+ * JSON records start with '{' (after optional whitespace) and never with a
+ * magic byte, so every kind of record can share the topic.
+ *
+ * Version 1 grows through optional fields. A record with a newer version
+ * changed the layout above them, so decoders reject it rather than misparse
+ * it; readers skip such records like any other malformed one.
+ */
+class MetadataCodec {
+public:
+    static constexpr uint8_t kMagic = 0xC7;
+    static constexpr uint8_t kDeltaMagic = 0xC8;
+    static constexpr uint8_t kRollupMagic = 0xC9;
+    static constexpr uint8_t kVersion = 1;
+
+    static void encode(const MetadataRecord& record, std::vector<uint8_t>& out);
+
+    /** Returns false if `data` is not a well-formed binary record. */
+    static bool decode(const uint8_t* data, size_t len, MetadataRecord& out);
+
+    /** True if `data` starts like a binary record. */
+    static bool isBinary(const uint8_t* data, size_t len);
+
+    static void encodeDelta(const ReactionDelta& delta, std::vector<uint8_t>& out);
+
+    /** Returns false if `data` is not a well-formed reaction delta. */
+    static bool decodeDelta(const uint8_t* data, size_t len, ReactionDelta& out);
+
+    static void encodeRollup(const RollupRecord& rollup, std::vector<uint8_t>& out);
+
+    /** Returns false if `data` is not a well-formed rollup. */
+    static bool decodeRollup(const uint8_t* data, size_t len, RollupRecord& out);
+
+    /**
+     * Finds the last frame index point at or before `mediaTimeMs`. Falls back
+     * to (`startOffset`, 0) when no point qualifies.
+     */
+    static std::pair<int64_t, int64_t> seek(const std::vector<std::pair<int64_t, int64_t>>& frameIndex,
+                                            int64_t startOffset, int64_t mediaTimeMs);
+
+private:
+    static bool decodeFrameIndex(const uint8_t* data, size_t len, MetadataRecord& out);
+};
+
+#endif //CHAT_OVER_KAFKA_METADATA_CODEC_H
@@ -0,0 +1,204 @@
+#include "native_log.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+static const char* const LOG_TAG = "NativeLog";
+
+// How long queued lines may wait before they reach logcat.
+static const auto kDrainInterval = std::chrono::milliseconds(50);
+
+// Per facility, unless set otherwise.
+static const int kDefaultPerSecond = 50;
+
+static void copyTruncated(char* dst, size_t capacity, const char* src) {
+    size_t len = src ? strnlen(src, capacity - 1) : 0;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static uint64_t hashName(const char* name) {
+    // FNV-1a; 0 marks a free facility
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char* p = name; *p; p++) {
+        hash = (hash ^ static_cast<uint8_t>(*p)) * 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+NativeLog& NativeLog::instance() {
+    static NativeLog log;
+    return log;
+}
+
+NativeLog::NativeLog() : m_defaultPerSecond(kDefaultPerSecond) {
+    for (size_t i = 0; i < kCapacity; i++) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    Facility& overflow = m_facilities[kFacilities];
+    copyTruncated(overflow.name, kTagLen, "(other)");
+    overflow.named.store(true, std::memory_order_release);
+
+    m_thread = std::thread(&NativeLog::run, this);
+}
+
+NativeLog::~NativeLog() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void NativeLog::setLevel(int priority) {
+    m_level.store(priority, std::memory_order_relaxed);
+}
+
+void NativeLog::setRate(const char* facilityName, int perSecond, int sampleEvery) {
+    perSecond = perSecond > 0 ? perSecond : 0;
+    sampleEvery = sampleEvery > 1 ? sampleEvery : 1;
+    if (!facilityName || !*facilityName) {
+        m_defaultPerSecond.store(perSecond, std::memory_order_relaxed);
+        m_defaultSampleEvery.store(sampleEvery, std::memory_order_relaxed);
+        return;
+    }
+    Facility& f = facility(facilityName);
+    f.perSecond.store(perSecond, std::memory_order_relaxed);
+    f.sampleEvery.store(sampleEvery, std::memory_order_relaxed);
+}
+
+NativeLog::Facility& NativeLog::facility(const char* name) {
+    const uint64_t hash = hashName(name);
+    for (size_t probe = 0; probe < kFacilities; probe++) {
+        Facility& f = m_facilities[(hash + probe) % kFacilities];
+        uint64_t seen = f.hash.load(std::memory_order_acquire);
+        if (seen == 0 && f.hash.compare_exchange_strong(seen, hash, std::memory_order_acq_rel)) {
+            copyTruncated(f.name, kTagLen, name);
+            f.named.store(true, std::memory_order_release);
+            return f;
+        }
+        if (seen == hash) return f;
+    }
+    return m_facilities[kFacilities];
+}
+
+bool NativeLog::admit(int priority, const char* facilityName) {
+    if (priority < m_level.load(std::memory_order_relaxed)) return false;
+    if (priority >= ANDROID_LOG_ERROR) return true;
+
+    Facility& f = facility(facilityName ? facilityName : "");
+
+    if (priority <= ANDROID_LOG_DEBUG) {
+        int sampleEvery = f.sampleEvery.load(std::memory_order_relaxed);
+        if (sampleEvery < 0) sampleEvery = m_defaultSampleEvery.load(std::memory_order_relaxed);
+        if (sampleEvery > 1 && f.seen.fetch_add(1, std::memory_order_relaxed) % sampleEvery != 0) {
+            return false;
+        }
+    }
+
+    int perSecond = f.perSecond.load(std::memory_order_relaxed);
+    if (perSecond < 0) perSecond = m_defaultPerSecond.load(std::memory_order_relaxed);
+    if (perSecond == 0) return true;
+
+    const int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t window = f.window.load(std::memory_order_relaxed);
+    // Whoever moves the window resets its count; a racing writer may count
+    // against either second, which only blurs the boundary
+    if (window != second && f.window.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        f.inWindow.store(0, std::memory_order_relaxed);
+    }
+    if (f.inWindow.fetch_add(1, std::memory_order_relaxed) >= perSecond) {
+        f.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+NativeLog::Slot* NativeLog::claim() {
+    uint64_t pos = m_tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = m_slots[pos & (kCapacity - 1)];
+        const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        const int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+        if (diff == 0) {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return &slot;
+        } else if (diff < 0) {
+            // The drain thread has not freed this slot yet: the ring is full
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void NativeLog::publish(Slot* slot) {
+    // The slot at `pos` was claimed at sequence `pos`; pos + 1 hands it to the drain thread
+    slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void NativeLog::push(int priority, const char* tag, const char* facilityName, const char* text) {
+    Slot* slot = claim();
+    if (!slot) return;
+    slot->priority = priority;
+    copyTruncated(slot->tag, kTagLen, tag);
+    copyTruncated(slot->facility, kTagLen, facilityName);
+    copyTruncated(slot->text, kTextLen, text);
+    publish(slot);
+}
+
+void NativeLog::print(int priority, const char* tag, const char* fmt, ...) {
+    if (!admit(priority, tag)) return;
+    Slot* slot = claim();
+    if (!slot) return;
+    slot->priority = priority;
+    copyTruncated(slot->tag, kTagLen, tag);
+    slot->facility[0] = '\0';
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(slot->text, kTextLen, fmt, args);
+    va_end(args);
+    publish(slot);
+}
+
+void NativeLog::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        lock.unlock();
+        drain();
+        lock.lock();
+        m_cv.wait_for(lock, kDrainInterval, [this] { return m_stop; });
+    }
+    lock.unlock();
+    drain();
+}
+
+void NativeLog::drain() {
+    for (;;) {
+        Slot& slot = m_slots[m_head & (kCapacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) break;  // empty, or still being written
+        if (slot.facility[0]) {
+            __android_log_print(slot.priority, slot.tag, "[%s] %s", slot.facility, slot.text);
+        } else {
+            __android_log_write(slot.priority, slot.tag, slot.text);
+        }
+        slot.sequence.store(m_head + kCapacity, std::memory_order_release);
+        m_head++;
+    }
+
+    for (Facility& f : m_facilities) {
+        if (!f.named.load(std::memory_order_acquire)) continue;
+        const uint32_t suppressed = f.suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed > 0) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "%u %s messages rate-limited", suppressed, f.name);
+        }
+    }
+    const uint32_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "%u messages dropped, log queue full", dropped);
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef CHAT_OVER_KAFKA_NATIVE_LOG_H
+#define CHAT_OVER_KAFKA_NATIVE_LOG_H
+
+#include <android/log.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/**
+ * Asynchronous, rate-limited logging for threads that must not block:
+ * librdkafka's broker threads, delivery reports, the audio path and the
+ * Kotlin consume loop.
+ *
+ * A message first passes the level, then its facility's sampling (debug and
+ * verbose only: one in `sampleEvery` is kept) and rate limit (at most
+ * `perSecond` per second; errors are never limited). Only then is it copied,
+ * or formatted, into a slot of a fixed ring; writers claim slots with a CAS
+ * and never wait for a lock or the log device. A background thread drains
+ * the ring every few milliseconds, composes the lines and writes them to
+ * logcat, followed by how many were rate-limited or lost to a full ring.
+ *
+ * Facilities are the Android tags of native and Kotlin callers and the
+ * facilities librdkafka passes to its log callback ("BROKER", "FETCH", ...).
+ * Levels are Android log priorities (ANDROID_LOG_DEBUG, ...).
+ */
+class NativeLog {
+public:
+    static NativeLog& instance();
+
+    NativeLog(const NativeLog&) = delete;
+    NativeLog& operator=(const NativeLog&) = delete;
+
+    /** Messages below `priority` are discarded before anything else happens. */
+    void setLevel(int priority);
+    int level() const { return m_level.load(std::memory_order_relaxed); }
+
+    /**
+     * Limits `facility` to `perSecond` messages (0: unlimited) and keeps one
+     * debug message in `sampleEvery`. An empty facility sets the defaults of
+     * every facility without its own limits.
+     */
+    void setRate(const char* facility, int perSecond, int sampleEvery);
+
+    /** Whether a message of `facility` at `priority` would be logged now; counts it if so. */
+    bool admit(int priority, const char* facility);
+
+    /** Queues `text`, already admitted. `facility` is printed before it unless empty. */
+    void push(int priority, const char* tag, const char* facility, const char* text);
+
+    /** Admits and queues `text`. */
+    void log(int priority, const char* tag, const char* facility, const char* text) {
+        if (admit(priority, facility)) push(priority, tag, facility, text);
+    }
+
+    /** Admits a message of facility `tag`, then formats it straight into the ring. */
+    void print(int priority, const char* tag, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+
+private:
+    static const size_t kCapacity = 256;  // slots, a power of two
+    static const size_t kFacilities = 64;
+    static const size_t kTagLen = 24;
+    static const size_t kTextLen = 480;
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        int priority = 0;
+        char tag[kTagLen] = {};
+        char facility[kTagLen] = {};
+        char text[kTextLen] = {};
+    };
+
+    struct Facility {
+        std::atomic<uint64_t> hash{0};       // 0: free
+        std::atomic<bool> named{false};      // name below is complete
+        char name[kTagLen] = {};
+        std::atomic<int> perSecond{-1};      // -1: the default
+        std::atomic<int> sampleEvery{-1};
+        std::atomic<int64_t> window{-1};     // the second inWindow counts
+        std::atomic<int> inWindow{0};
+        std::atomic<uint32_t> seen{0};       // debug messages, for sampling
+        std::atomic<uint32_t> suppressed{0}; // rate-limited since the last report
+    };
+
+    NativeLog();
+    ~NativeLog();
+
+    Facility& facility(const char* name);
+    Slot* claim();
+    void publish(Slot* slot);
+    void run();
+    void drain();
+
+    std::atomic<int> m_level{ANDROID_LOG_INFO};
+    std::atomic<int> m_defaultPerSecond;
+    std::atomic<int> m_defaultSampleEvery{1};
+
+    Slot m_slots[kCapacity];
+    std::atomic<uint64_t> m_tail{0};    // next slot to claim
+    uint64_t m_head = 0;                // next slot to drain, drain thread only
+    std::atomic<uint32_t> m_dropped{0}; // lost to a full ring since the last report
+
+    Facility m_facilities[kFacilities + 1];  // the last one takes whatever does not fit
+
+    std::mutex m_mutex;  // only for the drain thread's sleep
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+#endif //CHAT_OVER_KAFKA_NATIVE_LOG_H
@@ -6,6 +6,31 @@
 #include <cstdint>
 #include <memory>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+#include "nativelib.h"
+#include "activity_monitor.h"
+#include "client_pool.h"
+#include "connection_tracker.h"
+#include "frame_cipher.h"
+#include "frame_pipeline.h"
+#include "memory_budget.h"
+#include "metadata_cache.h"
+#include "metadata_codec.h"
+#include "native_log.h"
+#include "playout_merger.h"
+#include "reaction_aggregator.h"
+#include "reactor.h"
+#include "reaper.h"
+#include "recording_session.h"
+#include "rollup_store.h"
+#include "speaker_partitioner.h"
+#include "timeline_index.h"
+#include "timeline_snapshot.h"
+#include "tls_context.h"
 
 // --- C++ Best Practices & Helpers ---
 
@@ -54,6 +79,62 @@ void throwJavaException(JNIEnv *env, const char *msg) {
     env->DeleteLocalRef(exc);
 }
 
+/**
+ * JNI strings use "modified" UTF-8: supplementary characters (most emoji)
+ * arrive as two 3-byte surrogates and NUL as C0 80. Anything persisted or
+ * compared against standard UTF-8 goes through these two converters.
+ */
+static std::string fromModifiedUtf8(const char* s) {
+    std::string out;
+    if (!s) return out;
+    const auto* p = reinterpret_cast<const unsigned char*>(s);
+    while (*p) {
+        if (p[0] == 0xED && (p[1] & 0xF0) == 0xA0 && p[2] && p[3] == 0xED && (p[4] & 0xF0) == 0xB0 && p[5]) {
+            uint32_t high = ((p[1] & 0x0F) << 6) | (p[2] & 0x3F);
+            uint32_t low = ((p[4] & 0x0F) << 6) | (p[5] & 0x3F);
+            uint32_t cp = 0x10000 + (high << 10) + low;
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+            p += 6;
+        } else if (p[0] == 0xC0 && p[1] == 0x80) {
+            out += '\0';
+            p += 2;
+        } else {
+            out += static_cast<char>(*p++);
+        }
+    }
+    return out;
+}
+
+static jstring newStringFromUtf8(JNIEnv* env, const std::string& s) {
+    std::string modified;
+    modified.reserve(s.size() + 8);
+    const auto* p = reinterpret_cast<const unsigned char*>(s.data());
+    const auto* end = p + s.size();
+    while (p < end) {
+        if ((p[0] & 0xF8) == 0xF0 && end - p >= 4) {
+            uint32_t cp = ((p[0] & 0x07) << 18) | ((p[1] & 0x3F) << 12) | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+            cp -= 0x10000;
+            const uint32_t units[2] = { 0xD800 + (cp >> 10), 0xDC00 + (cp & 0x3FF) };
+            for (uint32_t u : units) {
+                modified += static_cast<char>(0xE0 | (u >> 12));
+                modified += static_cast<char>(0x80 | ((u >> 6) & 0x3F));
+                modified += static_cast<char>(0x80 | (u & 0x3F));
+            }
+            p += 4;
+        } else if (p[0] == 0) {
+            modified += static_cast<char>(0xC0);
+            modified += static_cast<char>(0x80);
+            p++;
+        } else {
+            modified += static_cast<char>(*p++);
+        }
+    }
+    return env->NewStringUTF(modified.c_str());
+}
+
 // --- JNI Implementations ---
 
 extern "C" {
@@ -81,7 +162,8 @@ void kafka_log_callback(const rd_kafka_t* /*rk*/, int level, const char* fac, co
             android_level = ANDROID_LOG_DEBUG;
             break;
     }
-    __android_log_print(android_level, LOG_TAG, "[%s] %s", fac, buf);
+    // Called on librdkafka's broker threads: queue the line, never wait for logcat
+    NativeLog::instance().log(android_level, LOG_TAG, fac, buf);
 }
 
 JNIEXPORT jstring JNICALL
@@ -115,161 +197,162 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_createConsumerMTLS(
         return 0;
     }
 
-    const char* brokers = env->GetStringUTFChars(jbrokers, nullptr);
-    const char* groupId = env->GetStringUTFChars(jgroupId, nullptr);
-    const char* caCertPath = env->GetStringUTFChars(jcaCertPath, nullptr);
-    const char* clientCertPath = env->GetStringUTFChars(jclientCertPath, nullptr);
-    const char* clientKeyPath = env->GetStringUTFChars(jclientKeyPath, nullptr);
-    const char* offsetStrategy = joffsetStrategy ? env->GetStringUTFChars(joffsetStrategy, nullptr) : "latest";
+    JniStringWrapper brokers(env, jbrokers);
+    JniStringWrapper groupId(env, jgroupId);
+    JniStringWrapper caCert(env, jcaCertPath);
+    JniStringWrapper clientCert(env, jclientCertPath);
+    JniStringWrapper clientKey(env, jclientKeyPath);
+    JniStringWrapper offsetStrategyArg(env, joffsetStrategy);
+    const char* offsetStrategy = offsetStrategyArg.get() ? offsetStrategyArg.get() : "latest";
 
-    if (!brokers || !groupId || !caCertPath || !clientCertPath || !clientKeyPath) {
-        if (brokers) env->ReleaseStringUTFChars(jbrokers, brokers);
-        if (groupId) env->ReleaseStringUTFChars(jgroupId, groupId);
-        if (caCertPath) env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-        if (clientCertPath) env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-        if (clientKeyPath) env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-        if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
+    if (!brokers.get() || !groupId.get() || !caCert.get() || !clientCert.get() || !clientKey.get()) {
         throwJavaException(env, "Failed to get strings from JNI");
         return 0;
     }
 
+    std::string tlsError;
+    std::shared_ptr<TlsContext> tls = TlsContext::acquire(caCert, clientCert, clientKey, tlsError);
+    if (!tls) {
+        throwJavaException(env, tlsError.c_str());
+        return 0;
+    }
+
     char errstr[512];
-    rd_kafka_conf_t* conf = rd_kafka_conf_new();
+    auto conf_deleter = [](rd_kafka_conf_t *c) { rd_kafka_conf_destroy(c); };
+    std::unique_ptr<rd_kafka_conf_t, decltype(conf_deleter)> conf_ptr(rd_kafka_conf_new(), conf_deleter);
 
-    // Set bootstrap servers
-    if (rd_kafka_conf_set(conf, "bootstrap.servers", brokers, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        env->ReleaseStringUTFChars(jbrokers, brokers);
-        env->ReleaseStringUTFChars(jgroupId, groupId);
-        env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-        env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-        env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-        if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
-        rd_kafka_conf_destroy(conf);
+    // Set bootstrap servers, plus the broker addresses remembered for this cluster
+    const std::string bootstrap = MetadataCache::instance().bootstrapFor(brokers.get());
+    if (rd_kafka_conf_set(conf_ptr.get(), "bootstrap.servers", bootstrap.c_str(), errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
         throwJavaException(env, errstr);
         return 0;
     }
 
     // Set group ID
-    if (rd_kafka_conf_set(conf, "group.id", groupId, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        env->ReleaseStringUTFChars(jbrokers, brokers);
-        env->ReleaseStringUTFChars(jgroupId, groupId);
-        env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-        env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-        env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-        if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
-        rd_kafka_conf_destroy(conf);
+    if (rd_kafka_conf_set(conf_ptr.get(), "group.id", groupId, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
         throwJavaException(env, errstr);
         return 0;
     }
 
-    // Set security protocol to SSL
-    if (rd_kafka_conf_set(conf, "security.protocol", "SSL", errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        env->ReleaseStringUTFChars(jbrokers, brokers);
-        env->ReleaseStringUTFChars(jgroupId, groupId);
-        env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-        env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-        env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-        if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
-        rd_kafka_conf_destroy(conf);
+    // Shared mTLS material (security protocol, CA, client certificate and key)
+    if (!tls->apply(conf_ptr.get(), errstr, sizeof(errstr))) {
         throwJavaException(env, errstr);
         return 0;
     }
 
-    // Set CA certificate
-    if (rd_kafka_conf_set(conf, "ssl.ca.location", caCertPath, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        env->ReleaseStringUTFChars(jbrokers, brokers);
-        env->ReleaseStringUTFChars(jgroupId, groupId);
-        env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-        env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-        env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-        if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
-        rd_kafka_conf_destroy(conf);
+    // Tracked sockets so network handoffs reconnect in place
+    if (!ConnectionTracker::instance().apply(conf_ptr.get(), errstr, sizeof(errstr))) {
         throwJavaException(env, errstr);
         return 0;
     }
 
-    // Set client certificate
-    if (rd_kafka_conf_set(conf, "ssl.certificate.location", clientCertPath, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        env->ReleaseStringUTFChars(jbrokers, brokers);
-        env->ReleaseStringUTFChars(jgroupId, groupId);
-        env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-        env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-        env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-        if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
-        rd_kafka_conf_destroy(conf);
+    // Set auto.offset.reset based on provided strategy
+    if (rd_kafka_conf_set(conf_ptr.get(), "auto.offset.reset", offsetStrategy, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
         throwJavaException(env, errstr);
         return 0;
     }
 
-    // Set client key
-    if (rd_kafka_conf_set(conf, "ssl.key.location", clientKeyPath, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        env->ReleaseStringUTFChars(jbrokers, brokers);
-        env->ReleaseStringUTFChars(jgroupId, groupId);
-        env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-        env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-        env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-        if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
-        rd_kafka_conf_destroy(conf);
+    // Queue and fetch limits derived from the process memory budget
+    if (!MemoryBudget::instance().apply(conf_ptr.get(), ClientRole::Consumer, errstr, sizeof(errstr))) {
         throwJavaException(env, errstr);
         return 0;
     }
 
-    // Set auto.offset.reset based on provided strategy
-    if (rd_kafka_conf_set(conf, "auto.offset.reset", offsetStrategy, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
-        env->ReleaseStringUTFChars(jbrokers, brokers);
-        env->ReleaseStringUTFChars(jgroupId, groupId);
-        env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-        env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-        env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-        if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
-        rd_kafka_conf_destroy(conf);
+    // Create consumer (rd_kafka_new takes ownership of the config on success)
+    rd_kafka_t* consumer = rd_kafka_new(RD_KAFKA_CONSUMER, conf_ptr.get(), errstr, sizeof(errstr));
+    if (!consumer) {
         throwJavaException(env, errstr);
         return 0;
     }
-
-    // Create consumer
-    rd_kafka_t* consumer = rd_kafka_new(RD_KAFKA_CONSUMER, conf, errstr, sizeof(errstr));
-
-    env->ReleaseStringUTFChars(jbrokers, brokers);
-    env->ReleaseStringUTFChars(jgroupId, groupId);
-    env->ReleaseStringUTFChars(jcaCertPath, caCertPath);
-    env->ReleaseStringUTFChars(jclientCertPath, clientCertPath);
-    env->ReleaseStringUTFChars(jclientKeyPath, clientKeyPath);
-    if (offsetStrategy && joffsetStrategy) env->ReleaseStringUTFChars(joffsetStrategy, offsetStrategy);
-
-    if (!consumer) {
-        rd_kafka_conf_destroy(conf);
-        throwJavaException(env, errstr);
+    conf_ptr.release();
+    std::string budgetError;
+    if (!MemoryBudget::instance().track(consumer, ClientRole::Consumer, budgetError)) {
+        rd_kafka_destroy(consumer);
+        throwJavaException(env, budgetError.c_str());
         return 0;
     }
+    Reactor::instance().attach(consumer);
 
     return reinterpret_cast<jlong>(consumer);
 }
 
 
-struct DeliveryState {
+// Deadline for the synchronous closeConsumer/destroyProducer wrappers.
+static const int kDefaultCloseDeadlineMs = 3000;
+
+// Wakes a caller blocked on one message in awaitDelivery().
+struct DeliveryState : DeliveryListener {
     std::mutex mtx;
     std::condition_variable cv;
     std::atomic<bool> done{false};
     rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
     int32_t partition = -1;
     int64_t offset = -1;
+    // Broker LogAppendTime on topics configured for it, else the CreateTime; -1 if unknown
+    int64_t timestamp = -1;
+    std::chrono::steady_clock::time_point reportedAt;
+
+    void onDelivery(const rd_kafka_message_t* msg) override {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            err = msg->err;
+            partition = msg->partition;
+            offset = msg->offset;
+            timestamp = rd_kafka_message_timestamp(msg, nullptr);
+            reportedAt = std::chrono::steady_clock::now();
+        }
+
+        done.store(true, std::memory_order_release);
+        cv.notify_one();
+    }
 };
-static void delivery_report_cb(rd_kafka_t*,
-                               const rd_kafka_message_t* msg,
-                               void*) {
-    auto* state = static_cast<DeliveryState*>(msg->_private);
-    if (!state) return;
+void delivery_report_cb(rd_kafka_t*,
+                        const rd_kafka_message_t* msg,
+                        void*) {
+    // Every opaque a producer is given is a DeliveryListener
+    auto* listener = static_cast<DeliveryListener*>(msg->_private);
+    if (listener) listener->onDelivery(msg);
+}
 
-    {
-        std::lock_guard<std::mutex> lock(state->mtx);
-        state->err = msg->err;
-        state->partition = msg->partition;
-        state->offset = msg->offset;
+/**
+ * Blocks until `state` has its delivery report. Handles served by the
+ * reactor only need to wait on the condition variable; anything else still
+ * has to drive its own main queue.
+ */
+static void awaitDelivery(rd_kafka_t* producer, DeliveryState& state) {
+    const bool reactorServed = Reactor::instance().serves(producer);
+    while (!state.done.load(std::memory_order_acquire)) {
+        if (!reactorServed) {
+            rd_kafka_poll(producer, 100);
+        }
+        std::unique_lock<std::mutex> lock(state.mtx);
+        if (reactorServed) {
+            state.cv.wait(lock, [&state] { return state.done.load(std::memory_order_acquire); });
+        } else {
+            state.cv.wait_for(lock, std::chrono::milliseconds(50));
+        }
     }
 
-    state->done.store(true, std::memory_order_release);
-    state->cv.notify_one();
+    std::lock_guard<std::mutex> lock(state.mtx);
+    Reactor::instance().recordDeliveryWake(std::chrono::steady_clock::now() - state.reportedAt);
+}
+
+/**
+ * The producer of QoS class `qos` for the pooled producer `producerPtr`
+ * (see ClientPool::forQos). Throws and returns nullptr on failure.
+ */
+static rd_kafka_t* producerFor(JNIEnv* env, jlong producerPtr, jint qos) {
+    if (qos < static_cast<jint>(QosClass::Realtime) || qos > static_cast<jint>(QosClass::Ordered)) {
+        throwJavaException(env, "Unknown QoS class");
+        return nullptr;
+    }
+    std::string error;
+    rd_kafka_t* producer = ClientPool::instance().forQos(
+            reinterpret_cast<rd_kafka_t*>(producerPtr), static_cast<QosClass>(qos), error);
+    if (!producer) {
+        throwJavaException(env, error.c_str());
+    }
+    return producer;
 }
 
 
@@ -295,29 +378,40 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_createProducerMTLS(
     auto conf_deleter = [](rd_kafka_conf_t *c) { rd_kafka_conf_destroy(c); };
     std::unique_ptr<rd_kafka_conf_t, decltype(conf_deleter)> conf_ptr(conf, conf_deleter);
 
+    std::string tlsError;
+    std::shared_ptr<TlsContext> tls = TlsContext::acquire(caCert, clientCert, clientKey, tlsError);
+    if (!tls) {
+        throwJavaException(env, tlsError.c_str());
+        return 0;
+    }
+
     // --- Configuration ---
-    if (rd_kafka_conf_set(conf_ptr.get(), "bootstrap.servers", brokers, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+    const std::string bootstrap = MetadataCache::instance().bootstrapFor(brokers.get());
+    if (rd_kafka_conf_set(conf_ptr.get(), "bootstrap.servers", bootstrap.c_str(), errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
         throwJavaException(env, errstr);
         return 0;
     }
-    if (rd_kafka_conf_set(conf_ptr.get(), "security.protocol", "SSL", errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+    if (!tls->apply(conf_ptr.get(), errstr, sizeof(errstr))) {
         throwJavaException(env, errstr);
         return 0;
     }
-    if (rd_kafka_conf_set(conf_ptr.get(), "ssl.ca.location", caCert, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+    if (!ConnectionTracker::instance().apply(conf_ptr.get(), errstr, sizeof(errstr))) {
         throwJavaException(env, errstr);
         return 0;
     }
-    if (rd_kafka_conf_set(conf_ptr.get(), "ssl.certificate.location", clientCert, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+    if (!MemoryBudget::instance().apply(conf_ptr.get(), ClientRole::Producer, errstr, sizeof(errstr))) {
         throwJavaException(env, errstr);
         return 0;
     }
-    if (rd_kafka_conf_set(conf_ptr.get(), "ssl.key.location", clientKey, errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+
+    if (!ClientPool::applyQos(conf_ptr.get(), QosClass::Durable, errstr, sizeof(errstr))) {
+        throwJavaException(env, errstr);
+        return 0;
+    }
+    if (!SpeakerPartitioner::instance().apply(conf_ptr.get(), errstr, sizeof(errstr))) {
         throwJavaException(env, errstr);
         return 0;
     }
-
-    rd_kafka_conf_set(conf_ptr.get(), "acks", "all", errstr, sizeof(errstr));
     rd_kafka_conf_set_log_cb(conf_ptr.get(), kafka_log_callback);
     rd_kafka_conf_set_dr_msg_cb(conf, delivery_report_cb);
 
@@ -329,6 +423,13 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_createProducerMTLS(
         throwJavaException(env, errstr);
         return 0;
     }
+    std::string budgetError;
+    if (!MemoryBudget::instance().track(producer, ClientRole::Producer, budgetError)) {
+        rd_kafka_destroy(producer);
+        throwJavaException(env, budgetError.c_str());
+        return 0;
+    }
+    Reactor::instance().attach(producer);
 
     return reinterpret_cast<jlong>(producer);
 }
@@ -339,14 +440,16 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytes(
         jlong producerPtr,
         jstring jtopic,
         jbyteArray jkey,
-        jbyteArray jvalue) {
+        jbyteArray jvalue,
+        jint qos) {
 
     if (!producerPtr || !jtopic || !jvalue) {
         throwJavaException(env, "Invalid arguments");
         return nullptr;
     }
 
-    auto* producer = reinterpret_cast<rd_kafka_t*>(producerPtr);
+    rd_kafka_t* producer = producerFor(env, producerPtr, qos);
+    if (!producer) return nullptr;
 
     // ---- Topic ----
     const char* topic = env->GetStringUTFChars(jtopic, nullptr);
@@ -389,7 +492,7 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytes(
                 RD_KAFKA_V_KEY(key_bytes, key_len),
                 RD_KAFKA_V_VALUE(value_bytes, value_len),
                 RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
-                RD_KAFKA_V_OPAQUE(&state),
+                RD_KAFKA_V_OPAQUE(static_cast<DeliveryListener*>(&state)),
                 RD_KAFKA_V_END
         );
     } else {
@@ -398,7 +501,7 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytes(
                 RD_KAFKA_V_TOPIC(topic),
                 RD_KAFKA_V_VALUE(value_bytes, value_len),
                 RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
-                RD_KAFKA_V_OPAQUE(&state),
+                RD_KAFKA_V_OPAQUE(static_cast<DeliveryListener*>(&state)),
                 RD_KAFKA_V_END
         );
     }
@@ -416,15 +519,7 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytes(
     }
 
     // ---- Block until delivery ----
-    while (true) {
-        rd_kafka_poll(producer, 100);
-
-        std::unique_lock<std::mutex> lock(state.mtx);
-        if (state.done)
-            break;
-
-        state.cv.wait_for(lock, std::chrono::milliseconds(50));
-    }
+    awaitDelivery(producer, state);
 
     if (state.err != RD_KAFKA_RESP_ERR_NO_ERROR) {
         throwJavaException(env, rd_kafka_err2str(state.err));
@@ -434,13 +529,14 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytes(
     // ---- Build Kotlin RecordMetadata ----
     jclass cls = env->FindClass(
             "org/github/cyterdan/chat_over_kafka/RecordMetadata");
-    jmethodID ctor = env->GetMethodID(cls, "<init>", "(IJ)V");
+    jmethodID ctor = env->GetMethodID(cls, "<init>", "(IJJ)V");
 
     return env->NewObject(
             cls,
             ctor,
             state.partition,
-            (jlong)state.offset
+            (jlong)state.offset,
+            (jlong)state.timestamp
     );
 }
 
@@ -452,14 +548,16 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytesToPartitio
         jstring jtopic,
         jint jpartition,
         jbyteArray jkey,
-        jbyteArray jvalue) {
+        jbyteArray jvalue,
+        jint qos) {
 
     if (!producerPtr || !jtopic || !jvalue) {
         throwJavaException(env, "Invalid arguments");
         return nullptr;
     }
 
-    auto* producer = reinterpret_cast<rd_kafka_t*>(producerPtr);
+    rd_kafka_t* producer = producerFor(env, producerPtr, qos);
+    if (!producer) return nullptr;
 
     // ---- Topic ----
     const char* topic = env->GetStringUTFChars(jtopic, nullptr);
@@ -503,7 +601,7 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytesToPartitio
                 RD_KAFKA_V_KEY(key_bytes, key_len),
                 RD_KAFKA_V_VALUE(value_bytes, value_len),
                 RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
-                RD_KAFKA_V_OPAQUE(&state),
+                RD_KAFKA_V_OPAQUE(static_cast<DeliveryListener*>(&state)),
                 RD_KAFKA_V_END
         );
     } else {
@@ -513,7 +611,7 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytesToPartitio
                 RD_KAFKA_V_PARTITION((int32_t)jpartition),
                 RD_KAFKA_V_VALUE(value_bytes, value_len),
                 RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
-                RD_KAFKA_V_OPAQUE(&state),
+                RD_KAFKA_V_OPAQUE(static_cast<DeliveryListener*>(&state)),
                 RD_KAFKA_V_END
         );
     }
@@ -531,15 +629,7 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytesToPartitio
     }
 
     // ---- Block until delivery ----
-    while (true) {
-        rd_kafka_poll(producer, 100);
-
-        std::unique_lock<std::mutex> lock(state.mtx);
-        if (state.done)
-            break;
-
-        state.cv.wait_for(lock, std::chrono::milliseconds(50));
-    }
+    awaitDelivery(producer, state);
 
     if (state.err != RD_KAFKA_RESP_ERR_NO_ERROR) {
         throwJavaException(env, rd_kafka_err2str(state.err));
@@ -549,14 +639,67 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessageBytesToPartitio
     // ---- Build Kotlin RecordMetadata ----
     jclass cls = env->FindClass(
             "org/github/cyterdan/chat_over_kafka/RecordMetadata");
-    jmethodID ctor = env->GetMethodID(cls, "<init>", "(IJ)V");
+    jmethodID ctor = env->GetMethodID(cls, "<init>", "(IJJ)V");
 
     return env->NewObject(
             cls,
             ctor,
             state.partition,
-            (jlong)state.offset
+            (jlong)state.offset,
+            (jlong)state.timestamp
+    );
+}
+
+/**
+ * Queues a message for a specific partition and returns without waiting for
+ * its delivery report. Only enqueue failures (e.g. a full queue) throw;
+ * delivery errors are logged by the producer.
+ */
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_enqueueMessageBytesToPartition(
+        JNIEnv* env,
+        jobject,
+        jlong producerPtr,
+        jstring jtopic,
+        jint jpartition,
+        jbyteArray jkey,
+        jbyteArray jvalue,
+        jint qos) {
+
+    if (!producerPtr || !jtopic || !jvalue) {
+        throwJavaException(env, "Invalid arguments");
+        return;
+    }
+
+    rd_kafka_t* producer = producerFor(env, producerPtr, qos);
+    if (!producer) return;
+
+    JniStringWrapper topic(env, jtopic);
+    if (!topic.get()) {
+        throwJavaException(env, "Failed to get topic");
+        return;
+    }
+
+    std::vector<jbyte> value(env->GetArrayLength(jvalue));
+    if (!value.empty()) env->GetByteArrayRegion(jvalue, 0, static_cast<jsize>(value.size()), value.data());
+
+    std::vector<jbyte> key(jkey ? env->GetArrayLength(jkey) : 0);
+    if (!key.empty()) env->GetByteArrayRegion(jkey, 0, static_cast<jsize>(key.size()), key.data());
+
+    // No opaque: delivery_report_cb has no waiter to wake.
+    rd_kafka_resp_err_t err = rd_kafka_producev(
+            producer,
+            RD_KAFKA_V_TOPIC(topic.get()),
+            RD_KAFKA_V_PARTITION((int32_t)jpartition),
+            RD_KAFKA_V_KEY(jkey ? key.data() : nullptr, key.size()),
+            RD_KAFKA_V_VALUE(value.data(), value.size()),
+            RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+            RD_KAFKA_V_END
     );
+
+    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        throwJavaException(env, rd_kafka_err2str(err));
+    }
 }
 
 // Create a consumer
@@ -618,6 +761,7 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_createConsumer(
         throwJavaException(env, errstr);
         return 0;
     }
+    Reactor::instance().attach(consumer);
 
     return reinterpret_cast<jlong>(consumer);
 }
@@ -725,6 +869,33 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_subscribeWithOffset(
     }
 }
 
+/**
+ * Timestamp of a consumed message and its age on arrival. On topics with
+ * message.timestamp.type=LogAppendTime the timestamp is the broker's clock,
+ * shared by every client; the age is measured against this device's clock, so
+ * it includes any skew between the two. All values are -1 when the message
+ * carries no timestamp.
+ */
+struct MessageTiming {
+    jlong timestamp = -1;
+    jint type = RD_KAFKA_TIMESTAMP_NOT_AVAILABLE;
+    jlong latencyMs = -1;
+};
+
+static MessageTiming messageTiming(const rd_kafka_message_t* rkmessage) {
+    MessageTiming timing;
+    rd_kafka_timestamp_type_t type;
+    const int64_t timestamp = rd_kafka_message_timestamp(rkmessage, &type);
+    if (type == RD_KAFKA_TIMESTAMP_NOT_AVAILABLE || timestamp < 0) return timing;
+
+    const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    timing.timestamp = timestamp;
+    timing.type = type;
+    timing.latencyMs = std::max<int64_t>(nowMs - timestamp, 0);
+    return timing;
+}
+
 // Poll for a message
 JNIEXPORT jobject JNICALL
 Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_pollMessage(
@@ -740,7 +911,7 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_pollMessage(
 
     auto* consumer = reinterpret_cast<rd_kafka_t*>(consumerPtr);
 
-    rd_kafka_message_t* rkmessage = rd_kafka_consumer_poll(consumer, timeoutMs);
+    rd_kafka_message_t* rkmessage = PlayoutMerger::instance().poll(consumer, timeoutMs);
 
     if (!rkmessage) {
         // Timeout, no message available
@@ -769,8 +940,9 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_pollMessage(
         return nullptr;
     }
 
-    // Get constructor: KafkaMessage(byte[] key, byte[] value, String topic, int partition, long offset)
-    jmethodID constructor = env->GetMethodID(messageClass, "<init>", "([B[BLjava/lang/String;IJ)V");
+    // Get constructor: KafkaMessage(byte[] key, byte[] value, String topic, int partition, long offset,
+    //                               long timestamp, int timestampType, long latencyMs)
+    jmethodID constructor = env->GetMethodID(messageClass, "<init>", "([B[BLjava/lang/String;IJJIJ)V");
     if (!constructor) {
         rd_kafka_message_destroy(rkmessage);
         throwJavaException(env, "Failed to find KafkaMessage constructor");
@@ -793,6 +965,8 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_pollMessage(
     // Get topic name
     jstring jtopic = env->NewStringUTF(rd_kafka_topic_name(rkmessage->rkt));
 
+    const MessageTiming timing = messageTiming(rkmessage);
+
     // Create KafkaMessage object
     jobject messageObj = env->NewObject(
             messageClass,
@@ -801,7 +975,10 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_pollMessage(
             jvalue,
             jtopic,
             static_cast<jint>(rkmessage->partition),
-            static_cast<jlong>(rkmessage->offset)
+            static_cast<jlong>(rkmessage->offset),
+            timing.timestamp,
+            timing.type,
+            timing.latencyMs
     );
 
     rd_kafka_message_destroy(rkmessage);
@@ -809,147 +986,1989 @@ Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_pollMessage(
     return messageObj;
 }
 
-// Close consumer
-JNIEXPORT void JNICALL
-Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_closeConsumer(
-        JNIEnv* env,
-        jobject /* this */,
-        jlong consumerPtr) {
-
-    if (consumerPtr == 0) {
-        return;
-    }
-
-    auto* consumer = reinterpret_cast<rd_kafka_t*>(consumerPtr);
+// --- Recycling consume path ---
+
+// Field IDs of KafkaMessageHolder, resolved once.
+struct HolderFields {
+    jfieldID key;
+    jfieldID value;
+    jfieldID keyLength;
+    jfieldID valueLength;
+    jfieldID topic;
+    jfieldID topicHandle;
+    jfieldID partition;
+    jfieldID offset;
+    jfieldID timestamp;
+    jfieldID timestampType;
+    jfieldID latencyMs;
+    jfieldID pendingMessage;
+};
 
-    // Close consumer (commit offsets and leave group)
-    rd_kafka_resp_err_t err = rd_kafka_consumer_close(consumer);
-    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
-        // Log but don't throw, we're cleaning up
+static const HolderFields* holderFields(JNIEnv* env, jobject holder) {
+    static HolderFields fields;
+    static std::atomic<bool> resolved{false};
+    if (resolved.load(std::memory_order_acquire)) {
+        return &fields;
+    }
+
+    jclass cls = env->GetObjectClass(holder);
+    // A missing field leaves NoSuchFieldError pending; no JNI lookup may follow it
+    auto field = [env, cls](const char* name, const char* signature) -> jfieldID {
+        if (env->ExceptionCheck()) return nullptr;
+        return env->GetFieldID(cls, name, signature);
+    };
+    HolderFields f{};
+    f.key = field("key", "Ljava/nio/ByteBuffer;");
+    f.value = field("value", "Ljava/nio/ByteBuffer;");
+    f.keyLength = field("keyLength", "I");
+    f.valueLength = field("valueLength", "I");
+    f.topic = field("topic", "Ljava/lang/String;");
+    f.topicHandle = field("topicHandle", "J");
+    f.partition = field("partition", "I");
+    f.offset = field("offset", "J");
+    f.timestamp = field("timestamp", "J");
+    f.timestampType = field("timestampType", "I");
+    f.latencyMs = field("latencyMs", "J");
+    f.pendingMessage = field("pendingMessage", "J");
+    const bool failed = env->ExceptionCheck();
+    env->DeleteLocalRef(cls);
+    if (failed) {
+        return nullptr;
     }
 
-    // Destroy consumer
-    rd_kafka_destroy(consumer);
+    // Field IDs stay valid for the lifetime of the class; racing threads
+    // resolve identical values.
+    fields = f;
+    resolved.store(true, std::memory_order_release);
+    return &fields;
 }
 
+static const jint POLL_INTO_NONE = 0;
+static const jint POLL_INTO_MESSAGE = 1;
+static const jint POLL_INTO_GROW = 2;
 
-JNIEXPORT jobject JNICALL
-Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessage(
+/**
+ * Consume one message into a reusable KafkaMessageHolder without allocating
+ * Java objects: key and value are copied into the holder's direct buffers and
+ * the scalar fields are set in place. The topic String is only replaced when
+ * the message comes from a different topic than the previous one.
+ *
+ * If a buffer is too small the message is parked in the holder, the required
+ * sizes are written to keyLength/valueLength and POLL_INTO_GROW is returned;
+ * the caller grows the buffers and calls again to receive the same message.
+ */
+JNIEXPORT jint JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_pollMessageInto(
         JNIEnv* env,
-        jobject,
-        jlong producerPtr,
-        jstring jtopic,
-        jstring jkey,
-        jstring jvalue) {
+        jobject /* this */,
+        jlong consumerPtr,
+        jobject holder,
+        jint timeoutMs) {
 
-    if (!producerPtr || !jtopic || !jvalue) {
-        throwJavaException(env, "Invalid arguments");
-        return nullptr;
+    if (consumerPtr == 0 || !holder) {
+        throwJavaException(env, "Consumer pointer and holder cannot be null");
+        return POLL_INTO_NONE;
     }
 
-    auto* producer = reinterpret_cast<rd_kafka_t*>(producerPtr);
-
-    const char* topic = env->GetStringUTFChars(jtopic, nullptr);
-    const char* value = env->GetStringUTFChars(jvalue, nullptr);
-    const char* key = jkey ? env->GetStringUTFChars(jkey, nullptr) : nullptr;
-
-    size_t value_len = env->GetStringUTFLength(jvalue);
-    size_t key_len = jkey ? env->GetStringUTFLength(jkey) : 0;
+    const HolderFields* f = holderFields(env, holder);
+    if (!f) {
+        // NoSuchFieldError is pending
+        return POLL_INTO_NONE;
+    }
 
-    DeliveryState state;
+    auto* consumer = reinterpret_cast<rd_kafka_t*>(consumerPtr);
 
-    rd_kafka_resp_err_t err;
-    if (key) {
-        err = rd_kafka_producev(
-                producer,
-                RD_KAFKA_V_TOPIC(topic),
-                RD_KAFKA_V_KEY((void*)key, key_len),
-                RD_KAFKA_V_VALUE((void*)value, value_len),
-                RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
-                RD_KAFKA_V_OPAQUE(&state),
-                RD_KAFKA_V_END
-        );
+    auto* rkmessage = reinterpret_cast<rd_kafka_message_t*>(env->GetLongField(holder, f->pendingMessage));
+    if (rkmessage) {
+        env->SetLongField(holder, f->pendingMessage, 0);
     } else {
-        err = rd_kafka_producev(
-                producer,
-                RD_KAFKA_V_TOPIC(topic),
-                RD_KAFKA_V_VALUE((void*)value, value_len),
-                RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
-                RD_KAFKA_V_OPAQUE(&state),
-                RD_KAFKA_V_END
-        );
+        rkmessage = PlayoutMerger::instance().poll(consumer, timeoutMs);
     }
 
-    env->ReleaseStringUTFChars(jtopic, topic);
-    env->ReleaseStringUTFChars(jvalue, value);
-    if (key) env->ReleaseStringUTFChars(jkey, key);
+    if (!rkmessage) {
+        return POLL_INTO_NONE;
+    }
 
-    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
-        throwJavaException(env, rd_kafka_err2str(err));
-        return nullptr;
+    if (rkmessage->err) {
+        if (rkmessage->err == RD_KAFKA_RESP_ERR__PARTITION_EOF) {
+            rd_kafka_message_destroy(rkmessage);
+            return POLL_INTO_NONE;
+        }
+        std::string errstr = rd_kafka_message_errstr(rkmessage);
+        rd_kafka_message_destroy(rkmessage);
+        throwJavaException(env, errstr.c_str());
+        return POLL_INTO_NONE;
     }
 
-    // 🔒 BLOCK until delivery report
-    {
-        while (!state.done.load(std::memory_order_acquire)) {
-            // Poll WITHOUT holding the mutex
-            rd_kafka_poll(producer, 100);
+    jobject jkeyBuffer = env->GetObjectField(holder, f->key);
+    jobject jvalueBuffer = env->GetObjectField(holder, f->value);
+    auto* keyDst = static_cast<uint8_t*>(env->GetDirectBufferAddress(jkeyBuffer));
+    auto* valueDst = static_cast<uint8_t*>(env->GetDirectBufferAddress(jvalueBuffer));
+    const jlong keyCapacity = env->GetDirectBufferCapacity(jkeyBuffer);
+    const jlong valueCapacity = env->GetDirectBufferCapacity(jvalueBuffer);
+    env->DeleteLocalRef(jkeyBuffer);
+    env->DeleteLocalRef(jvalueBuffer);
 
-            // Wait briefly (optional, avoids busy spin)
-            std::unique_lock<std::mutex> lock(state.mtx);
-            state.cv.wait_for(lock, std::chrono::milliseconds(50));
+    if (!keyDst || !valueDst) {
+        rd_kafka_message_destroy(rkmessage);
+        throwJavaException(env, "KafkaMessageHolder buffers must be direct");
+        return POLL_INTO_NONE;
+    }
+
+    // Sealed frames are opened straight into the holder instead of being copied
+    std::shared_ptr<FrameKey> frameKey = rkmessage->payload
+            ? FrameCipher::instance().keyFor(rd_kafka_topic_name(rkmessage->rkt)) : nullptr;
+    const jint keyLength = rkmessage->key ? static_cast<jint>(rkmessage->key_len) : -1;
+    jint valueLength = rkmessage->payload ? static_cast<jint>(rkmessage->len) : -1;
+    if (frameKey) {
+        valueLength = static_cast<jint>(FrameKey::openedSize(static_cast<const uint8_t*>(rkmessage->payload), rkmessage->len));
+        if (valueLength < 0) {
+            NativeLog::instance().print(ANDROID_LOG_WARN, LOG_TAG, "Dropping unsealed frame at offset %lld",
+                                        static_cast<long long>(rkmessage->offset));
+            rd_kafka_message_destroy(rkmessage);
+            return POLL_INTO_NONE;
         }
     }
 
-    if (state.err != RD_KAFKA_RESP_ERR_NO_ERROR) {
-        throwJavaException(env, rd_kafka_err2str(state.err));
-        return nullptr;
+    if (keyLength > keyCapacity || valueLength > valueCapacity) {
+        env->SetIntField(holder, f->keyLength, keyLength);
+        env->SetIntField(holder, f->valueLength, valueLength);
+        env->SetLongField(holder, f->pendingMessage, reinterpret_cast<jlong>(rkmessage));
+        return POLL_INTO_GROW;
     }
 
-    // Construct Kotlin RecordMetadata
-    jclass cls = env->FindClass(
-            "org/github/cyterdan/chat_over_kafka/RecordMetadata");
-    jmethodID ctor = env->GetMethodID(cls, "<init>", "(IJ)V");
+    if (keyLength > 0) memcpy(keyDst, rkmessage->key, keyLength);
+    if (frameKey) {
+        if (!frameKey->open(static_cast<const uint8_t*>(rkmessage->key), rkmessage->key_len,
+                            static_cast<const uint8_t*>(rkmessage->payload), rkmessage->len, valueDst)) {
+            NativeLog::instance().print(ANDROID_LOG_WARN, LOG_TAG, "Dropping frame at offset %lld: authentication failed",
+                                        static_cast<long long>(rkmessage->offset));
+            rd_kafka_message_destroy(rkmessage);
+            return POLL_INTO_NONE;
+        }
+    } else if (valueLength > 0) {
+        memcpy(valueDst, rkmessage->payload, valueLength);
+    }
 
-    return env->NewObject(
-            cls,
-            ctor,
-            state.partition,
-            (jlong)state.offset
-    );
-}
+    env->SetIntField(holder, f->keyLength, keyLength);
+    env->SetIntField(holder, f->valueLength, valueLength);
+    env->SetIntField(holder, f->partition, static_cast<jint>(rkmessage->partition));
+    env->SetLongField(holder, f->offset, static_cast<jlong>(rkmessage->offset));
 
+    const MessageTiming timing = messageTiming(rkmessage);
+    env->SetLongField(holder, f->timestamp, timing.timestamp);
+    env->SetIntField(holder, f->timestampType, timing.type);
+    env->SetLongField(holder, f->latencyMs, timing.latencyMs);
+
+    const jlong topicHandle = reinterpret_cast<jlong>(rkmessage->rkt);
+    if (env->GetLongField(holder, f->topicHandle) != topicHandle) {
+        jstring jtopic = env->NewStringUTF(rd_kafka_topic_name(rkmessage->rkt));
+        env->SetObjectField(holder, f->topic, jtopic);
+        env->SetLongField(holder, f->topicHandle, topicHandle);
+        env->DeleteLocalRef(jtopic);
+    }
 
+    rd_kafka_message_destroy(rkmessage);
+    return POLL_INTO_MESSAGE;
+}
 
+// Drop a message parked by pollMessageInto (holder discarded before growing)
 JNIEXPORT void JNICALL
-Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_flushProducer(
-        JNIEnv* env,
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_discardPendingMessage(
+        JNIEnv* /* env */,
         jobject /* this */,
-        jlong producerPtr,
-        jint timeoutMs) {
+        jlong messagePtr) {
 
-    if (producerPtr == 0) {
-        throwJavaException(env, "Producer pointer is null");
-        return;
-    }
+    if (messagePtr == 0) return;
+    rd_kafka_message_destroy(reinterpret_cast<rd_kafka_message_t*>(messagePtr));
+}
 
-    auto* producer = reinterpret_cast<rd_kafka_t*>(producerPtr);
-    rd_kafka_resp_err_t err = rd_kafka_flush(producer, timeoutMs);
+// --- Keyed range reads ---
 
+/**
+ * Reads the next records of an assigned offset range, keeping only those
+ * whose key equals `jkey` (every record when `jkey` is null). Records of
+ * other speakers interleaved in the range are dropped here, so they never
+ * cost a Java allocation or reach the decoder.
+ *
+ * Waits up to `timeoutMs` for the first record, then takes what is already
+ * fetched without waiting, until `maxFrames` records matched or `endOffset`
+ * was read. `progress` holds [last offset read, records skipped] and is
+ * updated in place; the range is complete once progress[0] >= endOffset.
+ * The caller bounds `endOffset` by the high watermark and gives up on a
+ * range that stops advancing, since retention may have removed its end.
+ * Returns the payloads of the matching records.
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_readKeyedRange(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong consumerPtr,
+        jbyteArray jkey,
+        jlong endOffset,
+        jint maxFrames,
+        jint timeoutMs,
+        jlongArray jprogress) {
+
+    if (consumerPtr == 0 || !jprogress || env->GetArrayLength(jprogress) < 2) {
+        throwJavaException(env, "Consumer pointer and progress cannot be null");
+        return nullptr;
+    }
+
+    auto* consumer = reinterpret_cast<rd_kafka_t*>(consumerPtr);
+
+    std::vector<uint8_t> key;
+    if (jkey) {
+        key.resize(env->GetArrayLength(jkey));
+        if (!key.empty()) {
+            env->GetByteArrayRegion(jkey, 0, static_cast<jsize>(key.size()), reinterpret_cast<jbyte*>(key.data()));
+        }
+    }
+
+    jlong progress[2];
+    env->GetLongArrayRegion(jprogress, 0, 2, progress);
+
+    std::vector<rd_kafka_message_t*> matched;
+    std::string error;
+    int waitMs = timeoutMs;
+    while (static_cast<jint>(matched.size()) < maxFrames && progress[0] < endOffset) {
+        rd_kafka_message_t* rkmessage = rd_kafka_consumer_poll(consumer, waitMs);
+        if (!rkmessage) break;
+        waitMs = 0;
+
+        if (rkmessage->err) {
+            if (rkmessage->err != RD_KAFKA_RESP_ERR__PARTITION_EOF) {
+                error = rd_kafka_message_errstr(rkmessage);
+            }
+            rd_kafka_message_destroy(rkmessage);
+            break;
+        }
+
+        progress[0] = rkmessage->offset;
+        const bool keep = rkmessage->payload && rkmessage->len > 0 &&
+                (!jkey || (rkmessage->key_len == key.size() &&
+                           (key.empty() || memcmp(rkmessage->key, key.data(), key.size()) == 0)));
+        if (keep) {
+            matched.push_back(rkmessage);
+        } else {
+            progress[1]++;
+            rd_kafka_message_destroy(rkmessage);
+        }
+    }
+
+    env->SetLongArrayRegion(jprogress, 0, 2, progress);
+
+    std::shared_ptr<FrameKey> frameKey = matched.empty()
+            ? nullptr : FrameCipher::instance().keyFor(rd_kafka_topic_name(matched.front()->rkt));
+    std::vector<uint8_t> opened;
+
+    jobjectArray result = nullptr;
+    if (error.empty()) {
+        jclass byteArrayClass = env->FindClass("[B");
+        if (byteArrayClass) {
+            result = env->NewObjectArray(static_cast<jsize>(matched.size()), byteArrayClass, nullptr);
+            env->DeleteLocalRef(byteArrayClass);
+        }
+        for (size_t i = 0; result && i < matched.size(); i++) {
+            const rd_kafka_message_t* m = matched[i];
+            const jbyte* bytes = static_cast<const jbyte*>(m->payload);
+            jsize length = static_cast<jsize>(m->len);
+            if (frameKey) {
+                // A frame that fails to open is handed over empty, which the decoder skips
+                const long size = FrameKey::openedSize(static_cast<const uint8_t*>(m->payload), m->len);
+                opened.resize(size > 0 ? static_cast<size_t>(size) : 0);
+                const bool ok = size >= 0 && frameKey->open(static_cast<const uint8_t*>(m->key), m->key_len,
+                                                            static_cast<const uint8_t*>(m->payload), m->len,
+                                                            opened.data());
+                if (!ok) {
+                    NativeLog::instance().print(ANDROID_LOG_WARN, LOG_TAG, "Frame at offset %lld failed to open",
+                                                static_cast<long long>(m->offset));
+                }
+                bytes = reinterpret_cast<const jbyte*>(opened.data());
+                length = ok ? static_cast<jsize>(size) : 0;
+            }
+            jbyteArray payload = env->NewByteArray(length);
+            if (!payload) {
+                result = nullptr;
+                break;
+            }
+            env->SetByteArrayRegion(payload, 0, length, bytes);
+            env->SetObjectArrayElement(result, static_cast<jsize>(i), payload);
+            env->DeleteLocalRef(payload);
+        }
+    }
+    for (rd_kafka_message_t* m : matched) {
+        rd_kafka_message_destroy(m);
+    }
+
+    if (!error.empty()) {
+        throwJavaException(env, error.c_str());
+    }
+    return result;
+}
+
+// --- Client pool ---
+
+JNIEXPORT jlong JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_acquireClient(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring jbrokers,
+        jstring jcaCertPath,
+        jstring jclientCertPath,
+        jstring jclientKeyPath,
+        jint role,
+        jstring jprofile) {
+
+    if (!jbrokers || !jcaCertPath || !jclientCertPath || !jclientKeyPath) {
+        throwJavaException(env, "Brokers and certificate paths cannot be null");
+        return 0;
+    }
+    if (role != static_cast<jint>(ClientRole::Producer) && role != static_cast<jint>(ClientRole::Consumer)) {
+        throwJavaException(env, "Unknown client role");
+        return 0;
+    }
+
+    JniStringWrapper brokers(env, jbrokers);
+    JniStringWrapper caCert(env, jcaCertPath);
+    JniStringWrapper clientCert(env, jclientCertPath);
+    JniStringWrapper clientKey(env, jclientKeyPath);
+    JniStringWrapper profile(env, jprofile);
+
+    if (!brokers.get() || !caCert.get() || !clientCert.get() || !clientKey.get()) {
+        throwJavaException(env, "Failed to get strings from JNI");
+        return 0;
+    }
+
+    ClientSpec spec;
+    spec.brokers = brokers.get();
+    spec.caCertPath = caCert.get();
+    spec.clientCertPath = clientCert.get();
+    spec.clientKeyPath = clientKey.get();
+    spec.role = static_cast<ClientRole>(role);
+    spec.profile = profile.get() ? profile.get() : "";
+
+    std::string error;
+    rd_kafka_t* rk = ClientPool::instance().acquire(spec, error);
+    if (!rk) {
+        throwJavaException(env, error.c_str());
+        return 0;
+    }
+    return reinterpret_cast<jlong>(rk);
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_releaseClient(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jlong handlePtr) {
+
+    if (handlePtr == 0) return;
+    ClientPool::instance().release(reinterpret_cast<rd_kafka_t*>(handlePtr));
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_setClientIdleGraceMs(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint graceMs) {
+
+    ClientPool::instance().setIdleGraceMs(graceMs);
+}
+
+// --- Memory budget ---
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_setMemoryBudget(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jlong budgetBytes) {
+
+    MemoryBudget::instance().setBudget(budgetBytes);
+    // Idle handles were sized for the previous budget; let them be recreated.
+    ClientPool::instance().evictIdle();
+}
+
+// Returns [producerQueueKbytes, consumerQueueKbytes, fetchMaxBytes, cacheBytes]
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_getMemoryLimits(
+        JNIEnv* env,
+        jobject /* this */) {
+
+    const MemoryLimits limits = MemoryBudget::instance().limits();
+    const jlong values[] = {
+            limits.producerQueueKbytes,
+            limits.consumerQueueKbytes,
+            limits.fetchMaxBytes,
+            limits.cacheBytes,
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result) env->SetLongArrayRegion(result, 0, 4, values);
+    return result;
+}
+
+// Returns [budgetBytes, producerQueuedBytes, consumerQueuedBytes, cacheBytes, handles, overBudgetBytes, breaches]
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_getMemoryUsage(
+        JNIEnv* env,
+        jobject /* this */) {
+
+    const MemoryUsage usage = MemoryBudget::instance().usage();
+    const jlong values[] = {
+            usage.budgetBytes,
+            usage.producerQueuedBytes,
+            usage.consumerQueuedBytes,
+            usage.cacheBytes,
+            usage.handles,
+            usage.overBudgetBytes,
+            usage.breaches,
+    };
+    jlongArray result = env->NewLongArray(7);
+    if (result) env->SetLongArrayRegion(result, 0, 7, values);
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_reportCacheUsage(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jlong bytes) {
+
+    MemoryBudget::instance().reportCacheUsage(bytes);
+}
+
+// Close consumer
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_closeConsumer(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong consumerPtr) {
+
+    if (consumerPtr == 0) {
+        return;
+    }
+
+    auto* consumer = reinterpret_cast<rd_kafka_t*>(consumerPtr);
+
+    // Close consumer (commit offsets and leave group), bounded by the reaper's deadline
+    int64_t ticket = Reaper::instance().submit(consumer, kDefaultCloseDeadlineMs);
+    Reaper::instance().await(ticket, kDefaultCloseDeadlineMs + 1000);
+}
+
+
+JNIEXPORT jobject JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_produceMessage(
+        JNIEnv* env,
+        jobject,
+        jlong producerPtr,
+        jstring jtopic,
+        jstring jkey,
+        jstring jvalue) {
+
+    if (!producerPtr || !jtopic || !jvalue) {
+        throwJavaException(env, "Invalid arguments");
+        return nullptr;
+    }
+
+    auto* producer = reinterpret_cast<rd_kafka_t*>(producerPtr);
+
+    const char* topic = env->GetStringUTFChars(jtopic, nullptr);
+    const char* value = env->GetStringUTFChars(jvalue, nullptr);
+    const char* key = jkey ? env->GetStringUTFChars(jkey, nullptr) : nullptr;
+
+    size_t value_len = env->GetStringUTFLength(jvalue);
+    size_t key_len = jkey ? env->GetStringUTFLength(jkey) : 0;
+
+    DeliveryState state;
+
+    rd_kafka_resp_err_t err;
+    if (key) {
+        err = rd_kafka_producev(
+                producer,
+                RD_KAFKA_V_TOPIC(topic),
+                RD_KAFKA_V_KEY((void*)key, key_len),
+                RD_KAFKA_V_VALUE((void*)value, value_len),
+                RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+                RD_KAFKA_V_OPAQUE(static_cast<DeliveryListener*>(&state)),
+                RD_KAFKA_V_END
+        );
+    } else {
+        err = rd_kafka_producev(
+                producer,
+                RD_KAFKA_V_TOPIC(topic),
+                RD_KAFKA_V_VALUE((void*)value, value_len),
+                RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+                RD_KAFKA_V_OPAQUE(static_cast<DeliveryListener*>(&state)),
+                RD_KAFKA_V_END
+        );
+    }
+
+    env->ReleaseStringUTFChars(jtopic, topic);
+    env->ReleaseStringUTFChars(jvalue, value);
+    if (key) env->ReleaseStringUTFChars(jkey, key);
+
+    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        throwJavaException(env, rd_kafka_err2str(err));
+        return nullptr;
+    }
+
+    // 🔒 BLOCK until delivery report
+    awaitDelivery(producer, state);
+
+    if (state.err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        throwJavaException(env, rd_kafka_err2str(state.err));
+        return nullptr;
+    }
+
+    // Construct Kotlin RecordMetadata
+    jclass cls = env->FindClass(
+            "org/github/cyterdan/chat_over_kafka/RecordMetadata");
+    jmethodID ctor = env->GetMethodID(cls, "<init>", "(IJJ)V");
+
+    return env->NewObject(
+            cls,
+            ctor,
+            state.partition,
+            (jlong)state.offset,
+            (jlong)state.timestamp
+    );
+}
+
+
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_flushProducer(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong producerPtr,
+        jint timeoutMs) {
+
+    if (producerPtr == 0) {
+        throwJavaException(env, "Producer pointer is null");
+        return;
+    }
+
+    // Frames may have gone through the producer of the other QoS class
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (rd_kafka_t* producer : ClientPool::instance().family(reinterpret_cast<rd_kafka_t*>(producerPtr))) {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+        rd_kafka_resp_err_t err = rd_kafka_flush(producer, static_cast<int>(std::max<int64_t>(left, 0)));
+        if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+            throwJavaException(env, rd_kafka_err2str(err));
+            return;
+        }
+    }
+}
+
+/**
+ * Establishes broker connections ahead of the first produce/fetch.
+ *
+ * Fetches metadata for each topic (bootstrap connection + topic leaders) and
+ * queries the watermarks of every partition, so the leader connection and its
+ * TLS handshake are already up when the first frame is sent or fetched. A
+ * pooled producer's ordered (audio) and durable handles (see
+ * ClientPool::forQos) are both created and warmed. Returns the number of
+ * partitions whose leader answered every handle in time.
+ */
+JNIEXPORT jint JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_warmUp(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong handlePtr,
+        jobjectArray jtopics,
+        jint timeoutMs) {
+
+    if (handlePtr == 0 || !jtopics) {
+        throwJavaException(env, "Invalid arguments");
+        return 0;
+    }
+
+    auto* rk = reinterpret_cast<rd_kafka_t*>(handlePtr);
+    const bool isProducer = rd_kafka_type(rk) == RD_KAFKA_PRODUCER;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    auto remainingMs = [&deadline]() {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+        return left > 0 ? static_cast<int>(left) : 0;
+    };
+
+    // A metadata answer only proves the bootstrap connection; a partition is
+    // warm once its leader answered a ListOffsets on every handle
+    std::vector<rd_kafka_t*> handles;
+    if (isProducer) {
+        std::string error;
+        for (QosClass qos : {QosClass::Ordered, QosClass::Durable}) {
+            rd_kafka_t* producer = ClientPool::instance().forQos(rk, qos, error);
+            if (producer && std::find(handles.begin(), handles.end(), producer) == handles.end()) {
+                handles.push_back(producer);
+            }
+        }
+    } else {
+        handles.push_back(rk);
+    }
+
+    int warmPartitions = 0;
+    jsize topicCount = env->GetArrayLength(jtopics);
+    for (jsize i = 0; i < topicCount && remainingMs() > 0; i++) {
+        auto jtopic = static_cast<jstring>(env->GetObjectArrayElement(jtopics, i));
+        if (!jtopic) continue;
+
+        {
+            JniStringWrapper topic(env, jtopic);
+            rd_kafka_topic_t* rkt = topic.get() ? rd_kafka_topic_new(rk, topic, nullptr) : nullptr;
+            if (rkt) {
+                const struct rd_kafka_metadata* metadata = nullptr;
+                rd_kafka_resp_err_t err = rd_kafka_metadata(rk, 0, rkt, &metadata, remainingMs());
+                if (err == RD_KAFKA_RESP_ERR_NO_ERROR && metadata->topic_cnt == 1) {
+                    MetadataCache::instance().recordMetadata(metadata);
+                    const rd_kafka_metadata_topic& mt = metadata->topics[0];
+                    for (int p = 0; p < mt.partition_cnt; p++) {
+                        if (mt.partitions[p].leader < 0) continue;
+                        bool warm = !handles.empty();
+                        for (rd_kafka_t* handle : handles) {
+                            int64_t low = 0, high = 0;
+                            if (remainingMs() > 0 &&
+                                rd_kafka_query_watermark_offsets(handle, mt.topic, mt.partitions[p].id,
+                                                                 &low, &high, remainingMs()) == RD_KAFKA_RESP_ERR_NO_ERROR) {
+                                MetadataCache::instance().recordWatermarks(mt.topic, mt.partitions[p].id, low, high);
+                            } else {
+                                warm = false;
+                            }
+                        }
+                        if (warm) warmPartitions++;
+                    }
+                } else if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+                    __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "warmUp: metadata for %s failed: %s",
+                                        topic.get(), rd_kafka_err2str(err));
+                }
+                if (metadata) rd_kafka_metadata_destroy(metadata);
+                rd_kafka_topic_destroy(rkt);
+            }
+        }
+        env->DeleteLocalRef(jtopic);
+    }
+
+    // What was just learned revalidates the persisted cache for the next start.
+    MetadataCache::instance().save();
+    return warmPartitions;
+}
+
+// --- Metadata cache ---
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_setMetadataCachePath(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring jpath,
+        jstring jbrokers) {
+
+    JniStringWrapper path(env, jpath);
+    JniStringWrapper brokers(env, jbrokers);
+    if (!path.get() || !brokers.get()) {
+        throwJavaException(env, "Invalid arguments");
+        return;
+    }
+    MetadataCache::instance().setPath(path.get(), brokers.get());
+}
+
+/**
+ * Asks the partition leader for the current [low, high] watermarks using any
+ * client handle and records them in the cache. Returns null if the leader
+ * did not answer within `timeoutMs`.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_queryWatermarks(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong handlePtr,
+        jstring jtopic,
+        jint partition,
+        jint timeoutMs) {
+
+    JniStringWrapper topic(env, jtopic);
+    if (handlePtr == 0 || !topic.get()) {
+        throwJavaException(env, "Invalid arguments");
+        return nullptr;
+    }
+
+    auto* rk = reinterpret_cast<rd_kafka_t*>(handlePtr);
+    int64_t low = 0, high = 0;
+    rd_kafka_resp_err_t err = rd_kafka_query_watermark_offsets(rk, topic.get(), partition, &low, &high, timeoutMs);
+    if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "queryWatermarks: %s [%d] failed: %s",
+                            topic.get(), partition, rd_kafka_err2str(err));
+        return nullptr;
+    }
+    MetadataCache::instance().recordWatermarks(topic.get(), partition, low, high);
+
+    jlong values[2] = { low, high };
+    jlongArray result = env->NewLongArray(2);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 2, values);
+    }
+    return result;
+}
+
+/**
+ * Asks the partition leader for the offset of the first record whose
+ * timestamp is at or after `timestampMs`, using any client handle. Returns
+ * RD_KAFKA_OFFSET_END if every record is older, and RD_KAFKA_OFFSET_BEGINNING
+ * if the leader did not answer within `timeoutMs`, so the caller falls back
+ * to reading the whole partition.
+ */
+JNIEXPORT jlong JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_offsetForTime(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong handlePtr,
+        jstring jtopic,
+        jint partition,
+        jlong timestampMs,
+        jint timeoutMs) {
+
+    JniStringWrapper topic(env, jtopic);
+    if (handlePtr == 0 || !topic.get()) {
+        throwJavaException(env, "Invalid arguments");
+        return RD_KAFKA_OFFSET_BEGINNING;
+    }
+
+    auto* rk = reinterpret_cast<rd_kafka_t*>(handlePtr);
+    rd_kafka_topic_partition_list_t* offsets = rd_kafka_topic_partition_list_new(1);
+    rd_kafka_topic_partition_t* rktpar = rd_kafka_topic_partition_list_add(offsets, topic.get(), partition);
+    rktpar->offset = timestampMs;
+
+    jlong offset = RD_KAFKA_OFFSET_BEGINNING;
+    rd_kafka_resp_err_t err = rd_kafka_offsets_for_times(rk, offsets, timeoutMs);
+    if (err == RD_KAFKA_RESP_ERR_NO_ERROR) err = rktpar->err;
+    if (err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+        offset = rktpar->offset;
+    } else {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "offsetForTime: %s [%d] failed: %s",
+                            topic.get(), partition, rd_kafka_err2str(err));
+    }
+    rd_kafka_topic_partition_list_destroy(offsets);
+    return offset;
+}
+
+// --- Network handoff ---
+
+JNIEXPORT jint JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_onNetworkChanged(
+        JNIEnv* env,
+        jobject /* this */) {
+
+    return ConnectionTracker::instance().onNetworkChanged();
+}
+
+// --- Reactor ---
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_wakeConsumer(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong consumerPtr) {
+
+    if (consumerPtr == 0) return;
+    // Makes a blocked rd_kafka_consumer_poll return right away. rd_kafka_yield
+    // would only work from a callback on the polling thread.
+    rd_kafka_queue_t* queue = rd_kafka_queue_get_consumer(reinterpret_cast<rd_kafka_t*>(consumerPtr));
+    if (!queue) return;
+    rd_kafka_queue_yield(queue);
+    rd_kafka_queue_destroy(queue);
+}
+
+// Returns [wakeups, eventsServed, emptyWakeups, deliveryWakes, avgDeliveryWakeUs, maxDeliveryWakeUs, handles]
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_getReactorStats(
+        JNIEnv* env,
+        jobject /* this */) {
+
+    const ReactorStats stats = Reactor::instance().stats();
+    const jlong values[] = {
+            stats.wakeups,
+            stats.eventsServed,
+            stats.emptyWakeups,
+            stats.deliveryWakes,
+            stats.avgDeliveryWakeUs,
+            stats.maxDeliveryWakeUs,
+            stats.handles,
+    };
+    jlongArray result = env->NewLongArray(7);
+    if (result) env->SetLongArrayRegion(result, 0, 7, values);
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_destroyProducer(
+        JNIEnv *env,
+        jobject /* this */,
+        jlong producerPtr) {
+
+    if (producerPtr == 0) return;
+    auto *producer = reinterpret_cast<rd_kafka_t *>(producerPtr);
+    int64_t ticket = Reaper::instance().submit(producer, kDefaultCloseDeadlineMs);
+    Reaper::instance().await(ticket, kDefaultCloseDeadlineMs + 1000);
+}
+
+// --- Asynchronous teardown ---
+
+JNIEXPORT jlong JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_closeAsync(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong handlePtr,
+        jint deadlineMs) {
+
+    if (handlePtr == 0) {
+        throwJavaException(env, "Invalid handle");
+        return 0;
+    }
+    return Reaper::instance().submit(reinterpret_cast<rd_kafka_t*>(handlePtr), deadlineMs);
+}
+
+JNIEXPORT jint JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_awaitClose(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong ticket,
+        jint timeoutMs) {
+
+    return static_cast<jint>(Reaper::instance().await(ticket, timeoutMs));
+}
+
+// --- Metadata codec ---
+
+static bool readStringArray(JNIEnv* env, jobjectArray array, std::vector<std::string>& out) {
+    const jsize count = array ? env->GetArrayLength(array) : 0;
+    out.clear();
+    out.reserve(count);
+    for (jsize i = 0; i < count; i++) {
+        auto jstr = static_cast<jstring>(env->GetObjectArrayElement(array, i));
+        {
+            JniStringWrapper str(env, jstr);
+            if (!str.get()) return false;
+            out.push_back(fromModifiedUtf8(str.get()));
+        }
+        env->DeleteLocalRef(jstr);
+    }
+    return true;
+}
+
+// Reactions cross JNI as parallel arrays: emojis[i] was used by reactors[i]
+static bool readReactions(JNIEnv* env, jobjectArray jemojis, jobjectArray jreactors,
+                          std::vector<std::pair<std::string, std::vector<std::string>>>& out) {
+    std::vector<std::string> emojis;
+    if (!readStringArray(env, jemojis, emojis) ||
+        static_cast<jsize>(emojis.size()) != (jreactors ? env->GetArrayLength(jreactors) : 0)) {
+        return false;
+    }
+    out.clear();
+    for (size_t i = 0; i < emojis.size(); i++) {
+        auto jusers = static_cast<jobjectArray>(env->GetObjectArrayElement(jreactors, static_cast<jsize>(i)));
+        std::vector<std::string> users;
+        bool ok = readStringArray(env, jusers, users);
+        env->DeleteLocalRef(jusers);
+        if (!ok) return false;
+        out.emplace_back(std::move(emojis[i]), std::move(users));
+    }
+    return true;
+}
+
+// Frame indexes cross JNI as interleaved [offset0, mediaMs0, offset1, mediaMs1, ...]
+static bool readFrameIndex(JNIEnv* env, jlongArray array, std::vector<std::pair<int64_t, int64_t>>& out) {
+    out.clear();
+    const jsize len = array ? env->GetArrayLength(array) : 0;
+    if (len % 2 != 0) return false;
+    std::vector<jlong> values(len);
+    if (len > 0) env->GetLongArrayRegion(array, 0, len, values.data());
+    out.reserve(len / 2);
+    for (jsize i = 0; i < len; i += 2) {
+        out.emplace_back(values[i], values[i + 1]);
+    }
+    return true;
+}
+
+static jlongArray newFrameIndexArray(JNIEnv* env, const std::vector<std::pair<int64_t, int64_t>>& frameIndex) {
+    const auto len = static_cast<jsize>(frameIndex.size() * 2);
+    std::vector<jlong> values;
+    values.reserve(len);
+    for (const auto& point : frameIndex) {
+        values.push_back(point.first);
+        values.push_back(point.second);
+    }
+    jlongArray result = env->NewLongArray(len);
+    if (result && len > 0) env->SetLongArrayRegion(result, 0, len, values.data());
+    return result;
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_encodeMetadata(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring juserId,
+        jint channelId,
+        jlong startOffset,
+        jlong endOffset,
+        jlong timestamp,
+        jlong messageCount,
+        jobjectArray jemojis,
+        jobjectArray jreactors,
+        jlongArray jframeIndex,
+        jstring jframeKey,
+        jlong firstFrameTime,
+        jlong lastFrameTime,
+        jint audioPartition) {
+
+    JniStringWrapper userId(env, juserId);
+    JniStringWrapper frameKey(env, jframeKey);
+    if (!userId.get() || !frameKey.get()) {
+        throwJavaException(env, "Invalid arguments");
+        return nullptr;
+    }
+
+    MetadataRecord record;
+    record.userId = fromModifiedUtf8(userId.get());
+    record.channelId = channelId;
+    record.startOffset = startOffset;
+    record.endOffset = endOffset;
+    record.timestamp = timestamp;
+    record.messageCount = messageCount;
+    record.frameKey = fromModifiedUtf8(frameKey.get());
+    record.firstFrameTime = firstFrameTime;
+    record.lastFrameTime = lastFrameTime;
+    record.audioPartition = audioPartition;
+
+    if (!readReactions(env, jemojis, jreactors, record.reactions)) {
+        throwJavaException(env, "Invalid reactions");
+        return nullptr;
+    }
+
+    if (!readFrameIndex(env, jframeIndex, record.frameIndex)) {
+        throwJavaException(env, "Frame index must hold (offset, mediaMs) pairs");
+        return nullptr;
+    }
+
+    std::vector<uint8_t> bytes;
+    MetadataCodec::encode(record, bytes);
+
+    jbyteArray result = env->NewByteArray(static_cast<jsize>(bytes.size()));
+    if (result) {
+        env->SetByteArrayRegion(result, 0, static_cast<jsize>(bytes.size()),
+                                reinterpret_cast<const jbyte*>(bytes.data()));
+    }
+    return result;
+}
+
+struct MetadataFactory {
+    jclass metadataClass;  // global ref
+    jclass stringClass;    // global ref
+    jclass stringArrayClass;  // global ref
+    jmethodID fromDecoded;
+};
+
+static const MetadataFactory* metadataFactory(JNIEnv* env) {
+    static MetadataFactory factory;
+    static std::atomic<bool> resolved{false};
+    static std::mutex mutex;
+    if (resolved.load(std::memory_order_acquire)) {
+        return &factory;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (resolved.load(std::memory_order_relaxed)) {
+        return &factory;
+    }
+    jclass metadataClass = env->FindClass("org/github/cyterdan/chat_over_kafka/AudioMetadata");
+    jclass stringClass = env->FindClass("java/lang/String");
+    jclass stringArrayClass = env->FindClass("[Ljava/lang/String;");
+    if (!metadataClass || !stringClass || !stringArrayClass) {
+        return nullptr;
+    }
+    jmethodID fromDecoded = env->GetStaticMethodID(
+            metadataClass, "fromDecoded",
+            "(Ljava/lang/String;IJJJJ[Ljava/lang/String;[[Ljava/lang/String;[JLjava/lang/String;JJI)"
+            "Lorg/github/cyterdan/chat_over_kafka/AudioMetadata;");
+    if (!fromDecoded) {
+        return nullptr;
+    }
+
+    factory.metadataClass = static_cast<jclass>(env->NewGlobalRef(metadataClass));
+    factory.stringClass = static_cast<jclass>(env->NewGlobalRef(stringClass));
+    factory.stringArrayClass = static_cast<jclass>(env->NewGlobalRef(stringArrayClass));
+    factory.fromDecoded = fromDecoded;
+    env->DeleteLocalRef(metadataClass);
+    env->DeleteLocalRef(stringClass);
+    env->DeleteLocalRef(stringArrayClass);
+    resolved.store(true, std::memory_order_release);
+    return &factory;
+}
+
+// Builds an AudioMetadata from a decoded record; null with a pending exception on failure.
+static jobject newAudioMetadata(JNIEnv* env, const MetadataFactory* f, const MetadataRecord& record) {
+    const auto reactionCount = static_cast<jsize>(record.reactions.size());
+    jobjectArray emojis = env->NewObjectArray(reactionCount, f->stringClass, nullptr);
+    jobjectArray reactors = env->NewObjectArray(reactionCount, f->stringArrayClass, nullptr);
+    if (!emojis || !reactors) return nullptr;
+
+    for (jsize r = 0; r < reactionCount; r++) {
+        const auto& reaction = record.reactions[r];
+        jstring emoji = newStringFromUtf8(env, reaction.first);
+        env->SetObjectArrayElement(emojis, r, emoji);
+        env->DeleteLocalRef(emoji);
+
+        const auto userCount = static_cast<jsize>(reaction.second.size());
+        jobjectArray users = env->NewObjectArray(userCount, f->stringClass, nullptr);
+        if (!users) return nullptr;
+        for (jsize u = 0; u < userCount; u++) {
+            jstring user = newStringFromUtf8(env, reaction.second[u]);
+            env->SetObjectArrayElement(users, u, user);
+            env->DeleteLocalRef(user);
+        }
+        env->SetObjectArrayElement(reactors, r, users);
+        env->DeleteLocalRef(users);
+    }
+
+    jlongArray frameIndex = newFrameIndexArray(env, record.frameIndex);
+    if (!frameIndex) return nullptr;
+
+    jstring userId = newStringFromUtf8(env, record.userId);
+    jstring frameKey = newStringFromUtf8(env, record.frameKey);
+    jobject metadata = env->CallStaticObjectMethod(
+            f->metadataClass, f->fromDecoded,
+            userId,
+            static_cast<jint>(record.channelId),
+            static_cast<jlong>(record.startOffset),
+            static_cast<jlong>(record.endOffset),
+            static_cast<jlong>(record.timestamp),
+            static_cast<jlong>(record.messageCount),
+            emojis,
+            reactors,
+            frameIndex,
+            frameKey,
+            static_cast<jlong>(record.firstFrameTime),
+            static_cast<jlong>(record.lastFrameTime),
+            static_cast<jint>(record.audioPartition));
+    env->DeleteLocalRef(frameKey);
+    env->DeleteLocalRef(frameIndex);
+    env->DeleteLocalRef(userId);
+    env->DeleteLocalRef(emojis);
+    env->DeleteLocalRef(reactors);
+    return metadata;
+}
+
+/**
+ * Decodes a binary metadata record straight into an AudioMetadata.
+ * Returns null if the bytes are not a well-formed binary record.
+ */
+JNIEXPORT jobject JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_decodeMetadata(
+        JNIEnv* env,
+        jobject /* this */,
+        jbyteArray jbytes) {
+
+    if (!jbytes) return nullptr;
+
+    MetadataRecord record;
+    const jsize len = env->GetArrayLength(jbytes);
+    auto* data = static_cast<uint8_t*>(env->GetPrimitiveArrayCritical(jbytes, nullptr));
+    if (!data) return nullptr;
+    const bool ok = MetadataCodec::decode(data, static_cast<size_t>(len), record);
+    env->ReleasePrimitiveArrayCritical(jbytes, data, JNI_ABORT);
+    if (!ok) return nullptr;
+
+    const MetadataFactory* f = metadataFactory(env);
+    if (!f) {
+        throwJavaException(env, "Failed to resolve AudioMetadata.fromDecoded");
+        return nullptr;
+    }
+
+    return newAudioMetadata(env, f, record);
+}
+
+/**
+ * Returns [offset, mediaMs]: where to start fetching to land at
+ * `mediaTimeMs` into a recording, and the media time that offset starts at.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_seekWithinRecording(
+        JNIEnv* env,
+        jobject /* this */,
+        jlongArray jframeIndex,
+        jlong startOffset,
+        jlong mediaTimeMs) {
+
+    std::vector<std::pair<int64_t, int64_t>> frameIndex;
+    if (!readFrameIndex(env, jframeIndex, frameIndex)) {
+        throwJavaException(env, "Frame index must hold (offset, mediaMs) pairs");
+        return nullptr;
+    }
+
+    const auto point = MetadataCodec::seek(frameIndex, startOffset, mediaTimeMs);
+    const jlong values[] = { point.first, point.second };
+    jlongArray result = env->NewLongArray(2);
+    if (result) env->SetLongArrayRegion(result, 0, 2, values);
+    return result;
+}
+
+// --- Reactions ---
+
+/**
+ * Records a reaction toggled on this device: folds it into the aggregator
+ * right away and returns the encoded delta to publish.
+ */
+JNIEXPORT jbyteArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_reactLocally(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jlong startOffset,
+        jstring jemoji,
+        jstring juserId,
+        jboolean added,
+        jlong timestamp) {
+
+    JniStringWrapper emoji(env, jemoji);
+    JniStringWrapper userId(env, juserId);
+    if (!emoji.get() || !userId.get()) {
+        throwJavaException(env, "Invalid arguments");
+        return nullptr;
+    }
+
+    ReactionDelta delta;
+    delta.channelId = channelId;
+    delta.startOffset = startOffset;
+    delta.emoji = fromModifiedUtf8(emoji.get());
+    delta.userId = fromModifiedUtf8(userId.get());
+    delta.added = added == JNI_TRUE;
+    delta.timestamp = timestamp;
+    ReactionAggregator::instance().apply(delta, true);
+
+    std::vector<uint8_t> bytes;
+    MetadataCodec::encodeDelta(delta, bytes);
+    jbyteArray result = env->NewByteArray(static_cast<jsize>(bytes.size()));
+    if (result) {
+        env->SetByteArrayRegion(result, 0, static_cast<jsize>(bytes.size()),
+                                reinterpret_cast<const jbyte*>(bytes.data()));
+    }
+    return result;
+}
+
+/**
+ * Folds a record read from the metadata topic if it is a reaction delta.
+ * Returns the start offset of the recording it belongs to, or -1 if the
+ * record is not a delta.
+ */
+JNIEXPORT jlong JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_foldReactionDelta(
+        JNIEnv* env,
+        jobject /* this */,
+        jbyteArray jbytes) {
+
+    if (!jbytes) return -1;
+
+    ReactionDelta delta;
+    const jsize len = env->GetArrayLength(jbytes);
+    auto* data = static_cast<uint8_t*>(env->GetPrimitiveArrayCritical(jbytes, nullptr));
+    if (!data) return -1;
+    const bool ok = MetadataCodec::decodeDelta(data, static_cast<size_t>(len), delta);
+    env->ReleasePrimitiveArrayCritical(jbytes, data, JNI_ABORT);
+    if (!ok) return -1;
+
+    ReactionAggregator::instance().apply(delta, false);
+    return delta.startOffset;
+}
+
+// Seeds the aggregator with the reactions of a full metadata record
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_seedReactions(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jlong startOffset,
+        jobjectArray jemojis,
+        jobjectArray jreactors) {
+
+    MetadataRecord record;
+    record.channelId = channelId;
+    record.startOffset = startOffset;
+    if (!readReactions(env, jemojis, jreactors, record.reactions)) {
+        throwJavaException(env, "Invalid reactions");
+        return;
+    }
+    ReactionAggregator::instance().seed(record);
+}
+
+// Returns one array per emoji: [emoji, user, user, ...]
+JNIEXPORT jobjectArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_foldedReactions(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jlong startOffset) {
+
+    const MetadataFactory* f = metadataFactory(env);
+    if (!f) {
+        throwJavaException(env, "Failed to resolve AudioMetadata.fromDecoded");
+        return nullptr;
+    }
+
+    const auto reactions = ReactionAggregator::instance().reactions(channelId, startOffset);
+    jobjectArray result = env->NewObjectArray(static_cast<jsize>(reactions.size()), f->stringArrayClass, nullptr);
+    if (!result) return nullptr;
+
+    for (size_t r = 0; r < reactions.size(); r++) {
+        const auto& users = reactions[r].second;
+        jobjectArray row = env->NewObjectArray(static_cast<jsize>(users.size() + 1), f->stringClass, nullptr);
+        if (!row) return nullptr;
+        for (size_t i = 0; i <= users.size(); i++) {
+            jstring str = newStringFromUtf8(env, i == 0 ? reactions[r].first : users[i - 1]);
+            env->SetObjectArrayElement(row, static_cast<jsize>(i), str);
+            env->DeleteLocalRef(str);
+        }
+        env->SetObjectArrayElement(result, static_cast<jsize>(r), row);
+        env->DeleteLocalRef(row);
+    }
+    return result;
+}
+
+// Returns the recording ids of `channelId` due for compaction
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_takeReactionsToCompact(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId) {
+
+    const std::vector<int64_t> due = ReactionAggregator::instance().takeCompactable(channelId);
+    const auto len = static_cast<jsize>(due.size());
+    jlongArray result = env->NewLongArray(len);
+    if (result && len > 0) env->SetLongArrayRegion(result, 0, len, reinterpret_cast<const jlong*>(due.data()));
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_keepReactionsToCompact(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint channelId,
+        jlong recordingId) {
+
+    ReactionAggregator::instance().keepCompactable(channelId, recordingId);
+}
+
+// --- Hourly rollups ---
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_setRollupPath(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring jpath) {
+
+    JniStringWrapper path(env, jpath);
+    if (!path.get()) {
+        throwJavaException(env, "Path cannot be null");
+        return;
+    }
+    RollupStore::instance().setPath(path.get());
+}
+
+/**
+ * Counts a recording published on this device in its hour's bucket and
+ * returns the encoded bucket to publish.
+ */
+JNIEXPORT jbyteArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_recordRollup(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jstring juserId,
+        jlong timestamp,
+        jlong durationMs) {
+
+    JniStringWrapper userId(env, juserId);
+    if (!userId.get()) {
+        throwJavaException(env, "User id cannot be null");
+        return nullptr;
+    }
+
+    const RollupRecord rollup = RollupStore::instance().recordPublished(
+            channelId, fromModifiedUtf8(userId.get()), timestamp, durationMs);
+
+    std::vector<uint8_t> bytes;
+    MetadataCodec::encodeRollup(rollup, bytes);
+    jbyteArray result = env->NewByteArray(static_cast<jsize>(bytes.size()));
+    if (result) {
+        env->SetByteArrayRegion(result, 0, static_cast<jsize>(bytes.size()),
+                                reinterpret_cast<const jbyte*>(bytes.data()));
+    }
+    return result;
+}
+
+// Folds a rollup read from the topic; false if the bytes are not a rollup
+JNIEXPORT jboolean JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_foldRollup(
+        JNIEnv* env,
+        jobject /* this */,
+        jbyteArray jbytes) {
+
+    if (!jbytes) return JNI_FALSE;
+
+    RollupRecord rollup;
+    const jsize len = env->GetArrayLength(jbytes);
+    auto* data = static_cast<uint8_t*>(env->GetPrimitiveArrayCritical(jbytes, nullptr));
+    if (!data) return JNI_FALSE;
+    const bool ok = MetadataCodec::decodeRollup(data, static_cast<size_t>(len), rollup);
+    env->ReleasePrimitiveArrayCritical(jbytes, data, JNI_ABORT);
+    if (!ok) return JNI_FALSE;
+
+    RollupStore::instance().fold(rollup);
+    return JNI_TRUE;
+}
+
+// Returns [recordings, durationMs, speakers] per hour, oldest hour first
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_getDensity(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jlong lastHour,
+        jint hours) {
+
+    const auto density = RollupStore::instance().density(channelId, lastHour, hours);
+    std::vector<jlong> values;
+    values.reserve(density.size() * 3);
+    for (const auto& hour : density) {
+        values.push_back(hour.recordings);
+        values.push_back(hour.durationMs);
+        values.push_back(hour.speakers);
+    }
+    const auto len = static_cast<jsize>(values.size());
+    jlongArray result = env->NewLongArray(len);
+    if (result && len > 0) env->SetLongArrayRegion(result, 0, len, values.data());
+    return result;
+}
+
+// --- Timeline index ---
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_clearTimelineIndex(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint channelId) {
+    TimelineIndex::instance().clear(channelId);
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_indexTimelineEntry(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jlong startOffset,
+        jlong startedAt,
+        jlong durationMs,
+        jstring juserId,
+        jint reactionCount) {
+
+    JniStringWrapper userId(env, juserId);
+    if (!userId.get()) {
+        throwJavaException(env, "User id cannot be null");
+        return;
+    }
+    TimelineIndex::instance().upsert(channelId, startOffset, startedAt, durationMs,
+                                     fromModifiedUtf8(userId.get()), reactionCount);
+}
+
+/**
+ * Returns the start offsets of the next page of recordings, newest first.
+ * `cursor` holds [startedAt, startOffset] of the last row already returned
+ * ([Long.MAX_VALUE, Long.MAX_VALUE] for the first page) and is advanced in
+ * place. A null `speaker` matches everyone.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_timelinePage(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jlong fromMs,
+        jlong toMs,
+        jstring jspeaker,
+        jlongArray jcursor,
+        jint limit) {
+
+    if (!jcursor || env->GetArrayLength(jcursor) < 2 || limit < 0) {
+        throwJavaException(env, "Cursor must hold [startedAt, startOffset]");
+        return nullptr;
+    }
+    JniStringWrapper speaker(env, jspeaker);
+    const std::string speakerId = speaker.get() ? fromModifiedUtf8(speaker.get()) : std::string();
+
+    jlong position[2];
+    env->GetLongArrayRegion(jcursor, 0, 2, position);
+
+    std::vector<int64_t> offsets;
+    offsets.reserve(static_cast<size_t>(limit));
+    const TimelineIndex::Key next = TimelineIndex::instance().page(
+            channelId, fromMs, toMs, speakerId, TimelineIndex::Key{position[0], position[1]},
+            static_cast<size_t>(limit), offsets);
+
+    position[0] = next.startedAt;
+    position[1] = next.startOffset;
+    env->SetLongArrayRegion(jcursor, 0, 2, position);
+
+    const auto len = static_cast<jsize>(offsets.size());
+    jlongArray result = env->NewLongArray(len);
+    if (result && len > 0) {
+        env->SetLongArrayRegion(result, 0, len, reinterpret_cast<const jlong*>(offsets.data()));
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_removeFromTimeline(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint channelId,
+        jlong startOffset) {
+    TimelineIndex::instance().remove(channelId, startOffset);
+}
+
+/**
+ * Changes of the rows of the window down to [floorStartedAt, floorStartOffset]
+ * since the previous call, see TimelineIndex::takeChanges.
+ * Returns [insertedCount, updatedCount, deletedCount, inserted..., updated..., deleted...]
+ */
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_takeTimelineChanges(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jlong fromMs,
+        jlong toMs,
+        jstring jspeaker,
+        jlong floorStartedAt,
+        jlong floorStartOffset,
+        jboolean snapshot) {
+
+    JniStringWrapper speaker(env, jspeaker);
+    const std::string speakerId = speaker.get() ? fromModifiedUtf8(speaker.get()) : std::string();
+
+    const TimelineIndex::Changes changes = TimelineIndex::instance().takeChanges(
+            channelId, fromMs, toMs, speakerId, TimelineIndex::Key{floorStartedAt, floorStartOffset},
+            snapshot == JNI_TRUE);
+
+    std::vector<jlong> values;
+    values.reserve(3 + changes.inserted.size() + changes.updated.size() + changes.deleted.size());
+    values.push_back(static_cast<jlong>(changes.inserted.size()));
+    values.push_back(static_cast<jlong>(changes.updated.size()));
+    values.push_back(static_cast<jlong>(changes.deleted.size()));
+    values.insert(values.end(), changes.inserted.begin(), changes.inserted.end());
+    values.insert(values.end(), changes.updated.begin(), changes.updated.end());
+    values.insert(values.end(), changes.deleted.begin(), changes.deleted.end());
+
+    const auto len = static_cast<jsize>(values.size());
+    jlongArray result = env->NewLongArray(len);
+    if (result) env->SetLongArrayRegion(result, 0, len, values.data());
+    return result;
+}
+
+// Returns [recordings, total durationMs, total reactions]
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_timelineSummary(
+        JNIEnv* env,
+        jobject /* this */,
+        jint channelId,
+        jlong fromMs,
+        jlong toMs,
+        jstring jspeaker) {
+
+    JniStringWrapper speaker(env, jspeaker);
+    const std::string speakerId = speaker.get() ? fromModifiedUtf8(speaker.get()) : std::string();
+    const TimelineIndex::Summary summary = TimelineIndex::instance().summarize(channelId, fromMs, toMs, speakerId);
+
+    const jlong values[3] = {summary.recordings, summary.durationMs, summary.reactions};
+    jlongArray result = env->NewLongArray(3);
+    if (result) env->SetLongArrayRegion(result, 0, 3, values);
+    return result;
+}
+
+
+// --- Timeline snapshot ---
+
+/**
+ * Saves `records` of `topic`/`partition` at `path` together with the
+ * reaction votes folded for `channelId` from deltas.
+ */
+JNIEXPORT jboolean JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_saveTimelineSnapshot(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring jpath,
+        jstring jtopic,
+        jint partition,
+        jint channelId,
+        jlong nextOffset,
+        jobjectArray jrecords) {
+
+    JniStringWrapper path(env, jpath);
+    JniStringWrapper topic(env, jtopic);
+    if (!path.get() || !topic.get() || !jrecords) {
+        throwJavaException(env, "Path, topic and records are required");
+        return JNI_FALSE;
+    }
+
+    const jsize count = env->GetArrayLength(jrecords);
+    std::vector<std::vector<uint8_t>> records;
+    records.reserve(static_cast<size_t>(count));
+    for (jsize i = 0; i < count; i++) {
+        auto jbytes = static_cast<jbyteArray>(env->GetObjectArrayElement(jrecords, i));
+        if (!jbytes) continue;
+        const jsize len = env->GetArrayLength(jbytes);
+        std::vector<uint8_t> bytes(static_cast<size_t>(len));
+        env->GetByteArrayRegion(jbytes, 0, len, reinterpret_cast<jbyte*>(bytes.data()));
+        env->DeleteLocalRef(jbytes);
+        records.push_back(std::move(bytes));
+    }
+
+    const TimelineCheckpoint checkpoint{topic.get(), partition, nextOffset};
+    const std::vector<ReactionDelta> votes = ReactionAggregator::instance().votes(channelId);
+    return TimelineSnapshot::save(path.get(), checkpoint, records, votes) ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Loads the snapshot of `topic`/`partition` at `path`, folds its reaction
+ * votes back into `channelId`'s reactions, sets checkpoint[0] to the offset
+ * to resume consuming from and returns its records, or null if there is no
+ * usable snapshot.
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_loadTimelineSnapshot(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring jpath,
+        jstring jtopic,
+        jint partition,
+        jint channelId,
+        jlongArray jcheckpoint) {
+
+    JniStringWrapper path(env, jpath);
+    JniStringWrapper topic(env, jtopic);
+    if (!path.get() || !topic.get() || !jcheckpoint || env->GetArrayLength(jcheckpoint) < 1) {
+        throwJavaException(env, "Path, topic and a checkpoint array are required");
+        return nullptr;
+    }
+
+    TimelineCheckpoint checkpoint{topic.get(), partition, 0};
+    std::vector<MetadataRecord> records;
+    std::vector<ReactionDelta> votes;
+    if (!TimelineSnapshot::load(path.get(), checkpoint, channelId, records, votes)) return nullptr;
+    for (const ReactionDelta& vote : votes) {
+        ReactionAggregator::instance().apply(vote, false);
+    }
+
+    const MetadataFactory* f = metadataFactory(env);
+    if (!f) {
+        throwJavaException(env, "Failed to resolve AudioMetadata.fromDecoded");
+        return nullptr;
+    }
+
+    jobjectArray result = env->NewObjectArray(static_cast<jsize>(records.size()), f->metadataClass, nullptr);
+    if (!result) return nullptr;
+    for (size_t i = 0; i < records.size(); i++) {
+        jobject metadata = newAudioMetadata(env, f, records[i]);
+        if (!metadata) return nullptr;
+        env->SetObjectArrayElement(result, static_cast<jsize>(i), metadata);
+        env->DeleteLocalRef(metadata);
+    }
+
+    const jlong nextOffset = checkpoint.nextOffset;
+    env->SetLongArrayRegion(jcheckpoint, 0, 1, &nextOffset);
+    return result;
+}
+
+
+// --- Speaker partitioning ---
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_mergePartitions(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong consumerPtr,
+        jint holdBackMs) {
+
+    if (consumerPtr == 0) {
+        throwJavaException(env, "Consumer pointer cannot be null");
+        return;
+    }
+    PlayoutMerger::instance().attach(reinterpret_cast<rd_kafka_t*>(consumerPtr), holdBackMs);
+}
+
+// --- Channel activity ---
+
+/**
+ * Starts watching the watermarks of every channel through `handlePtr`. The
+ * arrays describe one channel per index; the monitor must be stopped before
+ * the handle is released.
+ */
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_startActivityMonitor(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong handlePtr,
+        jobjectArray jaudioTopics,
+        jobjectArray jmetadataTopics,
+        jintArray jmetadataPartitions,
+        jint intervalMs) {
+
+    if (handlePtr == 0 || !jaudioTopics || !jmetadataTopics || !jmetadataPartitions) {
+        throwJavaException(env, "Invalid arguments");
+        return;
+    }
+    const jsize count = env->GetArrayLength(jaudioTopics);
+    if (env->GetArrayLength(jmetadataTopics) != count || env->GetArrayLength(jmetadataPartitions) != count) {
+        throwJavaException(env, "Channel arrays differ in length");
+        return;
+    }
+
+    std::vector<jint> metadataPartitions(static_cast<size_t>(count));
+    env->GetIntArrayRegion(jmetadataPartitions, 0, count, metadataPartitions.data());
+
+    std::vector<ActivityMonitor::Channel> channels;
+    for (jsize i = 0; i < count; i++) {
+        auto jaudio = static_cast<jstring>(env->GetObjectArrayElement(jaudioTopics, i));
+        auto jmetadata = static_cast<jstring>(env->GetObjectArrayElement(jmetadataTopics, i));
+        {
+            JniStringWrapper audio(env, jaudio);
+            JniStringWrapper metadata(env, jmetadata);
+            if (!audio.get() || !metadata.get()) {
+                throwJavaException(env, "Invalid channel topic");
+                return;
+            }
+            channels.push_back({audio.get(), metadata.get(), metadataPartitions[static_cast<size_t>(i)]});
+        }
+        env->DeleteLocalRef(jaudio);
+        env->DeleteLocalRef(jmetadata);
+    }
+
+    ActivityMonitor::instance().start(reinterpret_cast<rd_kafka_t*>(handlePtr), std::move(channels), intervalMs);
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_stopActivityMonitor(
+        JNIEnv* env,
+        jobject /* this */) {
+
+    ActivityMonitor::instance().stop();
+}
+
+// Returns [talking, audioPerMinute, metadataPerMinute, lastTalkMs] per channel
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_getChannelActivity(
+        JNIEnv* env,
+        jobject /* this */) {
+
+    const std::vector<ChannelActivity> activity = ActivityMonitor::instance().snapshot();
+    std::vector<jlong> values;
+    values.reserve(activity.size() * 4);
+    for (const ChannelActivity& channel : activity) {
+        values.push_back(channel.talking ? 1 : 0);
+        values.push_back(channel.audioPerMinute);
+        values.push_back(channel.metadataPerMinute);
+        values.push_back(channel.lastTalkMs);
+    }
+    jlongArray result = env->NewLongArray(static_cast<jsize>(values.size()));
+    if (result) env->SetLongArrayRegion(result, 0, static_cast<jsize>(values.size()), values.data());
+    return result;
+}
+
+// --- Frame encryption ---
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_setFrameKey(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring jtopic,
+        jint algorithm,
+        jbyteArray jkey) {
+
+    JniStringWrapper topic(env, jtopic);
+    if (!topic.get() || !jkey ||
+        (algorithm != static_cast<jint>(FrameAlgorithm::Aes128Gcm) &&
+         algorithm != static_cast<jint>(FrameAlgorithm::ChaCha20Poly1305))) {
+        throwJavaException(env, "Invalid arguments");
+        return;
+    }
+
+    std::vector<uint8_t> key(static_cast<size_t>(env->GetArrayLength(jkey)));
+    env->GetByteArrayRegion(jkey, 0, static_cast<jsize>(key.size()), reinterpret_cast<jbyte*>(key.data()));
+    std::string error;
+    const bool ok = FrameCipher::instance().setKey(topic.get(), static_cast<FrameAlgorithm>(algorithm),
+                                                   key.data(), key.size(), error);
+    std::fill(key.begin(), key.end(), 0);
+    if (!ok) {
+        throwJavaException(env, error.c_str());
+    }
+}
+
+/**
+ * Seals, then opens `frames` frames of `frameBytes` bytes under a throwaway
+ * key of `algorithm`, the way recordings and the audio consume paths do, for
+ * FrameCipherBenchmark. Returns [seal ns, open ns] per frame; throws if a
+ * frame does not come back intact.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_benchmarkFrameCipher(
+        JNIEnv* env,
+        jobject /* this */,
+        jint algorithm,
+        jint frameBytes,
+        jint frames) {
+
+    if ((algorithm != static_cast<jint>(FrameAlgorithm::Aes128Gcm) &&
+         algorithm != static_cast<jint>(FrameAlgorithm::ChaCha20Poly1305)) || frameBytes <= 0 || frames <= 0) {
+        throwJavaException(env, "Invalid arguments");
+        return nullptr;
+    }
+
+    const auto cipher = static_cast<FrameAlgorithm>(algorithm);
+    const std::vector<uint8_t> key(cipher == FrameAlgorithm::ChaCha20Poly1305 ? 32 : 16, 0x5A);
+    std::string error;
+    FrameKey frameKey(cipher, key.data(), key.size(), error);
+    std::string recordKey;
+    if (!frameKey.valid() || !FrameKey::sessionKey("benchmark", 0, recordKey)) {
+        throwJavaException(env, error.empty() ? "No random nonce prefix" : error.c_str());
+        return nullptr;
+    }
+    const auto* keyBytes = reinterpret_cast<const uint8_t*>(recordKey.data());
+
+    // Every sealed frame is kept, so the open pass reads what the seal pass wrote
+    const auto plainLen = static_cast<size_t>(frameBytes);
+    const size_t stride = FrameKey::prefixBytes(static_cast<uint32_t>(frames)) + plainLen + FrameKey::kTagBytes;
+    std::vector<uint8_t> plain(plainLen);
+    for (size_t i = 0; i < plainLen; i++) plain[i] = static_cast<uint8_t>(i * 31);
+    std::vector<uint8_t> sealed(stride * static_cast<size_t>(frames));
+    std::vector<size_t> sealedLen(static_cast<size_t>(frames));
+    std::vector<uint8_t> opened(plainLen);
+
+    const auto sealStart = std::chrono::steady_clock::now();
+    for (uint32_t sequence = 0; sequence < static_cast<uint32_t>(frames); sequence++) {
+        uint8_t* frame = sealed.data() + stride * sequence;
+        memcpy(frame + FrameKey::prefixBytes(sequence), plain.data(), plainLen);
+        sealedLen[sequence] = frameKey.seal(keyBytes, recordKey.size(), sequence, frame, plainLen);
+    }
+    const auto openStart = std::chrono::steady_clock::now();
+    int broken = 0;
+    for (uint32_t sequence = 0; sequence < static_cast<uint32_t>(frames); sequence++) {
+        if (sealedLen[sequence] == 0 ||
+            !frameKey.open(keyBytes, recordKey.size(), sealed.data() + stride * sequence, sealedLen[sequence],
+                           opened.data()) ||
+            memcmp(opened.data(), plain.data(), plainLen) != 0) {
+            broken++;
+        }
+    }
+    const auto openEnd = std::chrono::steady_clock::now();
+
+    if (broken > 0) {
+        throwJavaException(env, (std::to_string(broken) + " frames did not survive sealing").c_str());
+        return nullptr;
+    }
+    auto perFrameNs = [frames](std::chrono::steady_clock::duration elapsed) {
+        return static_cast<jlong>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / frames);
+    };
+    const jlong values[] = {perFrameNs(openStart - sealStart), perFrameNs(openEnd - openStart)};
+    jlongArray result = env->NewLongArray(2);
+    if (result) env->SetLongArrayRegion(result, 0, 2, values);
+    return result;
+}
+
+// --- Recording sessions ---
+
+/**
+ * Starts a recording on the pooled producer `producerPtr` (see
+ * RecordingSession). Returns its id.
+ */
+JNIEXPORT jlong JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_startRecording(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong producerPtr,
+        jstring jaudioTopic,
+        jstring jmetadataTopic,
+        jint metadataPartition,
+        jint rollupPartition,
+        jstring juserId,
+        jint channelId,
+        jlong startedAtMs,
+        jlong frameDurationMs,
+        jlong indexIntervalMs,
+        jint frameQos) {
+
+    JniStringWrapper audioTopic(env, jaudioTopic);
+    JniStringWrapper metadataTopic(env, jmetadataTopic);
+    JniStringWrapper userId(env, juserId);
+    if (!producerPtr || !audioTopic.get() || !metadataTopic.get() || !userId.get() || frameDurationMs <= 0 ||
+        (frameQos != static_cast<jint>(QosClass::Ordered) && frameQos != static_cast<jint>(QosClass::Realtime))) {
+        throwJavaException(env, "Invalid arguments");
+        return 0;
+    }
+
+    RecordingSpec spec;
+    spec.producer = reinterpret_cast<rd_kafka_t*>(producerPtr);
+    spec.audioTopic = audioTopic.get();
+    spec.metadataTopic = metadataTopic.get();
+    spec.metadataPartition = metadataPartition;
+    spec.rollupPartition = rollupPartition;
+    spec.userId = fromModifiedUtf8(userId.get());
+    spec.channelId = channelId;
+    spec.startedAtMs = startedAtMs;
+    spec.frameDurationMs = frameDurationMs;
+    spec.indexIntervalMs = indexIntervalMs;
+    spec.frameQos = static_cast<QosClass>(frameQos);
+
+    std::string error;
+    const int64_t id = Recorder::instance().begin(std::move(spec), error);
+    if (id == 0) {
+        throwJavaException(env, error.c_str());
+    }
+    return static_cast<jlong>(id);
+}
+
+/**
+ * Queues the next frame of `recording` without waiting for it. Only enqueue
+ * failures (e.g. a full queue) throw; the frame then counts as dropped.
+ */
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_recordFrame(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong recording,
+        jbyteArray jvalue) {
+
+    std::shared_ptr<RecordingSession> session = Recorder::instance().find(recording);
+    if (!session || !jvalue) {
+        throwJavaException(env, "Invalid arguments");
+        return;
+    }
+
+    static thread_local std::vector<uint8_t> frame;
+    frame.resize(static_cast<size_t>(env->GetArrayLength(jvalue)));
+    env->GetByteArrayRegion(jvalue, 0, static_cast<jsize>(frame.size()), reinterpret_cast<jbyte*>(frame.data()));
+
+    rd_kafka_resp_err_t err = session->addFrame(frame.data(), frame.size());
     if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
         throwJavaException(env, rd_kafka_err2str(err));
     }
 }
 
+// No more frames; the recording publishes itself once the last one is acked
 JNIEXPORT void JNICALL
-Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_destroyProducer(
-        JNIEnv *env,
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_endRecording(
+        JNIEnv* /* env */,
         jobject /* this */,
-        jlong producerPtr) {
+        jlong recording) {
 
-    if (producerPtr == 0) return;
-    auto *producer = reinterpret_cast<rd_kafka_t *>(producerPtr);
-    rd_kafka_destroy(producer);
+    std::shared_ptr<RecordingSession> session = Recorder::instance().find(recording);
+    if (session) session->finish();
+}
+
+/**
+ * Waits up to `timeoutMs` for `recording` to be published or to fail.
+ * Returns [state, framesEnqueued, framesDelivered, framesDropped,
+ * bytesEnqueued, bytesDelivered, audioPartition, startOffset, endOffset,
+ * firstFrameTime, lastFrameTime], or null for an unknown recording.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_awaitRecording(
+        JNIEnv* env,
+        jobject /* this */,
+        jlong recording,
+        jint timeoutMs) {
+
+    std::shared_ptr<RecordingSession> session = Recorder::instance().find(recording);
+    if (!session) return nullptr;
+
+    const RecordingSummary summary = session->await(timeoutMs);
+    const jlong values[] = {
+            static_cast<jlong>(summary.state),
+            summary.framesEnqueued, summary.framesDelivered, summary.framesDropped,
+            summary.bytesEnqueued, summary.bytesDelivered,
+            summary.audioPartition, summary.startOffset, summary.endOffset,
+            summary.firstFrameTime, summary.lastFrameTime,
+    };
+    const jsize count = static_cast<jsize>(sizeof(values) / sizeof(values[0]));
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
+    }
+    return result;
+}
+
+// Drops the id of `recording`; one that was never finished is finished now
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_forgetRecording(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jlong recording) {
+
+    Recorder::instance().forget(recording);
+}
+
+/** [enqueued, delivered, failed, retries, duplicates, reordered] */
+JNIEXPORT jlongArray JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_getFrameDeliveryStats(
+        JNIEnv* env,
+        jobject /* this */) {
+
+    const FrameDeliveryStats stats = FramePipeline::instance().stats();
+    const jlong values[] = {
+            stats.enqueued, stats.delivered, stats.failed, stats.retries, stats.duplicates, stats.reordered,
+    };
+    jlongArray result = env->NewLongArray(6);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 6, values);
+    }
+    return result;
+}
+
+// --- Native logging ---
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_setNativeLogLevel(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint priority) {
+
+    NativeLog::instance().setLevel(priority);
+}
+
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_setLogRate(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring facility,
+        jint perSecond,
+        jint sampleEvery) {
+
+    JniStringWrapper name(env, facility);
+    NativeLog::instance().setRate(name.get(), perSecond, sampleEvery);
+}
+
+// Shared sink for Kotlin hot paths: the message is only copied once admitted
+JNIEXPORT void JNICALL
+Java_org_github_cyterdan_chat_1over_1kafka_RdKafka_logMessage(
+        JNIEnv* env,
+        jobject /* this */,
+        jint priority,
+        jstring tag,
+        jstring message) {
+
+    NativeLog& log = NativeLog::instance();
+    if (priority < log.level()) return;
+    JniStringWrapper tagStr(env, tag);
+    if (!tagStr.get() || !log.admit(priority, tagStr.get())) return;
+    JniStringWrapper text(env, message);
+    if (text.get()) {
+        log.push(priority, tagStr.get(), "", text.get());
+    }
 }
 
 } // extern "C"
@@ -5,10 +5,17 @@
 #ifndef CHAT_OVER_KAFKA_NATIVELIB_H
 #define CHAT_OVER_KAFKA_NATIVELIB_H
 
+#include <rdkafka.h>
 
-class nativelib {
+// Callbacks shared by every client handle, defined in nativelib.cpp.
 
-};
+extern "C" {
+
+void kafka_log_callback(const rd_kafka_t* rk, int level, const char* fac, const char* buf);
+
+void delivery_report_cb(rd_kafka_t* rk, const rd_kafka_message_t* msg, void* opaque);
+
+} // extern "C"
 
 
 #endif //CHAT_OVER_KAFKA_NATIVELIB_H
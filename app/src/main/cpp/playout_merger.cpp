@@ -0,0 +1,107 @@
+#include "playout_merger.h"
+
+#include <algorithm>
+
+// A partition that delivered nothing for this long is considered idle: its
+// next message cannot be older than what the others are playing now.
+static const auto kIdleAfter = std::chrono::seconds(1);
+
+PlayoutMerger& PlayoutMerger::instance() {
+    static PlayoutMerger merger;
+    return merger;
+}
+
+void PlayoutMerger::attach(rd_kafka_t* rk, int holdBackMs) {
+    std::unique_ptr<Stream> stream(new Stream);
+    stream->holdBack = std::chrono::milliseconds(std::max(holdBackMs, 0));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streams[rk] = std::move(stream);
+}
+
+void PlayoutMerger::detach(rd_kafka_t* rk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streams.erase(rk);
+}
+
+PlayoutMerger::Stream::~Stream() {
+    for (auto& entry : partitions) {
+        for (const Held& held : entry.second.held) {
+            rd_kafka_message_destroy(held.message);
+        }
+    }
+}
+
+void PlayoutMerger::Stream::push(rd_kafka_message_t* message, Clock::time_point now) {
+    rd_kafka_timestamp_type_t type;
+    int64_t timestamp = rd_kafka_message_timestamp(message, &type);
+    if (type == RD_KAFKA_TIMESTAMP_NOT_AVAILABLE || timestamp < 0) {
+        // Untimed records keep their arrival position
+        timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    Partition& partition = partitions[{message->rkt, message->partition}];
+    partition.held.push_back(Held{message, timestamp, now});
+    partition.lastArrival = now;
+}
+
+rd_kafka_message_t* PlayoutMerger::Stream::popDue(Clock::time_point now) {
+    Partition* oldest = nullptr;
+    for (auto& entry : partitions) {
+        Partition& partition = entry.second;
+        if (partition.held.empty()) continue;
+        if (!oldest || partition.held.front().timestamp < oldest->held.front().timestamp) {
+            oldest = &partition;
+        }
+    }
+    if (!oldest) return nullptr;
+
+    // Due if no live partition could still deliver something older, or it waited long enough
+    bool due = now - oldest->held.front().arrived >= holdBack;
+    if (!due) {
+        due = std::none_of(partitions.begin(), partitions.end(), [&](const decltype(partitions)::value_type& entry) {
+            return entry.second.held.empty() && now - entry.second.lastArrival < kIdleAfter;
+        });
+    }
+    if (!due) return nullptr;
+
+    rd_kafka_message_t* message = oldest->held.front().message;
+    oldest->held.pop_front();
+    return message;
+}
+
+int PlayoutMerger::Stream::msUntilDue(Clock::time_point now, int timeoutMs) const {
+    int wait = timeoutMs;
+    for (const auto& entry : partitions) {
+        if (entry.second.held.empty()) continue;
+        // Rounded up, so the wait never ends just before the head is due
+        const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                entry.second.held.front().arrived + holdBack - now).count();
+        wait = std::min<int>(wait, static_cast<int>(std::max<int64_t>(left, 0)));
+    }
+    return wait;
+}
+
+rd_kafka_message_t* PlayoutMerger::poll(rd_kafka_t* rk, int timeoutMs) {
+    Stream* stream;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_streams.find(rk);
+        stream = it == m_streams.end() ? nullptr : it->second.get();
+    }
+    // A consumer is only polled by one thread at a time, which also detaches it
+    if (!stream) return rd_kafka_consumer_poll(rk, timeoutMs);
+
+    while (true) {
+        const auto now = Clock::now();
+        if (rd_kafka_message_t* due = stream->popDue(now)) return due;
+
+        rd_kafka_message_t* message = rd_kafka_consumer_poll(rk, stream->msUntilDue(now, timeoutMs));
+        if (!message) {
+            // Timed out or woken: hand out whatever became due meanwhile
+            return stream->popDue(Clock::now());
+        }
+        if (message->err) return message;
+        stream->push(message, Clock::now());
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef CHAT_OVER_KAFKA_PLAYOUT_MERGER_H
+#define CHAT_OVER_KAFKA_PLAYOUT_MERGER_H
+
+#include <rdkafka.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+/**
+ * Merges the partitions a consumer reads into one stream ordered by broker
+ * timestamp, for live playout of a channel whose speakers write to different
+ * partitions (see speaker_partitioner.h).
+ *
+ * Each partition is already in order, so messages are held in one queue per
+ * partition and the oldest head is released once every partition that
+ * delivered recently has a head to compare it with. A partition that went
+ * quiet cannot hold the stream back for longer than the hold-back delay, and
+ * one that has been silent for a while is not waited for at all, so a single
+ * speaker plays with no added latency.
+ *
+ * Attached consumers are polled through poll() instead of
+ * rd_kafka_consumer_poll(); both hand out messages the caller destroys.
+ * Consumers must be detached before they are reused or destroyed.
+ */
+class PlayoutMerger {
+public:
+    static PlayoutMerger& instance();
+
+    /** Merges `rk`'s partitions from now on, holding messages back up to `holdBackMs`. */
+    void attach(rd_kafka_t* rk, int holdBackMs);
+
+    /** Stops merging `rk` and destroys the messages still held. */
+    void detach(rd_kafka_t* rk);
+
+    /**
+     * Returns the next message of `rk` in merged order, an error or EOF event
+     * as soon as it is polled, or nullptr once `timeoutMs` passed (or the
+     * consumer was woken) without a message being due.
+     */
+    rd_kafka_message_t* poll(rd_kafka_t* rk, int timeoutMs);
+
+private:
+    PlayoutMerger() = default;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Held {
+        rd_kafka_message_t* message;
+        int64_t timestamp;
+        Clock::time_point arrived;
+    };
+
+    struct Partition {
+        std::deque<Held> held;
+        Clock::time_point lastArrival;
+    };
+
+    struct Stream {
+        Clock::duration holdBack;
+        std::map<std::pair<rd_kafka_topic_t*, int32_t>, Partition> partitions;
+
+        ~Stream();
+        void push(rd_kafka_message_t* message, Clock::time_point now);
+        rd_kafka_message_t* popDue(Clock::time_point now);
+        // How long poll may wait before the oldest head is due anyway
+        int msUntilDue(Clock::time_point now, int timeoutMs) const;
+    };
+
+    std::mutex m_mutex;
+    std::map<rd_kafka_t*, std::unique_ptr<Stream>> m_streams;
+};
+
+#endif //CHAT_OVER_KAFKA_PLAYOUT_MERGER_H
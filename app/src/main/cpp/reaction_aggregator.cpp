@@ -0,0 +1,102 @@
+#include "reaction_aggregator.h"
+
+#include <limits>
+
+// Votes taken from a snapshot lose against any delta.
+static const int64_t kSnapshotTimestamp = std::numeric_limits<int64_t>::min();
+
+ReactionAggregator& ReactionAggregator::instance() {
+    static ReactionAggregator aggregator;
+    return aggregator;
+}
+
+void ReactionAggregator::seed(const MetadataRecord& record) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& votes = m_entries[{record.channelId, record.startOffset}];
+
+    for (auto it = votes.begin(); it != votes.end();) {
+        if (it->second.timestamp == kSnapshotTimestamp) {
+            it = votes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const auto& reaction : record.reactions) {
+        for (const auto& user : reaction.second) {
+            votes.emplace(std::make_pair(reaction.first, user), Vote{kSnapshotTimestamp, true});
+        }
+    }
+}
+
+bool ReactionAggregator::apply(const ReactionDelta& delta, bool local) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const EntryKey key{delta.channelId, delta.startOffset};
+    auto& votes = m_entries[key];
+
+    auto it = votes.find({delta.emoji, delta.userId});
+    if (it != votes.end()) {
+        const Vote& current = it->second;
+        const bool newer = delta.timestamp > current.timestamp ||
+                (delta.timestamp == current.timestamp && delta.added && !current.added);
+        if (!newer) return false;
+        it->second = Vote{delta.timestamp, delta.added};
+    } else {
+        votes.emplace(std::make_pair(delta.emoji, delta.userId), Vote{delta.timestamp, delta.added});
+    }
+
+    if (local) m_compactable.insert(key);
+    return true;
+}
+
+ReactionAggregator::Reactions ReactionAggregator::reactions(int32_t channelId, int64_t startOffset) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Reactions result;
+    auto entry = m_entries.find({channelId, startOffset});
+    if (entry == m_entries.end()) return result;
+
+    for (const auto& vote : entry->second) {
+        if (!vote.second.added) continue;
+        const std::string& emoji = vote.first.first;
+        if (result.empty() || result.back().first != emoji) {
+            result.emplace_back(emoji, std::vector<std::string>());
+        }
+        result.back().second.push_back(vote.first.second);
+    }
+    return result;
+}
+
+std::vector<ReactionDelta> ReactionAggregator::votes(int32_t channelId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<ReactionDelta> result;
+    for (auto entry = m_entries.lower_bound({channelId, std::numeric_limits<int64_t>::min()});
+         entry != m_entries.end() && entry->first.first == channelId; ++entry) {
+        for (const auto& vote : entry->second) {
+            if (vote.second.timestamp == kSnapshotTimestamp) continue;
+            ReactionDelta delta;
+            delta.channelId = channelId;
+            delta.startOffset = entry->first.second;
+            delta.emoji = vote.first.first;
+            delta.userId = vote.first.second;
+            delta.added = vote.second.added;
+            delta.timestamp = vote.second.timestamp;
+            result.push_back(std::move(delta));
+        }
+    }
+    return result;
+}
+
+std::vector<int64_t> ReactionAggregator::takeCompactable(int32_t channelId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<int64_t> due;
+    auto it = m_compactable.lower_bound({channelId, std::numeric_limits<int64_t>::min()});
+    while (it != m_compactable.end() && it->first == channelId) {
+        due.push_back(it->second);
+        it = m_compactable.erase(it);
+    }
+    return due;
+}
+
+void ReactionAggregator::keepCompactable(int32_t channelId, int64_t startOffset) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_compactable.insert({channelId, startOffset});
+}
@@ -0,0 +1,79 @@
+#ifndef CHAT_OVER_KAFKA_REACTION_AGGREGATOR_H
+#define CHAT_OVER_KAFKA_REACTION_AGGREGATOR_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "metadata_codec.h"
+
+/**
+ * Folds reaction deltas into per-recording reaction sets.
+ *
+ * Every (recording, emoji, user) resolves last-writer-wins on the delta
+ * timestamp (an add beats a remove with the same timestamp), so deltas can be
+ * applied in any order, any number of times, by any client and still converge.
+ * Full metadata records act as a snapshot underneath the deltas: they seed the
+ * state, and any delta seen for the same (emoji, user) overrides them.
+ *
+ * Recordings that received deltas produced on this device are remembered
+ * until takeCompactable() for their channel, whose caller writes the folded
+ * set back under the recording's key.
+ */
+class ReactionAggregator {
+public:
+    // emoji -> ids of the users who reacted with it, as in MetadataRecord
+    using Reactions = std::vector<std::pair<std::string, std::vector<std::string>>>;
+
+    static ReactionAggregator& instance();
+
+    /** Replaces the snapshot layer of `record`'s recording with its reactions. */
+    void seed(const MetadataRecord& record);
+
+    /**
+     * Applies `delta`. Returns true if it changed the folded state; replays
+     * and deltas older than what is known return false. `local` marks the
+     * recording for compaction.
+     */
+    bool apply(const ReactionDelta& delta, bool local);
+
+    /** Folded reactions of a recording, emojis and users in byte order. */
+    Reactions reactions(int32_t channelId, int64_t startOffset);
+
+    /**
+     * The votes of `channelId`'s recordings that came from deltas, as deltas.
+     * A timeline snapshot keeps them so that, once apply()'d again on restore,
+     * a full record seen later cannot seed them away.
+     */
+    std::vector<ReactionDelta> votes(int32_t channelId);
+
+    /**
+     * Returns and forgets the recordings of `channelId` due for compaction.
+     * Those of other channels stay due until their own channel is open.
+     */
+    std::vector<int64_t> takeCompactable(int32_t channelId);
+
+    /** Marks a recording taken by takeCompactable() as due again, e.g. because it could not be written yet. */
+    void keepCompactable(int32_t channelId, int64_t startOffset);
+
+private:
+    ReactionAggregator() = default;
+
+    using EntryKey = std::pair<int32_t, int64_t>;
+
+    struct Vote {
+        int64_t timestamp;
+        bool added;
+    };
+
+    std::mutex m_mutex;
+    // (emoji, user) -> latest vote, per recording
+    std::map<EntryKey, std::map<std::pair<std::string, std::string>, Vote>> m_entries;
+    std::set<EntryKey> m_compactable;
+};
+
+#endif //CHAT_OVER_KAFKA_REACTION_AGGREGATOR_H
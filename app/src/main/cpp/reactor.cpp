@@ -0,0 +1,184 @@
+#include "reactor.h"
+
+#include <android/log.h>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static const char* const LOG_TAG = "Reactor";
+
+static const int kMaxEvents = 16;
+
+Reactor& Reactor::instance() {
+    static Reactor reactor;
+    return reactor;
+}
+
+Reactor::~Reactor() {
+    if (m_thread.joinable()) {
+        uint64_t one = 1;
+        if (write(m_stopFd, &one, sizeof(one)) < 0) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Failed to signal reactor shutdown");
+        }
+        m_thread.join();
+    }
+    if (m_stopFd >= 0) close(m_stopFd);
+    if (m_epollFd >= 0) close(m_epollFd);
+}
+
+bool Reactor::ensureStarted() {
+    // Called with m_mutex held.
+    if (m_thread.joinable()) return true;
+
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd < 0 || m_stopFd < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "Cannot create epoll/eventfd");
+        if (m_stopFd >= 0) close(m_stopFd);
+        if (m_epollFd >= 0) close(m_epollFd);
+        m_stopFd = m_epollFd = -1;
+        return false;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_stopFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_stopFd, &ev);
+
+    m_thread = std::thread(&Reactor::loop, this);
+    return true;
+}
+
+bool Reactor::attach(rd_kafka_t* rk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_byHandle.count(rk)) return true;
+    if (!ensureStarted()) return false;
+
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) return false;
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // librdkafka writes this payload to the fd whenever the queue turns
+    // non-empty; an eventfd needs exactly 8 bytes.
+    static const uint64_t kWake = 1;
+    rd_kafka_queue_t* queue = rd_kafka_queue_get_main(rk);
+    rd_kafka_queue_io_event_enable(queue, fd, &kWake, sizeof(kWake));
+    rd_kafka_queue_destroy(queue);
+
+    m_byFd[fd] = rk;
+    m_byHandle[rk] = fd;
+
+    // Anything queued before the fd was installed would never signal it.
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Initial wakeup failed for %s", rd_kafka_name(rk));
+    }
+    return true;
+}
+
+void Reactor::detach(rd_kafka_t* rk) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_byHandle.find(rk);
+    if (it == m_byHandle.end()) return;
+
+    // The caller destroys `rk` next: let a poll in progress finish first,
+    // unless this is one of its callbacks
+    if (std::this_thread::get_id() != m_thread.get_id()) {
+        m_dispatched.wait(lock, [this, rk] { return m_dispatching != rk; });
+        it = m_byHandle.find(rk);
+        if (it == m_byHandle.end()) return;
+    }
+
+    rd_kafka_queue_t* queue = rd_kafka_queue_get_main(rk);
+    rd_kafka_queue_io_event_enable(queue, -1, nullptr, 0);
+    rd_kafka_queue_destroy(queue);
+
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, it->second, nullptr);
+    close(it->second);
+    m_byFd.erase(it->second);
+    m_byHandle.erase(it);
+}
+
+bool Reactor::serves(rd_kafka_t* rk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_byHandle.count(rk) != 0;
+}
+
+void Reactor::loop() {
+    epoll_event events[kMaxEvents];
+    while (true) {
+        int n = epoll_wait(m_epollFd, events, kMaxEvents, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, "epoll_wait failed: %d", errno);
+            return;
+        }
+        m_wakeups.fetch_add(1, std::memory_order_relaxed);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == m_stopFd) return;
+            dispatch(events[i].data.fd);
+        }
+    }
+}
+
+void Reactor::dispatch(int fd) {
+    rd_kafka_t* rk;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_byFd.find(fd);
+        if (it == m_byFd.end()) return;
+        rk = it->second;
+
+        uint64_t count;
+        while (read(fd, &count, sizeof(count)) > 0) {}
+        // Keeps detach (and therefore rd_kafka_destroy) waiting until the poll is done
+        m_dispatching = rk;
+    }
+
+    // Callbacks run without the lock, so they may attach or detach handles
+    int64_t served = 0;
+    int n;
+    while ((n = rd_kafka_poll(rk, 0)) > 0) {
+        served += n;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_dispatching = nullptr;
+    }
+    m_dispatched.notify_all();
+    if (served == 0) {
+        m_emptyWakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_eventsServed.fetch_add(served, std::memory_order_relaxed);
+}
+
+void Reactor::recordDeliveryWake(std::chrono::steady_clock::duration latency) {
+    const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    m_deliveryWakes.fetch_add(1, std::memory_order_relaxed);
+    m_deliveryWakeTotalUs.fetch_add(us, std::memory_order_relaxed);
+    int64_t max = m_deliveryWakeMaxUs.load(std::memory_order_relaxed);
+    while (us > max && !m_deliveryWakeMaxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+}
+
+ReactorStats Reactor::stats() {
+    ReactorStats stats;
+    stats.wakeups = m_wakeups.load(std::memory_order_relaxed);
+    stats.eventsServed = m_eventsServed.load(std::memory_order_relaxed);
+    stats.emptyWakeups = m_emptyWakeups.load(std::memory_order_relaxed);
+    stats.deliveryWakes = m_deliveryWakes.load(std::memory_order_relaxed);
+    stats.avgDeliveryWakeUs = stats.deliveryWakes > 0
+            ? m_deliveryWakeTotalUs.load(std::memory_order_relaxed) / stats.deliveryWakes : 0;
+    stats.maxDeliveryWakeUs = m_deliveryWakeMaxUs.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.handles = static_cast<int64_t>(m_byHandle.size());
+    return stats;
+}
@@ -0,0 +1,81 @@
+#ifndef CHAT_OVER_KAFKA_REACTOR_H
+#define CHAT_OVER_KAFKA_REACTOR_H
+
+#include <rdkafka.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+
+/**
+ * Wakeup and latency counters.
+ */
+struct ReactorStats {
+    int64_t wakeups = 0;          // epoll returns
+    int64_t eventsServed = 0;     // callbacks/events served by rd_kafka_poll
+    int64_t emptyWakeups = 0;     // wakeups that found nothing to serve
+    int64_t deliveryWakes = 0;    // blocked producers woken by a delivery report
+    int64_t avgDeliveryWakeUs = 0;
+    int64_t maxDeliveryWakeUs = 0;
+    int64_t handles = 0;
+};
+
+/**
+ * Serves the main queue of every native handle from one epoll thread.
+ *
+ * Each attached handle gets an eventfd that librdkafka writes to when its
+ * main queue goes from empty to non-empty (rd_kafka_queue_io_event_enable).
+ * The reactor sleeps in epoll_wait with no timeout and drains the queue with
+ * rd_kafka_poll(rk, 0) on wakeup, so delivery reports, statistics and errors
+ * are dispatched exactly when they arrive and an idle app does not wake at
+ * all. Blocking produce calls then only wait on their condition variable.
+ *
+ * Handles must be detached before rd_kafka_destroy.
+ */
+class Reactor {
+public:
+    static Reactor& instance();
+    ~Reactor();
+
+    /** Routes `rk`'s main queue to the reactor. Returns false if it cannot. */
+    bool attach(rd_kafka_t* rk);
+
+    /** Stops serving `rk`. Safe to call for handles that were never attached. */
+    void detach(rd_kafka_t* rk);
+
+    /** True if the reactor serves `rk`'s main queue, i.e. nobody else has to poll it. */
+    bool serves(rd_kafka_t* rk);
+
+    /** Records the delay between a delivery report and its waiter resuming. */
+    void recordDeliveryWake(std::chrono::steady_clock::duration latency);
+
+    ReactorStats stats();
+
+private:
+    Reactor() = default;
+
+    bool ensureStarted();
+    void loop();
+    void dispatch(int fd);
+
+    std::mutex m_mutex;  // guards the maps and m_dispatching, never held while polling
+    std::condition_variable m_dispatched;
+    rd_kafka_t* m_dispatching = nullptr;  // the handle being polled; detach waits for it
+    std::map<int, rd_kafka_t*> m_byFd;
+    std::map<rd_kafka_t*, int> m_byHandle;
+    int m_epollFd = -1;
+    int m_stopFd = -1;
+    std::thread m_thread;
+
+    std::atomic<int64_t> m_wakeups{0};
+    std::atomic<int64_t> m_eventsServed{0};
+    std::atomic<int64_t> m_emptyWakeups{0};
+    std::atomic<int64_t> m_deliveryWakes{0};
+    std::atomic<int64_t> m_deliveryWakeTotalUs{0};
+    std::atomic<int64_t> m_deliveryWakeMaxUs{0};
+};
+
+#endif //CHAT_OVER_KAFKA_REACTOR_H
@@ -0,0 +1,157 @@
+#include "reaper.h"
+
+#include <android/log.h>
+#include <algorithm>
+#include <cstring>
+
+#include "activity_monitor.h"
+#include "frame_pipeline.h"
+#include "memory_budget.h"
+#include "playout_merger.h"
+#include "reactor.h"
+
+static const char* const LOG_TAG = "Reaper";
+
+// Finished outcomes nobody asked about are dropped beyond this count.
+static const size_t kMaxRememberedOutcomes = 64;
+
+namespace {
+
+int remainingMs(std::chrono::steady_clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+    return left > 0 ? static_cast<int>(left) : 0;
+}
+
+} // namespace
+
+Reaper& Reaper::instance() {
+    static Reaper reaper;
+    return reaper;
+}
+
+Reaper::~Reaper() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+int64_t Reaper::submit(rd_kafka_t* rk, int deadlineMs) {
+    // What it still holds drains within the deadline; its slot can go to a new handle now
+    MemoryBudget::instance().forget(rk);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const int64_t ticket = m_nextTicket++;
+    m_jobs.push_back({ticket, rk, std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(deadlineMs, 0))});
+    m_outcomes[ticket] = CloseOutcome::Pending;
+    if (!m_thread.joinable()) {
+        m_thread = std::thread(&Reaper::loop, this);
+    }
+    m_cv.notify_one();
+    return ticket;
+}
+
+CloseOutcome Reaper::outcome(int64_t ticket) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_outcomes.find(ticket);
+    if (it == m_outcomes.end()) return CloseOutcome::Unknown;
+    CloseOutcome result = it->second;
+    if (result != CloseOutcome::Pending) {
+        m_outcomes.erase(it);
+    }
+    return result;
+}
+
+CloseOutcome Reaper::await(int64_t ticket, int timeoutMs) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCv.wait_for(lock, std::chrono::milliseconds(std::max(timeoutMs, 0)), [this, ticket] {
+            auto it = m_outcomes.find(ticket);
+            return it == m_outcomes.end() || it->second != CloseOutcome::Pending;
+        });
+    }
+    return outcome(ticket);
+}
+
+void Reaper::loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+        if (m_jobs.empty()) return;  // stopping
+
+        Job job = m_jobs.front();
+        m_jobs.pop_front();
+
+        lock.unlock();
+        CloseOutcome result = reap(job);
+        lock.lock();
+
+        m_outcomes[job.ticket] = result;
+        // Keep the map bounded when callers fire and forget.
+        while (m_outcomes.size() > kMaxRememberedOutcomes &&
+               m_outcomes.begin()->second != CloseOutcome::Pending) {
+            m_outcomes.erase(m_outcomes.begin());
+        }
+        m_doneCv.notify_all();
+    }
+}
+
+CloseOutcome Reaper::reap(const Job& job) {
+    rd_kafka_t* rk = job.rk;
+    const bool isConsumer = rd_kafka_type(rk) == RD_KAFKA_CONSUMER;
+    bool clean = true;
+
+    if (isConsumer) {
+        rd_kafka_queue_t* queue = rd_kafka_queue_new(rk);
+        rd_kafka_error_t* error = rd_kafka_consumer_close_queue(rk, queue);
+        if (error) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "consumer_close_queue failed: %s",
+                                rd_kafka_error_string(error));
+            rd_kafka_error_destroy(error);
+            clean = false;
+        } else {
+            while (!rd_kafka_consumer_closed(rk) && remainingMs(job.deadline) > 0) {
+                rd_kafka_event_t* event = rd_kafka_queue_poll(queue, std::min(remainingMs(job.deadline), 100));
+                if (!event) continue;
+                if (rd_kafka_event_type(event) == RD_KAFKA_EVENT_REBALANCE) {
+                    // Give up the assignment so the close can complete.
+                    if (strcmp(rd_kafka_rebalance_protocol(rk), "COOPERATIVE") == 0) {
+                        rd_kafka_error_t* unassignError = rd_kafka_incremental_unassign(
+                                rk, rd_kafka_event_topic_partition_list(event));
+                        if (unassignError) rd_kafka_error_destroy(unassignError);
+                    } else {
+                        rd_kafka_assign(rk, nullptr);
+                    }
+                }
+                rd_kafka_event_destroy(event);
+            }
+            clean = rd_kafka_consumer_closed(rk);
+        }
+        rd_kafka_queue_destroy(queue);
+    } else {
+        if (rd_kafka_flush(rk, remainingMs(job.deadline)) != RD_KAFKA_RESP_ERR_NO_ERROR) {
+            // Fail what is left so blocked produce calls get their reports
+            // instead of waiting on a handle that is going away.
+            rd_kafka_purge(rk, RD_KAFKA_PURGE_F_QUEUE | RD_KAFKA_PURGE_F_INFLIGHT);
+            rd_kafka_flush(rk, 0);
+            clean = false;
+        }
+    }
+
+    ActivityMonitor::instance().stopFor(rk);
+    Reactor::instance().detach(rk);
+    PlayoutMerger::instance().detach(rk);
+    FramePipeline::instance().forget(rk);
+
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Destroying %s (%s)", rd_kafka_name(rk),
+                        clean ? "clean" : "deadline exceeded");
+    // The consumer is closed (or given up on) already; never wait on the group again.
+    rd_kafka_destroy_flags(rk, RD_KAFKA_DESTROY_F_NO_CONSUMER_CLOSE);
+
+    return clean ? CloseOutcome::Clean : CloseOutcome::Forced;
+}
@@ -0,0 +1,69 @@
+#ifndef CHAT_OVER_KAFKA_REAPER_H
+#define CHAT_OVER_KAFKA_REAPER_H
+
+#include <rdkafka.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+/**
+ * How a handle's teardown ended.
+ */
+enum class CloseOutcome : int {
+    Unknown = -1,  // never submitted, or already forgotten
+    Pending = 0,
+    Clean = 1,     // consumer left its group / producer delivered everything
+    Forced = 2,    // deadline hit: group left uncleanly or queued messages purged
+};
+
+/**
+ * Tears client handles down on a background thread with a hard deadline.
+ *
+ * rd_kafka_consumer_close, rd_kafka_flush and rd_kafka_destroy can each
+ * block for seconds while a broker is unreachable. submit() returns at once;
+ * the reaper closes consumers through rd_kafka_consumer_close_queue and
+ * flushes producers until the deadline, then purges whatever is left and
+ * destroys the handle with RD_KAFKA_DESTROY_F_NO_CONSUMER_CLOSE so the final
+ * destroy never waits on the network again.
+ */
+class Reaper {
+public:
+    static Reaper& instance();
+    ~Reaper();
+
+    /** Queues `rk` for teardown. Returns a ticket for outcome(). */
+    int64_t submit(rd_kafka_t* rk, int deadlineMs);
+
+    /** Current outcome of a ticket; final outcomes are forgotten once read. */
+    CloseOutcome outcome(int64_t ticket);
+
+    /** Waits up to `timeoutMs` for a ticket to finish, then returns outcome(). */
+    CloseOutcome await(int64_t ticket, int timeoutMs);
+
+private:
+    struct Job {
+        int64_t ticket;
+        rd_kafka_t* rk;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    Reaper() = default;
+
+    void loop();
+    CloseOutcome reap(const Job& job);
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;       // new jobs
+    std::condition_variable m_doneCv;   // finished jobs
+    std::deque<Job> m_jobs;
+    std::map<int64_t, CloseOutcome> m_outcomes;
+    int64_t m_nextTicket = 1;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
+
+#endif //CHAT_OVER_KAFKA_REAPER_H
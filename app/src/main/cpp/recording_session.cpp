@@ -0,0 +1,317 @@
+#include "recording_session.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "client_pool.h"
+#include "frame_cipher.h"
+#include "metadata_codec.h"
+#include "native_log.h"
+#include "rollup_store.h"
+#include "speaker_partitioner.h"
+
+static const char* const LOG_TAG = "RecordingSession";
+
+// Offsets stay far below 2^48; the partition lives above them (AudioMetadata.recordingId)
+static const int kRecordingIdPartitionShift = 48;
+
+static const int64_t kHourMs = 3600 * 1000;
+
+namespace {
+
+int64_t wallClockMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Same as AudioMetadata.messageKey()
+std::string messageKey(int32_t channelId, int32_t audioPartition, int64_t startOffset) {
+    const int64_t recordingId = audioPartition == 0
+            ? startOffset
+            : (static_cast<int64_t>(audioPartition) << kRecordingIdPartitionShift) | startOffset;
+    return "msg-" + std::to_string(channelId) + "-" + std::to_string(recordingId);
+}
+
+// Same as RdKafka.rollupKey()
+std::string rollupKey(int32_t channelId, const std::string& userId, int64_t timestampMs) {
+    return "rollup-" + std::to_string(channelId) + "-" + std::to_string(timestampMs / kHourMs) + "/" + userId;
+}
+
+} // namespace
+
+RecordingSession::RecordingSession(RecordingSpec spec, std::string key, rd_kafka_t* frames, rd_kafka_t* metadata,
+                                   bool retained)
+        : m_spec(std::move(spec)),
+          m_key(std::move(key)),
+          m_frames(frames),
+          m_metadata(metadata),
+          m_retained(retained) {}
+
+rd_kafka_resp_err_t RecordingSession::addFrame(const uint8_t* frame, size_t len) {
+    std::lock_guard<std::mutex> frameLock(m_frameMutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_summary.state != RecordingState::Recording) return RD_KAFKA_RESP_ERR__STATE;
+    }
+
+    const uint32_t sequence = m_nextSequence++;
+    const auto* key = reinterpret_cast<const uint8_t*>(m_key.data());
+    std::shared_ptr<FrameKey> frameKey = FrameCipher::instance().keyFor(m_spec.audioTopic.c_str());
+    const size_t prefix = frameKey ? FrameKey::prefixBytes(sequence) : 0;
+    const size_t capacity = prefix + len + (frameKey ? FrameKey::kTagBytes : 0);
+    if (m_frameBuffer.size() < capacity) m_frameBuffer.resize(capacity);
+    std::copy(frame, frame + len, m_frameBuffer.begin() + static_cast<std::ptrdiff_t>(prefix));
+
+    size_t frameLen = len;
+    rd_kafka_resp_err_t err = RD_KAFKA_RESP_ERR_NO_ERROR;
+    if (frameKey) {
+        frameLen = frameKey->seal(key, m_key.size(), sequence, m_frameBuffer.data(), len);
+        if (frameLen == 0) err = RD_KAFKA_RESP_ERR__FAIL;
+    }
+    if (!err) {
+        err = FramePipeline::instance().enqueue(m_frames, m_spec.audioTopic.c_str(), key, m_key.size(),
+                                                m_frameBuffer.data(), frameLen, sequence, shared_from_this());
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (err) {
+        m_summary.framesDropped++;
+    } else {
+        m_summary.framesEnqueued++;
+        m_summary.bytesEnqueued += static_cast<int64_t>(frameLen);
+    }
+    return err;
+}
+
+void RecordingSession::finish() {
+    // Waits out an addFrame in progress: its frame is counted before the
+    // session can settle, and any later one sees it is no longer recording
+    std::lock_guard<std::mutex> frameLock(m_frameMutex);
+    bool settled;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_summary.state != RecordingState::Recording) return;
+        m_summary.state = RecordingState::Draining;
+        settled = settledLocked();
+    }
+    m_cv.notify_all();
+    if (settled) publish();
+}
+
+bool RecordingSession::settledLocked() const {
+    return m_summary.state == RecordingState::Draining && m_settled >= m_summary.framesEnqueued;
+}
+
+void RecordingSession::onFrame(uint32_t sequence, size_t bytes, rd_kafka_resp_err_t err, const FrameReport& report) {
+    bool settled;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_settled++;
+        if (err) {
+            m_summary.framesDropped++;
+        } else {
+            m_summary.framesDelivered++;
+            m_summary.bytesDelivered += static_cast<int64_t>(bytes);
+            m_summary.audioPartition = report.partition;
+            if (m_summary.startOffset < 0 || report.offset < m_summary.startOffset) {
+                m_summary.startOffset = report.offset;
+                m_summary.firstFrameTime = report.timestamp;
+            }
+            if (report.offset > m_summary.endOffset) {
+                m_summary.endOffset = report.offset;
+                m_summary.lastFrameTime = report.timestamp;
+            }
+            const int64_t mediaMs = static_cast<int64_t>(sequence) * m_spec.frameDurationMs;
+            if (m_spec.indexIntervalMs > 0 && mediaMs % m_spec.indexIntervalMs < m_spec.frameDurationMs) {
+                m_frameIndex.emplace_back(report.offset, mediaMs);
+            }
+        }
+        settled = settledLocked();
+    }
+    if (settled) publish();
+}
+
+void RecordingSession::publish() {
+    // The last frame is in: the speaker's partition is free again
+    SpeakerPartitioner::instance().endSession(m_key);
+    FramePipeline::instance().endSession(m_key);
+
+    MetadataRecord record;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_summary.state != RecordingState::Draining) return;
+        m_summary.state = RecordingState::Publishing;
+        if (m_summary.framesDelivered == 0) {
+            NativeLog::instance().print(ANDROID_LOG_WARN, LOG_TAG, "%s: no frame was delivered", m_key.c_str());
+        } else {
+            m_self = shared_from_this();
+            m_publishedAtMs = wallClockMs();
+            record.userId = m_spec.userId;
+            record.channelId = m_spec.channelId;
+            record.startOffset = m_summary.startOffset;
+            record.endOffset = m_summary.endOffset;
+            record.timestamp = m_publishedAtMs;
+            record.messageCount = m_summary.framesDelivered;
+            std::sort(m_frameIndex.begin(), m_frameIndex.end(),
+                      [](const std::pair<int64_t, int64_t>& a, const std::pair<int64_t, int64_t>& b) {
+                          return a.second < b.second;
+                      });
+            record.frameIndex = m_frameIndex;
+            record.frameKey = m_key;
+            record.firstFrameTime = std::max<int64_t>(m_summary.firstFrameTime, 0);
+            record.lastFrameTime = std::max<int64_t>(m_summary.lastFrameTime, 0);
+            record.audioPartition = m_summary.audioPartition;
+        }
+    }
+    if (record.messageCount == 0) {
+        complete(RecordingState::Failed);
+        return;
+    }
+
+    std::vector<uint8_t> value;
+    MetadataCodec::encode(record, value);
+    const std::string key = messageKey(record.channelId, record.audioPartition, record.startOffset);
+    rd_kafka_resp_err_t err = rd_kafka_producev(
+            m_metadata,
+            RD_KAFKA_V_TOPIC(m_spec.metadataTopic.c_str()),
+            RD_KAFKA_V_PARTITION(m_spec.metadataPartition),
+            RD_KAFKA_V_KEY(key.data(), key.size()),
+            RD_KAFKA_V_VALUE(value.data(), value.size()),
+            RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+            RD_KAFKA_V_OPAQUE(static_cast<DeliveryListener*>(this)),
+            RD_KAFKA_V_END
+    );
+    if (err) {
+        NativeLog::instance().print(ANDROID_LOG_ERROR, LOG_TAG, "%s: metadata not queued: %s", m_key.c_str(),
+                                    rd_kafka_err2str(err));
+        std::shared_ptr<RecordingSession> self;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            self = std::move(m_self);
+        }
+        complete(RecordingState::Failed);
+    }
+}
+
+void RecordingSession::onDelivery(const rd_kafka_message_t* msg) {
+    // Released once this returns
+    std::shared_ptr<RecordingSession> self;
+    int64_t timestamp;
+    int64_t delivered;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        self = std::move(m_self);
+        // The hour the timeline puts the recording in: its first frame's broker
+        // time, unless the topic does not report one
+        timestamp = m_summary.firstFrameTime > 0 ? m_summary.firstFrameTime : m_publishedAtMs;
+        delivered = m_summary.framesDelivered;
+    }
+
+    if (msg->err) {
+        NativeLog::instance().print(ANDROID_LOG_ERROR, LOG_TAG, "%s: metadata not delivered: %s", m_key.c_str(),
+                                    rd_kafka_err2str(msg->err));
+        complete(RecordingState::Failed);
+        return;
+    }
+
+    // Bump the speaker's hourly bucket so timelines can show density without
+    // reading every metadata record. Nobody waits for it.
+    const RollupRecord rollup = RollupStore::instance().recordPublished(
+            m_spec.channelId, m_spec.userId, timestamp, delivered * m_spec.frameDurationMs);
+    std::vector<uint8_t> value;
+    MetadataCodec::encodeRollup(rollup, value);
+    const std::string key = rollupKey(m_spec.channelId, m_spec.userId, timestamp);
+    rd_kafka_resp_err_t err = rd_kafka_producev(
+            m_metadata,
+            RD_KAFKA_V_TOPIC(m_spec.metadataTopic.c_str()),
+            RD_KAFKA_V_PARTITION(m_spec.rollupPartition),
+            RD_KAFKA_V_KEY(key.data(), key.size()),
+            RD_KAFKA_V_VALUE(value.data(), value.size()),
+            RD_KAFKA_V_MSGFLAGS(RD_KAFKA_MSG_F_COPY),
+            RD_KAFKA_V_END
+    );
+    if (err) {
+        NativeLog::instance().print(ANDROID_LOG_WARN, LOG_TAG, "%s: rollup not queued: %s", m_key.c_str(),
+                                    rd_kafka_err2str(err));
+    }
+    complete(RecordingState::Published);
+}
+
+void RecordingSession::complete(RecordingState state) {
+    RecordingSummary summary;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_summary.state = state;
+        summary = m_summary;
+    }
+    m_cv.notify_all();
+    NativeLog::instance().print(ANDROID_LOG_INFO, LOG_TAG, "%s %s: %lld of %lld frames delivered (%lld bytes), %lld dropped",
+                                m_key.c_str(), state == RecordingState::Published ? "published" : "failed",
+                                static_cast<long long>(summary.framesDelivered),
+                                static_cast<long long>(summary.framesEnqueued),
+                                static_cast<long long>(summary.bytesDelivered),
+                                static_cast<long long>(summary.framesDropped));
+    if (m_retained) {
+        ClientPool::instance().release(m_spec.producer);
+    }
+}
+
+RecordingSummary RecordingSession::await(int timeoutMs) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait_for(lock, std::chrono::milliseconds(std::max(timeoutMs, 0)), [this] {
+        return m_summary.state == RecordingState::Published || m_summary.state == RecordingState::Failed;
+    });
+    return m_summary;
+}
+
+RecordingSummary RecordingSession::summary() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_summary;
+}
+
+Recorder& Recorder::instance() {
+    static Recorder recorder;
+    return recorder;
+}
+
+int64_t Recorder::begin(RecordingSpec spec, std::string& error) {
+    std::string key;
+    if (!FrameKey::sessionKey(spec.userId, spec.startedAtMs, key)) {
+        error = "No random nonce prefix for the recording";
+        return 0;
+    }
+
+    ClientPool& pool = ClientPool::instance();
+    rd_kafka_t* frames = pool.forQos(spec.producer, spec.frameQos, error);
+    rd_kafka_t* metadata = frames ? pool.forQos(spec.producer, QosClass::Durable, error) : nullptr;
+    if (!metadata) {
+        return 0;
+    }
+    // Unpooled (legacy) producers are the caller's to keep alive
+    const bool retained = pool.retain(spec.producer);
+
+    auto session = std::make_shared<RecordingSession>(std::move(spec), std::move(key), frames, metadata, retained);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const int64_t id = m_nextId++;
+    m_sessions[id] = std::move(session);
+    return id;
+}
+
+std::shared_ptr<RecordingSession> Recorder::find(int64_t id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_sessions.find(id);
+    return it == m_sessions.end() ? nullptr : it->second;
+}
+
+void Recorder::forget(int64_t id) {
+    std::shared_ptr<RecordingSession> session;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_sessions.find(id);
+        if (it == m_sessions.end()) return;
+        session = std::move(it->second);
+        m_sessions.erase(it);
+    }
+    // An abandoned recording still publishes what it has
+    session->finish();
+}
@@ -0,0 +1,144 @@
+#ifndef CHAT_OVER_KAFKA_RECORDING_SESSION_H
+#define CHAT_OVER_KAFKA_RECORDING_SESSION_H
+
+#include <rdkafka.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "client_pool.h"
+#include "frame_pipeline.h"
+
+/**
+ * Where a recording goes and what its metadata record says about its author.
+ */
+struct RecordingSpec {
+    rd_kafka_t* producer = nullptr;  // a pooled producer; frames and metadata use its siblings
+    std::string audioTopic;
+    std::string metadataTopic;
+    int32_t metadataPartition = 0;
+    int32_t rollupPartition = 0;
+    std::string userId;
+    int32_t channelId = 0;
+    int64_t startedAtMs = 0;        // wall clock; with userId it makes the record key
+    int64_t frameDurationMs = 0;
+    int64_t indexIntervalMs = 0;    // media time between frame index points
+    QosClass frameQos = QosClass::Ordered;  // Realtime when frames may be lost or reordered for a faster ack
+};
+
+enum class RecordingState : int {
+    Recording = 0,
+    Draining = 1,    // no more frames; waiting for the last ones to be acked
+    Publishing = 2,  // metadata record produced, waiting for its ack
+    Published = 3,
+    Failed = 4,      // nothing was delivered, or the metadata record was not
+};
+
+/** What became of a recording's frames and metadata record. */
+struct RecordingSummary {
+    RecordingState state = RecordingState::Recording;
+    int64_t framesEnqueued = 0;
+    int64_t framesDelivered = 0;
+    int64_t framesDropped = 0;   // not queued, or not delivered before the deadline
+    int64_t bytesEnqueued = 0;   // as produced, sealed frames included
+    int64_t bytesDelivered = 0;
+    int32_t audioPartition = -1;
+    int64_t startOffset = -1;    // first and last delivered frame
+    int64_t endOffset = -1;
+    int64_t firstFrameTime = -1;
+    int64_t lastFrameTime = -1;
+};
+
+/**
+ * One recording, from its first frame to its published metadata record.
+ *
+ * Frames are sealed (if the channel has a frame key) and queued on the
+ * pooled producer's ordered sibling without waiting (see FramePipeline).
+ * Their delivery reports come straight back to the session, which keeps the
+ * exact first and last offsets, counts and byte totals, and a frame index
+ * point every indexIntervalMs of media time.
+ *
+ * Once the recording is finished and every frame was acked or dropped, the
+ * session frees the speaker's partition, produces the metadata record on the
+ * durable sibling and, when that is acked, the speaker's hourly rollup. The
+ * pooled producer is retained until then, so the caller may release it
+ * right after finish().
+ */
+class RecordingSession : public FrameSink, public DeliveryListener,
+                         public std::enable_shared_from_this<RecordingSession> {
+public:
+    RecordingSession(RecordingSpec spec, std::string key, rd_kafka_t* frames, rd_kafka_t* metadata, bool retained);
+
+    RecordingSession(const RecordingSession&) = delete;
+    RecordingSession& operator=(const RecordingSession&) = delete;
+
+    /** Seals and queues the next frame. Returns the enqueue error, if any. */
+    rd_kafka_resp_err_t addFrame(const uint8_t* frame, size_t len);
+
+    /** No more frames. The metadata record follows the last ack. */
+    void finish();
+
+    /** Waits up to `timeoutMs` for the recording to be published or to fail. */
+    RecordingSummary await(int timeoutMs);
+
+    RecordingSummary summary();
+
+    const std::string& key() const { return m_key; }
+
+    void onFrame(uint32_t sequence, size_t bytes, rd_kafka_resp_err_t err, const FrameReport& report) override;
+    void onDelivery(const rd_kafka_message_t* msg) override;
+
+private:
+    bool settledLocked() const;
+    void publish();
+    void complete(RecordingState state);
+
+    const RecordingSpec m_spec;
+    const std::string m_key;  // "<speaker>/<start>/<nonce prefix>", the record key of every frame
+    rd_kafka_t* const m_frames;
+    rd_kafka_t* const m_metadata;
+    const bool m_retained;
+
+    std::mutex m_frameMutex;  // serialises addFrame and finish
+    uint32_t m_nextSequence = 0;
+    std::vector<uint8_t> m_frameBuffer;
+
+    std::mutex m_mutex;  // guards everything below
+    std::condition_variable m_cv;
+    RecordingSummary m_summary;
+    int64_t m_settled = 0;  // frames delivered or dropped after being queued
+    std::vector<std::pair<int64_t, int64_t>> m_frameIndex;  // (offset, media ms)
+    int64_t m_publishedAtMs = 0;  // the metadata record's timestamp
+    std::shared_ptr<RecordingSession> m_self;  // keeps the session alive while its record is in flight
+};
+
+/**
+ * Recordings by id, for the JNI layer. A recording stays registered until
+ * its owner forgets it; the session itself lives on until it has published.
+ */
+class Recorder {
+public:
+    static Recorder& instance();
+
+    /** Starts a recording, or returns 0 with `error` filled in. */
+    int64_t begin(RecordingSpec spec, std::string& error);
+
+    std::shared_ptr<RecordingSession> find(int64_t id);
+
+    void forget(int64_t id);
+
+private:
+    Recorder() = default;
+
+    std::mutex m_mutex;
+    int64_t m_nextId = 1;
+    std::map<int64_t, std::shared_ptr<RecordingSession>> m_sessions;
+};
+
+#endif //CHAT_OVER_KAFKA_RECORDING_SESSION_H
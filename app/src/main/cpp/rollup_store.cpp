@@ -0,0 +1,140 @@
+#include "rollup_store.h"
+
+#include <android/log.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static const char* const LOG_TAG = "RollupStore";
+static const char* const kHeader = "chok-rollups 1";
+
+static const int64_t kHourMs = 3600000;
+
+RollupStore& RollupStore::instance() {
+    static RollupStore store;
+    return store;
+}
+
+void RollupStore::setPath(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_path == path) return;
+    m_path = path;
+    loadLocked();
+}
+
+void RollupStore::loadLocked() {
+    std::ifstream in(m_path);
+    if (!in) return;
+
+    std::string line;
+    if (!std::getline(in, line) || line != kHeader) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Ignoring rollups with unknown format: %s", m_path.c_str());
+        return;
+    }
+
+    // bucket <channelId> <hour> <recordings> <durationMs> <userId...>
+    size_t loaded = 0;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind, userId;
+        int32_t channelId;
+        int64_t hour;
+        Bucket bucket;
+        if (!(fields >> kind >> channelId >> hour >> bucket.recordings >> bucket.durationMs) || kind != "bucket") {
+            continue;
+        }
+        fields.get();  // the separating space
+        std::getline(fields, userId);
+        Bucket& known = m_buckets[{channelId, hour}][userId];
+        if (bucket.recordings > known.recordings) known = bucket;
+        loaded++;
+    }
+    __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Loaded %zu buckets", loaded);
+}
+
+void RollupStore::saveLocked(int64_t currentHour) {
+    if (m_path.empty()) return;
+
+    // Everything older than the retention window only costs space.
+    const int64_t oldest = currentHour - kRetainHours;
+    for (auto it = m_buckets.begin(); it != m_buckets.end();) {
+        if (it->first.second < oldest) {
+            it = m_buckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    const std::string tmpPath = m_path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        if (!out) {
+            __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Cannot write %s", tmpPath.c_str());
+            return;
+        }
+        out << kHeader << '\n';
+        for (const auto& hour : m_buckets) {
+            for (const auto& speaker : hour.second) {
+                out << "bucket " << hour.first.first << ' ' << hour.first.second << ' '
+                    << speaker.second.recordings << ' ' << speaker.second.durationMs << ' '
+                    << speaker.first << '\n';
+            }
+        }
+        if (!out.flush()) {
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmpPath.c_str(), m_path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+    }
+}
+
+RollupRecord RollupStore::recordPublished(int32_t channelId, const std::string& userId,
+                                          int64_t timestampMs, int64_t durationMs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RollupRecord rollup;
+    rollup.channelId = channelId;
+    rollup.hour = timestampMs / kHourMs;
+    rollup.userId = userId;
+
+    Bucket& bucket = m_buckets[{channelId, rollup.hour}][userId];
+    bucket.recordings++;
+    bucket.durationMs += durationMs;
+    rollup.recordings = bucket.recordings;
+    rollup.durationMs = bucket.durationMs;
+
+    saveLocked(rollup.hour);
+    return rollup;
+}
+
+bool RollupStore::fold(const RollupRecord& rollup) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Bucket& known = m_buckets[{rollup.channelId, rollup.hour}][rollup.userId];
+    if (rollup.recordings < known.recordings ||
+        (rollup.recordings == known.recordings && rollup.durationMs <= known.durationMs)) {
+        return false;
+    }
+    known.recordings = rollup.recordings;
+    known.durationMs = rollup.durationMs;
+    return true;
+}
+
+std::vector<HourDensity> RollupStore::density(int32_t channelId, int64_t lastHour, int64_t hours) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<HourDensity> result(static_cast<size_t>(std::max<int64_t>(hours, 0)));
+    const int64_t firstHour = lastHour - static_cast<int64_t>(result.size()) + 1;
+
+    for (auto it = m_buckets.lower_bound({channelId, firstHour});
+         it != m_buckets.end() && it->first.first == channelId && it->first.second <= lastHour; ++it) {
+        HourDensity& hour = result[static_cast<size_t>(it->first.second - firstHour)];
+        for (const auto& speaker : it->second) {
+            if (speaker.second.recordings == 0) continue;
+            hour.recordings += speaker.second.recordings;
+            hour.durationMs += speaker.second.durationMs;
+            hour.speakers++;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,71 @@
+#ifndef CHAT_OVER_KAFKA_ROLLUP_STORE_H
+#define CHAT_OVER_KAFKA_ROLLUP_STORE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "metadata_codec.h"
+
+/**
+ * Activity of one channel during one hour, summed over speakers.
+ */
+struct HourDensity {
+    int64_t recordings = 0;
+    int64_t durationMs = 0;
+    int64_t speakers = 0;
+};
+
+/**
+ * Hourly activity buckets per channel and speaker.
+ *
+ * Publishing a recording bumps the speaker's bucket for that hour, and the
+ * bucket is published as a compacted rollup record keyed by channel, hour
+ * and speaker. Each bucket has a single writer, so the records never race;
+ * readers fold them (largest counts win) and sum over speakers, which yields
+ * a 24 h or 7 day density from at most a few records per hour instead of
+ * every metadata record in the range.
+ *
+ * Buckets of the last kRetainHours are kept in app storage so a restart does
+ * not reset the counts of the current hour.
+ */
+class RollupStore {
+public:
+    static constexpr int64_t kRetainHours = 24 * 7;
+
+    static RollupStore& instance();
+
+    /** Sets the backing file and loads it if present. */
+    void setPath(const std::string& path);
+
+    /** Counts a published recording and returns its bucket's new state. */
+    RollupRecord recordPublished(int32_t channelId, const std::string& userId,
+                                 int64_t timestampMs, int64_t durationMs);
+
+    /** Folds a rollup read from the topic. Returns true if it changed a bucket. */
+    bool fold(const RollupRecord& rollup);
+
+    /** Per-hour totals for `hours` hours ending with (and including) `lastHour`, oldest first. */
+    std::vector<HourDensity> density(int32_t channelId, int64_t lastHour, int64_t hours);
+
+private:
+    RollupStore() = default;
+
+    struct Bucket {
+        int64_t recordings = 0;
+        int64_t durationMs = 0;
+    };
+
+    void loadLocked();
+    void saveLocked(int64_t currentHour);
+
+    std::mutex m_mutex;
+    std::string m_path;
+    // (channelId, hour) -> speaker -> bucket
+    std::map<std::pair<int32_t, int64_t>, std::map<std::string, Bucket>> m_buckets;
+};
+
+#endif //CHAT_OVER_KAFKA_ROLLUP_STORE_H
@@ -0,0 +1,149 @@
+#include "speaker_partitioner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "native_log.h"
+
+static const char* const LOG_TAG = "SpeakerPartitioner";
+
+// A session that produced nothing for this long is over even if nobody ended
+// it (e.g. the recorder crashed); its partition counts as free again.
+static const auto kSessionIdle = std::chrono::seconds(10);
+
+namespace {
+
+uint64_t fnv1a64(const char* data, size_t len) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// splitmix64 finaliser, so neighbouring partitions get unrelated scores
+uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Length of the speaker id if `key` is a session frame key
+// "<speaker>/<decimal session start>[/<nonce prefix>]", 0 otherwise.
+size_t speakerLength(const char* key, size_t len) {
+    const char* slash = static_cast<const char*>(memchr(key, '/', len));
+    if (!slash || slash == key || slash == key + len - 1) return 0;
+    const char* p = slash + 1;
+    while (p < key + len && *p >= '0' && *p <= '9') p++;
+    if (p == slash + 1) return 0;
+    if (p < key + len && (*p != '/' || p == key + len - 1)) return 0;
+    return static_cast<size_t>(slash - key);
+}
+
+}  // namespace
+
+SpeakerPartitioner& SpeakerPartitioner::instance() {
+    static SpeakerPartitioner partitioner;
+    return partitioner;
+}
+
+bool SpeakerPartitioner::apply(rd_kafka_conf_t* conf, char* errstr, size_t errstr_size) {
+    // Reuse the default topic conf if topic properties (acks) already created
+    // it; replacing it would drop them.
+    rd_kafka_topic_conf_t* topicConf = rd_kafka_conf_get_default_topic_conf(conf);
+    if (!topicConf) {
+        topicConf = rd_kafka_topic_conf_new();
+        if (!topicConf) {
+            snprintf(errstr, errstr_size, "Failed to create topic configuration");
+            return false;
+        }
+        rd_kafka_conf_set_default_topic_conf(conf, topicConf);
+    }
+    rd_kafka_topic_conf_set_partitioner_cb(topicConf, partition);
+    return true;
+}
+
+int32_t SpeakerPartitioner::partition(const rd_kafka_topic_t* rkt, const void* key, size_t keylen,
+                                      int32_t partitionCount, void* rktOpaque, void* msgOpaque) {
+    const auto* chars = static_cast<const char*>(key);
+    const size_t speaker = key ? speakerLength(chars, keylen) : 0;
+    if (speaker == 0 || partitionCount <= 1) {
+        return rd_kafka_msg_partitioner_consistent_random(rkt, key, keylen, partitionCount, rktOpaque, msgOpaque);
+    }
+    return instance().pin(rkt, std::string(chars, keylen), speaker, partitionCount);
+}
+
+int32_t SpeakerPartitioner::pin(const rd_kafka_topic_t* rkt, const std::string& key, size_t speakerLength,
+                                int32_t partitionCount) {
+    const auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Topic& topic = m_topics[rkt];
+    if (topic.load.size() < static_cast<size_t>(partitionCount)) {
+        topic.load.resize(static_cast<size_t>(partitionCount), 0);
+    }
+
+    // Called again for every frame (and possibly more than once per frame)
+    auto it = topic.sessions.find(key);
+    if (it != topic.sessions.end() && it->second.partition < partitionCount) {
+        it->second.lastUsed = now;
+        return it->second.partition;
+    }
+    if (it != topic.sessions.end()) {
+        // The topic shrank under the session; pick again
+        topic.load[static_cast<size_t>(it->second.partition)]--;
+        topic.sessions.erase(it);
+    }
+    expire(topic, now);
+
+    const uint64_t speakerHash = fnv1a64(key.data(), speakerLength);
+    int32_t best = -1;
+    bool bestAvailable = false;
+    uint64_t bestScore = 0;
+    for (int32_t p = 0; p < partitionCount; p++) {
+        const bool available = rd_kafka_topic_partition_available(rkt, p) == 1;
+        const uint64_t score = mix(speakerHash ^ (static_cast<uint64_t>(p) * 0x9E3779B97F4A7C15ull));
+        // Prefer a partition with a leader, then the least loaded, then the speaker's ranking
+        bool better = best < 0 || (available && !bestAvailable);
+        if (!better && available == bestAvailable) {
+            const int32_t load = topic.load[static_cast<size_t>(p)];
+            const int32_t bestLoad = topic.load[static_cast<size_t>(best)];
+            better = load < bestLoad || (load == bestLoad && score > bestScore);
+        }
+        if (better) {
+            best = p;
+            bestAvailable = available;
+            bestScore = score;
+        }
+    }
+
+    topic.sessions.emplace(key, Session{best, now});
+    topic.load[static_cast<size_t>(best)]++;
+    NativeLog::instance().print(ANDROID_LOG_DEBUG, LOG_TAG, "Session %s pinned to partition %d (%d live)",
+                                key.c_str(), best, topic.load[static_cast<size_t>(best)]);
+    return best;
+}
+
+void SpeakerPartitioner::expire(Topic& topic, std::chrono::steady_clock::time_point now) {
+    for (auto it = topic.sessions.begin(); it != topic.sessions.end();) {
+        if (now - it->second.lastUsed > kSessionIdle) {
+            topic.load[static_cast<size_t>(it->second.partition)]--;
+            it = topic.sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SpeakerPartitioner::endSession(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& entry : m_topics) {
+        Topic& topic = entry.second;
+        auto it = topic.sessions.find(key);
+        if (it == topic.sessions.end()) continue;
+        topic.load[static_cast<size_t>(it->second.partition)]--;
+        topic.sessions.erase(it);
+    }
+}
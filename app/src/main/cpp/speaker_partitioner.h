@@ -0,0 +1,65 @@
+#ifndef CHAT_OVER_KAFKA_SPEAKER_PARTITIONER_H
+#define CHAT_OVER_KAFKA_SPEAKER_PARTITIONER_H
+
+#include <rdkafka.h>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Producer partitioner that pins every speaker session to one partition.
+ *
+ * Audio frames are keyed "<speaker>/<session start>/<nonce prefix>" (see
+ * FrameKey::sessionKey(); the prefix is optional here). The first frame of a
+ * session picks a partition and every later frame of the session goes to the
+ * same one, so a recording stays contiguous in one partition while concurrent
+ * talkers write to different partition leaders.
+ *
+ * The pick is stable per speaker: partitions are ranked by rendezvous hashing
+ * of the speaker id, and the session takes the highest ranked available
+ * partition among those with the fewest live sessions of this client. A lone
+ * speaker therefore always lands on the same partition, and a second session
+ * is steered to another one while the first is still talking.
+ *
+ * Keys of any other shape fall back to librdkafka's consistent-random
+ * partitioner, and explicit partitions never reach the partitioner at all.
+ */
+class SpeakerPartitioner {
+public:
+    static SpeakerPartitioner& instance();
+
+    /** Installs the partitioner on `conf`'s default topic configuration. */
+    bool apply(rd_kafka_conf_t* conf, char* errstr, size_t errstr_size);
+
+    /** Frees the partition of the session keyed `key` once its last frame was produced. */
+    void endSession(const std::string& key);
+
+private:
+    SpeakerPartitioner() = default;
+
+    struct Session {
+        int32_t partition;
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+
+    struct Topic {
+        std::map<std::string, Session> sessions;
+        std::vector<int32_t> load;  // live sessions per partition
+    };
+
+    static int32_t partition(const rd_kafka_topic_t* rkt, const void* key, size_t keylen,
+                             int32_t partitionCount, void* rktOpaque, void* msgOpaque);
+
+    int32_t pin(const rd_kafka_topic_t* rkt, const std::string& key, size_t speakerLength,
+                int32_t partitionCount);
+    void expire(Topic& topic, std::chrono::steady_clock::time_point now);
+
+    std::mutex m_mutex;
+    // Keyed by topic handle: the partitioner may not ask librdkafka for the name
+    std::map<const rd_kafka_topic_t*, Topic> m_topics;
+};
+
+#endif //CHAT_OVER_KAFKA_SPEAKER_PARTITIONER_H
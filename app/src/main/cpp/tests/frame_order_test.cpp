@@ -0,0 +1,255 @@
+// Checks that the ordered producer keeps every session's frames in order
+// while produce requests fail and are retried. Runs against librdkafka's mock
+// cluster, so it needs no broker; see tests/CMakeLists.txt for how to run it.
+
+#include <rdkafka.h>
+#include <rdkafka_mock.h>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client_pool.h"
+#include "frame_pipeline.h"
+#include "nativelib.h"
+#include "speaker_partitioner.h"
+
+// The app defines these in nativelib.cpp, which needs a JVM.
+extern "C" {
+
+void kafka_log_callback(const rd_kafka_t*, int level, const char* fac, const char* buf) {
+    if (level <= 4) fprintf(stderr, "rdkafka %s: %s\n", fac, buf);
+}
+
+void delivery_report_cb(rd_kafka_t*, const rd_kafka_message_t* msg, void*) {
+    auto* listener = static_cast<DeliveryListener*>(msg->_private);
+    if (listener) listener->onDelivery(msg);
+}
+
+} // extern "C"
+
+namespace {
+
+const char* const kTopic = "audio-frames";
+const int kPartitions = 2;
+const uint32_t kFrames = 400;
+const size_t kFrameBytes = 160;
+const int16_t kProduceApiKey = 0;  // RD_KAFKAP_Produce
+const char* const kSessions[] = {"alice/1700000000000", "bob/1700000000500"};
+
+int failures = 0;
+
+#define CHECK(cond, ...)                                             \
+    do {                                                             \
+        if (!(cond)) {                                               \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);     \
+            fprintf(stderr, __VA_ARGS__);                            \
+            fputc('\n', stderr);                                     \
+            failures++;                                              \
+        }                                                            \
+    } while (0)
+
+class Reports final : public FrameSink {
+public:
+    void onFrame(uint32_t sequence, size_t, rd_kafka_resp_err_t err, const FrameReport& report) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+            fprintf(stderr, "frame %u failed: %s\n", sequence, rd_kafka_err2str(err));
+            m_failed++;
+            return;
+        }
+        m_delivered.push_back(report);
+    }
+
+    std::vector<FrameReport> delivered() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_delivered;
+    }
+
+    int failed() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_failed;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<FrameReport> m_delivered;
+    int m_failed = 0;
+};
+
+// A producer configured exactly like the app's ordered handles, on a mock cluster of its own.
+rd_kafka_t* newOrderedProducer() {
+    char errstr[512];
+    rd_kafka_conf_t* conf = rd_kafka_conf_new();
+    const bool ok = rd_kafka_conf_set(conf, "test.mock.num.brokers", "3", errstr, sizeof(errstr)) == RD_KAFKA_CONF_OK &&
+                    ClientPool::applyQos(conf, QosClass::Ordered, errstr, sizeof(errstr)) &&
+                    SpeakerPartitioner::instance().apply(conf, errstr, sizeof(errstr));
+    if (!ok) {
+        fprintf(stderr, "Producer configuration failed: %s\n", errstr);
+        rd_kafka_conf_destroy(conf);
+        return nullptr;
+    }
+    rd_kafka_conf_set_dr_msg_cb(conf, delivery_report_cb);
+    rd_kafka_conf_set_log_cb(conf, kafka_log_callback);
+
+    rd_kafka_t* rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+    if (!rk) {
+        fprintf(stderr, "Producer creation failed: %s\n", errstr);
+        rd_kafka_conf_destroy(conf);
+    }
+    return rk;
+}
+
+void pushProduceErrors(rd_kafka_mock_cluster_t* mcluster) {
+    // Retriable errors and a dropped connection, which re-sends every request in flight
+    rd_kafka_mock_push_request_errors(mcluster, kProduceApiKey, 5,
+                                      RD_KAFKA_RESP_ERR_NOT_ENOUGH_REPLICAS,
+                                      RD_KAFKA_RESP_ERR_REQUEST_TIMED_OUT,
+                                      RD_KAFKA_RESP_ERR__TRANSPORT,
+                                      RD_KAFKA_RESP_ERR_NOT_LEADER_FOR_PARTITION,
+                                      RD_KAFKA_RESP_ERR_NOT_ENOUGH_REPLICAS);
+}
+
+uint32_t sequenceOf(const rd_kafka_message_t* msg) {
+    const auto* p = static_cast<const uint8_t*>(msg->payload);
+    return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+           static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+// Every session's reports: all frames delivered, in one partition, at consecutive offsets.
+void checkReports(const std::string& session, const std::vector<FrameReport>& reports) {
+    CHECK(reports.size() == kFrames, "%s: %zu of %u frames delivered", session.c_str(), reports.size(), kFrames);
+    std::vector<const FrameReport*> bySequence(kFrames, nullptr);
+    for (const FrameReport& report : reports) {
+        if (report.sequence < kFrames) bySequence[report.sequence] = &report;
+    }
+    for (uint32_t sequence = 1; sequence < kFrames; sequence++) {
+        const FrameReport* previous = bySequence[sequence - 1];
+        const FrameReport* current = bySequence[sequence];
+        if (!previous || !current) continue;
+        CHECK(current->partition == previous->partition, "%s: frame %u moved to partition %d",
+              session.c_str(), sequence, current->partition);
+        CHECK(current->offset == previous->offset + 1, "%s: frame %u at offset %lld after %lld",
+              session.c_str(), sequence, static_cast<long long>(current->offset),
+              static_cast<long long>(previous->offset));
+    }
+}
+
+// Reads the topic back: per session, sequences 0..kFrames-1 at strictly increasing, gap-free offsets.
+void checkLog(const char* bootstraps) {
+    char errstr[512];
+    rd_kafka_conf_t* conf = rd_kafka_conf_new();
+    rd_kafka_conf_set(conf, "bootstrap.servers", bootstraps, errstr, sizeof(errstr));
+    rd_kafka_conf_set(conf, "group.id", "frame-order-test", errstr, sizeof(errstr));
+    rd_kafka_conf_set(conf, "enable.partition.eof", "true", errstr, sizeof(errstr));
+    rd_kafka_t* consumer = rd_kafka_new(RD_KAFKA_CONSUMER, conf, errstr, sizeof(errstr));
+    if (!consumer) {
+        CHECK(false, "Consumer creation failed: %s", errstr);
+        rd_kafka_conf_destroy(conf);
+        return;
+    }
+
+    rd_kafka_topic_partition_list_t* partitions = rd_kafka_topic_partition_list_new(kPartitions);
+    for (int p = 0; p < kPartitions; p++) {
+        rd_kafka_topic_partition_list_add(partitions, kTopic, p)->offset = RD_KAFKA_OFFSET_BEGINNING;
+    }
+    rd_kafka_assign(consumer, partitions);
+    rd_kafka_topic_partition_list_destroy(partitions);
+
+    std::map<std::string, uint32_t> nextSequence;
+    std::map<std::string, int64_t> lastOffset;
+    int atEnd = 0;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (atEnd < kPartitions && std::chrono::steady_clock::now() < deadline) {
+        rd_kafka_message_t* msg = rd_kafka_consumer_poll(consumer, 500);
+        if (!msg) continue;
+        if (msg->err == RD_KAFKA_RESP_ERR__PARTITION_EOF) {
+            atEnd++;
+        } else if (msg->err) {
+            CHECK(false, "Consume failed: %s", rd_kafka_message_errstr(msg));
+        } else if (msg->len >= 4) {
+            const std::string session(static_cast<const char*>(msg->key), msg->key_len);
+            const uint32_t sequence = sequenceOf(msg);
+            CHECK(sequence == nextSequence[session], "%s: frame %u in the log where %u was due",
+                  session.c_str(), sequence, nextSequence[session]);
+            auto last = lastOffset.find(session);
+            if (last != lastOffset.end()) {
+                CHECK(msg->offset == last->second + 1, "%s: offset %lld follows %lld", session.c_str(),
+                      static_cast<long long>(msg->offset), static_cast<long long>(last->second));
+            }
+            nextSequence[session] = sequence + 1;
+            lastOffset[session] = msg->offset;
+        }
+        rd_kafka_message_destroy(msg);
+    }
+    CHECK(atEnd == kPartitions, "Timed out reading the log back");
+    for (const char* session : kSessions) {
+        CHECK(nextSequence[session] == kFrames, "%s: %u of %u frames in the log", session,
+              nextSequence[session], kFrames);
+    }
+
+    rd_kafka_consumer_close(consumer);
+    rd_kafka_destroy(consumer);
+}
+
+} // namespace
+
+int main() {
+    rd_kafka_t* producer = newOrderedProducer();
+    if (!producer) return 1;
+    rd_kafka_mock_cluster_t* mcluster = rd_kafka_handle_mock_cluster(producer);
+    rd_kafka_mock_topic_create(mcluster, kTopic, kPartitions, 3);
+
+    std::map<std::string, std::shared_ptr<Reports>> reports;
+    for (const char* session : kSessions) {
+        reports[session] = std::make_shared<Reports>();
+    }
+
+    // Two sessions talking at once, with produce errors injected twice along the way
+    std::vector<uint8_t> frame(kFrameBytes);
+    for (uint32_t sequence = 0; sequence < kFrames; sequence++) {
+        if (sequence == 0 || sequence == kFrames / 2) pushProduceErrors(mcluster);
+        frame[0] = static_cast<uint8_t>(sequence >> 24);
+        frame[1] = static_cast<uint8_t>(sequence >> 16);
+        frame[2] = static_cast<uint8_t>(sequence >> 8);
+        frame[3] = static_cast<uint8_t>(sequence);
+        for (const char* session : kSessions) {
+            const std::string key(session);
+            const rd_kafka_resp_err_t err = FramePipeline::instance().enqueue(
+                    producer, kTopic, reinterpret_cast<const uint8_t*>(key.data()), key.size(),
+                    frame.data(), frame.size(), sequence, reports[key]);
+            CHECK(err == RD_KAFKA_RESP_ERR_NO_ERROR, "%s: frame %u not queued: %s", session, sequence,
+                  rd_kafka_err2str(err));
+        }
+        rd_kafka_poll(producer, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    CHECK(rd_kafka_flush(producer, 30000) == RD_KAFKA_RESP_ERR_NO_ERROR, "Frames still queued after 30 s");
+
+    for (const char* session : kSessions) {
+        CHECK(reports[session]->failed() == 0, "%s: %d frames failed", session, reports[session]->failed());
+        checkReports(session, reports[session]->delivered());
+        FramePipeline::instance().endSession(session);
+        SpeakerPartitioner::instance().endSession(session);
+    }
+
+    const FrameDeliveryStats stats = FramePipeline::instance().stats();
+    CHECK(stats.duplicates == 0, "%lld duplicate deliveries", static_cast<long long>(stats.duplicates));
+    CHECK(stats.reordered == 0, "%lld reordered deliveries", static_cast<long long>(stats.reordered));
+
+    checkLog(rd_kafka_mock_cluster_bootstraps(mcluster));
+
+    FramePipeline::instance().forget(producer);
+    rd_kafka_destroy(producer);
+
+    if (failures > 0) {
+        fprintf(stderr, "frame_order_test: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("frame_order_test: %u frames of %zu sessions in order\n", kFrames, sizeof(kSessions) / sizeof(kSessions[0]));
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include "timeline_index.h"
+
+#include <algorithm>
+
+TimelineIndex& TimelineIndex::instance() {
+    static TimelineIndex index;
+    return index;
+}
+
+size_t TimelineIndex::Columns::lowerBound(Key key) const {
+    size_t lo = 0;
+    size_t hi = startedAt.size();
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (Key{startedAt[mid], startOffset[mid]} < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t TimelineIndex::Columns::rowOf(int64_t offset) const {
+    auto it = startedAtByOffset.find(offset);
+    if (it == startedAtByOffset.end()) return startedAt.size();
+    return lowerBound(Key{it->second, offset});
+}
+
+uint32_t TimelineIndex::speakerCode(const std::string& userId) {
+    auto it = m_speakerCodes.find(userId);
+    if (it != m_speakerCodes.end()) return it->second;
+    const auto code = static_cast<uint32_t>(m_speakers.size());
+    m_speakers.push_back(userId);
+    m_speakerCodes.emplace(userId, code);
+    return code;
+}
+
+bool TimelineIndex::findSpeaker(const std::string& userId, uint32_t& code) const {
+    auto it = m_speakerCodes.find(userId);
+    if (it == m_speakerCodes.end()) return false;
+    code = it->second;
+    return true;
+}
+
+void TimelineIndex::clear(int32_t channelId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_channels.erase(channelId);
+}
+
+void TimelineIndex::upsert(int32_t channelId, int64_t startOffset, int64_t startedAt, int64_t durationMs,
+                           const std::string& userId, int32_t reactionCount) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Columns& c = m_channels[channelId];
+    const uint32_t speaker = speakerCode(userId);
+
+    const size_t existing = c.rowOf(startOffset);
+    if (existing < c.startedAt.size()) {
+        if (c.startedAt[existing] == startedAt && c.speaker[existing] == speaker) {
+            c.durationMs[existing] = durationMs;
+            c.reactions[existing] = reactionCount;
+            c.dirty.insert(startOffset);
+            return;
+        }
+
+        // The record moved (rewritten with other times or author): drop the old row.
+        eraseRow(c, existing);
+    }
+    c.dirty.insert(startOffset);
+
+    const Key key{startedAt, startOffset};
+    const auto at = static_cast<std::ptrdiff_t>(c.lowerBound(key));
+    c.startedAt.insert(c.startedAt.begin() + at, startedAt);
+    c.startOffset.insert(c.startOffset.begin() + at, startOffset);
+    c.durationMs.insert(c.durationMs.begin() + at, durationMs);
+    c.speaker.insert(c.speaker.begin() + at, speaker);
+    c.reactions.insert(c.reactions.begin() + at, reactionCount);
+    c.startedAtByOffset[startOffset] = startedAt;
+
+    auto& keys = c.bySpeaker[speaker];
+    keys.insert(std::lower_bound(keys.begin(), keys.end(), key), key);
+}
+
+void TimelineIndex::eraseRow(Columns& c, size_t row) {
+    const Key key{c.startedAt[row], c.startOffset[row]};
+    auto& keys = c.bySpeaker[c.speaker[row]];
+    keys.erase(std::lower_bound(keys.begin(), keys.end(), key));
+    c.startedAtByOffset.erase(key.startOffset);
+
+    const auto at = static_cast<std::ptrdiff_t>(row);
+    c.startedAt.erase(c.startedAt.begin() + at);
+    c.startOffset.erase(c.startOffset.begin() + at);
+    c.durationMs.erase(c.durationMs.begin() + at);
+    c.speaker.erase(c.speaker.begin() + at);
+    c.reactions.erase(c.reactions.begin() + at);
+}
+
+void TimelineIndex::remove(int32_t channelId, int64_t startOffset) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto channel = m_channels.find(channelId);
+    if (channel == m_channels.end()) return;
+    Columns& c = channel->second;
+
+    const size_t row = c.rowOf(startOffset);
+    if (row == c.startedAt.size()) return;
+    eraseRow(c, row);
+    c.dirty.erase(startOffset);
+}
+
+TimelineIndex::Key TimelineIndex::page(int32_t channelId, int64_t fromMs, int64_t toMs, const std::string& speaker,
+                                       Key cursor, size_t limit, std::vector<int64_t>& out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto channel = m_channels.find(channelId);
+    if (channel == m_channels.end()) return cursor;
+    return pageLocked(channel->second, Key{fromMs, INT64_MIN}, toMs, speaker, cursor, limit, out);
+}
+
+TimelineIndex::Key TimelineIndex::pageLocked(const Columns& c, Key floor, int64_t toMs,
+                                             const std::string& speaker, Key cursor, size_t limit,
+                                             std::vector<int64_t>& out) const {
+    // Rows before both the cursor and the end of the window, walked backwards
+    const Key end = std::min(cursor, Key{toMs, INT64_MAX});
+    Key last = cursor;
+
+    if (speaker.empty()) {
+        for (size_t row = c.lowerBound(end); row > 0 && out.size() < limit; row--) {
+            const Key key{c.startedAt[row - 1], c.startOffset[row - 1]};
+            if (key < floor) break;
+            out.push_back(key.startOffset);
+            last = key;
+        }
+        return last;
+    }
+
+    uint32_t code;
+    if (!findSpeaker(speaker, code)) return cursor;
+    auto keys = c.bySpeaker.find(code);
+    if (keys == c.bySpeaker.end()) return cursor;
+    for (auto it = std::lower_bound(keys->second.begin(), keys->second.end(), end);
+         it != keys->second.begin() && out.size() < limit;) {
+        --it;
+        if (*it < floor) break;
+        out.push_back(it->startOffset);
+        last = *it;
+    }
+    return last;
+}
+
+TimelineIndex::Changes TimelineIndex::takeChanges(int32_t channelId, int64_t fromMs, int64_t toMs,
+                                                 const std::string& speaker, Key floor, bool snapshot) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Columns& c = m_channels[channelId];
+    if (snapshot) c.published.clear();
+
+    std::vector<int64_t> window;
+    window.reserve(c.published.size());
+    pageLocked(c, std::max(floor, Key{fromMs, INT64_MIN}), toMs, speaker, Key{INT64_MAX, INT64_MAX},
+               SIZE_MAX, window);
+
+    Changes changes;
+    std::unordered_set<int64_t> current(window.begin(), window.end());
+    for (int64_t offset : window) {
+        if (!c.published.count(offset)) {
+            changes.inserted.push_back(offset);
+        } else if (c.dirty.count(offset)) {
+            changes.updated.push_back(offset);
+        }
+    }
+    for (int64_t offset : c.published) {
+        if (!current.count(offset)) changes.deleted.push_back(offset);
+    }
+
+    c.published = std::move(current);
+    c.dirty.clear();
+    return changes;
+}
+
+TimelineIndex::Summary TimelineIndex::summarize(int32_t channelId, int64_t fromMs, int64_t toMs,
+                                                const std::string& speaker) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Summary summary;
+    auto channel = m_channels.find(channelId);
+    if (channel == m_channels.end()) return summary;
+    const Columns& c = channel->second;
+
+    const Key from{fromMs, INT64_MIN};
+    const Key to{toMs, INT64_MAX};
+    if (speaker.empty()) {
+        const size_t last = c.lowerBound(to);
+        for (size_t row = c.lowerBound(from); row < last; row++) {
+            summary.recordings++;
+            summary.durationMs += c.durationMs[row];
+            summary.reactions += c.reactions[row];
+        }
+        return summary;
+    }
+
+    // Only the speaker's own rows, each found by its key
+    uint32_t code;
+    if (!findSpeaker(speaker, code)) return summary;
+    auto keys = c.bySpeaker.find(code);
+    if (keys == c.bySpeaker.end()) return summary;
+    const auto end = std::lower_bound(keys->second.begin(), keys->second.end(), to);
+    for (auto it = std::lower_bound(keys->second.begin(), keys->second.end(), from); it != end; ++it) {
+        const size_t row = c.lowerBound(*it);
+        summary.recordings++;
+        summary.durationMs += c.durationMs[row];
+        summary.reactions += c.reactions[row];
+    }
+    return summary;
+}
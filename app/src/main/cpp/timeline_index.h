@@ -0,0 +1,133 @@
+#ifndef CHAT_OVER_KAFKA_TIMELINE_INDEX_H
+#define CHAT_OVER_KAFKA_TIMELINE_INDEX_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+ * Ordered index of the recordings of each channel, kept as parallel columns.
+ *
+ * Rows are sorted by (startedAt, startOffset), so a time window is two binary
+ * searches over one contiguous column and a page is a slice of it. Speakers
+ * are dictionary-coded, and every speaker also keeps its own sorted list of
+ * row keys so filtering by speaker costs the same as an unfiltered query.
+ *
+ * A row's startOffset is the recording id of AudioMetadata.recordingId: the
+ * start offset itself for audio partition 0, with the partition folded into
+ * the high bits otherwise.
+ *
+ * Recordings arrive mostly in start order, so inserts are appends; a record
+ * seen again (a reaction snapshot, or a compacted duplicate) updates its row
+ * in place.
+ *
+ * The index also serves a change stream: takeChanges() diffs the current
+ * window against the one taken last time, so a reader receives one batch of
+ * inserted, updated and deleted start offsets however many records arrived
+ * in between.
+ */
+class TimelineIndex {
+public:
+    /** Sort key of a row, also used as the position of a cursor. */
+    struct Key {
+        int64_t startedAt;
+        int64_t startOffset;
+
+        bool operator<(const Key& other) const {
+            return startedAt < other.startedAt ||
+                   (startedAt == other.startedAt && startOffset < other.startOffset);
+        }
+    };
+
+    /**
+     * Start offsets of the rows that entered, changed in or left a window.
+     * Inserted and updated rows are newest first; deleted rows may already be
+     * gone from the index, so they come in no particular order.
+     */
+    struct Changes {
+        std::vector<int64_t> inserted;
+        std::vector<int64_t> updated;
+        std::vector<int64_t> deleted;
+    };
+
+    struct Summary {
+        int64_t recordings = 0;
+        int64_t durationMs = 0;
+        int64_t reactions = 0;
+    };
+
+    static TimelineIndex& instance();
+
+    /** Drops every row of `channelId`, before its topic is read again. */
+    void clear(int32_t channelId);
+
+    void upsert(int32_t channelId, int64_t startOffset, int64_t startedAt, int64_t durationMs,
+                const std::string& userId, int32_t reactionCount);
+
+    /** Drops the row of a recording whose record was deleted. */
+    void remove(int32_t channelId, int64_t startOffset);
+
+    /**
+     * Appends to `out` the start offsets of up to `limit` recordings started in
+     * [fromMs, toMs] that sort strictly before `cursor`, newest first, spoken
+     * by `speaker` unless it is empty. Returns the key of the last row added,
+     * which is the cursor of the next page; `cursor` itself if none was.
+     */
+    Key page(int32_t channelId, int64_t fromMs, int64_t toMs, const std::string& speaker,
+             Key cursor, size_t limit, std::vector<int64_t>& out);
+
+    /**
+     * Diffs the rows of the window from the newest down to `floor` (the
+     * position of the cursor that paged the window in) against the rows
+     * returned by the previous call for `channelId`; rows upserted since then
+     * that are still in the window are reported as updated. With `snapshot`
+     * the previous rows are forgotten and all of them are reported as inserted.
+     */
+    Changes takeChanges(int32_t channelId, int64_t fromMs, int64_t toMs, const std::string& speaker,
+                        Key floor, bool snapshot);
+
+    /** Totals over the recordings `page` would walk without a limit. */
+    Summary summarize(int32_t channelId, int64_t fromMs, int64_t toMs, const std::string& speaker);
+
+private:
+    TimelineIndex() = default;
+
+    struct Columns {
+        std::vector<int64_t> startedAt;
+        std::vector<int64_t> startOffset;
+        std::vector<int64_t> durationMs;
+        std::vector<uint32_t> speaker;
+        std::vector<int32_t> reactions;
+        // startOffset -> startedAt, to find the row of a record seen again
+        std::unordered_map<int64_t, int64_t> startedAtByOffset;
+        // speaker code -> keys of that speaker's rows, sorted
+        std::unordered_map<uint32_t, std::vector<Key>> bySpeaker;
+        // Rows returned by the last takeChanges, and rows upserted since
+        std::unordered_set<int64_t> published;
+        std::unordered_set<int64_t> dirty;
+
+        size_t lowerBound(Key key) const;
+        size_t rowOf(int64_t startOffset) const;
+    };
+
+    // Like page(), down to and including `floor` rather than the start of a window
+    Key pageLocked(const Columns& c, Key floor, int64_t toMs, const std::string& speaker,
+                   Key cursor, size_t limit, std::vector<int64_t>& out) const;
+    void eraseRow(Columns& c, size_t row);
+
+    uint32_t speakerCode(const std::string& userId);
+    // Returns false if `userId` never spoke, so no row can match.
+    bool findSpeaker(const std::string& userId, uint32_t& code) const;
+
+    std::mutex m_mutex;
+    std::map<int32_t, Columns> m_channels;
+    std::vector<std::string> m_speakers;
+    std::unordered_map<std::string, uint32_t> m_speakerCodes;
+};
+
+#endif //CHAT_OVER_KAFKA_TIMELINE_INDEX_H
@@ -0,0 +1,185 @@
+#include "timeline_snapshot.h"
+
+#include <android/log.h>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* const LOG_TAG = "TimelineSnapshot";
+static const char kMagic[8] = {'C', 'H', 'O', 'K', 'T', 'L', 'S', 2};
+
+namespace {
+
+uint32_t fnv1a(const uint8_t* data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& out, T value) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void putString(std::vector<uint8_t>& out, const std::string& value) {
+    put<uint32_t>(out, static_cast<uint32_t>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+class Cursor {
+public:
+    Cursor(const uint8_t* data, size_t len) : m_p(data), m_end(data + len) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(m_end - m_p) < sizeof(T)) return false;
+        memcpy(&value, m_p, sizeof(T));
+        m_p += sizeof(T);
+        return true;
+    }
+
+    bool bytes(const uint8_t*& data, size_t len) {
+        if (static_cast<size_t>(m_end - m_p) < len) return false;
+        data = m_p;
+        m_p += len;
+        return true;
+    }
+
+    bool string(std::string& value) {
+        uint32_t len;
+        const uint8_t* data;
+        if (!get(len) || !bytes(data, len)) return false;
+        value.assign(reinterpret_cast<const char*>(data), len);
+        return true;
+    }
+
+private:
+    const uint8_t* m_p;
+    const uint8_t* m_end;
+};
+
+}  // namespace
+
+bool TimelineSnapshot::save(const std::string& path, const TimelineCheckpoint& checkpoint,
+                            const std::vector<std::vector<uint8_t>>& records,
+                            const std::vector<ReactionDelta>& votes) {
+    std::vector<uint8_t> out(kMagic, kMagic + sizeof(kMagic));
+    putString(out, checkpoint.topic);
+    put<int32_t>(out, checkpoint.partition);
+    put<int64_t>(out, checkpoint.nextOffset);
+    put<uint32_t>(out, static_cast<uint32_t>(records.size()));
+    for (const auto& record : records) {
+        put<uint32_t>(out, static_cast<uint32_t>(record.size()));
+        out.insert(out.end(), record.begin(), record.end());
+    }
+    put<uint32_t>(out, static_cast<uint32_t>(votes.size()));
+    for (const ReactionDelta& vote : votes) {
+        put<int64_t>(out, vote.startOffset);
+        putString(out, vote.emoji);
+        putString(out, vote.userId);
+        put<int64_t>(out, vote.timestamp);
+        put<uint8_t>(out, vote.added ? 1 : 0);
+    }
+    put<uint32_t>(out, fnv1a(out.data(), out.size()));
+
+    const std::string tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Cannot write %s", tmpPath.c_str());
+        return false;
+    }
+    const bool written = fwrite(out.data(), 1, out.size(), file) == out.size() &&
+                         fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !written || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Failed to save %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Parses a mapped snapshot; false if it is damaged or of another partition.
+static bool parse(const uint8_t* data, size_t size, const std::string& path, TimelineCheckpoint& expected,
+                  int32_t channelId, std::vector<MetadataRecord>& out, std::vector<ReactionDelta>& votes) {
+    uint32_t checksum;
+    memcpy(&checksum, data + size - sizeof(checksum), sizeof(checksum));
+    if (memcmp(data, kMagic, sizeof(kMagic)) != 0 || fnv1a(data, size - sizeof(checksum)) != checksum) {
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Ignoring damaged snapshot %s", path.c_str());
+        return false;
+    }
+
+    Cursor in(data + sizeof(kMagic), size - sizeof(kMagic) - sizeof(checksum));
+    uint32_t topicLen, count;
+    const uint8_t* topic;
+    int32_t partition;
+    int64_t nextOffset;
+    if (!in.get(topicLen) || !in.bytes(topic, topicLen) || !in.get(partition) ||
+        !in.get(nextOffset) || !in.get(count)) {
+        return false;
+    }
+    if (std::string(reinterpret_cast<const char*>(topic), topicLen) != expected.topic ||
+        partition != expected.partition) {
+        __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Snapshot belongs to another partition, ignoring it");
+        return false;
+    }
+
+    out.clear();
+    out.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t len;
+        const uint8_t* bytes;
+        if (!in.get(len) || !in.bytes(bytes, len)) return false;
+        MetadataRecord record;
+        if (MetadataCodec::decode(bytes, len, record)) out.push_back(std::move(record));
+    }
+
+    uint32_t voteCount;
+    if (!in.get(voteCount)) return false;
+    votes.clear();
+    votes.reserve(voteCount);
+    for (uint32_t i = 0; i < voteCount; i++) {
+        ReactionDelta vote;
+        uint8_t added;
+        vote.channelId = channelId;
+        if (!in.get(vote.startOffset) || !in.string(vote.emoji) || !in.string(vote.userId) ||
+            !in.get(vote.timestamp) || !in.get(added)) {
+            return false;
+        }
+        vote.added = added != 0;
+        votes.push_back(std::move(vote));
+    }
+
+    expected.nextOffset = nextOffset;
+    return true;
+}
+
+bool TimelineSnapshot::load(const std::string& path, TimelineCheckpoint& expected, int32_t channelId,
+                            std::vector<MetadataRecord>& out, std::vector<ReactionDelta>& votes) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(kMagic) + sizeof(uint32_t))) {
+        close(fd);
+        return false;
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    const bool ok = parse(static_cast<const uint8_t*>(mapped), size, path, expected, channelId, out, votes);
+    munmap(mapped, size);
+    if (ok) {
+        __android_log_print(ANDROID_LOG_INFO, LOG_TAG, "Loaded %zu records and %zu reaction votes, resuming at %lld",
+                            out.size(), votes.size(), static_cast<long long>(expected.nextOffset));
+    }
+    return ok;
+}
@@ -0,0 +1,56 @@
+#ifndef CHAT_OVER_KAFKA_TIMELINE_SNAPSHOT_H
+#define CHAT_OVER_KAFKA_TIMELINE_SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "metadata_codec.h"
+
+/**
+ * Where a snapshot was taken: the metadata partition it materialises and the
+ * next offset to consume from it.
+ */
+struct TimelineCheckpoint {
+    std::string topic;
+    int32_t partition = 0;
+    int64_t nextOffset = 0;
+};
+
+/**
+ * On-disk copy of a channel's materialised metadata table, so reopening the
+ * timeline renders at once and only consumes what was appended since.
+ *
+ * Layout (host byte order; the file never leaves the device):
+ *
+ *   "CHOKTLS" + version byte
+ *   u32 topic length, topic bytes, i32 partition, i64 nextOffset
+ *   u32 record count, then per record u32 length + a binary metadata
+ *     record (see metadata_codec.h) with its reactions folded in
+ *   u32 vote count, then per vote i64 recording id, u32 length + emoji,
+ *     u32 length + user id, i64 timestamp, u8 added
+ *   u32 FNV-1a of everything before it
+ *
+ * The folded records alone would turn every reaction into part of the
+ * snapshot layer, which the next full record of the recording replaces. The
+ * votes that came from deltas are therefore kept with their timestamps and
+ * folded again like deltas on restore (see ReactionAggregator::votes).
+ * Snapshots are written to a temp file, synced and renamed over the old one,
+ * and read through mmap; a torn or foreign file is simply ignored.
+ */
+class TimelineSnapshot {
+public:
+    static bool save(const std::string& path, const TimelineCheckpoint& checkpoint,
+                     const std::vector<std::vector<uint8_t>>& records, const std::vector<ReactionDelta>& votes);
+
+    /**
+     * Loads the snapshot at `path` if it was taken of `expected`'s topic and
+     * partition; sets `expected.nextOffset`, decodes the records into `out`
+     * and the votes, of channel `channelId`, into `votes`. Returns false if
+     * there is no usable snapshot.
+     */
+    static bool load(const std::string& path, TimelineCheckpoint& expected, int32_t channelId,
+                     std::vector<MetadataRecord>& out, std::vector<ReactionDelta>& votes);
+};
+
+#endif //CHAT_OVER_KAFKA_TIMELINE_SNAPSHOT_H
@@ -0,0 +1,47 @@
+#ifndef CHAT_OVER_KAFKA_TLS_CONTEXT_H
+#define CHAT_OVER_KAFKA_TLS_CONTEXT_H
+
+#include <rdkafka.h>
+#include <memory>
+#include <string>
+
+/**
+ * Process-wide mTLS material shared by every client handle.
+ *
+ * The CA bundle, client certificate and private key are read from disk once
+ * per distinct set of paths and handed to librdkafka as in-memory PEM, so
+ * creating another producer or consumer no longer re-reads and re-validates
+ * the files. The same instance also applies the connection settings that keep
+ * established TLS sessions alive on mobile links, which is what avoids most
+ * full handshakes in practice.
+ */
+class TlsContext {
+public:
+    /**
+     * Returns the shared context for the given certificate paths, loading the
+     * files on first use. Returns nullptr and fills `error` on failure.
+     */
+    static std::shared_ptr<TlsContext> acquire(const char* caCertPath,
+                                               const char* clientCertPath,
+                                               const char* clientKeyPath,
+                                               std::string& error);
+
+    /**
+     * Applies security.protocol, the PEM material and the connection reuse
+     * settings to `conf`. Returns false and fills `errstr` on failure.
+     */
+    bool apply(rd_kafka_conf_t* conf, char* errstr, size_t errstr_size) const;
+
+    TlsContext(std::string caPem, std::string certPem, std::string keyPem)
+        : m_caPem(std::move(caPem)), m_certPem(std::move(certPem)), m_keyPem(std::move(keyPem)) {}
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+private:
+    std::string m_caPem;
+    std::string m_certPem;
+    std::string m_keyPem;
+};
+
+#endif //CHAT_OVER_KAFKA_TLS_CONTEXT_H
@@ -3,9 +3,11 @@ package org.github.cyterdan.chat_over_kafka
 import kotlinx.serialization.Serializable
 import kotlinx.serialization.encodeToString
 import kotlinx.serialization.json.Json
+import org.github.cyterdan.chat_over_kafka.audio.AudioService
 
 /**
- * Available reaction emojis
+ * Available reaction emojis. The binary metadata codec stores them by index
+ * (kEmojiTable in metadata_codec.cpp): only append.
  */
 object Reactions {
     val EMOJIS = listOf("👍", "❤️", "🔥")
@@ -20,31 +22,74 @@ data class AudioMetadata(
     val timestamp: Long,
     val messageCount: Long,
     // Map of emoji -> list of userIds who reacted
-    val reactions: Map<String, List<String>> = emptyMap()
+    val reactions: Map<String, List<String>> = emptyMap(),
+    // Sparse seek points captured while recording, interleaved as
+    // [offset0, mediaMs0, offset1, mediaMs1, ...] in ascending media time
+    val frameIndex: LongArray = LongArray(0),
+    // Key of the recording's audio frames; empty for recordings made before
+    // frames were keyed per session, whose range is played unfiltered
+    val frameKey: String = "",
+    // Broker timestamps of the first and last audio frame (LogAppendTime on the audio
+    // topic); 0 for recordings published before frames were timed
+    val firstFrameTime: Long = 0L,
+    val lastFrameTime: Long = 0L,
+    // Partition of the audio topic holding the frames; speakers are spread over all of them
+    val audioPartition: Int = 0
 ) {
+    /**
+     * Identifies the recording on its channel. Offsets of different audio partitions overlap,
+     * so the partition is folded into the bits above the offset; for partition 0 this is just
+     * [startOffset], which keeps the keys of older records valid.
+     */
+    val recordingId: Long get() = recordingId(audioPartition, startOffset)
+
     /**
      * Generate unique message key for Kafka compaction
      */
-    fun messageKey(): String = "msg-$channelId-$startOffset"
+    fun messageKey(): String = "msg-$channelId-$recordingId"
+
+    val hasFrameTimes: Boolean get() = firstFrameTime > 0L && lastFrameTime >= firstFrameTime
 
     /**
-     * Toggle a reaction for a user. Returns new metadata with updated reactions.
+     * Playing time: the span between the first and last frame's broker timestamps when known,
+     * otherwise estimated from the frame count.
      */
-    fun toggleReaction(emoji: String, reactingUserId: String): AudioMetadata {
-        val currentReactors = reactions[emoji] ?: emptyList()
-        val newReactors = if (reactingUserId in currentReactors) {
-            currentReactors - reactingUserId
+    val durationMs: Long
+        get() = if (hasFrameTimes) {
+            lastFrameTime - firstFrameTime + AudioService.FRAME_DURATION_MS
         } else {
-            currentReactors + reactingUserId
+            messageCount * AudioService.FRAME_DURATION_MS
         }
-        val newReactions = if (newReactors.isEmpty()) {
-            reactions - emoji
-        } else {
-            reactions + (emoji to newReactors)
-        }
-        return copy(reactions = newReactions)
+
+    /**
+     * When the recording started on the broker's clock, which every device shares; older
+     * records fall back to the author's release time minus the estimated duration.
+     */
+    val startedAt: Long
+        get() = if (hasFrameTimes) firstFrameTime else timestamp - durationMs
+
+    /**
+     * Key of one user's reaction delta. Compaction keeps the latest delta per
+     * (recording, emoji, user), which is exactly the last-writer-wins state.
+     */
+    fun reactionKey(emoji: String, reactingUserId: String): String = "${messageKey()}/$emoji/$reactingUserId"
+
+    /**
+     * Toggle a reaction for a user as a delta event: folds it locally and returns the
+     * updated metadata together with the delta record to publish under [reactionKey].
+     */
+    fun react(emoji: String, reactingUserId: String, timestamp: Long = System.currentTimeMillis()): Pair<AudioMetadata, ByteArray> {
+        val delta = RdKafka.reactLocally(
+            channelId, recordingId, emoji, reactingUserId,
+            added = !hasUserReacted(emoji, reactingUserId),
+            timestamp = timestamp
+        )
+        return withFoldedReactions() to delta
     }
 
+    /** Copy carrying the natively folded reactions of this recording. */
+    fun withFoldedReactions(): AudioMetadata = copy(reactions = RdKafka.reactionsOf(channelId, recordingId))
+
     /**
      * Check if a user has reacted with a specific emoji
      */
@@ -57,11 +102,110 @@ data class AudioMetadata(
      */
     fun reactionCount(emoji: String): Int = reactions[emoji]?.size ?: 0
 
+    override fun equals(other: Any?): Boolean {
+        if (this === other) return true
+        if (other !is AudioMetadata) return false
+        return userId == other.userId &&
+            channelId == other.channelId &&
+            startOffset == other.startOffset &&
+            endOffset == other.endOffset &&
+            timestamp == other.timestamp &&
+            messageCount == other.messageCount &&
+            reactions == other.reactions &&
+            frameIndex.contentEquals(other.frameIndex) &&
+            frameKey == other.frameKey &&
+            firstFrameTime == other.firstFrameTime &&
+            lastFrameTime == other.lastFrameTime &&
+            audioPartition == other.audioPartition
+    }
+
+    override fun hashCode(): Int {
+        var result = userId.hashCode()
+        result = 31 * result + channelId
+        result = 31 * result + startOffset.hashCode()
+        result = 31 * result + endOffset.hashCode()
+        result = 31 * result + timestamp.hashCode()
+        result = 31 * result + messageCount.hashCode()
+        result = 31 * result + reactions.hashCode()
+        result = 31 * result + frameIndex.contentHashCode()
+        result = 31 * result + frameKey.hashCode()
+        result = 31 * result + firstFrameTime.hashCode()
+        result = 31 * result + lastFrameTime.hashCode()
+        result = 31 * result + audioPartition
+        return result
+    }
+
     fun toJson(): String = Json.encodeToString(this)
 
+    /**
+     * Compact binary encoding (see metadata_codec.h). This is what gets published;
+     * [fromBytes] still accepts records written as JSON.
+     */
+    fun toBytes(): ByteArray {
+        val emojis = reactions.keys.toTypedArray()
+        val reactors = Array(emojis.size) { i -> reactions.getValue(emojis[i]).toTypedArray() }
+        return RdKafka.encodeMetadata(userId, channelId, startOffset, endOffset, timestamp, messageCount, emojis, reactors, frameIndex, frameKey, firstFrameTime, lastFrameTime, audioPartition)
+    }
+
     companion object {
         private val jsonParser = Json { ignoreUnknownKeys = true }
 
+        // Offsets stay far below 2^48; the partition lives above them
+        private const val RECORDING_ID_PARTITION_SHIFT = 48
+
+        fun recordingId(audioPartition: Int, startOffset: Long): Long =
+            if (audioPartition == 0) startOffset else (audioPartition.toLong() shl RECORDING_ID_PARTITION_SHIFT) or startOffset
+
         fun fromJson(json: String): AudioMetadata = jsonParser.decodeFromString(json)
+
+        /**
+         * Recording id named by a record key from [messageKey], or null for any other key
+         * (reaction deltas, rollups).
+         */
+        fun recordingIdOfKey(key: String): Long? {
+            if (!key.startsWith("msg-") || '/' in key) return null
+            return key.substringAfterLast('-').toLongOrNull()
+        }
+
+        /**
+         * Decode a metadata record in either format: JSON records start with '{',
+         * everything else goes to the native binary decoder.
+         */
+        fun fromBytes(bytes: ByteArray): AudioMetadata {
+            val first = bytes.firstOrNull { !it.toInt().toChar().isWhitespace() }
+            if (first == '{'.code.toByte()) {
+                return fromJson(bytes.toString(Charsets.UTF_8))
+            }
+            return RdKafka.decodeMetadata(bytes)
+                ?: throw IllegalArgumentException("Malformed metadata record (${bytes.size} bytes)")
+        }
+
+        /** Called by the native decoder. */
+        @JvmStatic
+        fun fromDecoded(
+            userId: String,
+            channelId: Int,
+            startOffset: Long,
+            endOffset: Long,
+            timestamp: Long,
+            messageCount: Long,
+            emojis: Array<String>,
+            reactors: Array<Array<String>>,
+            frameIndex: LongArray,
+            frameKey: String,
+            firstFrameTime: Long,
+            lastFrameTime: Long,
+            audioPartition: Int
+        ): AudioMetadata {
+            val reactions = if (emojis.isEmpty()) {
+                emptyMap()
+            } else {
+                emojis.indices.associate { i -> emojis[i] to reactors[i].asList() }
+            }
+            return AudioMetadata(
+                userId, channelId, startOffset, endOffset, timestamp, messageCount,
+                reactions, frameIndex, frameKey, firstFrameTime, lastFrameTime, audioPartition
+            )
+        }
     }
 }
@@ -0,0 +1,13 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * What a channel is doing right now, judged from how far its partitions' watermarks moved
+ * between two rounds of the native activity monitor. Rates are per minute over the last round.
+ */
+data class ChannelActivity(
+    val talking: Boolean,
+    val audioFramesPerMinute: Long,
+    val metadataRecordsPerMinute: Long,
+    // Wall clock of the last round that saw audio frames, -1 if none did yet
+    val lastTalkMs: Long
+)
@@ -0,0 +1,18 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * How the frames queued with [RdKafka.recordFrame] fared. [duplicates] and [reordered] stay at
+ * 0 on ordered producers; anything else means a recording plays back wrong.
+ */
+data class FrameDeliveryStats(
+    val enqueued: Long,
+    val delivered: Long,
+    // Not delivered before the deadline, or not queued at all
+    val failed: Long,
+    // Produce requests the ordered producers had to send again
+    val retries: Long,
+    // Frames of a recording delivered twice
+    val duplicates: Long,
+    // Frames that landed out of sequence within their recording
+    val reordered: Long
+)
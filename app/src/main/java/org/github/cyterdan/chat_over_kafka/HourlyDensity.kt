@@ -0,0 +1,12 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * Channel activity during one clock hour, read from the hourly rollups rather than from
+ * the individual metadata records.
+ */
+data class HourlyDensity(
+    val hourStartMs: Long,
+    val recordings: Int,
+    val durationMs: Long,
+    val speakers: Int
+)
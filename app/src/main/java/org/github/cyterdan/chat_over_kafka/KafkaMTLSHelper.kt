@@ -1,12 +1,47 @@
 package org.github.cyterdan.chat_over_kafka
 
+import android.app.ActivityManager
 import android.content.Context
+import android.util.Base64
 import kotlinx.coroutines.flow.Flow
 import java.io.File
 import java.io.FileOutputStream
 
 object KafkaMTLSHelper {
 
+    /**
+     * Size the native memory budget for this device: a small fixed ceiling on low-RAM
+     * devices, otherwise a slice of the per-app heap class.
+     */
+    fun applyMemoryBudget(context: Context) {
+        val activityManager = context.getSystemService(ActivityManager::class.java)
+        val budgetBytes = if (activityManager.isLowRamDevice) {
+            16L * 1024 * 1024
+        } else {
+            (activityManager.memoryClass.toLong() * 1024 * 1024 / 8).coerceIn(16L * 1024 * 1024, 64L * 1024 * 1024)
+        }
+        RdKafka.setMemoryBudget(budgetBytes)
+    }
+
+    /** Keep broker metadata for [brokerUrl] in app storage across cold starts. */
+    fun useMetadataCache(context: Context, brokerUrl: String) {
+        RdKafka.setMetadataCachePath(File(context.filesDir, "kafka_metadata.cache").absolutePath, brokerUrl)
+    }
+
+    /** Keep this device's hourly rollup buckets in app storage across restarts. */
+    fun useRollupStore(context: Context) {
+        RdKafka.setRollupPath(File(context.filesDir, "rollups.cache").absolutePath)
+    }
+
+    /** Seal [audioTopic]'s frames end to end with the base64 [frameKey] under [cipher]. */
+    fun useFrameKey(audioTopic: String, cipher: String, frameKey: String) {
+        val cipherId = when (cipher) {
+            "chacha20-poly1305" -> RdKafka.FRAME_CIPHER_CHACHA20_POLY1305
+            else -> RdKafka.FRAME_CIPHER_AES_128_GCM
+        }
+        RdKafka.setFrameKey(audioTopic, cipherId, Base64.decode(frameKey, Base64.DEFAULT))
+    }
+
     private fun copyAssetToInternalStorage(context: Context, assetName: String): String {
         val file = File(context.filesDir, assetName)
        //cdse if (file.exists()) return file.absolutePath
@@ -19,6 +54,9 @@ object KafkaMTLSHelper {
         return file.absolutePath
     }
 
+    /**
+     * Acquire a pooled producer for these credentials. Release it with [releaseProducer].
+     */
     fun createProducerMTLSFromAssets(
         brokers: String,
         context: Context,
@@ -30,13 +68,18 @@ object KafkaMTLSHelper {
         val clientCertPath = copyAssetToInternalStorage(context, clientCertAssetName)
         val clientKeyPath = copyAssetToInternalStorage(context, clientKeyAssetName)
 
-        return RdKafka.createProducerMTLS(brokers, caCertPath, clientCertPath, clientKeyPath)
+        return RdKafka.acquireClient(
+            brokers, caCertPath, clientCertPath, clientKeyPath, RdKafka.ROLE_PRODUCER, "durable"
+        )
+    }
+
+    fun releaseProducer(producerHandle: Long) {
+        RdKafka.releaseClient(producerHandle)
     }
 
     fun consumeFromMTLSFromAssets(
         context: Context,
         brokers: String,
-        groupId: String,
         topic: String,
         caAssetName: String,
         clientCertAssetName: String,
@@ -49,7 +92,6 @@ object KafkaMTLSHelper {
 
         return RdKafka.consumeFromMTLS(
             brokers = brokers,
-            groupId = groupId,
             topic = topic,
             caCertPath = caCertPath,
             clientCertPath = clientCertPath,
@@ -58,10 +100,36 @@ object KafkaMTLSHelper {
         )
     }
 
+    fun consumeRecycledFromMTLSFromAssets(
+        context: Context,
+        brokers: String,
+        topic: String,
+        caAssetName: String,
+        clientCertAssetName: String,
+        clientKeyAssetName: String,
+        holderPool: MessageHolderPool,
+        offsetStrategy: String = "latest",
+        mergeHoldBackMs: Int = 0
+    ): Flow<KafkaMessageHolder> {
+        val caCertPath = copyAssetToInternalStorage(context, caAssetName)
+        val clientCertPath = copyAssetToInternalStorage(context, clientCertAssetName)
+        val clientKeyPath = copyAssetToInternalStorage(context, clientKeyAssetName)
+
+        return RdKafka.consumeRecycledFromMTLS(
+            brokers = brokers,
+            topic = topic,
+            caCertPath = caCertPath,
+            clientCertPath = clientCertPath,
+            clientKeyPath = clientKeyPath,
+            offsetStrategy = offsetStrategy,
+            holderPool = holderPool,
+            mergeHoldBackMs = mergeHoldBackMs
+        )
+    }
+
     fun consumeFromMTLSFromAssetsWithOffset(
         context: Context,
         brokers: String,
-        groupId: String,
         topic: String,
         caAssetName: String,
         clientCertAssetName: String,
@@ -75,7 +143,6 @@ object KafkaMTLSHelper {
 
         return RdKafka.consumeFromMTLSWithOffset(
             brokers = brokers,
-            groupId = groupId,
             topic = topic,
             caCertPath = caCertPath,
             clientCertPath = clientCertPath,
@@ -84,4 +151,33 @@ object KafkaMTLSHelper {
             offset = offset
         )
     }
+
+    fun consumeKeyedRangeFromAssets(
+        context: Context,
+        brokers: String,
+        topic: String,
+        caAssetName: String,
+        clientCertAssetName: String,
+        clientKeyAssetName: String,
+        partition: Int,
+        startOffset: Long,
+        endOffset: Long,
+        key: ByteArray?
+    ): Flow<ByteArray> {
+        val caCertPath = copyAssetToInternalStorage(context, caAssetName)
+        val clientCertPath = copyAssetToInternalStorage(context, clientCertAssetName)
+        val clientKeyPath = copyAssetToInternalStorage(context, clientKeyAssetName)
+
+        return RdKafka.consumeKeyedRangeFromMTLS(
+            brokers = brokers,
+            topic = topic,
+            caCertPath = caCertPath,
+            clientCertPath = clientCertPath,
+            clientKeyPath = clientKeyPath,
+            partition = partition,
+            startOffset = startOffset,
+            endOffset = endOffset,
+            key = key
+        )
+    }
 }
\ No newline at end of file
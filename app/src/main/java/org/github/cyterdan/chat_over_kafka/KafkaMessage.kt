@@ -5,10 +5,16 @@ data class KafkaMessage(
     val value: ByteArray?,
     val topic: String,
     val partition: Int,
-    val offset: Long
+    val offset: Long,
+    val timestamp: Long = -1,  // -1 when the record carries no timestamp
+    val timestampType: Int = TIMESTAMP_NOT_AVAILABLE,
+    val latencyMs: Long = -1  // age of the record when it was polled, by this device's clock
 ) {
     fun keyAsString(): String? = key?.toString(Charsets.UTF_8)
     fun valueAsString(): String? = value?.toString(Charsets.UTF_8)
+
+    /** True if [timestamp] was assigned by the broker rather than by the producing device. */
+    val isBrokerTimestamp: Boolean get() = timestampType == TIMESTAMP_LOG_APPEND_TIME
     
     override fun equals(other: Any?): Boolean {
         if (this === other) return true
@@ -27,6 +33,8 @@ data class KafkaMessage(
         if (topic != topic) return false
         if (partition != other.partition) return false
         if (offset != other.offset) return false
+        if (timestamp != other.timestamp) return false
+        if (timestampType != other.timestampType) return false
 
         return true
     }
@@ -37,6 +45,14 @@ data class KafkaMessage(
         result = 31 * result + topic.hashCode()
         result = 31 * result + partition
         result = 31 * result + offset.hashCode()
+        result = 31 * result + timestamp.hashCode()
         return result
     }
+
+    companion object {
+        // rd_kafka_timestamp_type_t
+        const val TIMESTAMP_NOT_AVAILABLE = 0
+        const val TIMESTAMP_CREATE_TIME = 1
+        const val TIMESTAMP_LOG_APPEND_TIME = 2
+    }
 }
\ No newline at end of file
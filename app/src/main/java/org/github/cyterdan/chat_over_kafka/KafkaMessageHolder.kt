@@ -0,0 +1,81 @@
+package org.github.cyterdan.chat_over_kafka
+
+import java.nio.ByteBuffer
+
+/**
+ * Reusable consume target that the native poll fills in place.
+ *
+ * Key and value live in direct buffers that are only reallocated when a record is larger
+ * than anything seen before; the topic String is only replaced when the topic changes.
+ * A holder obtained from [MessageHolderPool.lease] must be handed back with
+ * [MessageHolderPool.recycle] once its bytes have been consumed.
+ */
+class KafkaMessageHolder(keyCapacity: Int = 64, valueCapacity: Int = 2048) {
+    // Fields are read and written directly by native code; keep names in sync with nativelib.cpp
+    @JvmField var key: ByteBuffer = ByteBuffer.allocateDirect(keyCapacity)
+    @JvmField var value: ByteBuffer = ByteBuffer.allocateDirect(valueCapacity)
+    @JvmField var keyLength: Int = -1  // -1 when the record has no key
+    @JvmField var valueLength: Int = -1  // -1 when the record has no value
+    @JvmField var topic: String = ""
+    @JvmField var topicHandle: Long = 0
+    @JvmField var partition: Int = 0
+    @JvmField var offset: Long = 0
+    @JvmField var timestamp: Long = -1
+    @JvmField var timestampType: Int = KafkaMessage.TIMESTAMP_NOT_AVAILABLE
+    @JvmField var latencyMs: Long = -1
+    @JvmField var pendingMessage: Long = 0
+
+    // The pool it was leased from, which it goes back to
+    internal var owner: MessageHolderPool? = null
+
+    val hasValue: Boolean get() = valueLength >= 0
+
+    /** Grow the buffers to fit the sizes reported by the native side. */
+    internal fun ensureCapacity() {
+        if (keyLength > key.capacity()) key = ByteBuffer.allocateDirect(keyLength)
+        if (valueLength > value.capacity()) value = ByteBuffer.allocateDirect(valueLength)
+    }
+
+    /** Copy the value into [dest] (which must hold [valueLength] bytes). Returns the byte count. */
+    fun copyValueInto(dest: ByteArray): Int {
+        if (valueLength <= 0) return 0
+        value.clear()
+        value.get(dest, 0, valueLength)
+        return valueLength
+    }
+
+    fun keyMatches(expected: ByteArray): Boolean {
+        if (keyLength != expected.size) return false
+        for (i in expected.indices) {
+            if (key.get(i) != expected[i]) return false
+        }
+        return true
+    }
+
+    /** Allocating snapshot, for callers that need to keep the record around. */
+    fun toKafkaMessage(): KafkaMessage {
+        val keyBytes = if (keyLength >= 0) ByteArray(keyLength).also { key.clear(); key.get(it) } else null
+        val valueBytes = if (valueLength >= 0) ByteArray(valueLength).also { copyValueInto(it) } else null
+        return KafkaMessage(keyBytes, valueBytes, topic, partition, offset, timestamp, timestampType, latencyMs)
+    }
+}
+
+/**
+ * Bounded free list of [KafkaMessageHolder]s shared by the consume loop and its decoder.
+ */
+class MessageHolderPool(private val maxPooled: Int = 64) {
+    private val free = ArrayDeque<KafkaMessageHolder>(maxPooled)
+
+    fun lease(): KafkaMessageHolder =
+        (synchronized(free) { free.removeLastOrNull() } ?: KafkaMessageHolder()).also { it.owner = this }
+
+    fun recycle(holder: KafkaMessageHolder) {
+        if (holder.pendingMessage != 0L) {
+            RdKafka.discardPendingMessage(holder.pendingMessage)
+            holder.pendingMessage = 0
+        }
+        synchronized(free) {
+            if (free.size < maxPooled) free.addLast(holder)
+        }
+    }
+}
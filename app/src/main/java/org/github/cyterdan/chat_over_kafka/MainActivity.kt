@@ -6,7 +6,6 @@ import android.content.Intent
 import android.net.ConnectivityManager
 import android.net.Network
 import android.net.NetworkCapabilities
-import android.net.NetworkRequest
 import android.os.Bundle
 import android.util.Log
 import androidx.activity.ComponentActivity
@@ -58,6 +57,7 @@ import kotlinx.coroutines.cancel
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.isActive
 import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
 import org.github.cyterdan.chat_over_kafka.audio.AudioService
 import org.github.cyterdan.chat_over_kafka.data.KafkaConfig
 import org.github.cyterdan.chat_over_kafka.ui.EqualizerVisualizer
@@ -77,11 +77,24 @@ data class ChannelConfig(
     val audioPartition: Int,
     val metadataTopic: String,
     val metadataPartition: Int,
+    val rollupPartition: Int,
+    // RdKafka.QOS_ORDERED or RdKafka.QOS_REALTIME
+    val frameQos: Int,
     val caAssetName: String,
     val clientKeyAssetName: String,
     val clientCertAssetName: String
 )
 
+// Media time between seek points in a recording's frame index
+private const val FRAME_INDEX_INTERVAL_MS = 1000L
+
+// Between two watermark rounds of the channel activity monitor
+private const val ACTIVITY_INTERVAL_MS = 3000
+
+// How long live playout waits for a frame of a concurrent speaker on another partition
+// before playing what it has (two frames)
+private const val PLAYOUT_HOLD_BACK_MS = 120
+
 // Available channels - loaded from config at runtime
 private var _availableChannels: List<ChannelConfig>? = null
 val availableChannels: List<ChannelConfig>
@@ -107,6 +120,8 @@ fun loadChannelConfig(context: Context) {
             audioPartition = channel.audioPartition,
             metadataTopic = channel.metadataTopic,
             metadataPartition = channel.metadataPartition,
+            rollupPartition = channel.rollupPartition,
+            frameQos = if (channel.liveQos == "realtime") RdKafka.QOS_REALTIME else RdKafka.QOS_ORDERED,
             caAssetName = config.certificates.caAssetName,
             clientKeyAssetName = config.certificates.clientKeyAssetName,
             clientCertAssetName = config.certificates.clientCertAssetName
@@ -114,6 +129,13 @@ fun loadChannelConfig(context: Context) {
     }
 
     Log.i("MainActivity", "Loaded ${availableChannels.size} channels from config, broker: ${config.brokerUrl}")
+
+    KafkaMTLSHelper.applyMemoryBudget(context)
+    KafkaMTLSHelper.useMetadataCache(context, config.brokerUrl)
+    KafkaMTLSHelper.useRollupStore(context)
+    for (channel in config.channels) {
+        channel.frameKey?.let { KafkaMTLSHelper.useFrameKey(channel.audioTopic, channel.frameCipher, it) }
+    }
 }
 
 class MainActivity : ComponentActivity() {
@@ -121,6 +143,9 @@ class MainActivity : ComponentActivity() {
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
 
+        // Debug builds log librdkafka, the native modules and the hot paths at debug level
+        RdKafka.setLogLevel(if (BuildConfig.DEBUG) Log.DEBUG else Log.INFO)
+
         // Load Kafka configuration from assets
         loadChannelConfig(this)
 
@@ -186,6 +211,8 @@ fun ChatScreen() {
     val isPlaying by audioService.isPlaying.collectAsState()
     val isRecording by audioService.isRecording.collectAsState()
     val waveformData by audioService.waveformData.collectAsState()
+    // Reusable receive buffers for the live audio stream
+    val holderPool = remember { MessageHolderPool() }
     var consumerJob by remember { mutableStateOf<kotlinx.coroutines.Job?>(null) }
 
     // Channel selection
@@ -200,48 +227,58 @@ fun ChatScreen() {
 
     // Network monitoring for fast reconnection
     var isNetworkAvailable by remember { mutableStateOf(true) }
-    var networkReconnectTrigger by remember { mutableStateOf(0) }
+    // Bumped after each handoff so the producer re-warms its connections
+    var networkGeneration by remember { mutableStateOf(0) }
 
-    // Monitor network connectivity
+    // Follow the default network: a handoff resets the broker sockets in place, keeping the
+    // live producer, consumer, their queues and in-flight messages.
     DisposableEffect(context) {
         val connectivityManager = context.getSystemService(Context.CONNECTIVITY_SERVICE) as ConnectivityManager
         val networkCallback = object : ConnectivityManager.NetworkCallback() {
+            private var currentNetwork: Network? = null
+
+            private fun reconnect(reason: String) {
+                val reset = RdKafka.onNetworkChanged()
+                Log.i("Network", "$reason: reset $reset broker connections")
+                networkGeneration++
+            }
+
             override fun onAvailable(network: Network) {
                 Log.i("Network", "Network available")
+                val previous = currentNetwork
+                currentNetwork = network
                 isNetworkAvailable = true
-                // Trigger reconnection by incrementing counter
-                networkReconnectTrigger++
+                if (previous != null && previous != network) {
+                    reconnect("Default network changed")
+                }
             }
 
             override fun onLost(network: Network) {
                 Log.w("Network", "Network lost")
-                isNetworkAvailable = false
+                if (network == currentNetwork) {
+                    isNetworkAvailable = false
+                }
             }
 
             override fun onCapabilitiesChanged(network: Network, capabilities: NetworkCapabilities) {
                 val hasInternet = capabilities.hasCapability(NetworkCapabilities.NET_CAPABILITY_INTERNET) &&
                                 capabilities.hasCapability(NetworkCapabilities.NET_CAPABILITY_VALIDATED)
                 if (hasInternet && !isNetworkAvailable) {
-                    Log.i("Network", "Internet connectivity restored")
                     isNetworkAvailable = true
-                    networkReconnectTrigger++
+                    reconnect("Internet connectivity restored")
                 }
             }
         }
 
-        val networkRequest = NetworkRequest.Builder()
-            .addCapability(NetworkCapabilities.NET_CAPABILITY_INTERNET)
-            .build()
-
-        connectivityManager.registerNetworkCallback(networkRequest, networkCallback)
+        connectivityManager.registerDefaultNetworkCallback(networkCallback)
 
         onDispose {
             connectivityManager.unregisterNetworkCallback(networkCallback)
         }
     }
 
-    // Producer handle - recreate when channel OR network changes
-    val producerHandle = remember(selectedChannelIndex, networkReconnectTrigger) {
+    // Producer handle - recreated only when the channel changes; network handoffs reconnect in place
+    val producerHandle = remember(selectedChannelIndex) {
         Log.i("Kafka", "✓ Creating producer: Channel ${currentChannel.channelNumber} (${currentChannel.channelName}), Broker: ${currentChannel.brokerUrl}")
         KafkaMTLSHelper.createProducerMTLSFromAssets(
             brokers = currentChannel.brokerUrl,
@@ -252,9 +289,54 @@ fun ChatScreen() {
         )
     }
 
-    // Track the first and last offset from the current recording session
-    var sessionStartOffset by remember { mutableStateOf<RecordMetadata?>(null) }
-    var sessionEndOffset by remember { mutableStateOf<RecordMetadata?>(null) }
+    // Hand the pooled producer back when the channel changes or the screen goes away. Every
+    // channel shares the broker and certificates, so the handle itself rarely changes: each
+    // channel's lease holds its own reference.
+    DisposableEffect(selectedChannelIndex, producerHandle) {
+        onDispose { KafkaMTLSHelper.releaseProducer(producerHandle) }
+    }
+
+    // Pre-connect the producer so the first push-to-talk frame doesn't pay for DNS/TLS/metadata.
+    // Runs when the screen opens, when the channel changes and after a network handoff.
+    LaunchedEffect(selectedChannelIndex, producerHandle, networkGeneration) {
+        withContext(Dispatchers.IO) {
+            try {
+                val warm = RdKafka.warmUp(
+                    handle = producerHandle,
+                    topics = arrayOf(currentChannel.audioTopic, currentChannel.metadataTopic),
+                    timeoutMs = 5000
+                )
+                Log.i("Kafka", "Producer warmed up: $warm partition leaders connected")
+            } catch (e: RuntimeException) {
+                Log.w("Kafka", "Producer warm-up failed: ${e.message}")
+            }
+        }
+    }
+
+    // Which channels have someone talking, from the watermarks of all of them on one connection
+    var channelActivity by remember { mutableStateOf<List<ChannelActivity>>(emptyList()) }
+    DisposableEffect(context) {
+        // Every channel shares the broker and certificates, so this is the pooled producer's connection
+        val first = availableChannels.first()
+        val monitorHandle = KafkaMTLSHelper.createProducerMTLSFromAssets(
+            brokers = first.brokerUrl,
+            context = context,
+            caAssetName = first.caAssetName,
+            clientCertAssetName = first.clientCertAssetName,
+            clientKeyAssetName = first.clientKeyAssetName
+        )
+        RdKafka.startActivityMonitor(monitorHandle, availableChannels, ACTIVITY_INTERVAL_MS)
+        onDispose {
+            RdKafka.stopActivityMonitor()
+            KafkaMTLSHelper.releaseProducer(monitorHandle)
+        }
+    }
+    LaunchedEffect(Unit) {
+        while (isActive) {
+            channelActivity = RdKafka.channelActivity()
+            delay(ACTIVITY_INTERVAL_MS.toLong())
+        }
+    }
 
     // Log channel changes and immediately show connecting state
     LaunchedEffect(selectedChannelIndex) {
@@ -271,7 +353,7 @@ fun ChatScreen() {
     }
 
     // Automatic playback management (walkie-talkie mode)
-    LaunchedEffect(isPlaybackEnabled, isRecording, selectedChannelIndex, networkReconnectTrigger) {
+    LaunchedEffect(isPlaybackEnabled, isRecording, selectedChannelIndex) {
         // Stop playback when recording or when playback is disabled
         if (isRecording || !isPlaybackEnabled) {
             if (isPlaying) {
@@ -284,7 +366,7 @@ fun ChatScreen() {
         }
         // Start playback when enabled and not recording
         else if (isPlaybackEnabled && !isRecording) {
-            // Always restart consumer (even if already playing) to handle reconnections/channel changes
+            // Always restart consumer (even if already playing) to handle channel changes
             if (isPlaying) {
                 Log.i("ChatScreen", "⟳ Restarting consumer - switching to Channel ${currentChannel.channelNumber} (${currentChannel.channelName})")
                 consumerJob?.cancel()
@@ -306,14 +388,16 @@ fun ChatScreen() {
                 while (retryCount < maxRetries) {
                     try {
                         Log.i("Kafka", "Consumer connecting (attempt ${retryCount + 1}/$maxRetries)")
-                        val consumerFlow = KafkaMTLSHelper.consumeFromMTLSFromAssets(
+                        val consumerFlow = KafkaMTLSHelper.consumeRecycledFromMTLSFromAssets(
                             context = context,
                             brokers = currentChannel.brokerUrl,
                             caAssetName = currentChannel.caAssetName,
                             clientKeyAssetName = currentChannel.clientKeyAssetName,
                             clientCertAssetName = currentChannel.clientCertAssetName,
                             topic = currentChannel.audioTopic,
-                            groupId = "chat-group-${System.currentTimeMillis()}",
+                            holderPool = holderPool,
+                            // Speakers write to different partitions; play them in broker order
+                            mergeHoldBackMs = PLAYOUT_HOLD_BACK_MS,
                             offsetStrategy = "latest"
                         )
 
@@ -323,13 +407,11 @@ fun ChatScreen() {
                         isConnecting = false
                         Log.i("Kafka", "✓ Consumer connected successfully, waiting for messages...")
 
-                        consumerFlow.collect { receivedData ->
+                        consumerFlow.collect { holder ->
                             retryCount = 0 // Reset retry count on successful message
                             backoffDelay = 1000L
-                            if (receivedData.value != null) {
-                                Log.d("ChatScreen", "Received audio chunk: ${receivedData.value.size} bytes")
-                                audioService.onReceivedEncodedChunk(receivedData.value)
-                            }
+                            // Hands the holder back to the pool once decoded
+                            audioService.onReceivedEncodedChunk(holder, holderPool)
                         }
                         // If flow completes normally, break the retry loop
                         break
@@ -354,79 +436,65 @@ fun ChatScreen() {
     // Track recording start time for duration calculation
     var recordingStartTime by remember { mutableStateOf(0L) }
 
+    // The native recording session of the current press (see RdKafka.startRecording)
+    var currentRecording by remember { mutableStateOf(0L) }
+
     LaunchedEffect(isPressed, hasAudioPermission) {
         if (isPressed && hasAudioPermission) {
             Log.d("ChatScreen", "Starting streaming")
 
-            // Reset session offsets and start time when starting a new recording
-            sessionStartOffset = null
-            sessionEndOffset = null
             recordingStartTime = System.currentTimeMillis()
+            val recording = try {
+                RdKafka.startRecording(
+                    producerPtr = producerHandle,
+                    audioTopic = currentChannel.audioTopic,
+                    metadataTopic = currentChannel.metadataTopic,
+                    metadataPartition = currentChannel.metadataPartition,
+                    rollupPartition = currentChannel.rollupPartition,
+                    userId = userId.ifEmpty { "anonymous" },
+                    channelId = currentChannel.channelNumber,
+                    startedAtMs = recordingStartTime,
+                    frameDurationMs = AudioService.FRAME_DURATION_MS,
+                    indexIntervalMs = FRAME_INDEX_INTERVAL_MS,
+                    frameQos = currentChannel.frameQos
+                )
+            } catch (e: RuntimeException) {
+                Log.e("Kafka", "Recording failed to start: ${e.message}")
+                return@LaunchedEffect
+            }
+            currentRecording = recording
 
             // Note: Playback is automatically stopped by the playback management LaunchedEffect above
 
             audioService.startStreaming { encodedData ->
-                // Launch Kafka send in a separate coroutine to avoid blocking recording
-                coroutineScope.launch(Dispatchers.IO) {
-                    try {
-                        val meta = RdKafka.produceMessageBytesToPartition(
-                            producerPtr = producerHandle,
-                            topic = currentChannel.audioTopic,
-                            partition = currentChannel.audioPartition,
-                            key = "user1".toByteArray(),
-                            value = encodedData
-                        )
-
-                        synchronized(this) {
-                            if (sessionStartOffset == null || meta.offset < sessionStartOffset!!.offset) {
-                                sessionStartOffset = meta
-                            }
-                            if (sessionEndOffset == null || meta.offset > sessionEndOffset!!.offset) {
-                                sessionEndOffset = meta
-                            }
-                        }
-                    } catch (e: RuntimeException) {
-                        Log.e("Kafka", "Produce failed: ${e.message}")
-                    }
+                // Frames arrive in capture order, one per FRAME_DURATION_MS, and are queued
+                // right here so the producer sees them in that order. Nothing waits
+                // for acks: the recording session collects them.
+                try {
+                    RdKafka.recordFrame(recording, encodedData)
+                } catch (e: RuntimeException) {
+                    Log.e("Kafka", "Produce failed: ${e.message}")
                 }
             }
         } else {
             Log.d("ChatScreen", "Stopping streaming")
             audioService.stopStreaming()
-            try {
-                RdKafka.flushProducer(producerPtr = producerHandle, timeoutMs = 5000)
-
-                // Publish metadata for the recording session
-                if (sessionStartOffset != null && sessionEndOffset != null) {
-                    val messageCount = sessionEndOffset!!.offset - sessionStartOffset!!.offset + 1
-                    Log.i("ChatScreen", "Recording complete: $messageCount messages")
-
-                    try {
-                        val metadata = AudioMetadata(
-                            userId = userId.ifEmpty { "anonymous" },
-                            channelId = currentChannel.channelNumber,
-                            startOffset = sessionStartOffset!!.offset,
-                            endOffset = sessionEndOffset!!.offset,
-                            timestamp = System.currentTimeMillis(),
-                            messageCount = messageCount
-                        )
-
-                        RdKafka.produceMessageBytesToPartition(
-                            producerPtr = producerHandle,
-                            topic = currentChannel.metadataTopic,
-                            partition = currentChannel.metadataPartition,
-                            key = metadata.messageKey().toByteArray(),
-                            value = metadata.toJson().toByteArray()
-                        )
-                    } catch (e: Exception) {
-                        Log.e("ChatScreen", "Failed to publish metadata: ${e.message}", e)
-                    }
-                }
-
-                // Small delay to ensure Kafka has fully propagated all messages
-                delay(500)
-            } catch (e: RuntimeException) {
-                Log.e("Kafka", "Flush failed: ${e.message}")
+            val recording = currentRecording
+            if (recording == 0L) return@LaunchedEffect
+            currentRecording = 0L
+
+            // The session publishes the metadata record and rollup itself once the last
+            // frame is acked; this only waits to report how the recording went
+            val summary = RdKafka.finishRecording(recording, coroutineScope, timeoutMs = 10_000).await()
+            when {
+                summary == null -> Log.w("ChatScreen", "Recording $recording was already forgotten")
+                summary.published -> Log.i(
+                    "ChatScreen",
+                    "Recording complete: ${summary.framesDelivered} frames at " +
+                        "${summary.audioPartition}@${summary.startOffset}..${summary.endOffset}, " +
+                        "${summary.framesDropped} dropped, ${RdKafka.frameDeliveryStats()}"
+                )
+                else -> Log.e("ChatScreen", "Recording not published: $summary")
             }
         }
     }
@@ -610,6 +678,22 @@ fun ChatScreen() {
                         Text("▶", style = MaterialTheme.typography.titleLarge)
                     }
                 }
+                // Channels with someone talking light up, without tuning in to them
+                if (channelActivity.size == availableChannels.size && availableChannels.size > 1) {
+                    Spacer(modifier = Modifier.height(8.dp))
+                    Row(horizontalArrangement = Arrangement.spacedBy(12.dp)) {
+                        availableChannels.forEachIndexed { index, channel ->
+                            Text(
+                                text = if (channelActivity[index].talking) "● ${channel.channelNumber}" else "○ ${channel.channelNumber}",
+                                style = MaterialTheme.typography.labelSmall,
+                                color = if (channelActivity[index].talking)
+                                    NeonGreen
+                                else
+                                    MaterialTheme.colorScheme.onSurfaceVariant.copy(alpha = 0.5f)
+                            )
+                        }
+                    }
+                }
             }
 
             // Bottom section: Controls
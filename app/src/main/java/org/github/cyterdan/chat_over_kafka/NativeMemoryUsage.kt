@@ -0,0 +1,19 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * Snapshot of native queue usage against the memory budget, in bytes.
+ */
+data class NativeMemoryUsage(
+    val budgetBytes: Long,
+    val producerQueuedBytes: Long,
+    val consumerQueuedBytes: Long,
+    val cacheBytes: Long,
+    val handles: Int,
+    /** By how much the sampled total exceeds [budgetBytes]; 0 within budget. */
+    val overBudgetBytes: Long,
+    /** Samples in which producers, consumers or the cache exceeded their share of the budget. */
+    val breaches: Long
+) {
+    val totalBytes: Long get() = producerQueuedBytes + consumerQueuedBytes + cacheBytes
+    val withinBudget: Boolean get() = overBudgetBytes == 0L
+}
@@ -1,9 +1,16 @@
 package org.github.cyterdan.chat_over_kafka
+import kotlinx.coroutines.CoroutineScope
+import kotlinx.coroutines.CoroutineStart
+import kotlinx.coroutines.Deferred
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitCancellation
+import kotlinx.coroutines.coroutineScope
 import kotlinx.coroutines.currentCoroutineContext
 import kotlinx.coroutines.flow.Flow
 import kotlinx.coroutines.flow.flow
 import kotlinx.coroutines.isActive
-import kotlin.coroutines.coroutineContext
+import kotlinx.coroutines.launch
 
 object RdKafka {
     init { System.loadLibrary("native-lib") }
@@ -26,21 +33,166 @@ object RdKafka {
         clientKeyPath: String
     ): Long
 
+    /**
+     * Producer QoS classes. Every produce call picks one; a pooled producer handle stands for
+     * all of them, backed natively by one handle per class in use with the same credentials.
+     */
+    // Live audio that may be reordered: acks=1, no linger, dropped after a short deadline
+    const val QOS_REALTIME = 0
+    // Metadata, reactions, rollups: idempotent, acks=all, retried until delivered
+    const val QOS_DURABLE = 1
+    // Live audio: idempotent and pipelined (5 requests in flight), never reordered or duplicated
+    const val QOS_ORDERED = 2
+
     external fun produceMessageBytes(
         producerPtr: Long,
         topic: String?,
         key: ByteArray?,  // can be null
-        value: ByteArray?
+        value: ByteArray?,
+        qos: Int
     ): RecordMetadata
 
+    /** Frame ciphers understood by [setFrameKey]. */
+    const val FRAME_CIPHER_AES_128_GCM = 0
+    const val FRAME_CIPHER_CHACHA20_POLY1305 = 1
+
+    /**
+     * Seal the audio frames of [topic] with [key] (16 bytes for AES-128-GCM, 32 for
+     * ChaCha20-Poly1305) from now on: recordings seal them and the audio consume paths open
+     * them. Frames that fail authentication are dropped.
+     */
+    external fun setFrameKey(topic: String, cipher: Int, key: ByteArray)
+
+    /**
+     * Seal and open [frames] frames of [frameBytes] bytes natively under [cipher] with a
+     * throwaway key; returns [seal ns, open ns] per frame. For FrameCipherBenchmark.
+     */
+    external fun benchmarkFrameCipher(cipher: Int, frameBytes: Int, frames: Int): LongArray
+
     external fun produceMessageBytesToPartition(
         producerPtr: Long,
         topic: String?,
         partition: Int,
         key: ByteArray?,  // can be null
-        value: ByteArray?
+        value: ByteArray?,
+        qos: Int
     ): RecordMetadata
 
+    /**
+     * Queue a message for [partition] without waiting for its delivery report. Throws only
+     * if the message cannot be queued.
+     */
+    external fun enqueueMessageBytesToPartition(
+        producerPtr: Long,
+        topic: String?,
+        partition: Int,
+        key: ByteArray?,
+        value: ByteArray?,
+        qos: Int
+    )
+
+    /** [RecordingSummary.state] values. */
+    const val RECORDING_ACTIVE = 0
+    const val RECORDING_DRAINING = 1
+    const val RECORDING_PUBLISHING = 2
+    const val RECORDING_PUBLISHED = 3
+    const val RECORDING_FAILED = 4
+
+    /**
+     * Start a recording on the pooled producer [producerPtr] (see recording_session.h). Its
+     * frames are keyed "[userId]/[startedAtMs]" and go out on the producer's [frameQos]
+     * sibling ([QOS_ORDERED], or [QOS_REALTIME] for a faster ack at the price of order);
+     * its metadata record and rollup on the [QOS_DURABLE] one, produced natively once
+     * the last frame is acked. Returns the recording's id.
+     */
+    external fun startRecording(
+        producerPtr: Long,
+        audioTopic: String,
+        metadataTopic: String,
+        metadataPartition: Int,
+        rollupPartition: Int,
+        userId: String,
+        channelId: Int,
+        startedAtMs: Long,
+        frameDurationMs: Long,
+        indexIntervalMs: Long,
+        frameQos: Int = QOS_ORDERED
+    ): Long
+
+    /**
+     * Queue the next frame of [recording] without waiting for its delivery, sealed if the
+     * channel has a frame key. Throws only if the frame cannot be queued.
+     */
+    external fun recordFrame(recording: Long, value: ByteArray)
+
+    private external fun endRecording(recording: Long)
+    private external fun awaitRecording(recording: Long, timeoutMs: Int): LongArray?
+    private external fun forgetRecording(recording: Long)
+
+    /**
+     * End [recording] and return at once. The future completes with the recording's summary
+     * when its metadata record is acked or it fails, or with where it stands after
+     * [timeoutMs]; the native side keeps publishing either way.
+     */
+    fun finishRecording(recording: Long, scope: CoroutineScope, timeoutMs: Int): Deferred<RecordingSummary?> {
+        endRecording(recording)
+        return scope.async(Dispatchers.IO) {
+            try {
+                awaitRecording(recording, timeoutMs)?.let { a ->
+                    RecordingSummary(
+                        a[0].toInt(), a[1], a[2], a[3], a[4], a[5], a[6].toInt(), a[7], a[8], a[9], a[10]
+                    )
+                }
+            } finally {
+                forgetRecording(recording)
+            }
+        }
+    }
+
+    private external fun getFrameDeliveryStats(): LongArray
+
+    /** Delivery counters of every recorded frame since the process started. */
+    fun frameDeliveryStats(): FrameDeliveryStats {
+        val a = getFrameDeliveryStats()
+        return FrameDeliveryStats(a[0], a[1], a[2], a[3], a[4], a[5])
+    }
+
+    /**
+     * Lowest priority (android.util.Log.DEBUG, ...) that reaches logcat, for librdkafka,
+     * the native modules and [log]. Mirrored here so [log] costs one volatile read when off.
+     */
+    @Volatile
+    var logLevel = android.util.Log.INFO
+        private set
+
+    fun setLogLevel(priority: Int) {
+        logLevel = priority
+        setNativeLogLevel(priority)
+    }
+
+    private external fun setNativeLogLevel(priority: Int)
+
+    /**
+     * Limit [facility] (a log tag, or a librdkafka facility such as "FETCH") to [perSecond]
+     * lines (0: unlimited) and keep one debug line in [sampleEvery]. An empty facility sets
+     * the defaults (50 per second, no sampling).
+     */
+    external fun setLogRate(facility: String, perSecond: Int, sampleEvery: Int)
+
+    external fun logMessage(priority: Int, tag: String, message: String)
+
+    /**
+     * Log from a hot path (the consume loop, the audio path) through the native log queue:
+     * [message] is only built at an enabled level, and the line is rate-limited per [tag]
+     * and written to logcat off this thread.
+     */
+    inline fun log(priority: Int, tag: String, message: () -> String) {
+        if (priority >= logLevel) logMessage(priority, tag, message())
+    }
+
+    // Merge the consumer's partitions by broker timestamp (see playout_merger.h)
+    private external fun mergePartitions(consumerPtr: Long, holdBackMs: Int)
+
     external fun produceMessage(
         producerPtr: Long,
         topic: String,
@@ -54,78 +206,613 @@ object RdKafka {
         timeoutMs: Int
     )
 
+    /** Flushes for at most a few seconds, then destroys the producer. */
     external fun destroyProducer(
         producerPtr: Long
     )
+
+    /** Outcomes reported by [awaitClose]. */
+    const val CLOSE_UNKNOWN = -1
+    const val CLOSE_PENDING = 0
+    const val CLOSE_CLEAN = 1
+    const val CLOSE_FORCED = 2
+
+    /**
+     * Hand a handle that is not pooled to the native reaper and return immediately. Consumers
+     * leave their group and producers deliver what they hold until [deadlineMs]; after that
+     * the handle is torn down regardless. Returns a ticket for [awaitClose].
+     */
+    external fun closeAsync(handle: Long, deadlineMs: Int): Long
+
+    /** Wait up to [timeoutMs] for a [closeAsync] ticket; returns one of the CLOSE_ codes. */
+    external fun awaitClose(ticket: Long, timeoutMs: Int): Int
+
+    /**
+     * Connect to the brokers and partition leaders for [topics] ahead of time so the first
+     * produce/fetch runs at steady-state latency. Blocks for at most [timeoutMs].
+     * Returns the number of partitions whose leader is connected.
+     */
+    external fun warmUp(
+        handle: Long,
+        topics: Array<String>,
+        timeoutMs: Int
+    ): Int
+
+    /**
+     * Persist broker addresses, partition leaders and watermarks for [brokers] at [path].
+     * New clients also try the remembered brokers when bootstrapping; [warmUp] refreshes the file.
+     */
+    external fun setMetadataCachePath(path: String, brokers: String)
+
+    /** Current [low, high] watermarks of a partition, asked through any client handle; null on timeout. */
+    external fun queryWatermarks(handlePtr: Long, topic: String, partition: Int, timeoutMs: Int): LongArray?
+
+    /**
+     * Offset of the first record of a partition stamped at or after [timestampMs], asked through
+     * any client handle; [OFFSET_END] if all are older, [OFFSET_BEGINNING] on timeout.
+     */
+    external fun offsetForTime(handlePtr: Long, topic: String, partition: Int, timestampMs: Long, timeoutMs: Int): Long
+
+    private external fun startActivityMonitor(
+        handlePtr: Long,
+        audioTopics: Array<String>,
+        metadataTopics: Array<String>,
+        metadataPartitions: IntArray,
+        intervalMs: Int
+    )
+
+    /** Stop the activity monitor; must happen before the handle it was started with is released. */
+    external fun stopActivityMonitor()
+
+    private external fun getChannelActivity(): LongArray
+
+    /**
+     * Watch [channels] through [handlePtr] without consuming them: every [intervalMs] the
+     * log end offsets of all their audio partitions and metadata partitions are asked for in
+     * one batched ListOffsets round. Replaces a monitor that is already running.
+     */
+    fun startActivityMonitor(handlePtr: Long, channels: List<ChannelConfig>, intervalMs: Int) {
+        startActivityMonitor(
+            handlePtr = handlePtr,
+            audioTopics = channels.map { it.audioTopic }.toTypedArray(),
+            metadataTopics = channels.map { it.metadataTopic }.toTypedArray(),
+            metadataPartitions = channels.map { it.metadataPartition }.toIntArray(),
+            intervalMs = intervalMs
+        )
+    }
+
+    /** Activity of each monitored channel, in the order given to [startActivityMonitor]. */
+    fun channelActivity(): List<ChannelActivity> {
+        val a = getChannelActivity()
+        return (0 until a.size / 4).map { i ->
+            ChannelActivity(a[i * 4] != 0L, a[i * 4 + 1], a[i * 4 + 2], a[i * 4 + 3])
+        }
+    }
+
+    /**
+     * Reset every broker socket after the default network changed. Live handles reconnect
+     * immediately and keep their queues, assignments and in-flight messages.
+     * Returns the number of sockets reset.
+     */
+    external fun onNetworkChanged(): Int
+
+    /** Binary metadata codec; use [AudioMetadata.toBytes] / [AudioMetadata.fromBytes]. */
+    internal external fun encodeMetadata(
+        userId: String,
+        channelId: Int,
+        startOffset: Long,
+        endOffset: Long,
+        timestamp: Long,
+        messageCount: Long,
+        emojis: Array<String>,
+        reactors: Array<Array<String>>,
+        frameIndex: LongArray,
+        frameKey: String,
+        firstFrameTime: Long,
+        lastFrameTime: Long,
+        audioPartition: Int
+    ): ByteArray
+
+    internal external fun decodeMetadata(bytes: ByteArray): AudioMetadata?
+
+    /**
+     * Reaction deltas (see reaction_aggregator.h). [reactLocally] folds a toggle made on this
+     * device and returns the delta to publish; [foldReactionDelta] folds a record read from the
+     * metadata topic and returns the recording's id ([AudioMetadata.recordingId]), or -1 if it
+     * is not a delta. Recordings are identified by that id throughout the native side.
+     */
+    internal external fun reactLocally(
+        channelId: Int,
+        recordingId: Long,
+        emoji: String,
+        userId: String,
+        added: Boolean,
+        timestamp: Long
+    ): ByteArray
+
+    internal external fun foldReactionDelta(bytes: ByteArray): Long
+    private external fun seedReactions(channelId: Int, recordingId: Long, emojis: Array<String>, reactors: Array<Array<String>>)
+    private external fun foldedReactions(channelId: Int, recordingId: Long): Array<Array<String>>
+    private external fun takeReactionsToCompact(channelId: Int): LongArray
+
+    /** Use [metadata]'s reactions as the snapshot underneath any deltas for its recording. */
+    fun seedReactions(metadata: AudioMetadata) {
+        val emojis = metadata.reactions.keys.toTypedArray()
+        val reactors = Array(emojis.size) { i -> metadata.reactions.getValue(emojis[i]).toTypedArray() }
+        seedReactions(metadata.channelId, metadata.recordingId, emojis, reactors)
+    }
+
+    /** The folded reactions of a recording: emoji -> users. */
+    fun reactionsOf(channelId: Int, recordingId: Long): Map<String, List<String>> =
+        foldedReactions(channelId, recordingId).associate { row -> row[0] to row.asList().drop(1) }
+
+    /**
+     * Recordings of [channelId] with local reactions not yet written back. They are no longer
+     * due once returned; hand back the ones that could not be written with [keepReactionsToCompact].
+     */
+    fun reactionsToCompact(channelId: Int): List<Long> = takeReactionsToCompact(channelId).toList()
+
+    /** Make [recordingId] of [channelId] due for compaction again. */
+    external fun keepReactionsToCompact(channelId: Int, recordingId: Long)
+
+    /** Hourly rollups (see rollup_store.h). */
+    external fun setRollupPath(path: String)
+
+    /**
+     * Count a recording published on this device in its hour's bucket and return the encoded
+     * bucket, to be published under [rollupKey].
+     */
+    external fun recordRollup(channelId: Int, userId: String, timestamp: Long, durationMs: Long): ByteArray
+
+    /** Fold a record read from the rollup partition. Returns false if it is not a rollup. */
+    external fun foldRollup(bytes: ByteArray): Boolean
+
+    private external fun getDensity(channelId: Int, lastHour: Long, hours: Int): LongArray
+
+    private const val HOUR_MS = 3_600_000L
+
+    /** Compaction key of one speaker's bucket for the hour containing [timestamp]. */
+    fun rollupKey(channelId: Int, userId: String, timestamp: Long): String =
+        "rollup-$channelId-${timestamp / HOUR_MS}/$userId"
+
+    /** Activity of the [hours] hours up to and including the current one, oldest first. */
+    fun density(channelId: Int, hours: Int, now: Long = System.currentTimeMillis()): List<HourlyDensity> {
+        val lastHour = now / HOUR_MS
+        val values = getDensity(channelId, lastHour, hours)
+        return List(values.size / 3) { i ->
+            HourlyDensity(
+                hourStartMs = (lastHour - hours + 1 + i) * HOUR_MS,
+                recordings = values[i * 3].toInt(),
+                durationMs = values[i * 3 + 1],
+                speakers = values[i * 3 + 2].toInt()
+            )
+        }
+    }
+
+    /**
+     * Native timeline index (see timeline_index.h): recordings ordered by broker start time,
+     * queried by time window and speaker in O(log n) and read page by page through a
+     * [TimelineCursor]. Rows are identified by [AudioMetadata.recordingId].
+     */
+    external fun clearTimelineIndex(channelId: Int)
+
+    private external fun indexTimelineEntry(
+        channelId: Int,
+        recordingId: Long,
+        startedAt: Long,
+        durationMs: Long,
+        userId: String,
+        reactionCount: Int
+    )
+
+    internal external fun timelinePage(
+        channelId: Int,
+        fromMs: Long,
+        toMs: Long,
+        speaker: String?,
+        cursor: LongArray,
+        limit: Int
+    ): LongArray
+
+    private external fun timelineSummary(channelId: Int, fromMs: Long, toMs: Long, speaker: String?): LongArray
+
+    /** Drop the recording whose metadata record was deleted (a tombstone) from the index. */
+    external fun removeFromTimeline(channelId: Int, recordingId: Long)
+
+    private external fun takeTimelineChanges(
+        channelId: Int,
+        fromMs: Long,
+        toMs: Long,
+        speaker: String?,
+        floorStartedAt: Long,
+        floorStartOffset: Long,
+        snapshot: Boolean
+    ): LongArray
+
+    /**
+     * Start offsets of the rows that entered ([TimelineChangeIds.inserted]), changed in or left
+     * the window since the previous call; all rows as inserted when [snapshot] is set. The
+     * window reaches down to the last recording [cursor] paged in, or to [fromMs] once it is
+     * exhausted.
+     */
+    internal fun timelineChanges(
+        channelId: Int,
+        fromMs: Long,
+        speaker: String?,
+        cursor: TimelineCursor,
+        snapshot: Boolean
+    ): TimelineChangeIds {
+        val values = if (cursor.exhausted) {
+            takeTimelineChanges(channelId, fromMs, Long.MAX_VALUE, speaker, Long.MIN_VALUE, Long.MIN_VALUE, snapshot)
+        } else {
+            takeTimelineChanges(channelId, fromMs, Long.MAX_VALUE, speaker, cursor.startedAt, cursor.startOffset, snapshot)
+        }
+        val inserted = values[0].toInt()
+        val updated = values[1].toInt()
+        val deleted = values[2].toInt()
+        return TimelineChangeIds(
+            inserted = values.copyOfRange(3, 3 + inserted),
+            updated = values.copyOfRange(3 + inserted, 3 + inserted + updated),
+            deleted = values.copyOfRange(3 + inserted + updated, 3 + inserted + updated + deleted)
+        )
+    }
+
+    internal class TimelineChangeIds(val inserted: LongArray, val updated: LongArray, val deleted: LongArray)
+
+    /** Add [metadata]'s recording to the index, or update its row if it is already there. */
+    fun indexTimeline(metadata: AudioMetadata) {
+        indexTimelineEntry(
+            metadata.channelId,
+            metadata.recordingId,
+            metadata.startedAt,
+            metadata.durationMs,
+            metadata.userId,
+            metadata.reactions.values.sumOf { it.size }
+        )
+    }
+
+    /** Totals of the recordings started in [fromMs]..[toMs], by [speaker] unless null. */
+    fun timelineSummary(channelId: Int, fromMs: Long, toMs: Long = Long.MAX_VALUE, speaker: String? = null): TimelineSummary {
+        val values = timelineSummary(channelId, fromMs, toMs, speaker)
+        return TimelineSummary(recordings = values[0].toInt(), durationMs = values[1], reactions = values[2].toInt())
+    }
+
+    /**
+     * Timeline snapshots (see timeline_snapshot.h): the binary metadata [records] of
+     * [topic]/[partition], the [nextOffset] to resume from and the reaction votes folded for
+     * [channelId], written atomically to [path].
+     */
+    external fun saveTimelineSnapshot(
+        path: String,
+        topic: String,
+        partition: Int,
+        channelId: Int,
+        nextOffset: Long,
+        records: Array<ByteArray>
+    ): Boolean
+
+    private external fun loadTimelineSnapshot(
+        path: String,
+        topic: String,
+        partition: Int,
+        channelId: Int,
+        checkpoint: LongArray
+    ): Array<AudioMetadata>?
+
+    /**
+     * The snapshot of [topic]/[partition] at [path], or null if there is none or it is damaged.
+     * Its reaction votes are folded back into [channelId]'s reactions on the way.
+     */
+    fun loadTimelineSnapshot(path: String, topic: String, partition: Int, channelId: Int): TimelineSnapshot? {
+        val checkpoint = LongArray(1)
+        val records = loadTimelineSnapshot(path, topic, partition, channelId, checkpoint) ?: return null
+        return TimelineSnapshot(records.asList(), nextOffset = checkpoint[0])
+    }
+
+    private external fun seekWithinRecording(frameIndex: LongArray, startOffset: Long, mediaTimeMs: Long): LongArray
+
+    /**
+     * Jump to [mediaTimeMs] into [entry]'s recording using its frame index, so playback
+     * fetches nothing before the nearest seek point. Recordings without an index start
+     * from the beginning.
+     */
+    fun seekWithinRecording(entry: TimelineEntry, mediaTimeMs: Long): SeekPosition {
+        val metadata = entry.metadata
+        val point = seekWithinRecording(metadata.frameIndex, metadata.startOffset, mediaTimeMs)
+        return SeekPosition(point[0], point[1])
+    }
+
+    /** librdkafka's logical offset for the start of a partition (RD_KAFKA_OFFSET_BEGINNING). */
+    const val OFFSET_BEGINNING = -2L
+
+    /** librdkafka's logical offset for the end of a partition (RD_KAFKA_OFFSET_END). */
+    const val OFFSET_END = -1L
+
+    /** Client roles understood by [acquireClient]. */
+    const val ROLE_PRODUCER = 0
+    const val ROLE_CONSUMER = 1
+
+    /**
+     * Get a handle from the process-wide client pool.
+     *
+     * Producers with the same brokers/credentials/profile are shared between callers;
+     * consumers are leased exclusively and reused once released. [profile] is the
+     * auto.offset.reset strategy for consumers. Every acquire must be paired with
+     * [releaseClient]; idle handles are closed after the pool's grace period.
+     */
+    external fun acquireClient(
+        brokers: String,
+        caCertPath: String,
+        clientCertPath: String,
+        clientKeyPath: String,
+        role: Int,
+        profile: String
+    ): Long
+
+    external fun releaseClient(handle: Long)
+
+    external fun setClientIdleGraceMs(graceMs: Int)
+
+    /**
+     * Bound every native queue by one byte budget. Producer queues, consumer prefetch and
+     * the audio cache limits are derived from it for handles created afterwards, each
+     * sized for one of a fixed number of slots per role; creating a handle when every
+     * slot of its role is held throws. 0 restores librdkafka's defaults.
+     */
+    external fun setMemoryBudget(budgetBytes: Long)
+
+    /** [producerQueueKbytes, consumerQueueKbytes, fetchMaxBytes, cacheBytes]; zeros when no budget is set. */
+    external fun getMemoryLimits(): LongArray
+
+    /** Audio cache size derived from the memory budget, or 0 when unbounded. */
+    fun cacheBudgetBytes(): Long = getMemoryLimits()[3]
+
+    /** Report how many bytes the app-side audio cache currently holds. */
+    external fun reportCacheUsage(bytes: Long)
+
+    private external fun getMemoryUsage(): LongArray
+
+    fun memoryUsage(): NativeMemoryUsage {
+        val u = getMemoryUsage()
+        return NativeMemoryUsage(u[0], u[1], u[2], u[3], u[4].toInt(), u[5], u[6])
+    }
+
+    private external fun getReactorStats(): LongArray
+
+    fun reactorStats(): ReactorStats {
+        val s = getReactorStats()
+        return ReactorStats(s[0], s[1], s[2], s[3], s[4], s[5], s[6].toInt())
+    }
+
+    /** Make a blocked poll on [consumerPtr] return immediately. */
+    private external fun wakeConsumer(consumerPtr: Long)
+
+    /**
+     * Polls wake as soon as a record arrives, so the timeout only bounds how long an idle
+     * consumer sleeps; cancellation interrupts it through [wakingOnCancel].
+     */
+    private const val IDLE_POLL_TIMEOUT_MS = 30_000
+
+    /**
+     * Run [block] while a watcher interrupts any blocked poll on [consumerPtr] as soon as the
+     * caller is cancelled. Returns only after the watcher is done, so the consumer can be
+     * released safely afterwards.
+     */
+    private suspend fun <T> wakingOnCancel(consumerPtr: Long, block: suspend () -> T): T = coroutineScope {
+        val waker = launch(start = CoroutineStart.UNDISPATCHED) {
+            try {
+                awaitCancellation()
+            } finally {
+                wakeConsumer(consumerPtr)
+            }
+        }
+        try {
+            block()
+        } finally {
+            waker.cancel()
+        }
+    }
+
     private external fun subscribe(consumerPtr: Long, topic: String, offsetStrategy: String)
     private external fun subscribeWithOffset(consumerPtr: Long, topic: String, partition: Int, offset: Long)
     private external fun pollMessage(consumerPtr: Long, timeoutMs: Int): KafkaMessage?
     private external fun closeConsumer(consumerPtr: Long)
+    private external fun pollMessageInto(consumerPtr: Long, holder: KafkaMessageHolder, timeoutMs: Int): Int
+    internal external fun discardPendingMessage(messagePtr: Long)
+    private external fun readKeyedRange(
+        consumerPtr: Long,
+        key: ByteArray?,
+        endOffset: Long,
+        maxFrames: Int,
+        timeoutMs: Int,
+        progress: LongArray
+    ): Array<ByteArray>
+
+    /** Upper bound on frames handed over per [readKeyedRange] call. */
+    private const val RANGE_BATCH_FRAMES = 64
+
+    // A range read is finite, so its polls stay short rather than relying on a wakeup alone
+    private const val RANGE_POLL_TIMEOUT_MS = 500
+    private const val RANGE_WATERMARK_TIMEOUT_MS = 5_000
+    private const val RANGE_STALL_TIMEOUT_MS = 10_000L
+
+    private const val POLL_INTO_MESSAGE = 1
+    private const val POLL_INTO_GROW = 2
+
+    /**
+     * Poll one record into [holder] without allocating. Returns false on timeout.
+     */
+    fun pollInto(consumerPtr: Long, holder: KafkaMessageHolder, timeoutMs: Int): Boolean {
+        var result = pollMessageInto(consumerPtr, holder, timeoutMs)
+        while (result == POLL_INTO_GROW) {
+            holder.ensureCapacity()
+            result = pollMessageInto(consumerPtr, holder, timeoutMs)
+        }
+        return result == POLL_INTO_MESSAGE
+    }
+
     /**
-     * Create a consumer with mTLS and return a Flow that emits messages from the earliest offset
+     * Lease a pooled mTLS consumer and return a Flow that emits messages from [offsetStrategy]
      */
     fun consumeFromMTLS(
         brokers: String,
-        groupId: String,
         topic: String,
         caCertPath: String,
         clientCertPath: String,
         clientKeyPath: String,
         offsetStrategy: String,
-        pollTimeoutMs: Int = 1000
+        pollTimeoutMs: Int = IDLE_POLL_TIMEOUT_MS
     ): Flow<KafkaMessage> = flow {
-        android.util.Log.i("Kafka", "Creating consumer: topic=$topic, groupId=$groupId, offsetStrategy=$offsetStrategy")
-        val consumerPtr = createConsumerMTLS(brokers, groupId, caCertPath, clientCertPath, clientKeyPath, offsetStrategy)
+        android.util.Log.i("Kafka", "Acquiring consumer: topic=$topic, offsetStrategy=$offsetStrategy")
+        val consumerPtr = acquireClient(brokers, caCertPath, clientCertPath, clientKeyPath, ROLE_CONSUMER, offsetStrategy)
         try {
             subscribe(consumerPtr, topic, offsetStrategy)
             android.util.Log.i("Kafka", "Subscribed to topic=$topic with offsetStrategy=$offsetStrategy")
 
             var pollCount = 0
             var messageCount = 0
-            while (coroutineContext.isActive) {
-                val message = pollMessage(consumerPtr, pollTimeoutMs)
-                pollCount++
-                if (message != null) {
-                    messageCount++
-                    android.util.Log.d("Kafka", "Polled message #$messageCount: topic=${message.topic}, partition=${message.partition}, offset=${message.offset}")
-                    emit(message)
-                } else if (pollCount % 10 == 0) {
-                    android.util.Log.d("Kafka", "Polled $pollCount times, received $messageCount messages (no message in last poll)")
+            wakingOnCancel(consumerPtr) {
+                while (currentCoroutineContext().isActive) {
+                    val message = pollMessage(consumerPtr, pollTimeoutMs)
+                    pollCount++
+                    if (message != null) {
+                        messageCount++
+                        log(android.util.Log.DEBUG, "Kafka") {
+                            "Polled message #$messageCount: topic=${message.topic}, partition=${message.partition}, offset=${message.offset}"
+                        }
+                        emit(message)
+                    } else if (pollCount % 10 == 0) {
+                        log(android.util.Log.DEBUG, "Kafka") {
+                            "Polled $pollCount times, received $messageCount messages (no message in last poll)"
+                        }
+                    }
+                }
+            }
+            android.util.Log.i("Kafka", "Consumer stopped: polled $pollCount times, received $messageCount messages, ${reactorStats()}")
+        } finally {
+            releaseClient(consumerPtr)
+        }
+    }
+
+    /**
+     * Like [consumeFromMTLS], but emits holders leased from [holderPool] and filled in place.
+     * The collector owns each emitted holder and must [MessageHolderPool.recycle] it once
+     * the bytes have been consumed.
+     */
+    fun consumeRecycledFromMTLS(
+        brokers: String,
+        topic: String,
+        caCertPath: String,
+        clientCertPath: String,
+        clientKeyPath: String,
+        offsetStrategy: String,
+        holderPool: MessageHolderPool,
+        pollTimeoutMs: Int = IDLE_POLL_TIMEOUT_MS,
+        mergeHoldBackMs: Int = 0  // > 0: emit all partitions as one stream ordered by broker time
+    ): Flow<KafkaMessageHolder> = flow {
+        val consumerPtr = acquireClient(brokers, caCertPath, clientCertPath, clientKeyPath, ROLE_CONSUMER, offsetStrategy)
+        try {
+            subscribe(consumerPtr, topic, offsetStrategy)
+            if (mergeHoldBackMs > 0) mergePartitions(consumerPtr, mergeHoldBackMs)
+            var holder = holderPool.lease()
+            try {
+                wakingOnCancel(consumerPtr) {
+                    while (currentCoroutineContext().isActive) {
+                        if (pollInto(consumerPtr, holder, pollTimeoutMs)) {
+                            val filled = holder
+                            holder = holderPool.lease()
+                            emit(filled)
+                        }
+                    }
                 }
+            } finally {
+                holderPool.recycle(holder)
             }
-            android.util.Log.i("Kafka", "Consumer stopped: polled $pollCount times, received $messageCount messages")
         } finally {
-            closeConsumer(consumerPtr)
+            releaseClient(consumerPtr)
         }
     }
 
     /**
-     * Create a consumer with mTLS that starts from a specific partition and offset
+     * Lease a pooled mTLS consumer that starts from a specific partition and offset
      */
     fun consumeFromMTLSWithOffset(
         brokers: String,
-        groupId: String,
         topic: String,
         caCertPath: String,
         clientCertPath: String,
         clientKeyPath: String,
         partition: Int,
         offset: Long,
-        pollTimeoutMs: Int = 1000
+        pollTimeoutMs: Int = IDLE_POLL_TIMEOUT_MS
     ): Flow<KafkaMessage> = flow {
         // For assign mode, offsetStrategy doesn't matter since we're seeking to a specific offset
-        val consumerPtr = createConsumerMTLS(brokers, groupId, caCertPath, clientCertPath, clientKeyPath, "earliest")
+        val consumerPtr = acquireClient(brokers, caCertPath, clientCertPath, clientKeyPath, ROLE_CONSUMER, "earliest")
         try {
             subscribeWithOffset(consumerPtr, topic, partition, offset)
 
-            while (coroutineContext.isActive) {
-                val message = pollMessage(consumerPtr, pollTimeoutMs)
-                if (message != null) {
-                    emit(message)
+            wakingOnCancel(consumerPtr) {
+                while (currentCoroutineContext().isActive) {
+                    val message = pollMessage(consumerPtr, pollTimeoutMs)
+                    if (message != null) {
+                        emit(message)
+                    }
+                }
+            }
+        } finally {
+            releaseClient(consumerPtr)
+        }
+    }
+
+    /**
+     * Lease a pooled mTLS consumer for [startOffset]..[endOffset] of [partition] and emit the
+     * payloads of the records keyed [key] (every record when null). Records of other speakers
+     * interleaved in the range are dropped natively. Completes once [endOffset], or the last
+     * record the partition still holds, was read, or when the range stops advancing for
+     * [RANGE_STALL_TIMEOUT_MS] (records lost to retention or truncation).
+     */
+    fun consumeKeyedRangeFromMTLS(
+        brokers: String,
+        topic: String,
+        caCertPath: String,
+        clientCertPath: String,
+        clientKeyPath: String,
+        partition: Int,
+        startOffset: Long,
+        endOffset: Long,
+        key: ByteArray?,
+        pollTimeoutMs: Int = RANGE_POLL_TIMEOUT_MS
+    ): Flow<ByteArray> = flow {
+        val consumerPtr = acquireClient(brokers, caCertPath, clientCertPath, clientKeyPath, ROLE_CONSUMER, "earliest")
+        try {
+            subscribeWithOffset(consumerPtr, topic, partition, startOffset)
+
+            // Offsets past the high watermark were never written, or were truncated away
+            val highWatermark = queryWatermarks(consumerPtr, topic, partition, RANGE_WATERMARK_TIMEOUT_MS)?.get(1)
+            val lastOffset = if (highWatermark != null) minOf(endOffset, highWatermark - 1) else endOffset
+
+            // [last offset read, records skipped]
+            val progress = longArrayOf(startOffset - 1, 0)
+            var advancedAt = android.os.SystemClock.elapsedRealtime()
+            wakingOnCancel(consumerPtr) {
+                while (currentCoroutineContext().isActive && progress[0] < lastOffset) {
+                    val before = progress[0]
+                    val frames = readKeyedRange(consumerPtr, key, lastOffset, RANGE_BATCH_FRAMES, pollTimeoutMs, progress)
+                    for (frame in frames) {
+                        emit(frame)
+                    }
+                    val now = android.os.SystemClock.elapsedRealtime()
+                    if (progress[0] != before) {
+                        advancedAt = now
+                    } else if (now - advancedAt >= RANGE_STALL_TIMEOUT_MS) {
+                        android.util.Log.w("Kafka", "Range $startOffset..$lastOffset stalled at ${progress[0]}, giving up")
+                        break
+                    }
                 }
             }
+            android.util.Log.i("Kafka", "Range $startOffset..$endOffset read up to ${progress[0]}, skipped ${progress[1]} records of other speakers")
         } finally {
-            closeConsumer(consumerPtr)
+            releaseClient(consumerPtr)
         }
     }
 
@@ -0,0 +1,16 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * Counters from the native event reactor. Idle wakeups should stay flat while nothing is
+ * produced or consumed; delivery wake latency is the time from a delivery report to the
+ * blocked producer resuming.
+ */
+data class ReactorStats(
+    val wakeups: Long,
+    val eventsServed: Long,
+    val emptyWakeups: Long,
+    val deliveryWakes: Long,
+    val avgDeliveryWakeUs: Long,
+    val maxDeliveryWakeUs: Long,
+    val handles: Int
+)
@@ -2,5 +2,7 @@ package org.github.cyterdan.chat_over_kafka
 
 data class RecordMetadata(
     val partition: Int,
-    val offset: Long
+    val offset: Long,
+    // Broker append time on LogAppendTime topics, else the producer's CreateTime; -1 if unknown
+    val timestamp: Long = -1
 )
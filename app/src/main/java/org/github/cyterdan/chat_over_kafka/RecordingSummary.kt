@@ -0,0 +1,22 @@
+package org.github.cyterdan.chat_over_kafka
+
+/** What became of a recording's frames and metadata record (see [RdKafka.finishRecording]). */
+data class RecordingSummary(
+    // One of RdKafka.RECORDING_*
+    val state: Int,
+    val framesEnqueued: Long,
+    val framesDelivered: Long,
+    // Not queued, or not delivered before the deadline
+    val framesDropped: Long,
+    // As produced: sealed frames include their sequence and tag
+    val bytesEnqueued: Long,
+    val bytesDelivered: Long,
+    val audioPartition: Int,
+    // First and last delivered frame, -1 if none was
+    val startOffset: Long,
+    val endOffset: Long,
+    val firstFrameTime: Long,
+    val lastFrameTime: Long
+) {
+    val published: Boolean get() = state == RdKafka.RECORDING_PUBLISHED
+}
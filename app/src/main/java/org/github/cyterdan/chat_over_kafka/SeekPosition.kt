@@ -0,0 +1,10 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * Where to start fetching a recording: [offset] is the first record to read and
+ * [mediaMs] the media time within the recording at which it starts.
+ */
+data class SeekPosition(
+    val offset: Long,
+    val mediaMs: Long
+)
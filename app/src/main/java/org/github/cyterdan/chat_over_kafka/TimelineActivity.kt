@@ -22,22 +22,28 @@ import androidx.compose.runtime.DisposableEffect
 import androidx.compose.runtime.LaunchedEffect
 import androidx.compose.runtime.collectAsState
 import androidx.compose.runtime.getValue
+import androidx.compose.runtime.mutableStateListOf
 import androidx.compose.runtime.mutableStateOf
 import androidx.compose.runtime.remember
 import androidx.compose.runtime.rememberCoroutineScope
 import androidx.compose.runtime.setValue
+import androidx.compose.runtime.snapshots.Snapshot
 import androidx.compose.ui.Modifier
 import androidx.compose.ui.platform.LocalContext
 import androidx.compose.ui.unit.dp
+import kotlinx.coroutines.CancellationException
 import kotlinx.coroutines.Dispatchers
-import kotlinx.coroutines.cancel
 import kotlinx.coroutines.delay
-import kotlinx.coroutines.isActive
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.conflate
 import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
 import org.github.cyterdan.chat_over_kafka.audio.AudioService
 import org.github.cyterdan.chat_over_kafka.ui.PlaybackState
 import org.github.cyterdan.chat_over_kafka.ui.TimelineView
 import org.github.cyterdan.chat_over_kafka.ui.theme.ChatoverkafkaTheme
+import java.io.File
+import kotlin.concurrent.thread
 
 class TimelineActivity : ComponentActivity() {
     @OptIn(ExperimentalMaterial3Api::class)
@@ -78,6 +84,17 @@ class TimelineActivity : ComponentActivity() {
     }
 }
 
+// How often folded reactions are written back under their record key
+private const val REACTION_COMPACTION_INTERVAL_MS = 30_000L
+
+// Bound on delivering the last compacted reactions when the screen closes
+private const val COMPACTION_FLUSH_TIMEOUT_MS = 3_000
+
+// Bound on asking the leader where the metadata partition currently ends
+private const val WATERMARK_TIMEOUT_MS = 5_000
+
+private const val HOUR_MS = 3_600_000L
+
 @androidx.compose.runtime.Composable
 fun TimelineScreen(
     currentChannel: ChannelConfig,
@@ -91,11 +108,16 @@ fun TimelineScreen(
     val currentUserId = BuildConfig.CHOK_USER_ID
 
     // Timeline state
-    var timeline by remember { mutableStateOf<List<TimelineEntry>>(emptyList()) }
+    // Newest first; updated in place from the timeline change stream
+    val timeline = remember { mutableStateListOf<TimelineEntry>() }
+    var timelineSummary by remember { mutableStateOf(TimelineSummary()) }
     var selectedTimeRange by remember { mutableStateOf(TimeRange.ONE_HOUR) }
+    var selectedSpeaker by remember { mutableStateOf<String?>(null) }
+    val timelineQuery = remember { MutableStateFlow(TimelineQuery()) }
     var timelineJob by remember { mutableStateOf<kotlinx.coroutines.Job?>(null) }
     var isTimelineLoading by remember { mutableStateOf(true) }  // Start as true to show initial loading
     var consumerJob by remember { mutableStateOf<kotlinx.coroutines.Job?>(null) }
+    var density by remember { mutableStateOf<List<HourlyDensity>>(emptyList()) }
 
     // Playback state
     var playbackState by remember { mutableStateOf(PlaybackState()) }
@@ -114,42 +136,109 @@ fun TimelineScreen(
         )
     }
 
+    /**
+     * Write the folded reactions of recordings reacted to on this device back under their
+     * record key, so readers replaying the compacted topic start from a recent snapshot.
+     */
+    fun compactReactions() {
+        val channelId = currentChannel.channelNumber
+        for (recordingId in RdKafka.reactionsToCompact(channelId)) {
+            val entry = timeline.find { it.metadata.recordingId == recordingId }
+            if (entry == null) {
+                // Not loaded right now; stays due for a later pass
+                RdKafka.keepReactionsToCompact(channelId, recordingId)
+                continue
+            }
+            val snapshot = entry.metadata.withFoldedReactions()
+            try {
+                RdKafka.enqueueMessageBytesToPartition(
+                    producerPtr = producerHandle,
+                    topic = currentChannel.metadataTopic,
+                    partition = currentChannel.metadataPartition,
+                    key = snapshot.messageKey().toByteArray(),
+                    value = snapshot.toBytes(),
+                    qos = RdKafka.QOS_DURABLE
+                )
+            } catch (e: Exception) {
+                Log.e("Timeline", "Failed to compact reactions of $recordingId: ${e.message}", e)
+                RdKafka.keepReactionsToCompact(channelId, recordingId)
+            }
+        }
+    }
+
+    LaunchedEffect(producerHandle) {
+        while (true) {
+            delay(REACTION_COMPACTION_INTERVAL_MS)
+            compactReactions()
+        }
+    }
+
+    DisposableEffect(producerHandle) {
+        onDispose {
+            compactReactions()
+            // The last snapshots are only queued; deliver them before the handle goes back to
+            // the pool, off the main thread and for a bounded time
+            thread(name = "ReactionCompaction") {
+                try {
+                    RdKafka.flushProducer(producerHandle, COMPACTION_FLUSH_TIMEOUT_MS)
+                } catch (e: Exception) {
+                    Log.w("Timeline", "Compacted reactions not delivered before release: ${e.message}")
+                } finally {
+                    KafkaMTLSHelper.releaseProducer(producerHandle)
+                }
+            }
+        }
+    }
+
+    // Range and speaker only change the query: the index answers it without re-reading the topic
+    LaunchedEffect(selectedTimeRange, selectedSpeaker) {
+        timelineQuery.value = TimelineQuery(hours = selectedTimeRange.hours, speaker = selectedSpeaker)
+    }
+
     // Load timeline for this channel
-    LaunchedEffect(currentChannel, selectedTimeRange) {
+    LaunchedEffect(currentChannel) {
         timelineJob?.cancel()
-        timeline = emptyList()
+        timeline.clear()
         isTimelineLoading = true
 
         timelineJob = coroutineScope.launch(Dispatchers.IO) {
             try {
                 Log.i("Timeline", "Loading timeline for channel ${currentChannel.channelNumber}...")
 
-                val metadataFlow = KafkaMTLSHelper.consumeFromMTLSFromAssets(
-                    context = context,
-                    brokers = currentChannel.brokerUrl,
-                    caAssetName = currentChannel.caAssetName,
-                    clientKeyAssetName = currentChannel.clientKeyAssetName,
-                    clientCertAssetName = currentChannel.clientCertAssetName,
-                    topic = currentChannel.metadataTopic,
-                    groupId = "timeline-${System.currentTimeMillis()}",
-                    offsetStrategy = "earliest"
-                )
+                // Cold starts show the timeline once everything up to here was read; a saved
+                // checkpoint past it is stale
+                val highWatermark = RdKafka.queryWatermarks(
+                    producerHandle, currentChannel.metadataTopic, currentChannel.metadataPartition, WATERMARK_TIMEOUT_MS
+                )?.get(1) ?: -1L
 
-                var isFirstEmission = true
                 TimelineManager.consumeTimeline(
-                    metadataFlow = metadataFlow,
-                    timeRangeHours = selectedTimeRange.hours,
-                    metadataPartition = currentChannel.metadataPartition
-                ).collect { updatedTimeline ->
-                    timeline = updatedTimeline
-
-                    // Skip the first emission (always empty), then stop loading if we have data or no data
-                    if (!isFirstEmission) {
+                    metadataFlow = { startOffset ->
+                        KafkaMTLSHelper.consumeFromMTLSFromAssetsWithOffset(
+                            context = context,
+                            brokers = currentChannel.brokerUrl,
+                            topic = currentChannel.metadataTopic,
+                            caAssetName = currentChannel.caAssetName,
+                            clientCertAssetName = currentChannel.clientCertAssetName,
+                            clientKeyAssetName = currentChannel.clientKeyAssetName,
+                            partition = currentChannel.metadataPartition,
+                            offset = startOffset
+                        )
+                    },
+                    channelId = currentChannel.channelNumber,
+                    query = timelineQuery,
+                    metadataTopic = currentChannel.metadataTopic,
+                    metadataPartition = currentChannel.metadataPartition,
+                    highWatermark = highWatermark,
+                    snapshotFile = File(context.filesDir, "timeline-${currentChannel.channelNumber}.snapshot")
+                ).collect { changes ->
+                    // One atomic update per batch, so a frame never shows half of it
+                    Snapshot.withMutableSnapshot {
+                        changes.applyTo(timeline)
+                        timelineSummary = changes.summary
                         isTimelineLoading = false
                     }
-                    isFirstEmission = false
 
-                    Log.d("Timeline", "Timeline updated: ${updatedTimeline.size} entries")
+                    Log.d("Timeline", "Timeline updated: +${changes.inserted.size} ~${changes.updated.size} -${changes.deleted.size}, ${timeline.size} of ${changes.summary.recordings} shown")
                 }
             } catch (e: Exception) {
                 isTimelineLoading = false
@@ -158,6 +247,42 @@ fun TimelineScreen(
         }
     }
 
+    // Hourly density from the rollup partition; cancelled with the composition
+    LaunchedEffect(currentChannel, selectedTimeRange) {
+        withContext(Dispatchers.IO) {
+            try {
+                // A bucket's rollup is produced once its recording ended, so nothing the range
+                // shows is stamped before the range's first hour: skip everything older
+                val firstHourMs = (System.currentTimeMillis() / HOUR_MS - selectedTimeRange.hours + 1) * HOUR_MS
+                val startOffset = RdKafka.offsetForTime(
+                    producerHandle, currentChannel.metadataTopic, currentChannel.rollupPartition,
+                    firstHourMs, WATERMARK_TIMEOUT_MS
+                )
+                val rollupFlow = KafkaMTLSHelper.consumeFromMTLSFromAssetsWithOffset(
+                    context = context,
+                    brokers = currentChannel.brokerUrl,
+                    topic = currentChannel.metadataTopic,
+                    caAssetName = currentChannel.caAssetName,
+                    clientCertAssetName = currentChannel.clientCertAssetName,
+                    clientKeyAssetName = currentChannel.clientKeyAssetName,
+                    partition = currentChannel.rollupPartition,
+                    offset = startOffset
+                )
+                TimelineManager.consumeDensity(
+                    rollupFlow = rollupFlow,
+                    channelId = currentChannel.channelNumber,
+                    timeRangeHours = selectedTimeRange.hours
+                ).conflate().collect { updated ->
+                    density = updated
+                }
+            } catch (e: CancellationException) {
+                throw e
+            } catch (e: Exception) {
+                Log.e("Timeline", "Failed to load density: ${e.message}", e)
+            }
+        }
+    }
+
     // Cleanup when leaving
     DisposableEffect(Unit) {
         onDispose {
@@ -167,6 +292,75 @@ fun TimelineScreen(
         }
     }
 
+    /**
+     * Streams [entry]'s frames from [fromOffset] to its end offset; [startAtMs] is where
+     * [fromOffset] sits within the recording. Frames of other speakers that were
+     * transmitting at the same time are filtered out by their key.
+     */
+    fun playRange(entry: TimelineEntry, fromOffset: Long, startAtMs: Long = 0L) {
+        val endOffset = entry.metadata.endOffset
+
+        // Cancel any existing playback
+        consumerJob?.cancel()
+        audioService.stopPlayback()
+
+        // Set initial playback state
+        playbackState = PlaybackState(
+            playingEntryId = entry.metadata.recordingId,
+            progress = 0f
+        )
+
+        // Set expected duration for progress calculation
+        audioService.setExpectedDuration(entry.durationMs, startAtMs)
+
+        // Start playback from specific offset range
+        consumerJob = coroutineScope.launch(Dispatchers.IO) {
+            try {
+                // Speakers are spread over the audio partitions; the record names this one's
+                val partition = entry.metadata.audioPartition
+                Log.i("Timeline", "Creating Kafka consumer from offset $fromOffset on partition $partition...")
+                val audioFlow = KafkaMTLSHelper.consumeKeyedRangeFromAssets(
+                    context = context,
+                    brokers = currentChannel.brokerUrl,
+                    topic = currentChannel.audioTopic,
+                    caAssetName = currentChannel.caAssetName,
+                    clientCertAssetName = currentChannel.clientCertAssetName,
+                    clientKeyAssetName = currentChannel.clientKeyAssetName,
+                    partition = partition,
+                    startOffset = fromOffset,
+                    endOffset = endOffset,
+                    // Recordings from before per-session keys play their whole range
+                    key = entry.metadata.frameKey.takeIf { it.isNotEmpty() }?.toByteArray()
+                )
+
+                Log.i("Timeline", "Starting audio playback...")
+                audioService.startPlayback()
+
+                // Wait for decoder to initialize
+                delay(100)
+
+                var frameCount = 0
+                audioFlow.collect { bytes ->
+                    frameCount++
+                    RdKafka.log(Log.DEBUG, "Timeline") { "Playing audio chunk #$frameCount: ${bytes.size} bytes" }
+                    audioService.onReceivedEncodedChunk(bytes)
+                }
+
+                // The flow completes after reading the end offset
+                Log.i("Timeline", "✓ Reached end offset $endOffset, stopping playback after $frameCount frames")
+                // Wait for all queued audio to be decoded and played
+                audioService.stopPlaybackGracefully()
+                playbackState = PlaybackState()  // Reset on completion
+            } catch (e: Exception) {
+                Log.e("Timeline", "Playback from offset failed: ${e.message}", e)
+                e.printStackTrace()
+                playbackState = PlaybackState()  // Reset on error
+            } finally {
+                audioService.stopPlayback()
+            }
+        }
+    }
+
     Box(
         modifier = modifier
             .fillMaxSize()
@@ -180,132 +374,68 @@ fun TimelineScreen(
             TimelineView(
                 timeline = timeline,
                 selectedRange = selectedTimeRange,
+                density = density,
+                summary = timelineSummary,
+                speakerFilter = selectedSpeaker,
+                hasOlder = timelineSummary.recordings > timeline.size,
                 isLoading = isTimelineLoading,
                 currentUserId = currentUserId,
                 playbackState = playbackState.copy(progress = audioProgress, waveformData = waveformData),
                 onRangeChange = { newRange ->
                     selectedTimeRange = newRange
                 },
-                onReact = { startOffset, emoji ->
-                    Log.i("Timeline", "React: $emoji on message $startOffset")
+                onSpeakerFilter = { speaker ->
+                    selectedSpeaker = speaker
+                },
+                onLoadOlder = {
+                    timelineQuery.value = timelineQuery.value.let {
+                        it.copy(limit = it.limit + TimelineManager.PAGE_SIZE)
+                    }
+                },
+                onReact = { recordingId, emoji ->
+                    Log.i("Timeline", "React: $emoji on message $recordingId")
 
-                    // Find the entry and toggle reaction
-                    val entry = timeline.find { it.metadata.startOffset == startOffset }
+                    val entry = timeline.find { it.metadata.recordingId == recordingId }
                     if (entry != null) {
-                        val updatedMetadata = entry.metadata.toggleReaction(emoji, currentUserId)
-                        val metadataJson = updatedMetadata.toJson()
-
-                        Log.i("Timeline", "Publishing reaction update: $metadataJson")
+                        // Publish a tiny delta instead of rewriting the whole record: concurrent
+                        // reactors no longer overwrite each other
+                        val (updatedMetadata, delta) = entry.metadata.react(emoji, currentUserId)
 
                         // Update local state immediately for responsive UI
-                        timeline = timeline.map { e ->
-                            if (e.metadata.startOffset == startOffset) {
-                                e.copy(metadata = updatedMetadata)
-                            } else {
-                                e
-                            }
+                        val index = timeline.indexOfFirst { it.metadata.recordingId == recordingId }
+                        if (index >= 0) {
+                            timeline[index] = timeline[index].copy(metadata = updatedMetadata)
                         }
 
-                        // Publish to Kafka
-                        coroutineScope.launch(Dispatchers.IO) {
-                            try {
-                                RdKafka.produceMessageBytesToPartition(
-                                    producerPtr = producerHandle,
-                                    topic = currentChannel.metadataTopic,
-                                    partition = currentChannel.metadataPartition,
-                                    key = updatedMetadata.messageKey().toByteArray(),
-                                    value = metadataJson.toByteArray()
-                                )
-                                RdKafka.flushProducer(producerHandle, 1000)
-                                Log.i("Timeline", "Reaction published successfully")
-                            } catch (e: Exception) {
-                                Log.e("Timeline", "Failed to publish reaction: ${e.message}", e)
-                            }
+                        try {
+                            RdKafka.enqueueMessageBytesToPartition(
+                                producerPtr = producerHandle,
+                                topic = currentChannel.metadataTopic,
+                                partition = currentChannel.metadataPartition,
+                                key = updatedMetadata.reactionKey(emoji, currentUserId).toByteArray(),
+                                value = delta,
+                                qos = RdKafka.QOS_DURABLE
+                            )
+                        } catch (e: Exception) {
+                            Log.e("Timeline", "Failed to publish reaction: ${e.message}", e)
                         }
                     }
                 },
-                onPlayFromOffset = { startOffset, endOffset, durationMs ->
+                onPlay = { entry ->
                     Log.i("Timeline", "═══════════════════════════════════════")
                     Log.i("Timeline", "▶ PLAY FROM TIMELINE CLICKED")
-                    Log.i("Timeline", "   Offset range: $startOffset - $endOffset")
-                    Log.i("Timeline", "   Duration: ${durationMs}ms")
+                    Log.i("Timeline", "   Offset range: ${entry.metadata.startOffset} - ${entry.metadata.endOffset}")
+                    Log.i("Timeline", "   Duration: ${entry.durationMs}ms")
                     Log.i("Timeline", "   Channel: ${currentChannel.channelNumber}")
-                    Log.i("Timeline", "   Topic: ${currentChannel.audioTopic}")
+                    Log.i("Timeline", "   Topic: ${currentChannel.audioTopic}, partition ${entry.metadata.audioPartition}")
                     Log.i("Timeline", "═══════════════════════════════════════")
 
-                    // Cancel any existing playback
-                    consumerJob?.cancel()
-                    audioService.stopPlayback()
-
-                    // Set initial playback state
-                    playbackState = PlaybackState(
-                        playingEntryId = startOffset,
-                        progress = 0f
-                    )
-
-                    // Set expected duration for progress calculation
-                    audioService.setExpectedDuration(durationMs)
-
-                    // Start playback from specific offset range
-                    consumerJob = coroutineScope.launch(Dispatchers.IO) {
-                        try {
-                            Log.i("Timeline", "Creating Kafka consumer from offset $startOffset on partition ${currentChannel.audioPartition}...")
-                            val audioFlow = KafkaMTLSHelper.consumeFromMTLSFromAssetsWithOffset(
-                                context = context,
-                                brokers = currentChannel.brokerUrl,
-                                groupId = "timeline-playback-${System.currentTimeMillis()}",
-                                topic = currentChannel.audioTopic,
-                                caAssetName = currentChannel.caAssetName,
-                                clientCertAssetName = currentChannel.clientCertAssetName,
-                                clientKeyAssetName = currentChannel.clientKeyAssetName,
-                                partition = currentChannel.audioPartition,
-                                offset = startOffset
-                            )
-
-                            Log.i("Timeline", "Starting audio playback...")
-                            audioService.startPlayback()
-
-                            // Wait for decoder to initialize
-                            delay(100)
-
-                            var messageCount = 0
-                            audioFlow.collect { message ->
-                                if (!isActive) {
-                                    Log.i("Timeline", "Consumer job cancelled")
-                                    audioService.stopPlayback()
-                                    playbackState = PlaybackState()
-                                    return@collect
-                                }
-
-                                messageCount++
-                                Log.d("Timeline", "Received message #$messageCount at offset ${message.offset}")
-
-                                // Queue audio chunk for playback (do this BEFORE checking end offset)
-                                message.value?.let { bytes ->
-                                    Log.d("Timeline", "Playing audio chunk: ${bytes.size} bytes")
-                                    audioService.onReceivedEncodedChunk(bytes)
-                                }
-
-                                // Stop when we reach the end offset (after queueing the last chunk)
-                                if (message.offset >= endOffset) {
-                                    Log.i("Timeline", "✓ Reached end offset (${message.offset} >= $endOffset), stopping playback after $messageCount messages")
-                                    // Wait for all queued audio to be decoded and played
-                                    audioService.stopPlaybackGracefully()
-                                    playbackState = PlaybackState()  // Reset playback state
-                                    cancel()
-                                    return@collect
-                                }
-                            }
-                            Log.i("Timeline", "Consumer flow completed")
-                            playbackState = PlaybackState()  // Reset on completion
-                        } catch (e: Exception) {
-                            Log.e("Timeline", "Playback from offset failed: ${e.message}", e)
-                            e.printStackTrace()
-                            playbackState = PlaybackState()  // Reset on error
-                        } finally {
-                            audioService.stopPlayback()
-                        }
-                    }
+                    playRange(entry, fromOffset = entry.metadata.startOffset)
+                },
+                onSeekWithinRecording = { entry, fraction ->
+                    val position = RdKafka.seekWithinRecording(entry, (fraction * entry.durationMs).toLong())
+                    Log.i("Timeline", "Seek to ${position.mediaMs}ms of ${entry.metadata.startOffset} -> offset ${position.offset}")
+                    playRange(entry, fromOffset = position.offset, startAtMs = position.mediaMs)
                 }
             )
         }
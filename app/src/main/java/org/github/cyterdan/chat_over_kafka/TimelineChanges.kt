@@ -0,0 +1,39 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * One batch of the timeline change stream, see [TimelineManager.consumeTimeline].
+ *
+ * Entries are identified by their [AudioMetadata.recordingId]. A [snapshot] replaces whatever
+ * was shown before; other batches only carry the entries that entered, changed in or left
+ * the window since the previous batch.
+ */
+data class TimelineChanges(
+    val snapshot: Boolean,
+    val inserted: List<TimelineEntry>,  // newest first
+    val updated: List<TimelineEntry>,
+    val deleted: List<Long>,  // in no particular order
+    val summary: TimelineSummary
+) {
+    val isEmpty: Boolean get() = !snapshot && inserted.isEmpty() && updated.isEmpty() && deleted.isEmpty()
+
+    /** Apply this batch to [timeline], which is kept newest first. */
+    fun applyTo(timeline: MutableList<TimelineEntry>) {
+        if (snapshot) {
+            timeline.clear()
+            timeline.addAll(inserted)
+            return
+        }
+
+        // Updated entries are re-inserted: a rewritten record may have moved
+        if (deleted.isNotEmpty() || updated.isNotEmpty()) {
+            val gone = HashSet<Long>(deleted.size + updated.size)
+            gone.addAll(deleted)
+            updated.mapTo(gone) { it.metadata.recordingId }
+            timeline.removeAll { it.metadata.recordingId in gone }
+        }
+        for (entry in updated + inserted) {
+            val at = timeline.binarySearch(entry, TimelineManager.newestFirst)
+            timeline.add(if (at < 0) -at - 1 else at, entry)
+        }
+    }
+}
@@ -0,0 +1,34 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * Reads the native timeline index of [channelId] page by page, newest first.
+ *
+ * Each [next] continues strictly after the last recording of the previous page, so pages
+ * never overlap or skip rows even while new recordings are being indexed.
+ */
+class TimelineCursor(
+    private val channelId: Int,
+    private val fromMs: Long,
+    private val toMs: Long = Long.MAX_VALUE,
+    private val speaker: String? = null
+) {
+    // [startedAt, startOffset] of the last recording returned; advanced by the native side
+    private val position = longArrayOf(Long.MAX_VALUE, Long.MAX_VALUE)
+
+    var exhausted = false
+        private set
+
+    /** Broker start time of the oldest recording returned so far; Long.MAX_VALUE before any. */
+    val startedAt: Long get() = position[0]
+
+    /** Start offset of the oldest recording returned so far, breaking ties of [startedAt]. */
+    val startOffset: Long get() = position[1]
+
+    /** Start offsets of up to [limit] further recordings. */
+    fun next(limit: Int): LongArray {
+        if (exhausted) return LongArray(0)
+        val page = RdKafka.timelinePage(channelId, fromMs, toMs, speaker, position, limit)
+        if (page.size < limit) exhausted = true
+        return page
+    }
+}
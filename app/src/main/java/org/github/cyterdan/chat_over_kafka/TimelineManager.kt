@@ -1,9 +1,22 @@
 package org.github.cyterdan.chat_over_kafka
 
 import android.util.Log
+import kotlinx.coroutines.delay
 import kotlinx.coroutines.flow.Flow
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.StateFlow
+import kotlinx.coroutines.flow.channelFlow
+import kotlinx.coroutines.flow.combine
+import kotlinx.coroutines.flow.conflate
+import kotlinx.coroutines.flow.first
 import kotlinx.coroutines.flow.flow
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.withTimeoutOrNull
+import java.io.File
+import java.util.concurrent.ConcurrentHashMap
 import java.util.concurrent.TimeUnit
+import java.util.concurrent.atomic.AtomicBoolean
+import java.util.concurrent.atomic.AtomicLong
 
 data class TimelineEntry(
     val metadata: AudioMetadata,
@@ -17,7 +30,8 @@ data class TimelineEntry(
     companion object {
         fun fromMetadata(metadata: AudioMetadata): TimelineEntry {
             val now = System.currentTimeMillis()
-            val ageMs = now - metadata.timestamp
+            val durationMs = metadata.durationMs
+            val ageMs = now - (metadata.startedAt + durationMs)
 
             val displayTime = when {
                 ageMs < TimeUnit.MINUTES.toMillis(1) -> "Just now"
@@ -35,9 +49,6 @@ data class TimelineEntry(
                 }
             }
 
-            // Estimate duration from message count (60ms per frame)
-            val durationMs = metadata.messageCount * 60L
-
             // Format duration display
             val durationDisplay = when {
                 durationMs < 1000 -> "${durationMs}ms"
@@ -60,59 +71,211 @@ data class TimelineEntry(
 enum class TimeRange(val hours: Int, val displayName: String) {
     ONE_HOUR(1, "Last Hour"),
     SIX_HOURS(6, "Last 6 Hours"),
-    TWENTY_FOUR_HOURS(24, "Last 24 Hours")
+    TWENTY_FOUR_HOURS(24, "Last 24 Hours"),
+    SEVEN_DAYS(24 * 7, "Last 7 Days")
 }
 
+/**
+ * What the timeline shows: recordings of the last [hours] hours, by [speaker] unless null,
+ * the newest [limit] of them plus any that arrived since they were paged in.
+ */
+data class TimelineQuery(
+    val hours: Int = TimeRange.ONE_HOUR.hours,
+    val speaker: String? = null,
+    val limit: Int = TimelineManager.PAGE_SIZE
+)
+
 object TimelineManager {
+    /** Recordings fetched per page; the window grows by this much when older ones are requested. */
+    const val PAGE_SIZE = 200
+
+    // Changes indexed within one frame are delivered as one batch
+    private const val FRAME_BUDGET_MS = 16L
+
+    // Deliver the first snapshot anyway if the high watermark is not reached by then
+    private const val CATCH_UP_TIMEOUT_MS = 5_000L
+
+    // How often a changed table is written back to its snapshot file
+    private const val SNAPSHOT_INTERVAL_MS = 30_000L
+
+    // Newest first by broker start time; offsets break ties between frames appended together
+    internal val newestFirst = compareByDescending<TimelineEntry> { it.metadata.startedAt }
+        .thenByDescending { it.metadata.startOffset }
+
     /**
-     * Consume metadata from the past N hours and build timeline.
-     * Uses startOffset as unique key to support reaction updates (compacted topic).
+     * Consume the channel's metadata into the native index and stream the changes of the
+     * window selected by [query].
+     * Uses the recording id as unique key to support reaction updates (compacted topic).
+     * Reaction deltas are folded natively and applied to the entry they belong to;
+     * full records only provide the snapshot underneath them, and tombstones delete.
+     *
+     * With a [snapshotFile], the records saved there last time are indexed first and shown
+     * at once, and [metadataFlow] is asked to start at the offset they were saved at, so only
+     * what was appended since is read. The table is saved back every
+     * [SNAPSHOT_INTERVAL_MS] while it changes and once more when the flow is cancelled.
+     *
+     * Without a snapshot nothing is emitted until the record before [highWatermark] of
+     * [metadataPartition] was read (-1 when unknown); then the window arrives as one snapshot.
+     * After that every batch holds the inserted, updated and deleted entries of at least one
+     * frame, however many records arrived meanwhile. A larger [TimelineQuery.limit] pages in
+     * just the older recordings through the same [TimelineCursor]; a new range or speaker
+     * starts over with a snapshot.
      */
     fun consumeTimeline(
-        metadataFlow: Flow<KafkaMessage>,
-        timeRangeHours: Int = 24,
-        metadataPartition: Int = 0  // Default to partition 0 for metadata
-    ): Flow<List<TimelineEntry>> = flow {
-        val timelineMap = mutableMapOf<Long, TimelineEntry>()
-        val cutoffTime = System.currentTimeMillis() - TimeUnit.HOURS.toMillis(timeRangeHours.toLong())
-
-        // Emit initial empty state
-        emit(emptyList())
-
-        metadataFlow.collect { message ->
-            try {
+        metadataFlow: (startOffset: Long) -> Flow<KafkaMessage>,
+        channelId: Int,
+        query: StateFlow<TimelineQuery>,
+        metadataTopic: String,
+        metadataPartition: Int = 0,  // Default to partition 0 for metadata
+        highWatermark: Long = -1L,
+        snapshotFile: File? = null
+    ): Flow<TimelineChanges> = channelFlow {
+        val entries = ConcurrentHashMap<Long, TimelineEntry>()
+        val indexed = MutableStateFlow(0L)
+        RdKafka.clearTimelineIndex(channelId)
+
+        fun index(entry: TimelineEntry) {
+            entries[entry.metadata.recordingId] = entry
+            RdKafka.indexTimeline(entry.metadata)
+            indexed.value++
+        }
+
+        // A checkpoint past the end means the topic was recreated since it was taken
+        val restored = snapshotFile
+            ?.let { RdKafka.loadTimelineSnapshot(it.path, metadataTopic, metadataPartition, channelId) }
+            ?.takeIf { highWatermark < 0 || it.nextOffset <= highWatermark }
+        restored?.records?.forEach { metadata ->
+            RdKafka.seedReactions(metadata)
+            index(TimelineEntry.fromMetadata(metadata))
+        }
+
+        val nextOffset = AtomicLong(restored?.nextOffset ?: RdKafka.OFFSET_BEGINNING)
+        val unsaved = AtomicBoolean(false)
+        val caughtUp = MutableStateFlow(
+            restored != null || highWatermark <= 0L || nextOffset.get() >= highWatermark
+        )
+
+        fun save() {
+            val file = snapshotFile ?: return
+            if (!unsaved.getAndSet(false)) return
+            // Read the offset first: entries may then only be ahead of it, and re-reading is harmless
+            val offset = nextOffset.get()
+            val records = entries.values.map { it.metadata.withFoldedReactions().toBytes() }.toTypedArray()
+            if (!RdKafka.saveTimelineSnapshot(file.path, metadataTopic, metadataPartition, channelId, offset, records)) {
+                Log.w("Timeline", "Failed to save timeline snapshot to ${file.path}")
+            }
+        }
+
+        launch {
+            metadataFlow(nextOffset.get()).collect { message ->
                 if (message.partition != metadataPartition) return@collect
+                try {
+                    val bytes = message.value
+                    if (bytes == null) {
+                        val recordingId = message.keyAsString()?.let { AudioMetadata.recordingIdOfKey(it) }
+                            ?: return@collect
+                        entries.remove(recordingId)
+                        RdKafka.removeFromTimeline(channelId, recordingId)
+                        indexed.value++
+                        return@collect
+                    }
 
-                val json = message.value?.toString(Charsets.UTF_8) ?: return@collect
-                val metadata = AudioMetadata.fromJson(json)
+                    val reactedId = RdKafka.foldReactionDelta(bytes)
+                    if (reactedId >= 0) {
+                        // Deltas may precede their recording; they are applied once it is seen
+                        val entry = entries[reactedId] ?: return@collect
+                        index(entry.copy(metadata = entry.metadata.withFoldedReactions()))
+                        return@collect
+                    }
 
-                if (metadata.timestamp >= cutoffTime) {
-                    val entry = TimelineEntry.fromMetadata(metadata)
-                    timelineMap[metadata.startOffset] = entry
-                    emit(timelineMap.values.sortedByDescending { it.metadata.timestamp })
+                    val metadata = AudioMetadata.fromBytes(bytes)
+                    RdKafka.seedReactions(metadata)
+                    index(TimelineEntry.fromMetadata(metadata.withFoldedReactions()))
+                } catch (e: Exception) {
+                    Log.e("Timeline", "Failed to parse metadata: ${e.message}")
+                } finally {
+                    nextOffset.set(message.offset + 1)
+                    unsaved.set(true)
+                    if (message.offset >= highWatermark - 1) caughtUp.value = true
                 }
-            } catch (e: Exception) {
-                Log.e("Timeline", "Failed to parse metadata: ${e.message}")
             }
         }
+
+        if (snapshotFile != null) {
+            launch {
+                while (true) {
+                    delay(SNAPSHOT_INTERVAL_MS)
+                    save()
+                }
+            }
+        }
+
+        try {
+            withTimeoutOrNull(CATCH_UP_TIMEOUT_MS) { caughtUp.first { it } }
+
+            var shown: TimelineQuery? = null
+            var cursor: TimelineCursor? = null
+            var pagedIn = 0
+            combine(query, indexed) { q, _ -> q }
+                .conflate()
+                .collect { q ->
+                    val snapshot = shown?.let { it.hours != q.hours || it.speaker != q.speaker } ?: true
+                    shown = q
+                    val fromMs = System.currentTimeMillis() - TimeUnit.HOURS.toMillis(q.hours.toLong())
+                    val pages = cursor?.takeUnless { snapshot }
+                        ?: TimelineCursor(channelId, fromMs, speaker = q.speaker).also {
+                            cursor = it
+                            pagedIn = 0
+                        }
+                    // Older pages continue where the previous one ended
+                    if (q.limit > pagedIn) {
+                        pages.next(q.limit - pagedIn)
+                        pagedIn = q.limit
+                    }
+                    val changes = takeChanges(channelId, q, fromMs, pages, entries, snapshot)
+                    if (!changes.isEmpty) send(changes)
+                    delay(FRAME_BUDGET_MS)
+                }
+        } finally {
+            save()
+        }
+    }
+
+    private fun takeChanges(
+        channelId: Int,
+        query: TimelineQuery,
+        fromMs: Long,
+        cursor: TimelineCursor,
+        entries: Map<Long, TimelineEntry>,
+        snapshot: Boolean
+    ): TimelineChanges {
+        val ids = RdKafka.timelineChanges(channelId, fromMs, query.speaker, cursor, snapshot)
+        return TimelineChanges(
+            snapshot = snapshot,
+            inserted = ids.inserted.mapNotNull { entries[it] },
+            updated = ids.updated.mapNotNull { entries[it] },
+            deleted = ids.deleted.asList(),
+            summary = RdKafka.timelineSummary(channelId, fromMs, speaker = query.speaker)
+        )
     }
 
     /**
-     * Calculate message density for visualization
-     * Returns list of (hourIndex, messageCount) pairs
+     * Fold the hourly rollups of [channelId] and emit the density of the last
+     * [timeRangeHours] hours, oldest first, whenever a bucket changes. Reads one small record
+     * per speaker and hour instead of every metadata record in the range.
      */
-    fun calculateDensity(entries: List<TimelineEntry>, timeRangeHours: Int): List<Pair<Int, Int>> {
-        val density = IntArray(timeRangeHours) { 0 }
-        val now = System.currentTimeMillis()
-
-        entries.forEach { entry ->
-            val ageMs = now - entry.metadata.timestamp
-            val hourIndex = TimeUnit.MILLISECONDS.toHours(ageMs).toInt()
-            if (hourIndex in 0 until timeRangeHours) {
-                density[hourIndex]++
+    fun consumeDensity(
+        rollupFlow: Flow<KafkaMessage>,
+        channelId: Int,
+        timeRangeHours: Int
+    ): Flow<List<HourlyDensity>> = flow {
+        emit(RdKafka.density(channelId, timeRangeHours))
+
+        rollupFlow.collect { message ->
+            val bytes = message.value ?: return@collect
+            if (RdKafka.foldRollup(bytes)) {
+                emit(RdKafka.density(channelId, timeRangeHours))
             }
         }
-
-        return density.mapIndexed { index, count -> index to count }
     }
 }
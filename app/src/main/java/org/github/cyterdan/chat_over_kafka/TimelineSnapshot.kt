@@ -0,0 +1,10 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * A channel's metadata as saved on disk, with reactions folded in, and the offset of the
+ * metadata partition to resume consuming from.
+ */
+data class TimelineSnapshot(
+    val records: List<AudioMetadata>,
+    val nextOffset: Long
+)
@@ -0,0 +1,10 @@
+package org.github.cyterdan.chat_over_kafka
+
+/**
+ * Totals over the recordings of a timeline window, computed by the native index.
+ */
+data class TimelineSummary(
+    val recordings: Int = 0,
+    val durationMs: Long = 0,
+    val reactions: Int = 0
+)
@@ -13,6 +13,9 @@ import android.util.Log
 import androidx.core.app.ActivityCompat
 import com.theeasiestway.opus.Constants
 import com.theeasiestway.opus.Opus
+import org.github.cyterdan.chat_over_kafka.KafkaMessageHolder
+import org.github.cyterdan.chat_over_kafka.MessageHolderPool
+import org.github.cyterdan.chat_over_kafka.RdKafka
 import kotlinx.coroutines.CoroutineScope
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.Job
@@ -23,6 +26,7 @@ import kotlinx.coroutines.flow.StateFlow
 import kotlinx.coroutines.isActive
 import kotlinx.coroutines.launch
 import kotlinx.coroutines.withContext
+import java.util.concurrent.ArrayBlockingQueue
 import java.util.concurrent.Executors
 import java.util.concurrent.TimeUnit
 import java.nio.ByteBuffer
@@ -43,8 +47,11 @@ class AudioService(private val context: Context, private val coroutineScope: Cor
         private val FRAME_SIZE = Constants.FrameSize._2880()
         private val FRAME_SIZE_SAMPLES = FRAME_SIZE.v
         private const val AUDIO_FORMAT = AudioFormat.ENCODING_PCM_16BIT
-        private const val FRAME_DURATION_MS = 60L
+        const val FRAME_DURATION_MS = 60L
         private const val WAVEFORM_UPDATE_INTERVAL = 2
+        private const val MAX_POOLED_PACKET_BYTES = 1275  // largest Opus packet
+        private const val MAX_QUEUED_FRAMES = 1024  // about a minute of audio
+        private const val DECODE_POLL_MS = 50L
     }
 
     private val opusEncoder = Opus()
@@ -58,6 +65,11 @@ class AudioService(private val context: Context, private val coroutineScope: Cor
     private val audioExecutor = Executors.newSingleThreadExecutor()
     private val audioDispatcher = audioExecutor.asCoroutineDispatcher()
 
+    // Frames waiting for the audio thread, as ByteArrays or leased holders. Queued and taken
+    // without allocating, unlike a coroutine per frame.
+    private val decodeQueue = ArrayBlockingQueue<Any>(MAX_QUEUED_FRAMES)
+    @Volatile private var decodeLoopRunning = false
+
     @Volatile private var pendingDecodeCount = 0
     private val pendingDecodeLock = Object()
     @Volatile private var isShuttingDown = false
@@ -78,10 +90,22 @@ class AudioService(private val context: Context, private val coroutineScope: Cor
     val playbackProgress: StateFlow<Float> = _playbackProgress
 
     private var expectedTotalDurationMs = 0L
+    private var playbackStartAtMs = 0L
+
+    // Decoded PCM bytes held per queued frame, and how many frames the memory budget allows
+    private val bytesPerQueuedFrame = FRAME_SIZE_SAMPLES * 2L
+    private val maxPendingDecodeFrames = RdKafka.cacheBudgetBytes().let { budget ->
+        if (budget > 0) (budget / bytesPerQueuedFrame).toInt().coerceAtLeast(16) else Int.MAX_VALUE
+    }
 
-    fun setExpectedDuration(durationMs: Long) {
+    /**
+     * Duration of the recording about to play. [startAtMs] is where playback starts within it
+     * when seeking, so progress is reported against the whole recording.
+     */
+    fun setExpectedDuration(durationMs: Long, startAtMs: Long = 0L) {
         expectedTotalDurationMs = durationMs
-        _playbackProgress.value = 0f
+        playbackStartAtMs = startAtMs.coerceIn(0L, durationMs)
+        _playbackProgress.value = if (durationMs > 0) playbackStartAtMs.toFloat() / durationMs else 0f
     }
 
     fun startStreaming(onEncodedChunk: (ByteArray) -> Unit) {
@@ -190,6 +214,8 @@ class AudioService(private val context: Context, private val coroutineScope: Cor
                 opusDecoder.decoderInit(SAMPLE_RATE, CHANNELS)
                 decoderInitialized = true
             }
+            decodeLoopRunning = true
+            coroutineScope.launch(audioDispatcher) { runDecodeLoop() }
 
             try {
                 audioTrack?.play()
@@ -207,67 +233,124 @@ class AudioService(private val context: Context, private val coroutineScope: Cor
     private var firstWriteTime = 0L
     private var totalFramesConsumed = 0L
 
+    // Exact-size scratch arrays for pooled-holder frames, indexed by packet size (audio thread only)
+    private val encodedScratch = arrayOfNulls<ByteArray>(MAX_POOLED_PACKET_BYTES + 1)
+
     fun onReceivedEncodedChunk(encodedData: ByteArray) {
-        if (playbackJob?.isActive != true || encodedData.isEmpty() || isShuttingDown) return
-        if (!decoderInitialized) return  // Skip until decoder is ready
+        if (encodedData.isEmpty()) return
+        enqueueDecode(encodedData, null, null)
+    }
 
-        synchronized(pendingDecodeLock) { pendingDecodeCount++ }
+    /**
+     * Allocation-free variant for the recycling consume path: the frame is copied out of
+     * [holder] on the audio thread and the holder goes back to [pool] once decoded.
+     */
+    fun onReceivedEncodedChunk(holder: KafkaMessageHolder, pool: MessageHolderPool) {
+        if (holder.valueLength <= 0) {
+            pool.recycle(holder)
+            return
+        }
+        enqueueDecode(null, holder, pool)
+    }
 
-        coroutineScope.launch(audioDispatcher) {
-            try {
-                // Check decoder is ready (don't check isShuttingDown - let queued chunks finish)
-                if (!decoderInitialized) {
-                    return@launch
+    private fun enqueueDecode(bytes: ByteArray?, holder: KafkaMessageHolder?, pool: MessageHolderPool?) {
+        val accepted = playbackJob?.isActive == true && !isShuttingDown && decoderInitialized &&
+            synchronized(pendingDecodeLock) {
+                if (pendingDecodeCount >= maxPendingDecodeFrames) {
+                    RdKafka.log(Log.WARN, "AudioService") {
+                        "Decode queue at memory budget ($pendingDecodeCount frames), dropping chunk"
+                    }
+                    false
+                } else {
+                    pendingDecodeCount++
+                    reportCacheUsageIfDue()
+                    true
                 }
+            }
+        if (!accepted) {
+            if (holder != null) pool?.recycle(holder)
+            return
+        }
 
-                if (playbackStartTime == 0L) {
-                    playbackStartTime = System.currentTimeMillis()
-                    totalFramesConsumed = 0
-                }
-                totalFramesConsumed++
+        if (holder != null) holder.owner = pool
+        val item: Any = holder ?: bytes!!
+        if (!decodeQueue.offer(item)) {
+            finishDecode(item)
+        }
+    }
+
+    // Runs on the audio thread for as long as the decoder is up
+    private fun runDecodeLoop() {
+        while (decodeLoopRunning) {
+            val item = decodeQueue.poll(DECODE_POLL_MS, TimeUnit.MILLISECONDS) ?: continue
+            decode(item)
+        }
+    }
+
+    private fun decode(item: Any) {
+        val holder = item as? KafkaMessageHolder
+        try {
+            // Check decoder is ready (don't check isShuttingDown - let queued chunks finish)
+            if (!decoderInitialized) {
+                return
+            }
 
-                val decodedPcm = if (encodedData.size == 2 && encodedData[0] == 0.toByte() && encodedData[1] == 0.toByte()) {
+            val encodedData = holder?.let { holderBytes(it) } ?: item as ByteArray
+
+            if (playbackStartTime == 0L) {
+                playbackStartTime = System.currentTimeMillis()
+                totalFramesConsumed = 0
+            }
+            totalFramesConsumed++
+
+            val decodedPcm = if (encodedData.size == 2 && encodedData[0] == 0.toByte() && encodedData[1] == 0.toByte()) {
+                ShortArray(FRAME_SIZE_SAMPLES)
+            } else {
+                // Decode bytes directly, get PCM bytes, convert to shorts for AudioTrack
+                val decodedBytes = opusDecoder.decode(encodedData, FRAME_SIZE)
+                if (decodedBytes == null || decodedBytes.isEmpty()) {
+                    RdKafka.log(Log.WARN, "AudioService") { "Decode failed, inserting silence" }
                     ShortArray(FRAME_SIZE_SAMPLES)
                 } else {
-                    // Decode bytes directly, get PCM bytes, convert to shorts for AudioTrack
-                    val decodedBytes = opusDecoder.decode(encodedData, FRAME_SIZE)
-                    if (decodedBytes == null || decodedBytes.isEmpty()) {
-                        Log.w("AudioService", "Decode failed, inserting silence")
-                        ShortArray(FRAME_SIZE_SAMPLES)
-                    } else {
-                        pcmBytesToShorts(decodedBytes)
-                    }
+                    pcmBytesToShorts(decodedBytes)
                 }
+            }
 
-                if (decodedPcm.isNotEmpty()) {
-                    if (playbackJob?.isActive == true) {
-                        waveformUpdateCounter++
-                        if (waveformUpdateCounter >= WAVEFORM_UPDATE_INTERVAL) {
-                            _waveformData.value = _waveformData.value.addSample(calculateRMSAmplitude(decodedPcm))
-                            waveformUpdateCounter = 0
-                        }
+            if (decodedPcm.isNotEmpty()) {
+                if (playbackJob?.isActive == true) {
+                    waveformUpdateCounter++
+                    if (waveformUpdateCounter >= WAVEFORM_UPDATE_INTERVAL) {
+                        _waveformData.value = _waveformData.value.addSample(calculateRMSAmplitude(decodedPcm))
+                        waveformUpdateCounter = 0
                     }
+                }
 
-                    val writeTime = System.currentTimeMillis()
-                    val result = audioTrack?.write(decodedPcm, 0, decodedPcm.size) ?: 0
-
-                    if (firstWriteTime == 0L) firstWriteTime = writeTime
+                val writeTime = System.currentTimeMillis()
+                val result = audioTrack?.write(decodedPcm, 0, decodedPcm.size) ?: 0
 
-                    if (expectedTotalDurationMs > 0 && firstWriteTime > 0) {
-                        val elapsed = System.currentTimeMillis() - firstWriteTime
-                        _playbackProgress.value = (elapsed.toFloat() / expectedTotalDurationMs).coerceIn(0f, 1f)
-                    }
+                if (firstWriteTime == 0L) firstWriteTime = writeTime
 
-                    if (result < 0) Log.e("AudioService", "AudioTrack write error: $result")
-                }
-            } catch (e: Exception) {
-                Log.e("AudioService", "Error decoding audio: ${e.message}", e)
-            } finally {
-                synchronized(pendingDecodeLock) {
-                    pendingDecodeCount--
-                    pendingDecodeLock.notifyAll()
+                if (expectedTotalDurationMs > 0 && firstWriteTime > 0) {
+                    val elapsed = System.currentTimeMillis() - firstWriteTime + playbackStartAtMs
+                    _playbackProgress.value = (elapsed.toFloat() / expectedTotalDurationMs).coerceIn(0f, 1f)
                 }
+
+                if (result < 0) Log.e("AudioService", "AudioTrack write error: $result")
             }
+        } catch (e: Exception) {
+            Log.e("AudioService", "Error decoding audio: ${e.message}", e)
+        } finally {
+            finishDecode(item)
+        }
+    }
+
+    // Hands a holder back to its pool and frees its slot in the decode budget
+    private fun finishDecode(item: Any) {
+        if (item is KafkaMessageHolder) item.owner?.recycle(item)
+        synchronized(pendingDecodeLock) {
+            pendingDecodeCount--
+            reportCacheUsageIfDue()
+            pendingDecodeLock.notifyAll()
         }
     }
 
@@ -304,6 +387,7 @@ class AudioService(private val context: Context, private val coroutineScope: Cor
         _waveformData.value = WaveformData()
         _playbackProgress.value = 0f
         expectedTotalDurationMs = 0L
+        playbackStartAtMs = 0L
         waveformUpdateCounter = 0
 
         // Wait briefly for any pending decode operations to complete
@@ -318,6 +402,12 @@ class AudioService(private val context: Context, private val coroutineScope: Cor
             }
         }
 
+        // The loop leaves the audio thread within DECODE_POLL_MS; what it did not get to is dropped
+        decodeLoopRunning = false
+        while (true) {
+            finishDecode(decodeQueue.poll() ?: break)
+        }
+
         audioTrack?.pause()
         audioTrack?.flush()
         audioTrack?.release()
@@ -345,6 +435,24 @@ class AudioService(private val context: Context, private val coroutineScope: Cor
         }
     }
 
+    private fun holderBytes(holder: KafkaMessageHolder): ByteArray {
+        val size = holder.valueLength
+        val target = if (size <= MAX_POOLED_PACKET_BYTES) {
+            encodedScratch[size] ?: ByteArray(size).also { encodedScratch[size] = it }
+        } else {
+            ByteArray(size)
+        }
+        holder.copyValueInto(target)
+        return target
+    }
+
+    // Called with pendingDecodeLock held; keeps JNI calls off most frames
+    private fun reportCacheUsageIfDue() {
+        if (pendingDecodeCount % 16 == 0) {
+            RdKafka.reportCacheUsage(pendingDecodeCount * bytesPerQueuedFrame)
+        }
+    }
+
     private fun pcmShortsToBytes(shorts: ShortArray): ByteArray {
         // Convert 16-bit PCM samples to bytes (little endian, 2 bytes per sample)
         val buffer = ByteBuffer.allocate(shorts.size * 2).order(ByteOrder.LITTLE_ENDIAN)
@@ -22,7 +22,15 @@ data class KafkaConfig(
         val audioTopic: String,
         val audioPartition: Int,
         val metadataTopic: String,
-        val metadataPartition: Int
+        val metadataPartition: Int,
+        // Partition of the metadata topic holding hourly rollups
+        val rollupPartition: Int = 1,
+        // Base64 end-to-end key for the audio frames; frames are plaintext without one
+        val frameKey: String? = null,
+        // "aes-128-gcm" or "chacha20-poly1305"
+        val frameCipher: String = "aes-128-gcm",
+        // QoS class of live frames: "ordered", or "realtime" for a faster ack where frames may be reordered
+        val liveQos: String = "ordered"
     )
 
     @Serializable
@@ -69,7 +77,8 @@ data class KafkaConfig(
                         audioTopic = "chok-audio-1",
                         audioPartition = 0,
                         metadataTopic = "chok-metadata-1",
-                        metadataPartition = 0
+                        metadataPartition = 0,
+                        rollupPartition = 1
                     )
                 ),
                 certificates = CertificateConfig(
@@ -5,6 +5,7 @@ import androidx.compose.animation.core.animateFloatAsState
 import androidx.compose.animation.core.tween
 import androidx.compose.foundation.background
 import androidx.compose.foundation.clickable
+import androidx.compose.foundation.gestures.detectTapGestures
 import androidx.compose.foundation.layout.Arrangement
 import androidx.compose.foundation.layout.Box
 import androidx.compose.foundation.layout.Column
@@ -34,17 +35,23 @@ import androidx.compose.runtime.getValue
 import androidx.compose.runtime.mutableStateOf
 import androidx.compose.runtime.remember
 import androidx.compose.runtime.setValue
+import androidx.compose.runtime.snapshotFlow
 import androidx.compose.ui.Alignment
 import androidx.compose.ui.Modifier
 import androidx.compose.ui.draw.clip
 import androidx.compose.ui.graphics.Color
+import androidx.compose.ui.input.pointer.pointerInput
 import androidx.compose.ui.text.font.FontWeight
 import androidx.compose.ui.unit.dp
+import org.github.cyterdan.chat_over_kafka.HourlyDensity
 import org.github.cyterdan.chat_over_kafka.Reactions
 import org.github.cyterdan.chat_over_kafka.TimeRange
 import org.github.cyterdan.chat_over_kafka.TimelineEntry
+import org.github.cyterdan.chat_over_kafka.TimelineSummary
 import org.github.cyterdan.chat_over_kafka.audio.WaveformData
 import org.github.cyterdan.chat_over_kafka.ui.theme.NeonGreen
+import kotlinx.coroutines.flow.distinctUntilChanged
+import kotlinx.coroutines.flow.filter
 import kotlin.math.absoluteValue
 
 /**
@@ -150,6 +157,8 @@ fun AudioChatBubble(
     playbackProgress: Float,  // 0.0 to 1.0
     waveformData: WaveformData,  // Live amplitude data
     onPlay: () -> Unit,
+    onSelectSpeaker: () -> Unit,
+    onSeek: (fraction: Float) -> Unit,
     onReact: (emoji: String) -> Unit,
     modifier: Modifier = Modifier
 ) {
@@ -227,7 +236,8 @@ fun AudioChatBubble(
                 text = if (isOwnMessage) "You" else entry.metadata.userId,
                 style = MaterialTheme.typography.labelSmall,
                 color = userColor,
-                fontWeight = FontWeight.Bold
+                fontWeight = FontWeight.Bold,
+                modifier = Modifier.clickable(onClick = onSelectSpeaker)
             )
             Spacer(modifier = Modifier.height(4.dp))
 
@@ -253,11 +263,16 @@ fun AudioChatBubble(
                     )
                 }
 
-                // Waveform with progress cursor
+                // Waveform with progress cursor; tapping it seeks within the recording
                 Box(
                     modifier = Modifier
                         .weight(1f)
                         .height(32.dp)
+                        .pointerInput(entry.metadata.recordingId) {
+                            detectTapGestures { position ->
+                                onSeek((position.x / size.width).coerceIn(0f, 1f))
+                            }
+                        }
                 ) {
                     // Waveform bars
                     Row(
@@ -365,6 +380,40 @@ data class PlaybackState(
     val waveformData: WaveformData = WaveformData()
 )
 
+/**
+ * One bar per hour of the selected range, oldest on the left, scaled to the busiest hour
+ */
+@Composable
+fun DensityStrip(
+    density: List<HourlyDensity>,
+    modifier: Modifier = Modifier
+) {
+    val busiest = density.maxOfOrNull { it.recordings } ?: 0
+    if (busiest == 0) return
+
+    Row(
+        modifier = modifier
+            .fillMaxWidth()
+            .height(24.dp)
+            .background(MaterialTheme.colorScheme.surface)
+            .padding(horizontal = 16.dp, vertical = 4.dp),
+        horizontalArrangement = Arrangement.spacedBy(1.dp),
+        verticalAlignment = Alignment.Bottom
+    ) {
+        density.forEach { hour ->
+            Box(
+                modifier = Modifier
+                    .weight(1f)
+                    .fillMaxHeight(hour.recordings.toFloat() / busiest)
+                    .background(
+                        if (hour.recordings > 0) NeonGreen.copy(alpha = 0.7f)
+                        else Color.Transparent
+                    )
+            )
+        }
+    }
+}
+
 /**
  * Main chat-style timeline view
  */
@@ -372,26 +421,42 @@ data class PlaybackState(
 fun TimelineView(
     timeline: List<TimelineEntry>,
     selectedRange: TimeRange,
+    density: List<HourlyDensity>,
+    summary: TimelineSummary,
+    speakerFilter: String?,
+    hasOlder: Boolean,
     isLoading: Boolean,
     currentUserId: String,
     playbackState: PlaybackState,
     onRangeChange: (TimeRange) -> Unit,
-    onPlayFromOffset: (startOffset: Long, endOffset: Long, durationMs: Long) -> Unit,
-    onReact: (startOffset: Long, emoji: String) -> Unit,
+    onSpeakerFilter: (speaker: String?) -> Unit,
+    onLoadOlder: () -> Unit,
+    onPlay: (entry: TimelineEntry) -> Unit,
+    onSeekWithinRecording: (entry: TimelineEntry, fraction: Float) -> Unit,
+    onReact: (recordingId: Long, emoji: String) -> Unit,
     modifier: Modifier = Modifier
 ) {
     val listState = rememberLazyListState()
 
-    // Reverse the timeline so oldest messages are at the top (chat style)
-    val chatMessages = remember(timeline) { timeline.reversed() }
+    // Oldest messages at the top (chat style); a view, so change batches show up without copying
+    val chatMessages = timeline.asReversed()
 
-    // Auto-scroll to bottom when new messages arrive
-    LaunchedEffect(chatMessages.size) {
+    // Auto-scroll to bottom when a newer message arrives (not when older pages load above)
+    LaunchedEffect(chatMessages.lastOrNull()?.metadata?.recordingId) {
         if (chatMessages.isNotEmpty()) {
             listState.animateScrollToItem(chatMessages.size - 1)
         }
     }
 
+    // Scrolled to the oldest loaded message: ask for the next page
+    LaunchedEffect(listState, hasOlder) {
+        if (!hasOlder) return@LaunchedEffect
+        snapshotFlow { listState.firstVisibleItemIndex == 0 && listState.layoutInfo.totalItemsCount > 0 }
+            .distinctUntilChanged()
+            .filter { it }
+            .collect { onLoadOlder() }
+    }
+
     Column(
         modifier = modifier.fillMaxSize(),
         verticalArrangement = Arrangement.spacedBy(0.dp)
@@ -405,12 +470,21 @@ fun TimelineView(
             horizontalArrangement = Arrangement.SpaceBetween,
             verticalAlignment = Alignment.CenterVertically
         ) {
-            Text(
-                text = "[ MESSAGES ]",
-                style = MaterialTheme.typography.titleMedium,
-                color = NeonGreen,
-                fontWeight = FontWeight.Bold
-            )
+            Column {
+                Text(
+                    text = "[ MESSAGES ]",
+                    style = MaterialTheme.typography.titleMedium,
+                    color = NeonGreen,
+                    fontWeight = FontWeight.Bold
+                )
+                if (summary.recordings > 0) {
+                    Text(
+                        text = "${summary.recordings} · ${summary.durationMs / 60000}m ${(summary.durationMs % 60000) / 1000}s",
+                        style = MaterialTheme.typography.labelSmall,
+                        color = NeonGreen.copy(alpha = 0.6f)
+                    )
+                }
+            }
 
             // Time range chips
             Row(horizontalArrangement = Arrangement.spacedBy(4.dp)) {
@@ -420,7 +494,7 @@ fun TimelineView(
                         onClick = { onRangeChange(range) },
                         label = {
                             Text(
-                                text = "${range.hours}h",
+                                text = if (range.hours >= 48) "${range.hours / 24}d" else "${range.hours}h",
                                 style = MaterialTheme.typography.labelSmall
                             )
                         },
@@ -430,6 +504,30 @@ fun TimelineView(
             }
         }
 
+        DensityStrip(density = density)
+
+        // Active speaker filter; tapping a speaker's name in a bubble sets it
+        if (speakerFilter != null) {
+            Row(
+                modifier = Modifier
+                    .fillMaxWidth()
+                    .background(MaterialTheme.colorScheme.surface)
+                    .padding(horizontal = 16.dp, vertical = 4.dp)
+            ) {
+                FilterChip(
+                    selected = true,
+                    onClick = { onSpeakerFilter(null) },
+                    label = {
+                        Text(
+                            text = "@$speakerFilter  ✕",
+                            style = MaterialTheme.typography.labelSmall
+                        )
+                    },
+                    modifier = Modifier.height(28.dp)
+                )
+            }
+        }
+
         // Chat messages area
         Box(
             modifier = Modifier
@@ -486,12 +584,12 @@ fun TimelineView(
                     ) {
                         items(
                             items = chatMessages,
-                            key = { it.metadata.startOffset }
+                            key = { it.metadata.recordingId }
                         ) { entry ->
                             val isOwnMessage = entry.metadata.userId == currentUserId ||
                                     (currentUserId.isEmpty() && entry.metadata.userId == "anonymous")
                             val userColor = getUserColor(entry.metadata.userId)
-                            val isPlaying = playbackState.playingEntryId == entry.metadata.startOffset
+                            val isPlaying = playbackState.playingEntryId == entry.metadata.recordingId
 
                             AudioChatBubble(
                                 entry = entry,
@@ -501,15 +599,11 @@ fun TimelineView(
                                 isPlaying = isPlaying,
                                 playbackProgress = if (isPlaying) playbackState.progress else 0f,
                                 waveformData = if (isPlaying) playbackState.waveformData else WaveformData(),
-                                onPlay = {
-                                    onPlayFromOffset(
-                                        entry.metadata.startOffset,
-                                        entry.metadata.endOffset,
-                                        entry.durationMs
-                                    )
-                                },
+                                onPlay = { onPlay(entry) },
+                                onSelectSpeaker = { onSpeakerFilter(entry.metadata.userId) },
+                                onSeek = { fraction -> onSeekWithinRecording(entry, fraction) },
                                 onReact = { emoji ->
-                                    onReact(entry.metadata.startOffset, emoji)
+                                    onReact(entry.metadata.recordingId, emoji)
                                 }
                             )
                         }
@@ -53,6 +53,10 @@ resource "aiven_kafka_topic" "audio1" {
   topic_name   = "chok-audio-1"
   partitions   = 2
   replication  = 2
+  config {
+    # Frames carry the broker's clock so recordings time and order the same on every device
+    message_timestamp_type = "LogAppendTime"
+  }
 }
 resource "aiven_kafka_topic" "audio2" {
   service_name = data.aiven_kafka.kafka.service_name
@@ -60,6 +64,10 @@ resource "aiven_kafka_topic" "audio2" {
   topic_name   = "chok-audio-2"
   partitions   = 2
   replication  = 2
+  config {
+    # Frames carry the broker's clock so recordings time and order the same on every device
+    message_timestamp_type = "LogAppendTime"
+  }
 }
 
 resource "aiven_kafka_topic" "md1" {
@@ -136,6 +144,7 @@ locals {
       audioPartition    = 0
       metadataTopic     = aiven_kafka_topic.md1.topic_name
       metadataPartition = 0
+      rollupPartition   = 1
     },
     {
       channelNumber     = 2
@@ -144,6 +153,7 @@ locals {
       audioPartition    = 0
       metadataTopic     = aiven_kafka_topic.md2.topic_name
       metadataPartition = 0
+      rollupPartition   = 1
     }
   ]
   kafka_config = {
@@ -22,6 +22,8 @@ PROJECT_ROOT="$(dirname "$SCRIPT_DIR")"
 USERS_DIR="$SCRIPT_DIR/users"
 BUNDLES_DIR="$SCRIPT_DIR/bundles"
 USERS_JSON="$SCRIPT_DIR/users.json"
+# End-to-end audio frame keys, one per channel and shared by every user
+FRAME_KEYS_DIR="$SCRIPT_DIR/frame-keys"
 SERVER_PORT="${CHOK_SERVER_PORT:-8080}"
 
 # Android SDK/Emulator paths
@@ -86,6 +88,17 @@ ensure_dirs() {
     [[ -f "$USERS_JSON" ]] || echo '{"users":{}}' > "$USERS_JSON"
 }
 
+# Prints the base64 AES-128 frame key of an audio topic, creating it on first use
+channel_frame_key() {
+    local topic="$1"
+    local key_file="$FRAME_KEYS_DIR/$topic.key"
+    if [[ ! -f "$key_file" ]]; then
+        mkdir -p "$FRAME_KEYS_DIR"
+        (umask 077 && python3 -c 'import base64, os; print(base64.b64encode(os.urandom(16)).decode())' > "$key_file")
+    fi
+    cat "$key_file"
+}
+
 get_local_ip() {
     # Get the local IP address for QR code generation
     if command -v ip >/dev/null 2>&1; then
@@ -308,7 +321,9 @@ build_user_apk() {
             "audioTopic": "chok-audio-1",
             "audioPartition": 0,
             "metadataTopic": "chok-metadata-1",
-            "metadataPartition": 0
+            "metadataPartition": 0,
+            "rollupPartition": 1,
+            "frameKey": "$(channel_frame_key chok-audio-1)"
         },
         {
             "channelNumber": 2,
@@ -316,7 +331,9 @@ build_user_apk() {
             "audioTopic": "chok-audio-2",
             "audioPartition": 0,
             "metadataTopic": "chok-metadata-2",
-            "metadataPartition": 0
+            "metadataPartition": 0,
+            "rollupPartition": 1,
+            "frameKey": "$(channel_frame_key chok-audio-2)"
         }
     ],
     "certificates": {